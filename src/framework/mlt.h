@@ -56,6 +56,9 @@ extern "C"
 #include "mlt_repository.h"
 #include "mlt_log.h"
 #include "mlt_cache.h"
+#include "mlt_peaks.h"
+#include "mlt_audio_ring.h"
+#include "mlt_probe.h"
 #include "mlt_version.h"
 
 #ifdef __cplusplus
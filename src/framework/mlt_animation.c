@@ -28,19 +28,35 @@
 #include <stdlib.h>
 #include <string.h>
 
-/** \brief animation list node pointer */
+/** the node value has been checked for being numeric */
+#define COMPILED_NUMERIC (1)
+/** the node value has been converted to a double */
+#define COMPILED_DOUBLE (2)
+/** the node value has been converted to a rectangle */
+#define COMPILED_RECT (4)
+
+/** \brief animation node pointer */
 typedef struct animation_node_s *animation_node;
-/** \brief private animation list node */
+/** \brief private animation node */
 struct animation_node_s
 {
 	struct mlt_animation_item_s item;
-	animation_node next, prev;
+	int compiled;                   /**< a bitmask of the COMPILED_* values that are current */
+	int numeric;                    /**< whether the property holds a numeric value */
+	double value;                   /**< the property converted to a double */
+	mlt_rect rect;                  /**< the property converted to a rectangle */
 };
 
 /** \brief Property Animation class
  *
  * This is the animation engine for a Property object. It is dependent upon
  * the mlt_property API and used by the various mlt_property_anim_* functions.
+ *
+ * The nodes are kept in an array sorted by frame, so a position is found by
+ * binary search, and the node found last is remembered because playback
+ * mostly asks for the same span or the next one. The numeric value of each
+ * node is converted from its property once, on first use, so interpolating
+ * between numeric keyframes does not parse strings.
  */
 
 struct mlt_animation_s
@@ -49,7 +65,10 @@ struct mlt_animation_s
 	int length;           /**< the maximum number of frames to use when interpreting negative keyframe positions */
 	double fps;           /**< framerate to use when converting time clock strings to frame units */
 	locale_t locale;      /**< pointer to a locale to use when converting strings to numeric values */
-	animation_node nodes; /**< a linked list of keyframes (and possibly non-keyframe values) */
+	animation_node nodes; /**< an array of keyframes (and possibly non-keyframe values) sorted by frame */
+	int count;            /**< the number of nodes */
+	int size;             /**< the allocated number of nodes */
+	int cursor;           /**< the index of the node found by the last search */
 };
 
 /** Create a new animation object.
@@ -73,77 +92,55 @@ mlt_animation mlt_animation_new( )
 void mlt_animation_interpolate( mlt_animation self )
 {
 	// Parse all items to ensure non-keyframes are calculated correctly.
-	if ( self->nodes )
+	int i;
+	for ( i = 0; i < self->count; i++ )
 	{
-		animation_node current = self->nodes;
-		while ( current )
+		animation_node current = &self->nodes[i];
+		if ( !current->item.is_key )
 		{
-			if ( !current->item.is_key )
-			{
-				double progress;
-				mlt_property points[4];
-				animation_node prev = current->prev;
-				animation_node next = current->next;
+			double progress;
+			mlt_property points[4];
+			int prev = i - 1;
+			int next = i + 1;
 
-				while ( prev && !prev->item.is_key ) prev = prev->prev;
-				while ( next && !next->item.is_key ) next = next->next;
+			while ( prev >= 0 && !self->nodes[prev].item.is_key ) prev--;
+			while ( next < self->count && !self->nodes[next].item.is_key ) next++;
 
-				if ( !prev ) {
-					current->item.is_key = 1;
-					prev = current;
-				}
-				if ( !next ) {
-					next = current;
-				}
-				points[0] = prev->prev? prev->prev->item.property : prev->item.property;
-				points[1] = prev->item.property;
-				points[2] = next->item.property;
-				points[3] = next->next? next->next->item.property : next->item.property;
-				progress = current->item.frame - prev->item.frame;
-				progress /= next->item.frame - prev->item.frame;
-				mlt_property_interpolate( current->item.property, points, progress,
-					self->fps, self->locale, current->item.keyframe_type );
+			if ( prev < 0 ) {
+				current->item.is_key = 1;
+				prev = i;
 			}
-
-			// Move to the next item
-			current = current->next;
+			if ( next >= self->count ) {
+				next = i;
+			}
+			points[0] = self->nodes[prev > 0 ? prev - 1 : prev].item.property;
+			points[1] = self->nodes[prev].item.property;
+			points[2] = self->nodes[next].item.property;
+			points[3] = self->nodes[next + 1 < self->count ? next + 1 : next].item.property;
+			progress = current->item.frame - self->nodes[prev].item.frame;
+			progress /= self->nodes[next].item.frame - self->nodes[prev].item.frame;
+			mlt_property_interpolate( current->item.property, points, progress,
+				self->fps, self->locale, current->item.keyframe_type );
+			current->compiled = 0;
 		}
 	}
 }
 
-/** Remove a node from the linked list.
+/** Remove a node from the array.
  *
  * \private \memberof mlt_animation_s
  * \param self an animation
- * \param node the node to remove
+ * \param index the index of the node to remove
  * \return false
  */
 
-static int mlt_animation_drop( mlt_animation self, animation_node node )
+static int mlt_animation_drop( mlt_animation self, int index )
 {
-	if ( node == self->nodes )
-	{
-		self->nodes = node->next;
-		if ( self->nodes ) {
-			self->nodes->prev = NULL;
-			self->nodes->item.is_key = 1;
-		}
-	}
-	else if ( node->next && node->prev )
-	{
-		node->prev->next = node->next;
-		node->next->prev = node->prev;
-	}
-	else if ( node->next )
-	{
-		node->next->prev = node->prev;
-	}
-	else if ( node->prev )
-	{
-		node->prev->next = node->next;
-	}
-	mlt_property_close( node->item.property );
-	free( node );
+	mlt_property_close( self->nodes[index].item.property );
+	self->count--;
+	memmove( &self->nodes[index], &self->nodes[index + 1], ( self->count - index ) * sizeof( *self->nodes ) );
+	if ( index == 0 && self->count > 0 )
+		self->nodes[0].item.is_key = 1;
 
 	return 0;
 }
@@ -156,10 +153,157 @@ static int mlt_animation_drop( mlt_animation self, animation_node node )
 
 static void mlt_animation_clean( mlt_animation self )
 {
+	int i;
 	free( self->data );
 	self->data = NULL;
-	while ( self->nodes )
-		mlt_animation_drop( self, self->nodes );
+	for ( i = 0; i < self->count; i++ )
+		mlt_property_close( self->nodes[i].item.property );
+	self->count = 0;
+	self->cursor = 0;
+}
+
+/** Find the node that governs a position.
+ *
+ * This checks the span found by the previous search and the one after it
+ * before falling back to a binary search.
+ * \private \memberof mlt_animation_s
+ * \param self an animation
+ * \param position the frame number
+ * \return the index of the last node at or before \p position, 0 if \p position
+ * precedes all of the nodes, or -1 if there are no nodes
+ */
+
+static int mlt_animation_find( mlt_animation self, int position )
+{
+	animation_node nodes = self->nodes;
+	int count = self->count;
+	int i = self->cursor;
+	int lo, hi;
+
+	if ( count <= 0 )
+		return -1;
+	if ( i >= count )
+		i = count - 1;
+
+	if ( position >= nodes[i].item.frame )
+	{
+		if ( i + 1 == count || position < nodes[i + 1].item.frame )
+			return i;
+		if ( i + 2 == count || position < nodes[i + 2].item.frame )
+			return self->cursor = i + 1;
+	}
+	if ( position < nodes[0].item.frame )
+		return 0;
+
+	lo = 0;
+	hi = count - 1;
+	while ( lo < hi )
+	{
+		int mid = lo + ( hi - lo + 1 ) / 2;
+		if ( nodes[mid].item.frame <= position )
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return self->cursor = lo;
+}
+
+/** Convert the value of a node to the numeric forms needed for interpolation.
+ *
+ * \private \memberof mlt_animation_s
+ * \param self an animation
+ * \param node a node
+ * \param what a bitmask of the COMPILED_* values wanted
+ */
+
+static void mlt_animation_compile( mlt_animation self, animation_node node, int what )
+{
+	what &= ~node->compiled;
+	if ( what & COMPILED_NUMERIC )
+		node->numeric = mlt_property_is_numeric( node->item.property, self->locale );
+	if ( what & COMPILED_DOUBLE )
+		node->value = mlt_property_get_double( node->item.property, self->fps, self->locale );
+	if ( what & COMPILED_RECT )
+		node->rect = mlt_property_get_rect( node->item.property, self->locale );
+	node->compiled |= what;
+}
+
+static inline double linear_interpolate( double y1, double y2, double t )
+{
+	return y1 + ( y2 - y1 ) * t;
+}
+
+static inline double catmull_rom_interpolate( double y0, double y1, double y2, double y3, double t )
+{
+	double t2 = t * t;
+	double a0 = -0.5 * y0 + 1.5 * y1 - 1.5 * y2 + 0.5 * y3;
+	double a1 = y0 - 2.5 * y1 + 2 * y2 - 0.5 * y3;
+	double a2 = -0.5 * y0 + 0.5 * y2;
+	double a3 = y1;
+	return a0 * t * t2 + a1 * t2 + a2 * t + a3;
+}
+
+/** Interpolate between nodes using their compiled values.
+ *
+ * This gives the same result as mlt_property_interpolate() for linear and
+ * smooth keyframes between numeric values. Anything else is left to it.
+ * \private \memberof mlt_animation_s
+ * \param self an animation
+ * \param item the animation item to fill in
+ * \param points the nodes before, at, after, and following the span
+ * \param progress the fraction of the span to interpolate
+ * \return true if the values could not be interpolated here
+ */
+
+static int mlt_animation_interpolate_compiled( mlt_animation self, mlt_animation_item item, animation_node points[4], double progress )
+{
+	mlt_keyframe_type interp = item->keyframe_type;
+	int what;
+	int i;
+
+	if ( !item->property || ( interp != mlt_keyframe_linear && interp != mlt_keyframe_smooth ) )
+		return 1;
+	mlt_animation_compile( self, points[1], COMPILED_NUMERIC );
+	mlt_animation_compile( self, points[2], COMPILED_NUMERIC );
+	if ( !points[1]->numeric || !points[2]->numeric )
+		return 1;
+
+	what = mlt_property_is_rect( item->property ) ? COMPILED_RECT : COMPILED_DOUBLE;
+	for ( i = interp == mlt_keyframe_linear ? 1 : 0; i < ( interp == mlt_keyframe_linear ? 3 : 4 ); i++ )
+		mlt_animation_compile( self, points[i], what );
+
+	if ( what == COMPILED_RECT )
+	{
+		mlt_rect value;
+		if ( interp == mlt_keyframe_linear )
+		{
+			value.x = linear_interpolate( points[1]->rect.x, points[2]->rect.x, progress );
+			value.y = linear_interpolate( points[1]->rect.y, points[2]->rect.y, progress );
+			value.w = linear_interpolate( points[1]->rect.w, points[2]->rect.w, progress );
+			value.h = linear_interpolate( points[1]->rect.h, points[2]->rect.h, progress );
+			value.o = linear_interpolate( points[1]->rect.o, points[2]->rect.o, progress );
+		}
+		else
+		{
+			value.x = catmull_rom_interpolate( points[0]->rect.x, points[1]->rect.x, points[2]->rect.x, points[3]->rect.x, progress );
+			value.y = catmull_rom_interpolate( points[0]->rect.y, points[1]->rect.y, points[2]->rect.y, points[3]->rect.y, progress );
+			value.w = catmull_rom_interpolate( points[0]->rect.w, points[1]->rect.w, points[2]->rect.w, points[3]->rect.w, progress );
+			value.h = catmull_rom_interpolate( points[0]->rect.h, points[1]->rect.h, points[2]->rect.h, points[3]->rect.h, progress );
+			value.o = catmull_rom_interpolate( points[0]->rect.o, points[1]->rect.o, points[2]->rect.o, points[3]->rect.o, progress );
+		}
+		mlt_property_set_rect( item->property, value );
+	}
+	else if ( interp == mlt_keyframe_linear )
+	{
+		mlt_property_set_double( item->property,
+			linear_interpolate( points[1]->value, points[2]->value, progress ) );
+	}
+	else
+	{
+		mlt_property_set_double( item->property, catmull_rom_interpolate( points[0]->value,
+			points[1]->value, points[2]->value, points[3]->value, progress ) );
+	}
+	return 0;
 }
 
 /** Parse a string representing an animation.
@@ -257,13 +401,8 @@ int mlt_animation_get_length( mlt_animation self )
 		if ( self->length > 0 ) {
 			length = self->length;
 		}
-		else if ( self->nodes ) {
-			animation_node node = self->nodes;
-			while ( node ) {
-				if ( node->item.frame > length )
-					length = node->item.frame;
-				node = node->next;
-			}
+		else if ( self->count > 0 && self->nodes[self->count - 1].item.frame > 0 ) {
+			length = self->nodes[self->count - 1].item.frame;
 		}
 	}
 	return length;
@@ -362,14 +501,12 @@ int mlt_animation_get_item( mlt_animation self, mlt_animation_item item, int pos
 {
 	int error = 0;
 	// Need to find the nearest keyframe to the position specifed
-	animation_node node = self->nodes;
+	int i = mlt_animation_find( self, position );
 
-	// Iterate through the keyframes until we reach last or have
-	while ( node && node->next && position >= node->next->item.frame )
-		node = node->next;
-
-	if ( node )
+	if ( i >= 0 )
 	{
+		animation_node node = &self->nodes[i];
+
 		item->keyframe_type = node->item.keyframe_type;
 
 		// Position is before the first keyframe.
@@ -387,7 +524,7 @@ int mlt_animation_get_item( mlt_animation self, mlt_animation_item item, int pos
 				mlt_property_pass( item->property, node->item.property );
 		}
 		// Position is after the last keyframe.
-		else if ( !node->next )
+		else if ( i + 1 == self->count )
 		{
 			item->is_key = 0;
 			if ( item->property )
@@ -397,15 +534,23 @@ int mlt_animation_get_item( mlt_animation self, mlt_animation_item item, int pos
 		else
 		{
 			double progress;
-			mlt_property points[4];
-			points[0] = node->prev? node->prev->item.property : node->item.property;
-			points[1] = node->item.property;
-			points[2] = node->next->item.property;
-			points[3] = node->next->next? node->next->next->item.property : node->next->item.property;
+			animation_node points[4];
+			points[0] = i > 0 ? node - 1 : node;
+			points[1] = node;
+			points[2] = node + 1;
+			points[3] = i + 2 < self->count ? node + 2 : node + 1;
 			progress = position - node->item.frame;
-			progress /= node->next->item.frame - node->item.frame;
-			mlt_property_interpolate( item->property, points, progress,
-				self->fps, self->locale, item->keyframe_type );
+			progress /= points[2]->item.frame - node->item.frame;
+			if ( mlt_animation_interpolate_compiled( self, item, points, progress ) )
+			{
+				mlt_property properties[4];
+				properties[0] = points[0]->item.property;
+				properties[1] = points[1]->item.property;
+				properties[2] = points[2]->item.property;
+				properties[3] = points[3]->item.property;
+				mlt_property_interpolate( item->property, properties, progress,
+					self->fps, self->locale, item->keyframe_type );
+			}
 			item->is_key = 0;
 		}
 	}
@@ -431,57 +576,41 @@ int mlt_animation_get_item( mlt_animation self, mlt_animation_item item, int pos
 int mlt_animation_insert( mlt_animation self, mlt_animation_item item )
 {
 	int error = 0;
-	animation_node node = calloc( 1, sizeof( *node ) );
-	node->item.frame = item->frame;
-	node->item.is_key = 1;
-	node->item.keyframe_type = item->keyframe_type;
-	node->item.property = mlt_property_init();
-	mlt_property_pass( node->item.property, item->property );
+	int i = mlt_animation_find( self, item->frame );
+	animation_node node;
 
-	// Determine if we need to insert or append to the list, or if it's a new list
-	if ( self->nodes )
+	if ( i >= 0 && item->frame == self->nodes[i].item.frame )
 	{
-		// Get the first item
-		animation_node current = self->nodes;
-
-		// Locate an existing nearby item
-		while ( current->next && item->frame > current->item.frame )
-			current = current->next;
-
-		if ( item->frame < current->item.frame )
-		{
-			if ( current == self->nodes )
-				self->nodes = node;
-			if ( current->prev )
-				current->prev->next = node;
-			node->next = current;
-			node->prev = current->prev;
-			current->prev = node;
-		}
-		else if ( item->frame > current->item.frame )
-		{
-			if ( current->next )
-				current->next->prev = node;
-			node->next = current->next;
-			node->prev = current;
-			current->next = node;
-		}
-		else
-		{
-			// Update matching node.
-			current->item.frame = item->frame;
-			current->item.is_key = 1;
-			current->item.keyframe_type = item->keyframe_type;
-			mlt_property_close( current->item.property );
-			current->item.property = node->item.property;
-			free( node );
-		}
+		// Update matching node.
+		node = &self->nodes[i];
+		mlt_property_close( node->item.property );
 	}
 	else
 	{
-		// Set the first item
-		self->nodes = node;
+		// Make room for a new node after the one found, or at the front.
+		if ( i < 0 || item->frame < self->nodes[i].item.frame )
+			i = 0;
+		else
+			i++;
+		if ( self->count == self->size )
+		{
+			int size = self->size ? self->size * 2 : 8;
+			animation_node nodes = realloc( self->nodes, size * sizeof( *nodes ) );
+			if ( !nodes )
+				return 1;
+			self->nodes = nodes;
+			self->size = size;
+		}
+		node = &self->nodes[i];
+		memmove( node + 1, node, ( self->count - i ) * sizeof( *node ) );
+		self->count++;
 	}
+	node->item.frame = item->frame;
+	node->item.is_key = 1;
+	node->item.keyframe_type = item->keyframe_type;
+	node->item.property = mlt_property_init();
+	mlt_property_pass( node->item.property, item->property );
+	node->compiled = 0;
 
 	return error;
 }
@@ -497,13 +626,10 @@ int mlt_animation_insert( mlt_animation self, mlt_animation_item item )
 int mlt_animation_remove( mlt_animation self, int position )
 {
 	int error = 1;
-	animation_node node = self->nodes;
+	int i = mlt_animation_find( self, position );
 
-	while ( node && position != node->item.frame )
-		node = node->next;
-
-	if ( node && position == node->item.frame )
-		error = mlt_animation_drop( self, node );
+	if ( i >= 0 && position == self->nodes[i].item.frame )
+		error = mlt_animation_drop( self, i );
 
 	return error;
 }
@@ -519,10 +645,13 @@ int mlt_animation_remove( mlt_animation self, int position )
 
 int mlt_animation_next_key( mlt_animation self, mlt_animation_item item, int position )
 {
-	animation_node node = self->nodes;
+	int i = mlt_animation_find( self, position );
+	animation_node node = NULL;
 
-	while ( node && position > node->item.frame )
-		node = node->next;
+	if ( i >= 0 && position > self->nodes[i].item.frame )
+		i++;
+	if ( i >= 0 && i < self->count )
+		node = &self->nodes[i];
 
 	if ( node )
 	{
@@ -547,10 +676,8 @@ int mlt_animation_next_key( mlt_animation self, mlt_animation_item item, int pos
 
 int mlt_animation_prev_key( mlt_animation self, mlt_animation_item item, int position )
 {
-	animation_node node = self->nodes;
-
-	while ( node && node->next && position >= node->next->item.frame )
-		node = node->next;
+	int i = mlt_animation_find( self, position );
+	animation_node node = i >= 0 ? &self->nodes[i] : NULL;
 
 	if ( node )
 	{
@@ -605,7 +732,7 @@ char *mlt_animation_serialize_cut( mlt_animation self, int in, int out )
 
 				// If the first keyframe is larger than the current position
 				// then do nothing here
-				if ( self->nodes->item.frame > item.frame )
+				if ( self->nodes[0].item.frame > item.frame )
 				{
 					item.frame ++;
 					continue;
@@ -708,14 +835,7 @@ char *mlt_animation_serialize( mlt_animation self )
 
 int mlt_animation_key_count( mlt_animation self )
 {
-	int count = -1;
-	if ( self )
-	{
-		animation_node node = self->nodes;
-		for ( count = 0; node; ++count )
-			node = node->next;
-	}
-	return count;
+	return self ? self->count : -1;
 }
 
 /** Get an animation item for the N-th keyframe.
@@ -730,12 +850,7 @@ int mlt_animation_key_count( mlt_animation self )
 int mlt_animation_key_get( mlt_animation self, mlt_animation_item item, int index )
 {
 	int error = 0;
-	animation_node node = self->nodes;
-
-	// Iterate through the keyframes.
-	int i = index;
-	while ( i-- && node )
-		node = node->next;
+	animation_node node = index >= 0 && index < self->count ? &self->nodes[index] : NULL;
 
 	if ( node )
 	{
@@ -765,6 +880,7 @@ void mlt_animation_close( mlt_animation self )
 	if ( self )
 	{
 		mlt_animation_clean( self );
+		free( self->nodes );
 		free( self );
 	}
 }
@@ -0,0 +1,298 @@
+/**
+ * \file mlt_audio_ring.c
+ * \brief lock-free audio ring buffer for realtime consumers
+ * \see mlt_audio_ring_s
+ *
+ * Copyright (C) 2015 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "mlt_audio_ring.h"
+#include "mlt_frame.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** the smallest capacity of a ring in sample frames */
+#define MIN_RING_SIZE (4096)
+
+/** \brief Audio Ring class
+ *
+ * An audio ring carries interleaved audio from one writer thread, normally
+ * the consumer's render thread, to one reader thread, normally the audio
+ * device callback. Neither side takes a lock: each one owns a running count
+ * of the sample frames it has transferred, and the fill level is the
+ * difference between them. The capacity is a power of two, so the counts
+ * map to the same position in the ring when they wrap around. The reader
+ * never waits; when the ring runs dry it pads with silence and counts an
+ * underrun. The writer waits, by sleeping, while the fill level is at or
+ * above the latency target.
+ */
+
+struct mlt_audio_ring_s
+{
+	uint8_t *buffer;                   /**< the ring storage */
+	unsigned int size;                 /**< the capacity in sample frames, a power of two */
+	int frame_size;                    /**< the bytes per sample frame */
+	int frequency;                     /**< the sample rate */
+	unsigned int latency;              /**< the target fill level in sample frames */
+	unsigned int written;              /**< the sample frames written, owned by the writer */
+	unsigned int read;                 /**< the sample frames read, owned by the reader */
+	unsigned int started;              /**< set once the writer has written, owned by the writer */
+	int underruns;                     /**< the number of short reads, owned by the reader */
+};
+
+/** Load a count with acquire semantics.
+ *
+ * \private \memberof mlt_audio_ring_s
+ */
+
+static inline unsigned int ring_load( unsigned int *count )
+{
+	return __sync_fetch_and_add( count, 0 );
+}
+
+/** Advance a count with release semantics.
+ *
+ * \private \memberof mlt_audio_ring_s
+ */
+
+static inline void ring_advance( unsigned int *count, unsigned int samples )
+{
+	__sync_fetch_and_add( count, samples );
+}
+
+/** Get the number of sample frames waiting to be read.
+ *
+ * \private \memberof mlt_audio_ring_s
+ */
+
+static inline unsigned int ring_fill( mlt_audio_ring self )
+{
+	return ring_load( &self->written ) - ring_load( &self->read );
+}
+
+/** Create an audio ring.
+ *
+ * \public \memberof mlt_audio_ring_s
+ * \param format an interleaved audio format
+ * \param frequency the sample rate
+ * \param channels the number of channels
+ * \param latency the target fill level in milliseconds
+ * \return a new audio ring or NULL on error
+ */
+
+mlt_audio_ring mlt_audio_ring_init( mlt_audio_format format, int frequency, int channels, int latency )
+{
+	mlt_audio_ring self = NULL;
+	int frame_size = mlt_audio_format_size( format, 1, channels );
+
+	if ( format == mlt_audio_float || frame_size <= 0 || frequency <= 0 )
+		return NULL;
+
+	self = calloc( 1, sizeof( struct mlt_audio_ring_s ) );
+	if ( self )
+	{
+		self->frame_size = frame_size;
+		self->frequency = frequency;
+		self->latency = (int64_t) frequency * ( latency > 0 ? latency : 1 ) / 1000;
+		if ( self->latency < 1 )
+			self->latency = 1;
+		self->size = MIN_RING_SIZE;
+		while ( self->size < self->latency * 2 )
+			self->size *= 2;
+		self->buffer = calloc( self->size, frame_size );
+		if ( !self->buffer )
+		{
+			free( self );
+			self = NULL;
+		}
+	}
+	return self;
+}
+
+/** Write audio to the ring.
+ *
+ * This waits up to \p timeout milliseconds for the fill level to drop
+ * below the latency target, and then writes as many sample frames as fit.
+ * Call it only from the writer thread.
+ *
+ * \public \memberof mlt_audio_ring_s
+ * \param self an audio ring
+ * \param data the interleaved audio to write, or NULL to write silence
+ * \param samples the number of sample frames to write
+ * \param timeout the longest time to wait in milliseconds
+ * \return the number of sample frames written, which may be less than requested
+ */
+
+int mlt_audio_ring_write( mlt_audio_ring self, const void *data, int samples, int timeout )
+{
+	unsigned int fill = ring_fill( self );
+
+	if ( fill >= self->latency && timeout > 0 )
+	{
+		// Poll at a fraction of the latency so the reader never has to signal
+		int64_t step = (int64_t) self->latency * 250000 / self->frequency;
+		int64_t remaining = (int64_t) timeout * 1000000;
+		struct timespec tm;
+
+		if ( step < 500000 )
+			step = 500000;
+		while ( fill >= self->latency && remaining > 0 )
+		{
+			tm.tv_sec = 0;
+			tm.tv_nsec = step < remaining ? step : remaining;
+			nanosleep( &tm, NULL );
+			remaining -= tm.tv_nsec;
+			fill = ring_fill( self );
+		}
+	}
+	if ( fill >= self->latency )
+		return 0;
+
+	unsigned int count = self->size - fill < (unsigned int) samples ? self->size - fill : (unsigned int) samples;
+	unsigned int offset = self->written & ( self->size - 1 );
+	unsigned int first = offset + count > self->size ? self->size - offset : count;
+	const uint8_t *src = data;
+
+	if ( src )
+	{
+		memcpy( self->buffer + offset * self->frame_size, src, first * self->frame_size );
+		memcpy( self->buffer, src + first * self->frame_size, ( count - first ) * self->frame_size );
+	}
+	else
+	{
+		memset( self->buffer + offset * self->frame_size, 0, first * self->frame_size );
+		memset( self->buffer, 0, ( count - first ) * self->frame_size );
+	}
+
+	// Publish the samples only after they are in place
+	ring_advance( &self->written, count );
+	if ( count > 0 && !self->started )
+		ring_advance( &self->started, 1 );
+
+	return count;
+}
+
+/** Read audio from the ring.
+ *
+ * This never waits. If fewer sample frames are available than requested,
+ * the remainder of \p data is filled with silence and an underrun is
+ * counted. Call it only from the reader thread.
+ *
+ * \public \memberof mlt_audio_ring_s
+ * \param self an audio ring
+ * \param data the buffer for the interleaved audio
+ * \param samples the number of sample frames to read
+ * \return the number of sample frames read from the ring
+ */
+
+int mlt_audio_ring_read( mlt_audio_ring self, void *data, int samples )
+{
+	// Acquire the writer's samples before copying them
+	unsigned int fill = ring_fill( self );
+	unsigned int count = fill < (unsigned int) samples ? fill : (unsigned int) samples;
+	unsigned int offset = self->read & ( self->size - 1 );
+	unsigned int first = offset + count > self->size ? self->size - offset : count;
+	uint8_t *dest = data;
+
+	memcpy( dest, self->buffer + offset * self->frame_size, first * self->frame_size );
+	memcpy( dest + first * self->frame_size, self->buffer, ( count - first ) * self->frame_size );
+	if ( count < (unsigned int) samples )
+	{
+		memset( dest + count * self->frame_size, 0, ( samples - count ) * self->frame_size );
+		if ( ring_load( &self->started ) )
+			__sync_fetch_and_add( &self->underruns, 1 );
+	}
+
+	// Release the space only after the samples are copied out
+	ring_advance( &self->read, count );
+
+	return count;
+}
+
+/** Start the running counts of a new ring at a given value.
+ *
+ * This is only meant for tests, to reach the wrap of the counts without
+ * passing 2^32 sample frames through the ring. Call it before the first
+ * write or read.
+ *
+ * \public \memberof mlt_audio_ring_s
+ * \param self an audio ring
+ * \param count the count of sample frames written and read
+ */
+
+void mlt_audio_ring_set_count( mlt_audio_ring self, unsigned int count )
+{
+	self->written = count;
+	self->read = count;
+}
+
+/** Get the number of sample frames waiting to be read.
+ *
+ * \public \memberof mlt_audio_ring_s
+ * \param self an audio ring
+ * \return the fill level in sample frames
+ */
+
+int mlt_audio_ring_fill( mlt_audio_ring self )
+{
+	return ring_fill( self );
+}
+
+/** Get the fill level as a duration.
+ *
+ * \public \memberof mlt_audio_ring_s
+ * \param self an audio ring
+ * \return the queued audio in milliseconds
+ */
+
+int mlt_audio_ring_latency( mlt_audio_ring self )
+{
+	return (int64_t) mlt_audio_ring_fill( self ) * 1000 / self->frequency;
+}
+
+/** Get the number of reads that ran out of audio.
+ *
+ * Reads before the first write are not counted.
+ *
+ * \public \memberof mlt_audio_ring_s
+ * \param self an audio ring
+ * \return the number of underruns
+ */
+
+int mlt_audio_ring_underruns( mlt_audio_ring self )
+{
+	return __sync_fetch_and_add( &self->underruns, 0 );
+}
+
+/** Close an audio ring.
+ *
+ * The reader and writer must both have stopped using it.
+ *
+ * \public \memberof mlt_audio_ring_s
+ * \param self an audio ring
+ */
+
+void mlt_audio_ring_close( mlt_audio_ring self )
+{
+	if ( self )
+	{
+		free( self->buffer );
+		free( self );
+	}
+}
@@ -0,0 +1,37 @@
+/**
+ * \file mlt_audio_ring.h
+ * \brief lock-free audio ring buffer for realtime consumers
+ * \see mlt_audio_ring_s
+ *
+ * Copyright (C) 2015 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MLT_AUDIO_RING_H
+#define MLT_AUDIO_RING_H
+
+#include "mlt_types.h"
+
+extern mlt_audio_ring mlt_audio_ring_init( mlt_audio_format format, int frequency, int channels, int latency );
+extern int mlt_audio_ring_write( mlt_audio_ring self, const void *data, int samples, int timeout );
+extern int mlt_audio_ring_read( mlt_audio_ring self, void *data, int samples );
+extern int mlt_audio_ring_fill( mlt_audio_ring self );
+extern int mlt_audio_ring_latency( mlt_audio_ring self );
+extern int mlt_audio_ring_underruns( mlt_audio_ring self );
+extern void mlt_audio_ring_set_count( mlt_audio_ring self, unsigned int count );
+extern void mlt_audio_ring_close( mlt_audio_ring self );
+
+#endif
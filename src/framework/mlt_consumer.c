@@ -75,6 +75,12 @@ typedef struct
 	int process_head;
 	int started;
 	pthread_t *threads; /**< used to deallocate all threads */
+
+	/* additional fields added for the audio-only path */
+	int audio_only;
+	mlt_frame audio_pending; /**< a frame that did not fit the previous block */
+
+	mlt_event_handle frame_render; /**< the consumer-frame-render event, fired for every frame */
 }
 consumer_private;
 
@@ -155,6 +161,7 @@ int mlt_consumer_init( mlt_consumer self, void *child, mlt_profile profile )
 		mlt_events_register( properties, "consumer-thread-create", ( mlt_transmitter )transmit_thread_create );
 		mlt_events_register( properties, "consumer-thread-join", ( mlt_transmitter )transmit_thread_join );
 		mlt_events_listen( properties, self, "consumer-frame-show", ( mlt_listener )on_consumer_frame_show );
+		priv->frame_render = mlt_events_handle( properties, "consumer-frame-render" );
 
 		// Register a property-changed listener to handle the profile property -
 		// subsequent properties can override the profile
@@ -587,9 +594,14 @@ int mlt_consumer_start( mlt_consumer self )
 	if ( abs( priv->real_time ) > 1 && mlt_properties_get_int( properties, "buffer" ) <= abs( priv->real_time ) )
 		mlt_properties_set_int( properties, "_buffer", abs( priv->real_time ) + 1 );
 
+	// Rendering audio alone needs none of the image read-ahead or workers
+	priv->audio_only = priv->real_time <= 0 &&
+		mlt_properties_get_int( properties, "video_off" ) &&
+		!mlt_properties_get_int( properties, "audio_off" );
+
 	priv->preroll = 1;
 #ifdef WIN32
-	if ( priv->real_time == 1 || priv->real_time == -1 )
+	if ( ( priv->real_time == 1 || priv->real_time == -1 ) && !priv->audio_only )
 		consumer_read_ahead_start( self );
 #endif
 
@@ -820,7 +832,7 @@ static void *consumer_read_ahead_thread( void *arg )
 		// Get the image of the first frame
 		if ( !video_off )
 		{
-			mlt_events_fire( MLT_CONSUMER_PROPERTIES( self ), "consumer-frame-render", frame, NULL );
+			mlt_event_handle_fire( priv->frame_render, frame, NULL );
 			mlt_frame_get_image( frame, &image, &priv->image_format, &width, &height, 0 );
 		}
 
@@ -892,7 +904,7 @@ static void *consumer_read_ahead_thread( void *arg )
 				height = mlt_properties_get_int( properties, "height" );
 
 				// Get the image
-				mlt_events_fire( MLT_CONSUMER_PROPERTIES( self ), "consumer-frame-render", frame, NULL );
+				mlt_event_handle_fire( priv->frame_render, frame, NULL );
 				mlt_frame_get_image( frame, &image, &priv->image_format, &width, &height, 0 );
 			}
 
@@ -1083,7 +1095,7 @@ static void *consumer_worker_thread( void *arg )
 			// Fetch width/height again
 			width = mlt_properties_get_int( properties, "width" );
 			height = mlt_properties_get_int( properties, "height" );
-			mlt_events_fire( MLT_CONSUMER_PROPERTIES( self ), "consumer-frame-render", frame, NULL );
+			mlt_event_handle_fire( priv->frame_render, frame, NULL );
 			mlt_frame_get_image( frame, &image, &format, &width, &height, 0 );
 		}
 		mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "rendered", 1 );
@@ -1337,6 +1349,9 @@ void mlt_consumer_purge( mlt_consumer self )
 		pthread_cond_broadcast( &priv->put_cond );
 		pthread_mutex_unlock( &priv->put_mutex );
 
+		mlt_frame_close( priv->audio_pending );
+		priv->audio_pending = NULL;
+
 		if ( self->purge )
 			self->purge( self );
 
@@ -1521,6 +1536,124 @@ static mlt_frame worker_get_frame( mlt_consumer self, mlt_properties properties
 	return frame;
 }
 
+/** Get the next frame and its audio in the audio-only path.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param self a consumer
+ * \return a frame with its audio fetched, or NULL
+ */
+
+static mlt_frame audio_get_next_frame( mlt_consumer self )
+{
+	consumer_private *priv = self->local;
+	mlt_frame frame = priv->audio_pending;
+
+	if ( frame )
+	{
+		priv->audio_pending = NULL;
+	}
+	else if ( ( frame = mlt_consumer_get_frame( self ) ) )
+	{
+		void *audio = NULL;
+		int samples = mlt_sample_calculator( priv->fps, priv->frequency, priv->aud_counter++ );
+
+		// Let producers know that nobody will ask for an image
+		mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "consumer_video_off", 1 );
+		mlt_frame_get_audio( frame, &audio, &priv->audio_format, &priv->frequency, &priv->channels, &samples );
+	}
+	return frame;
+}
+
+/** Pull a block of audio without any of the image machinery.
+ *
+ * Frames are fetched synchronously, and when the audio_block property is set,
+ * the audio of the following frames up to that duration is appended to the
+ * returned frame so that the consumer handles a large block per pull. Only
+ * frames that play at the same, nonzero speed are put in one block.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param self a consumer
+ * \param properties the consumer's properties
+ * \return a frame
+ */
+
+static mlt_frame audio_get_frame( mlt_consumer self, mlt_properties properties )
+{
+	consumer_private *priv = self->local;
+	mlt_frame frame = NULL;
+	int block = mlt_properties_get_double( properties, "audio_block" ) * priv->fps + 0.5;
+
+	if ( !priv->ahead )
+	{
+		priv->ahead = 1;
+		set_audio_format( self );
+		mlt_events_fire( properties, "consumer-thread-started", NULL );
+	}
+
+	frame = audio_get_next_frame( self );
+	if ( frame && block > 1 )
+	{
+		mlt_properties frame_properties = MLT_FRAME_PROPERTIES( frame );
+		mlt_audio_format format = mlt_properties_get_int( frame_properties, "audio_format" );
+		int frequency = mlt_properties_get_int( frame_properties, "audio_frequency" );
+		int channels = mlt_properties_get_int( frame_properties, "audio_channels" );
+		int samples = mlt_properties_get_int( frame_properties, "audio_samples" );
+		double speed = mlt_properties_get_double( frame_properties, "_speed" );
+		uint8_t *audio = mlt_properties_get_data( frame_properties, "audio", NULL );
+		int size = mlt_audio_format_size( format, samples, channels );
+		int max_size = mlt_audio_format_size( format, mlt_sample_calculator( priv->fps, frequency, 0 ) * ( block + 1 ), channels );
+		uint8_t *buffer = NULL;
+		int count = 1;
+
+		// Planar formats cannot simply be appended
+		if ( audio && format != mlt_audio_none && format != mlt_audio_float && format != mlt_audio_s32 )
+			buffer = mlt_pool_alloc( max_size );
+
+		if ( buffer )
+		{
+			memcpy( buffer, audio, size );
+			while ( priv->ahead && count < block )
+			{
+				mlt_frame next = audio_get_next_frame( self );
+				if ( !next )
+					break;
+				mlt_properties next_properties = MLT_FRAME_PROPERTIES( next );
+				int next_samples = mlt_properties_get_int( next_properties, "audio_samples" );
+				int next_size = mlt_audio_format_size( format, next_samples, channels );
+				uint8_t *next_audio = mlt_properties_get_data( next_properties, "audio", NULL );
+				double next_speed = mlt_properties_get_double( next_properties, "_speed" );
+
+				// A change of layout or speed, or a pause such as at the end of the
+				// input, ends the block; keep the frame for the next pull
+				if ( !next_audio || size + next_size > max_size || next_speed != speed || next_speed == 0 ||
+					 mlt_properties_get_int( next_properties, "audio_format" ) != format ||
+					 mlt_properties_get_int( next_properties, "audio_frequency" ) != frequency ||
+					 mlt_properties_get_int( next_properties, "audio_channels" ) != channels )
+				{
+					priv->audio_pending = next;
+					break;
+				}
+				memcpy( buffer + size, next_audio, next_size );
+				size += next_size;
+				samples += next_samples;
+				count++;
+				mlt_frame_close( next );
+			}
+			mlt_frame_set_audio( frame, buffer, format, size, mlt_pool_release );
+			mlt_properties_set_int( frame_properties, "audio_samples", samples );
+			mlt_properties_set_int( frame_properties, "audio_block", count );
+		}
+	}
+
+	if ( frame )
+	{
+		mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "rendered", 1 );
+		mlt_properties_set_data( MLT_FRAME_PROPERTIES( frame ), "consumer", self, 0, NULL, NULL );
+	}
+
+	return frame;
+}
+
 /** Get the next frame from the producer connected to a consumer.
  *
  * Typically, one uses this instead of \p mlt_consumer_get_frame to make
@@ -1542,7 +1675,11 @@ mlt_frame mlt_consumer_rt_frame( mlt_consumer self )
 	consumer_private *priv = self->local;
 
 	// Check if the user has requested real time or not
-	if ( priv->real_time > 1 || priv->real_time < -1 )
+	if ( priv->audio_only )
+	{
+		return audio_get_frame( self, properties );
+	}
+	else if ( priv->real_time > 1 || priv->real_time < -1 )
 	{
 		// see above
 		return worker_get_frame( self, properties );
@@ -1649,6 +1786,15 @@ int mlt_consumer_stop( mlt_consumer self )
 		consumer_read_ahead_stop( self );
 	else if ( abs( priv->real_time ) > 1 )
 		consumer_work_stop( self );
+	mlt_frame_close( priv->audio_pending );
+	priv->audio_pending = NULL;
+
+	// The audio only path has no read ahead thread to say that it stopped
+	if ( priv->audio_only && priv->ahead )
+	{
+		priv->ahead = 0;
+		mlt_events_fire( properties, "consumer-thread-stopped", NULL );
+	}
 
 	// Kill the test card
 	mlt_properties_set_data( properties, "test_card_producer", NULL, 0, NULL, NULL );
@@ -78,7 +78,10 @@
  * \properties \em mlt_image_format the image format to request in rendering threads, defaults to yuv422
  * \properties \em mlt_audio_format the audio format to request in rendering threads, defaults to S16
  * \properties \em audio_off set non-zero to disable audio processing
- * \properties \em video_off set non-zero to disable video processing
+ * \properties \em video_off set non-zero to disable video processing; when real_time is not positive,
+ *   frames are then pulled synchronously for their audio alone and flagged with \em consumer_video_off
+ * \properties \em audio_block with video_off, the duration in seconds of the audio to gather into each
+ *   frame returned by mlt_consumer_rt_frame(), which then sets \em audio_block on it to the number of frames merged
  */
 
 struct mlt_consumer_s
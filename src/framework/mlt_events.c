@@ -53,6 +53,21 @@ struct mlt_events_struct
 
 typedef struct mlt_events_struct *mlt_events;
 
+/** \brief Event handle class
+ *
+ * A handle is a registered event: its transmitter and its listeners. It is held
+ * in the events list under the name of the event and lives as long as the
+ * properties on which the event was registered. It counts its connected listeners
+ * so that firing an event that nobody listens to costs next to nothing.
+ */
+
+struct mlt_event_handle_struct
+{
+	mlt_transmitter transmitter;
+	mlt_properties listeners;
+	int count; /**< the number of connected listeners */
+};
+
 /** \brief Event class
  *
  */
@@ -64,8 +79,24 @@ struct mlt_event_struct
 	int block_count;
 	mlt_listener listener;
 	void *service;
+	mlt_event_handle handle;
 };
 
+/** Disconnect an event from its handle.
+ *
+ * \private \memberof mlt_event_struct
+ * \param self an event
+ */
+
+static void mlt_event_detach( mlt_event self )
+{
+	if ( self->owner != NULL )
+	{
+		self->owner = NULL;
+		self->handle->count --;
+	}
+}
+
 /** Increment the reference count on self event.
  *
  * \public \memberof mlt_event_struct
@@ -112,8 +143,8 @@ void mlt_event_close( mlt_event self )
 {
 	if ( self != NULL )
 	{
-		if ( -- self->ref_count == 1 )
-			self->owner = NULL;
+		if ( -- self->ref_count <= 1 )
+			mlt_event_detach( self );
 		if ( self->ref_count <= 0 )
 		{
 #ifdef _MLT_EVENT_CHECKS_
@@ -130,6 +161,7 @@ void mlt_event_close( mlt_event self )
 static mlt_events mlt_events_fetch( mlt_properties );
 static void mlt_events_store( mlt_properties, mlt_events );
 static void mlt_events_close( mlt_events );
+static void mlt_event_handle_close( mlt_event_handle );
 
 /** Initialise the events structure.
  *
@@ -163,16 +195,99 @@ int mlt_events_register( mlt_properties self, const char *id, mlt_transmitter tr
 	mlt_events events = mlt_events_fetch( self );
 	if ( events != NULL )
 	{
-		mlt_properties list = events->list;
-		char temp[ 128 ];
-		error = mlt_properties_set_data( list, id, transmitter, 0, NULL, NULL );
-		sprintf( temp, "list:%s", id );
-		if ( mlt_properties_get_data( list, temp, NULL ) == NULL )
-			mlt_properties_set_data( list, temp, mlt_properties_new( ), 0, ( mlt_destructor )mlt_properties_close, NULL );
+		mlt_event_handle handle = mlt_properties_get_data( events->list, id, NULL );
+		if ( handle == NULL )
+		{
+			handle = calloc( 1, sizeof( struct mlt_event_handle_struct ) );
+			handle->listeners = mlt_properties_new( );
+			error = mlt_properties_set_data( events->list, id, handle, 0, ( mlt_destructor )mlt_event_handle_close, NULL );
+		}
+		else
+		{
+			error = 0;
+		}
+		handle->transmitter = transmitter;
 	}
 	return error;
 }
 
+/** Get the handle of a registered event.
+ *
+ * Resolve the handle once and use it to fire the event or to check for listeners
+ * without looking the event up by name each time.
+ * The handle remains valid for as long as the properties list.
+ *
+ * \public \memberof mlt_events_struct
+ * \param self a properties list
+ * \param id the name of an event
+ * \return the event handle or NULL if the event is not registered
+ */
+
+mlt_event_handle mlt_events_handle( mlt_properties self, const char *id )
+{
+	mlt_events events = mlt_events_fetch( self );
+	return events != NULL ? mlt_properties_get_data( events->list, id, NULL ) : NULL;
+}
+
+/** Determine if anyone listens to an event.
+ *
+ * \public \memberof mlt_events_struct
+ * \param self a properties list
+ * \param id the name of an event
+ * \return the number of connected listeners
+ */
+
+int mlt_events_listening( mlt_properties self, const char *id )
+{
+	return mlt_event_handle_listening( mlt_events_handle( self, id ) );
+}
+
+/** Determine if anyone listens to the event of a handle.
+ *
+ * \public \memberof mlt_event_handle_struct
+ * \param self an event handle
+ * \return the number of connected listeners
+ */
+
+int mlt_event_handle_listening( mlt_event_handle self )
+{
+	return self != NULL ? self->count : 0;
+}
+
+/** Send an event to its listeners.
+ *
+ * \private \memberof mlt_event_handle_struct
+ * \param self an event handle
+ * \param alist the NULL terminated arguments for the listeners
+ * \return the number of listeners
+ */
+
+static int mlt_event_handle_transmit( mlt_event_handle self, va_list alist )
+{
+	int result = 0;
+	int i = 0;
+	void *args[ 10 ];
+	mlt_properties listeners = self->listeners;
+
+	do
+		args[ i ] = va_arg( alist, void * );
+	while( args[ i ++ ] != NULL );
+
+	for ( i = 0; i < mlt_properties_count( listeners ); i ++ )
+	{
+		mlt_event event = mlt_properties_get_data_at( listeners, i, NULL );
+		if ( event != NULL && event->owner != NULL && event->block_count == 0 )
+		{
+			if ( self->transmitter != NULL )
+				self->transmitter( event->listener, event->owner, event->service, args );
+			else
+				event->listener( event->owner, event->service );
+			++result;
+		}
+	}
+	return result;
+}
+
 /** Fire an event.
  *
  * This takes a variable number of arguments to supply to the listener.
@@ -186,40 +301,35 @@ int mlt_events_register( mlt_properties self, const char *id, mlt_transmitter tr
 int mlt_events_fire( mlt_properties self, const char *id, ... )
 {
 	int result = 0;
-	mlt_events events = mlt_events_fetch( self );
-	if ( events != NULL )
+	mlt_event_handle handle = mlt_events_handle( self, id );
+	if ( handle != NULL && handle->count > 0 )
 	{
-		int i = 0;
 		va_list alist;
-		void *args[ 10 ];
-		mlt_properties list = events->list;
-		mlt_properties listeners = NULL;
-		char temp[ 128 ];
-		mlt_transmitter transmitter = mlt_properties_get_data( list, id, NULL );
-		sprintf( temp, "list:%s", id );
-		listeners = mlt_properties_get_data( list, temp, NULL );
-
 		va_start( alist, id );
-		do
-			args[ i ] = va_arg( alist, void * );
-		while( args[ i ++ ] != NULL );
+		result = mlt_event_handle_transmit( handle, alist );
 		va_end( alist );
+	}
+	return result;
+}
 
-		if ( listeners != NULL )
-		{
-			for ( i = 0; i < mlt_properties_count( listeners ); i ++ )
-			{
-				mlt_event event = mlt_properties_get_data_at( listeners, i, NULL );
-				if ( event != NULL && event->owner != NULL && event->block_count == 0 )
-				{
-					if ( transmitter != NULL )
-						transmitter( event->listener, event->owner, event->service, args );
-					else
-						event->listener( event->owner, event->service );
-					++result;
-				}
-			}
-		}
+/** Fire the event of a handle.
+ *
+ * This takes a variable number of arguments to supply to the listener.
+ *
+ * \public \memberof mlt_event_handle_struct
+ * \param self an event handle
+ * \return the number of listeners
+ */
+
+int mlt_event_handle_fire( mlt_event_handle self, ... )
+{
+	int result = 0;
+	if ( self != NULL && self->count > 0 )
+	{
+		va_list alist;
+		va_start( alist, self );
+		result = mlt_event_handle_transmit( self, alist );
+		va_end( alist );
 	}
 	return result;
 }
@@ -238,50 +348,46 @@ mlt_event mlt_events_listen( mlt_properties self, void *service, const char *id,
 {
 	mlt_event event = NULL;
 	mlt_events events = mlt_events_fetch( self );
-	if ( events != NULL )
+	mlt_event_handle handle = events != NULL ? mlt_properties_get_data( events->list, id, NULL ) : NULL;
+	if ( handle != NULL )
 	{
-		mlt_properties list = events->list;
-		mlt_properties listeners = NULL;
-		char temp[ 128 ];
-		sprintf( temp, "list:%s", id );
-		listeners = mlt_properties_get_data( list, temp, NULL );
-		if ( listeners != NULL )
+		mlt_properties listeners = handle->listeners;
+		char temp[ 20 ];
+		int first_null = -1;
+		int i = 0;
+		for ( i = 0; event == NULL && i < mlt_properties_count( listeners ); i ++ )
 		{
-			int first_null = -1;
-			int i = 0;
-			for ( i = 0; event == NULL && i < mlt_properties_count( listeners ); i ++ )
+			mlt_event entry = mlt_properties_get_data_at( listeners, i, NULL );
+			if ( entry != NULL && entry->owner != NULL )
 			{
-				mlt_event entry = mlt_properties_get_data_at( listeners, i, NULL );
-				if ( entry != NULL && entry->owner != NULL )
-				{
-					if ( entry->service == service && entry->listener == listener )
-						event = entry;
-				}
-				else if ( ( entry == NULL || entry->owner == NULL ) && first_null == -1 )
-				{
-					first_null = i;
-				}
+				if ( entry->service == service && entry->listener == listener )
+					event = entry;
+			}
+			else if ( ( entry == NULL || entry->owner == NULL ) && first_null == -1 )
+			{
+				first_null = i;
 			}
+		}
 
-			if ( event == NULL )
+		if ( event == NULL )
+		{
+			event = malloc( sizeof( struct mlt_event_struct ) );
+			if ( event != NULL )
 			{
-				event = malloc( sizeof( struct mlt_event_struct ) );
-				if ( event != NULL )
-				{
 #ifdef _MLT_EVENT_CHECKS_
-					events_created ++;
+				events_created ++;
 #endif
-					sprintf( temp, "%d", first_null == -1 ? mlt_properties_count( listeners ) : first_null );
-					event->owner = events;
-					event->ref_count = 0;
-					event->block_count = 0;
-					event->listener = listener;
-					event->service = service;
-					mlt_properties_set_data( listeners, temp, event, 0, ( mlt_destructor )mlt_event_close, NULL );
-					mlt_event_inc_ref( event );
-				}
+				sprintf( temp, "%d", first_null == -1 ? mlt_properties_count( listeners ) : first_null );
+				event->owner = events;
+				event->ref_count = 0;
+				event->block_count = 0;
+				event->listener = listener;
+				event->service = service;
+				event->handle = handle;
+				handle->count ++;
+				mlt_properties_set_data( listeners, temp, event, 0, ( mlt_destructor )mlt_event_close, NULL );
+				mlt_event_inc_ref( event );
 			}
-
 		}
 	}
 	return event;
@@ -303,10 +409,10 @@ void mlt_events_block( mlt_properties self, void *service )
 		mlt_properties list = events->list;
 		for ( j = 0; j < mlt_properties_count( list ); j ++ )
 		{
-			char *temp = mlt_properties_get_name( list, j );
-			if ( !strncmp( temp, "list:", 5 ) )
+			mlt_event_handle handle = mlt_properties_get_data_at( list, j, NULL );
+			if ( handle != NULL )
 			{
-				mlt_properties listeners = mlt_properties_get_data( list, temp, NULL );
+				mlt_properties listeners = handle->listeners;
 				for ( i = 0; i < mlt_properties_count( listeners ); i ++ )
 				{
 					mlt_event entry = mlt_properties_get_data_at( listeners, i, NULL );
@@ -334,10 +440,10 @@ void mlt_events_unblock( mlt_properties self, void *service )
 		mlt_properties list = events->list;
 		for ( j = 0; j < mlt_properties_count( list ); j ++ )
 		{
-			char *temp = mlt_properties_get_name( list, j );
-			if ( !strncmp( temp, "list:", 5 ) )
+			mlt_event_handle handle = mlt_properties_get_data_at( list, j, NULL );
+			if ( handle != NULL )
 			{
-				mlt_properties listeners = mlt_properties_get_data( list, temp, NULL );
+				mlt_properties listeners = handle->listeners;
 				for ( i = 0; i < mlt_properties_count( listeners ); i ++ )
 				{
 					mlt_event entry = mlt_properties_get_data_at( listeners, i, NULL );
@@ -365,10 +471,10 @@ void mlt_events_disconnect( mlt_properties self, void *service )
 		mlt_properties list = events->list;
 		for ( j = 0; j < mlt_properties_count( list ); j ++ )
 		{
-			char *temp = mlt_properties_get_name( list, j );
-			if ( !strncmp( temp, "list:", 5 ) )
+			mlt_event_handle handle = mlt_properties_get_data_at( list, j, NULL );
+			if ( handle != NULL )
 			{
-				mlt_properties listeners = mlt_properties_get_data( list, temp, NULL );
+				mlt_properties listeners = handle->listeners;
 				for ( i = 0; i < mlt_properties_count( listeners ); i ++ )
 				{
 					mlt_event entry = mlt_properties_get_data_at( listeners, i, NULL );
@@ -449,7 +555,7 @@ void mlt_events_close_wait_for( mlt_properties self, mlt_event event )
 	if ( event != NULL )
 	{
 		condition_pair *pair = event->service;
-		event->owner = NULL;
+		mlt_event_detach( event );
 		pthread_mutex_unlock( &pair->mutex );
 		pthread_mutex_destroy( &pair->mutex );
 		pthread_cond_destroy( &pair->cond );
@@ -499,3 +605,28 @@ static void mlt_events_close( mlt_events events )
 		free( events );
 	}
 }
+
+/** Close an event handle.
+ *
+ * This disconnects the listeners that are still referenced elsewhere before
+ * releasing them.
+ *
+ * \private \memberof mlt_event_handle_struct
+ * \param self an event handle
+ */
+
+static void mlt_event_handle_close( mlt_event_handle self )
+{
+	if ( self != NULL )
+	{
+		int i = 0;
+		for ( i = 0; i < mlt_properties_count( self->listeners ); i ++ )
+		{
+			mlt_event event = mlt_properties_get_data_at( self->listeners, i, NULL );
+			if ( event != NULL )
+				mlt_event_detach( event );
+		}
+		mlt_properties_close( self->listeners );
+		free( self );
+	}
+}
@@ -44,6 +44,8 @@ typedef void ( *mlt_listener )( );
 extern void mlt_events_init( mlt_properties self );
 extern int mlt_events_register( mlt_properties self, const char *id, mlt_transmitter transmitter );
 extern int mlt_events_fire( mlt_properties self, const char *id, ... );
+extern mlt_event_handle mlt_events_handle( mlt_properties self, const char *id );
+extern int mlt_events_listening( mlt_properties self, const char *id );
 extern mlt_event mlt_events_listen( mlt_properties self, void *service, const char *id, mlt_listener listener );
 extern void mlt_events_block( mlt_properties self, void *service );
 extern void mlt_events_unblock( mlt_properties self, void *service );
@@ -58,5 +60,8 @@ extern void mlt_event_block( mlt_event self );
 extern void mlt_event_unblock( mlt_event self );
 extern void mlt_event_close( mlt_event self );
 
+extern int mlt_event_handle_listening( mlt_event_handle self );
+extern int mlt_event_handle_fire( mlt_event_handle self, ... );
+
 #endif
 
@@ -209,6 +209,131 @@ mlt_get_image mlt_frame_pop_get_image( mlt_frame self )
 	return mlt_deque_pop_back( self->stack_image );
 }
 
+/** A stage of fused per-channel lookup tables.
+ *
+ * Consecutive point operations pushed with mlt_frame_push_lut() are composed
+ * into one stage so that the image is only traversed once.
+ */
+
+typedef struct
+{
+	mlt_image_format format;
+	uint8_t lut[3][256];
+}
+lut_stage;
+
+static int lut_get_image( mlt_frame self, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+{
+	lut_stage *stage = mlt_frame_pop_service( self );
+	int error;
+
+	// RGB stages leave alpha untouched, so keep rgb24a when requested
+	if ( stage->format == mlt_image_yuv422 || ( *format != mlt_image_rgb24 && *format != mlt_image_rgb24a ) )
+		*format = stage->format;
+
+	error = mlt_frame_get_image( self, image, format, width, height, 1 );
+
+	if ( !error && *image )
+	{
+		const uint8_t *l0 = stage->lut[0];
+		const uint8_t *l1 = stage->lut[1];
+		const uint8_t *l2 = stage->lut[2];
+		uint8_t *p = *image;
+		int h = *height;
+		int x;
+
+		switch ( *format )
+		{
+		case mlt_image_yuv422:
+			// Chroma alternates U and V starting at U on every row
+			while ( h-- )
+			{
+				for ( x = 0; x < *width; x++, p += 2 )
+				{
+					p[0] = l0[ p[0] ];
+					p[1] = ( x & 1 ) ? l2[ p[1] ] : l1[ p[1] ];
+				}
+			}
+			break;
+		case mlt_image_rgb24:
+			for ( x = *width * *height; x > 0; x--, p += 3 )
+			{
+				p[0] = l0[ p[0] ];
+				p[1] = l1[ p[1] ];
+				p[2] = l2[ p[2] ];
+			}
+			break;
+		case mlt_image_rgb24a:
+			for ( x = *width * *height; x > 0; x--, p += 4 )
+			{
+				p[0] = l0[ p[0] ];
+				p[1] = l1[ p[1] ];
+				p[2] = l2[ p[2] ];
+			}
+			break;
+		default:
+			mlt_log_error( NULL, "[frame] lookup table not applied to %s image\n", mlt_image_format_name( *format ) );
+			break;
+		}
+	}
+
+	return error;
+}
+
+/** Push a per-channel point operation on to the image stack.
+ *
+ * A filter whose effect on every sample only depends upon that sample value can
+ * call this from its process method instead of pushing its own get_image.
+ * If the top of the image stack is already a lookup table stage for the same
+ * image format, the tables are composed with it, so any number of adjacent
+ * point filters cost a single pass over the image.
+ *
+ * The channels are Y, U, V for mlt_image_yuv422 and R, G, B for mlt_image_rgb24,
+ * which also applies to mlt_image_rgb24a and leaves alpha unchanged.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param format mlt_image_yuv422 or mlt_image_rgb24
+ * \param lut the tables for the three channels, copied
+ * \return true if error
+ */
+
+int mlt_frame_push_lut( mlt_frame self, mlt_image_format format, uint8_t lut[3][256] )
+{
+	int count = mlt_deque_count( self->stack_image );
+	lut_stage *stage = NULL;
+	int c, i;
+
+	if ( format != mlt_image_yuv422 && format != mlt_image_rgb24 )
+		return 1;
+
+	if ( count >= 2 && mlt_deque_peek_back( self->stack_image ) == lut_get_image )
+		stage = mlt_deque_peek( self->stack_image, count - 2 );
+
+	if ( stage && stage->format == format )
+	{
+		// Apply the new tables after the existing ones
+		for ( c = 0; c < 3; c++ )
+			for ( i = 0; i < 256; i++ )
+				stage->lut[c][i] = lut[c][ stage->lut[c][i] ];
+	}
+	else
+	{
+		char key[ 32 ];
+		stage = malloc( sizeof( lut_stage ) );
+		if ( stage == NULL )
+			return 1;
+		stage->format = format;
+		memcpy( stage->lut, lut, sizeof( stage->lut ) );
+		snprintf( key, sizeof( key ), "_lut_stage.%p", stage );
+		mlt_properties_set_data( MLT_FRAME_PROPERTIES( self ), key, stage, sizeof( lut_stage ), free, NULL );
+		mlt_frame_push_service( self, stage );
+		mlt_frame_push_get_image( self, lut_get_image );
+	}
+
+	return 0;
+}
+
 /** Push a frame.
  *
  * \public \memberof mlt_frame_s
@@ -333,6 +458,8 @@ mlt_deque mlt_frame_service_stack( mlt_frame self )
 
 int mlt_frame_set_image( mlt_frame self, uint8_t *image, int size, mlt_destructor destroy )
 {
+	// The new image may carry its own alpha
+	mlt_frame_set_uniform_alpha( self, -1 );
 	return mlt_properties_set_data( MLT_FRAME_PROPERTIES( self ), "image", image, size, destroy, NULL );
 }
 
@@ -349,6 +476,7 @@ int mlt_frame_set_image( mlt_frame self, uint8_t *image, int size, mlt_destructo
 int mlt_frame_set_alpha( mlt_frame self, uint8_t *alpha, int size, mlt_destructor destroy )
 {
 	self->get_alpha_mask = NULL;
+	mlt_frame_set_uniform_alpha( self, -1 );
 	return mlt_properties_set_data( MLT_FRAME_PROPERTIES( self ), "alpha", alpha, size, destroy, NULL );
 }
 
@@ -389,6 +517,7 @@ void mlt_frame_replace_image( mlt_frame self, uint8_t *image, mlt_image_format f
 	mlt_properties_set_int( MLT_FRAME_PROPERTIES( self ), "height", height );
 	mlt_properties_set_int( MLT_FRAME_PROPERTIES( self ), "format", format );
 	self->get_alpha_mask = NULL;
+	mlt_frame_set_uniform_alpha( self, -1 );
 }
 
 /** Get the short name for an image format.
@@ -613,6 +742,10 @@ int mlt_frame_get_image( mlt_frame self, uint8_t **buffer, mlt_image_format *for
 		error = generate_test_image( properties, buffer, format, width, height, writable );
 	}
 
+	// The caller may alter an alpha channel that is held in the image
+	if ( writable && ( *format == mlt_image_rgb24a || *format == mlt_image_opengl ) )
+		mlt_frame_set_uniform_alpha( self, -1 );
+
 	return error;
 }
 
@@ -632,6 +765,8 @@ uint8_t *mlt_frame_get_alpha_mask( mlt_frame self )
 	uint8_t *alpha = NULL;
 	if ( self != NULL )
 	{
+		// The caller may write to the mask
+		mlt_frame_set_uniform_alpha( self, -1 );
 		if ( self->get_alpha_mask != NULL )
 			alpha = self->get_alpha_mask( self );
 		if ( alpha == NULL )
@@ -670,6 +805,60 @@ uint8_t *mlt_frame_get_alpha( mlt_frame self )
 	return alpha;
 }
 
+/** Declare that every alpha sample of the frame has the same value.
+ *
+ * Producers that know their image is opaque (or uniformly translucent) should
+ * say so, because services may then skip per-pixel alpha processing and need
+ * not allocate an alpha mask. The declaration holds whether or not an alpha
+ * channel is attached to the frame, and it is withdrawn automatically by
+ * mlt_frame_set_image(), mlt_frame_replace_image(), mlt_frame_set_alpha(),
+ * mlt_frame_get_alpha_mask() and writable requests for an image format that
+ * carries alpha. So declare it after setting the image.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param value the alpha value from 0 to 255, or -1 to withdraw the declaration
+ * \return true if error
+ */
+
+int mlt_frame_set_uniform_alpha( mlt_frame self, int value )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+	if ( value >= 0 && value <= 255 )
+		return mlt_properties_set_int( properties, "uniform_alpha", value );
+	else if ( mlt_properties_get( properties, "uniform_alpha" ) )
+		return mlt_properties_set( properties, "uniform_alpha", NULL );
+	return 0;
+}
+
+/** Get the value shared by every alpha sample of the frame.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \return the alpha value from 0 to 255, or -1 if the alpha is not known to be uniform
+ * \see mlt_frame_set_uniform_alpha
+ */
+
+int mlt_frame_get_uniform_alpha( mlt_frame self )
+{
+	if ( self == NULL || mlt_properties_get( MLT_FRAME_PROPERTIES( self ), "uniform_alpha" ) == NULL )
+		return -1;
+	return mlt_properties_get_int( MLT_FRAME_PROPERTIES( self ), "uniform_alpha" );
+}
+
+/** Determine if the frame is known to be fully opaque.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \return true if every alpha sample is 255
+ * \see mlt_frame_set_uniform_alpha
+ */
+
+int mlt_frame_is_opaque( mlt_frame self )
+{
+	return mlt_frame_get_uniform_alpha( self ) == 255;
+}
+
 /** Get the short name for an audio format.
  *
  * You do not need to deallocate the returned string.
@@ -717,6 +906,25 @@ int mlt_audio_format_size( mlt_audio_format format, int samples, int channels )
 	return 0;
 }
 
+/** Convert the audio of a frame and count the conversion.
+ *
+ * \private \memberof mlt_frame_s
+ */
+
+static int convert_audio( mlt_frame self, void **buffer, mlt_audio_format *format, mlt_audio_format requested_format )
+{
+	mlt_audio_format original_format = *format;
+	int error = self->convert_audio( self, buffer, format, requested_format );
+
+	// Keep count of the conversions for debugging the audio path
+	if ( *format != original_format )
+	{
+		mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+		mlt_properties_set_int( properties, "audio_conversions", mlt_properties_get_int( properties, "audio_conversions" ) + 1 );
+	}
+	return error;
+}
+
 /** Get the audio associated to the frame.
  *
  * You should express the desired format, frequency, channels, and samples as inputs. As long
@@ -753,7 +961,7 @@ int mlt_frame_get_audio( mlt_frame self, void **buffer, mlt_audio_format *format
 		mlt_properties_set_int( properties, "audio_samples", *samples );
 		mlt_properties_set_int( properties, "audio_format", *format );
 		if ( self->convert_audio && *buffer && requested_format != mlt_audio_none )
-			self->convert_audio( self, buffer, format, requested_format );
+			convert_audio( self, buffer, format, requested_format );
 	}
 	else if ( mlt_properties_get_data( properties, "audio", NULL ) )
 	{
@@ -763,7 +971,7 @@ int mlt_frame_get_audio( mlt_frame self, void **buffer, mlt_audio_format *format
 		*channels = mlt_properties_get_int( properties, "audio_channels" );
 		*samples = mlt_properties_get_int( properties, "audio_samples" );
 		if ( self->convert_audio && *buffer && requested_format != mlt_audio_none )
-			self->convert_audio( self, buffer, format, requested_format );
+			convert_audio( self, buffer, format, requested_format );
 	}
 	else
 	{
@@ -813,6 +1021,51 @@ int mlt_frame_get_audio( mlt_frame self, void **buffer, mlt_audio_format *format
 	return 0;
 }
 
+/** Get the audio in whichever of several formats needs the fewest conversions.
+ *
+ * Services that process more than one audio format natively should use this
+ * instead of mlt_frame_get_audio(). The audio is obtained in the format in
+ * which it was produced, and it is converted only when that format is not
+ * accepted, in which case the first accepted format is used. List the formats
+ * in order of preference, with float first to keep float audio end-to-end.
+ *
+ * \public \memberof mlt_frame_s
+ * \param self a frame
+ * \param accepted the audio formats accepted, terminated by mlt_audio_none
+ * \param[out] buffer an audio buffer
+ * \param[out] format the audio format obtained
+ * \param[in,out] frequency the sample rate
+ * \param[in,out] channels
+ * \param[in,out] samples the number of samples per frame
+ * \return true if error
+ */
+
+int mlt_frame_get_audio_accepting( mlt_frame self, const mlt_audio_format *accepted, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
+{
+	int error;
+	int i = 0;
+
+	*format = mlt_audio_none;
+	error = mlt_frame_get_audio( self, buffer, format, frequency, channels, samples );
+
+	if ( accepted == NULL || accepted[ 0 ] == mlt_audio_none )
+		return error;
+
+	// There was no audio to obtain, so make silence in the preferred format
+	if ( !error && *buffer == NULL )
+	{
+		*format = accepted[ 0 ];
+		return mlt_frame_get_audio( self, buffer, format, frequency, channels, samples );
+	}
+
+	while ( accepted[ i ] != mlt_audio_none && accepted[ i ] != *format )
+		i ++;
+	if ( !error && accepted[ i ] == mlt_audio_none && self->convert_audio )
+		error = convert_audio( self, buffer, format, accepted[ 0 ] );
+
+	return error;
+}
+
 /** Set the audio on a frame.
  *
  * \public \memberof mlt_frame_s
@@ -63,10 +63,12 @@ typedef int ( *mlt_get_audio )( mlt_frame self, void **buffer, mlt_audio_format
  * \properties \em audio_channels the number of audio channels
  * \properties \em audio_samples the number of audio samples
  * \properties \em audio_format the mlt_audio_format for the audio on this frame
+ * \properties \em audio_conversions the number of audio format conversions made for this frame (for debugging)
  * \properties \em format the mlt_image_format of the image on this frame
  * \properties \em width the horizontal resolution of the image
  * \properties \em height the vertical resolution of the image
  * \properties \em aspect_ratio the sample aspect ratio of the image
+ * \properties \em uniform_alpha the value of every alpha sample when known to be uniform
  */
 
 struct mlt_frame_s
@@ -123,11 +125,16 @@ extern void mlt_frame_replace_image( mlt_frame self, uint8_t *image, mlt_image_f
 extern int mlt_frame_get_image( mlt_frame self, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable );
 extern uint8_t *mlt_frame_get_alpha_mask( mlt_frame self );
 extern uint8_t *mlt_frame_get_alpha( mlt_frame self );
+extern int mlt_frame_set_uniform_alpha( mlt_frame self, int value );
+extern int mlt_frame_get_uniform_alpha( mlt_frame self );
+extern int mlt_frame_is_opaque( mlt_frame self );
 extern int mlt_frame_get_audio( mlt_frame self, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples );
+extern int mlt_frame_get_audio_accepting( mlt_frame self, const mlt_audio_format *accepted, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples );
 extern int mlt_frame_set_audio( mlt_frame self, void *buffer, mlt_audio_format, int size, mlt_destructor );
 extern unsigned char *mlt_frame_get_waveform( mlt_frame self, int w, int h );
 extern int mlt_frame_push_get_image( mlt_frame self, mlt_get_image get_image );
 extern mlt_get_image mlt_frame_pop_get_image( mlt_frame self );
+extern int mlt_frame_push_lut( mlt_frame self, mlt_image_format format, uint8_t lut[3][256] );
 extern int mlt_frame_push_frame( mlt_frame self, mlt_frame that );
 extern mlt_frame mlt_frame_pop_frame( mlt_frame self );
 extern int mlt_frame_push_service( mlt_frame self, void *that );
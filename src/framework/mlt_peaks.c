@@ -0,0 +1,745 @@
+/**
+ * \file mlt_peaks.c
+ * \brief multi-resolution audio peak cache
+ * \see mlt_peaks_s
+ *
+ * Copyright (C) 2015 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "mlt_peaks.h"
+#include "mlt_factory.h"
+#include "mlt_producer.h"
+#include "mlt_frame.h"
+#include "mlt_profile.h"
+#include "mlt_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+/** the number of samples summarised by each peak of the finest level */
+#define PEAKS_BASE (256)
+
+/** the number of peaks of a level summarised by each peak of the next level */
+#define PEAKS_FACTOR (4)
+
+/** the number of levels in the pyramid */
+#define PEAKS_LEVELS (5)
+
+/** the version of the sidecar file layout */
+#define PEAKS_VERSION (1)
+
+/** the sample rate at which peaks are measured */
+#define PEAKS_FREQUENCY (48000)
+
+/** \brief Peak of one channel over one bin, as 16-bit fractions of full scale */
+
+typedef struct
+{
+	int16_t min;
+	int16_t max;
+	int16_t rms;
+} peak;
+
+/** \brief Sidecar file header, followed by the levels, finest first */
+
+typedef struct
+{
+	char magic[8];                 /**< "MLTPEAKS" */
+	int32_t version;               /**< \p PEAKS_VERSION */
+	int32_t frequency;             /**< the sample rate of the measured audio */
+	int32_t channels;              /**< the number of channels */
+	int32_t levels;                /**< \p PEAKS_LEVELS */
+	int64_t samples;               /**< the number of samples measured */
+	int64_t resource_size;         /**< the size of the resource when measured */
+	int64_t resource_mtime;        /**< the modification time of the resource when measured */
+	int64_t counts[PEAKS_LEVELS];  /**< the number of bins in each level */
+} peaks_header;
+
+/** \brief Running summary of the bin being built for one level */
+
+typedef struct
+{
+	int count;      /**< the number of samples folded in */
+	float *min;     /**< per channel */
+	float *max;     /**< per channel */
+	double *sumsq;  /**< per channel */
+} peaks_accumulator;
+
+/** \brief Peaks class
+ *
+ * A peak pyramid holds the minimum, maximum and RMS level of each audio channel
+ * of a resource at several zoom levels. The finest level summarises \p PEAKS_BASE
+ * samples per bin and each following level \p PEAKS_FACTOR times more. This lets a
+ * timeline draw waveforms for any range and zoom without decoding audio.
+ *
+ * Opening a resource that has a valid sidecar file ("<resource>.peaks") maps it
+ * into memory. Otherwise the pyramid is built by a background thread that pulls
+ * only the audio from a new producer for the resource. Peaks are available as
+ * soon as they are measured, and the finished pyramid is written to the sidecar.
+ */
+
+struct mlt_peaks_s
+{
+	char *resource;                 /**< the resource measured */
+	char *path;                     /**< the sidecar file, or NULL if the resource is not a file */
+	mlt_profile profile;            /**< the profile used to open the producer and convert positions */
+	int frequency;                  /**< the sample rate of the measured audio */
+	int channels;                   /**< the number of channels */
+	int64_t samples;                /**< the number of samples measured so far */
+	int64_t resource_size;          /**< the size of the resource file */
+	int64_t resource_mtime;         /**< the modification time of the resource file */
+	peak *levels[PEAKS_LEVELS];     /**< the bins of each level, interleaved by channel */
+	int64_t counts[PEAKS_LEVELS];   /**< the number of complete bins in each level */
+	int64_t allocated[PEAKS_LEVELS];/**< the number of bins allocated in each level */
+	void *map;                      /**< the mapped sidecar file, if loaded */
+	size_t map_size;                /**< the size of \p map */
+	int complete;                   /**< set when every level is final, including when the build stopped early */
+	int abort;                      /**< set to stop the background build */
+	int thread_running;             /**< set when \p thread must be joined */
+	pthread_t thread;               /**< the background build */
+	pthread_mutex_t mutex;          /**< protects the levels while building */
+};
+
+static inline int16_t quantise( float value )
+{
+	value = value < -1.0f ? -1.0f : value > 1.0f ? 1.0f : value;
+	return (int16_t) lrintf( value * 32767.0f );
+}
+
+/** Map a valid sidecar file.
+ *
+ * \private \memberof mlt_peaks_s
+ * \param self a peaks
+ * \return true if the sidecar was loaded
+ */
+
+static int peaks_load( mlt_peaks self )
+{
+	peaks_header header;
+	FILE *file = fopen( self->path, "rb" );
+	size_t size = sizeof( header );
+	int i;
+
+	if ( !file )
+		return 0;
+	if ( fread( &header, sizeof( header ), 1, file ) != 1 ||
+		 memcmp( header.magic, "MLTPEAKS", 8 ) ||
+		 header.version != PEAKS_VERSION ||
+		 header.levels != PEAKS_LEVELS ||
+		 header.channels <= 0 ||
+		 header.resource_size != self->resource_size ||
+		 header.resource_mtime != self->resource_mtime )
+	{
+		fclose( file );
+		return 0;
+	}
+	for ( i = 0; i < PEAKS_LEVELS; i++ )
+		size += header.counts[i] * header.channels * sizeof( peak );
+
+#ifndef WIN32
+	self->map = mmap( NULL, size, PROT_READ, MAP_SHARED, fileno( file ), 0 );
+	if ( self->map == MAP_FAILED )
+		self->map = NULL;
+	else
+	{
+		struct stat file_stat;
+		if ( fstat( fileno( file ), &file_stat ) || file_stat.st_size < size )
+		{
+			munmap( self->map, size );
+			self->map = NULL;
+		}
+	}
+#else
+	self->map = malloc( size );
+	if ( self->map && ( fseek( file, 0, SEEK_SET ) || fread( self->map, size, 1, file ) != 1 ) )
+	{
+		free( self->map );
+		self->map = NULL;
+	}
+#endif
+	fclose( file );
+	if ( !self->map )
+		return 0;
+
+	self->map_size = size;
+	self->frequency = header.frequency;
+	self->channels = header.channels;
+	self->samples = header.samples;
+	size = sizeof( header );
+	for ( i = 0; i < PEAKS_LEVELS; i++ )
+	{
+		self->levels[i] = (peak*) ( (uint8_t*) self->map + size );
+		self->counts[i] = header.counts[i];
+		size += header.counts[i] * header.channels * sizeof( peak );
+	}
+	self->complete = 1;
+
+	return 1;
+}
+
+/** Write the finished pyramid to the sidecar file.
+ *
+ * \private \memberof mlt_peaks_s
+ * \param self a peaks
+ */
+
+static void peaks_save( mlt_peaks self )
+{
+	peaks_header header;
+	char *temp = malloc( strlen( self->path ) + 8 );
+	FILE *file = NULL;
+	int i, fd, error = 0;
+
+	if ( !temp )
+		return;
+
+	// Each writer gets a file of its own so that processes never write the same one
+	sprintf( temp, "%s.XXXXXX", self->path );
+	fd = mkstemp( temp );
+	if ( fd != -1 )
+	{
+		file = fdopen( fd, "wb" );
+		if ( !file )
+		{
+			close( fd );
+			remove( temp );
+		}
+	}
+	if ( !file )
+	{
+		mlt_log_warning( NULL, "[mlt_peaks] unable to write %s\n", self->path );
+		free( temp );
+		return;
+	}
+
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, "MLTPEAKS", 8 );
+	header.version = PEAKS_VERSION;
+	header.frequency = self->frequency;
+	header.channels = self->channels;
+	header.levels = PEAKS_LEVELS;
+	header.samples = self->samples;
+	header.resource_size = self->resource_size;
+	header.resource_mtime = self->resource_mtime;
+	for ( i = 0; i < PEAKS_LEVELS; i++ )
+		header.counts[i] = self->counts[i];
+
+	error = fwrite( &header, sizeof( header ), 1, file ) != 1;
+	for ( i = 0; !error && i < PEAKS_LEVELS; i++ )
+		if ( self->counts[i] )
+			error = fwrite( self->levels[i], self->counts[i] * self->channels * sizeof( peak ), 1, file ) != 1;
+	error |= fclose( file ) != 0;
+
+	// Replace the sidecar in one step so readers never see a partial file
+	if ( error || rename( temp, self->path ) )
+		remove( temp );
+	free( temp );
+}
+
+/** Append a finished bin to a level.
+ *
+ * \private \memberof mlt_peaks_s
+ * \param self a peaks
+ * \param level the level index
+ * \param acc the summary of the bin
+ */
+
+static void peaks_append( mlt_peaks self, int level, peaks_accumulator *acc )
+{
+	int c;
+
+	pthread_mutex_lock( &self->mutex );
+	if ( self->counts[level] >= self->allocated[level] )
+	{
+		int64_t allocated = self->allocated[level] ? self->allocated[level] * 2 : 1024;
+		peak *bins = realloc( self->levels[level], allocated * self->channels * sizeof( peak ) );
+		if ( !bins )
+		{
+			pthread_mutex_unlock( &self->mutex );
+			return;
+		}
+		self->levels[level] = bins;
+		self->allocated[level] = allocated;
+	}
+	for ( c = 0; c < self->channels; c++ )
+	{
+		peak *p = &self->levels[level][ self->counts[level] * self->channels + c ];
+		p->min = quantise( acc->min[c] );
+		p->max = quantise( acc->max[c] );
+		p->rms = quantise( sqrt( acc->sumsq[c] / acc->count ) );
+	}
+	self->counts[level]++;
+	pthread_mutex_unlock( &self->mutex );
+}
+
+/** Fold one accumulator into another.
+ *
+ * \private \memberof mlt_peaks_s
+ */
+
+static void accumulator_fold( peaks_accumulator *dest, peaks_accumulator *src, int channels )
+{
+	int c;
+	for ( c = 0; c < channels; c++ )
+	{
+		if ( !dest->count || src->min[c] < dest->min[c] )
+			dest->min[c] = src->min[c];
+		if ( !dest->count || src->max[c] > dest->max[c] )
+			dest->max[c] = src->max[c];
+		dest->sumsq[c] = ( dest->count ? dest->sumsq[c] : 0.0 ) + src->sumsq[c];
+	}
+	dest->count += src->count;
+}
+
+/** Get the number of samples summarised by each bin of a level.
+ *
+ * \private \memberof mlt_peaks_s
+ */
+
+static int level_size( int level )
+{
+	int size = PEAKS_BASE;
+	while ( level-- )
+		size *= PEAKS_FACTOR;
+	return size;
+}
+
+/** Emit the bin of a level and cascade it into the coarser levels.
+ *
+ * \private \memberof mlt_peaks_s
+ * \param self a peaks
+ * \param acc the accumulators of all levels
+ * \param level the level whose bin is complete
+ * \param flush also emit partially filled coarser bins
+ */
+
+static void peaks_emit( mlt_peaks self, peaks_accumulator *acc, int level, int flush )
+{
+	for ( ; level < PEAKS_LEVELS && acc[level].count; level++ )
+	{
+		peaks_append( self, level, &acc[level] );
+		if ( level + 1 < PEAKS_LEVELS )
+			accumulator_fold( &acc[ level + 1 ], &acc[level], self->channels );
+		acc[level].count = 0;
+
+		// Stop unless the coarser bin is now full
+		if ( !flush && ( level + 1 >= PEAKS_LEVELS || acc[ level + 1 ].count < level_size( level + 1 ) ) )
+			break;
+	}
+}
+
+/** Measure a block of planar float audio.
+ *
+ * \private \memberof mlt_peaks_s
+ */
+
+static void peaks_measure( mlt_peaks self, peaks_accumulator *acc, const float *buffer, int channels, int samples )
+{
+	int s, c;
+
+	for ( s = 0; s < samples; s++ )
+	{
+		for ( c = 0; c < self->channels; c++ )
+		{
+			float value = buffer[ ( c % channels ) * samples + s ];
+			if ( !acc->count || value < acc->min[c] )
+				acc->min[c] = value;
+			if ( !acc->count || value > acc->max[c] )
+				acc->max[c] = value;
+			acc->sumsq[c] = ( acc->count ? acc->sumsq[c] : 0.0 ) + value * value;
+		}
+		if ( ++acc->count == PEAKS_BASE )
+			peaks_emit( self, acc, 0, 0 );
+	}
+	pthread_mutex_lock( &self->mutex );
+	self->samples += samples;
+	pthread_mutex_unlock( &self->mutex );
+}
+
+/** The formats the builder accepts without conversion. */
+
+static const mlt_audio_format peaks_formats[] = { mlt_audio_float, mlt_audio_s16, mlt_audio_none };
+
+/** The background procedure that builds the pyramid.
+ *
+ * \private \memberof mlt_peaks_s
+ * \param arg a peaks
+ */
+
+static void *peaks_build( void *arg )
+{
+	mlt_peaks self = arg;
+	mlt_producer producer = mlt_factory_producer( self->profile, NULL, self->resource );
+	peaks_accumulator acc[PEAKS_LEVELS];
+	float *planar = NULL;
+	int planar_size = 0;
+	int i;
+
+	memset( acc, 0, sizeof( acc ) );
+
+	if ( producer )
+	{
+		double fps = mlt_producer_get_fps( producer );
+		mlt_position length = mlt_producer_get_length( producer );
+		mlt_position position;
+
+		for ( position = 0; position < length && !self->abort; position++ )
+		{
+			mlt_frame frame = NULL;
+			mlt_audio_format format = mlt_audio_none;
+			int frequency = self->frequency;
+			// Until the first audio arrives, ask for the channels the stream has
+			int channels = self->channels;
+			int samples = mlt_sample_calculator( fps, frequency, position );
+			void *buffer = NULL;
+
+			if ( mlt_service_get_frame( MLT_PRODUCER_SERVICE( producer ), &frame, 0 ) || !frame )
+				break;
+
+			// Nobody asks this frame for an image
+			mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "consumer_video_off", 1 );
+			if ( !mlt_frame_get_audio_accepting( frame, peaks_formats, &buffer, &format, &frequency, &channels, &samples ) &&
+				 buffer && channels > 0 && samples > 0 && frequency > 0 )
+			{
+				// Without a resampler the producer delivers its own rate
+				if ( !self->samples && frequency != self->frequency )
+				{
+					pthread_mutex_lock( &self->mutex );
+					self->frequency = frequency;
+					pthread_mutex_unlock( &self->mutex );
+				}
+				if ( !self->channels )
+				{
+					for ( i = 0; i < PEAKS_LEVELS; i++ )
+					{
+						acc[i].min = calloc( channels, sizeof( float ) );
+						acc[i].max = calloc( channels, sizeof( float ) );
+						acc[i].sumsq = calloc( channels, sizeof( double ) );
+						if ( !acc[i].min || !acc[i].max || !acc[i].sumsq )
+							self->abort = 1;
+					}
+					pthread_mutex_lock( &self->mutex );
+					self->channels = channels;
+					pthread_mutex_unlock( &self->mutex );
+				}
+				if ( !self->abort && format == mlt_audio_s16 )
+				{
+					int16_t *pcm = buffer;
+					int s, c;
+					if ( planar_size < samples * channels )
+					{
+						free( planar );
+						planar_size = samples * channels;
+						planar = malloc( planar_size * sizeof( float ) );
+					}
+					if ( planar )
+					{
+						for ( s = 0; s < samples; s++ )
+							for ( c = 0; c < channels; c++ )
+								planar[ c * samples + s ] = pcm[ s * channels + c ] / 32768.0f;
+						peaks_measure( self, acc, planar, channels, samples );
+					}
+					else
+					{
+						planar_size = 0;
+					}
+				}
+				else if ( !self->abort && format == mlt_audio_float )
+				{
+					peaks_measure( self, acc, buffer, channels, samples );
+				}
+			}
+			mlt_frame_close( frame );
+		}
+		mlt_producer_close( producer );
+	}
+
+	// Flush the partial bins at the end of the audio
+	for ( i = 0; i < PEAKS_LEVELS && !self->abort; i++ )
+		if ( acc[i].count )
+			peaks_emit( self, acc, i, 1 );
+
+	for ( i = 0; i < PEAKS_LEVELS; i++ )
+	{
+		free( acc[i].min );
+		free( acc[i].max );
+		free( acc[i].sumsq );
+	}
+	free( planar );
+
+	// Only a finished pyramid is saved, but nothing more arrives either way
+	if ( !self->abort && self->path && self->samples > 0 )
+		peaks_save( self );
+	pthread_mutex_lock( &self->mutex );
+	self->complete = 1;
+	pthread_mutex_unlock( &self->mutex );
+
+	return NULL;
+}
+
+/** Open the peaks of a resource.
+ *
+ * The peaks are loaded from the sidecar file when it matches the resource,
+ * or else built in the background.
+ *
+ * \public \memberof mlt_peaks_s
+ * \param profile the profile to use for the producer and for positions, which must outlive the peaks
+ * \param resource the resource to measure
+ * \return a new peaks object or NULL on error
+ */
+
+mlt_peaks mlt_peaks_open( mlt_profile profile, const char *resource )
+{
+	mlt_peaks self;
+	struct stat file_stat;
+
+	if ( !profile || !resource )
+		return NULL;
+	self = calloc( 1, sizeof( struct mlt_peaks_s ) );
+	if ( !self )
+		return NULL;
+
+	self->resource = strdup( resource );
+	self->profile = profile;
+	self->frequency = PEAKS_FREQUENCY;
+	pthread_mutex_init( &self->mutex, NULL );
+
+	if ( !stat( resource, &file_stat ) && S_ISREG( file_stat.st_mode ) )
+	{
+		self->resource_size = file_stat.st_size;
+		self->resource_mtime = file_stat.st_mtime;
+		self->path = malloc( strlen( resource ) + strlen( ".peaks" ) + 1 );
+		if ( self->path )
+			sprintf( self->path, "%s.peaks", resource );
+	}
+
+	if ( !self->path || !peaks_load( self ) )
+	{
+		self->thread_running = !pthread_create( &self->thread, NULL, peaks_build, self );
+		if ( !self->thread_running )
+			self->complete = 1;
+	}
+
+	return self;
+}
+
+/** Determine if every level of the peaks is final.
+ *
+ * This is also true once the build has stopped early, as on running out of
+ * memory, with whatever peaks it measured.
+ * \public \memberof mlt_peaks_s
+ * \param self a peaks
+ * \return true if the peaks are complete
+ */
+
+int mlt_peaks_is_complete( mlt_peaks self )
+{
+	int result = 0;
+	if ( self )
+	{
+		pthread_mutex_lock( &self->mutex );
+		result = self->complete;
+		pthread_mutex_unlock( &self->mutex );
+	}
+	return result;
+}
+
+/** Get the number of channels measured.
+ *
+ * The peaks keep every channel of the stream.
+ *
+ * \public \memberof mlt_peaks_s
+ * \param self a peaks
+ * \return the number of channels, or 0 until the first audio is measured
+ */
+
+int mlt_peaks_channels( mlt_peaks self )
+{
+	int result = 0;
+	if ( self )
+	{
+		pthread_mutex_lock( &self->mutex );
+		result = self->channels;
+		pthread_mutex_unlock( &self->mutex );
+	}
+	return result;
+}
+
+/** Get the sample rate of the measured audio.
+ *
+ * \public \memberof mlt_peaks_s
+ * \param self a peaks
+ * \return the sample rate in Hertz
+ */
+
+int mlt_peaks_frequency( mlt_peaks self )
+{
+	return self ? self->frequency : 0;
+}
+
+/** Get the duration measured so far.
+ *
+ * \public \memberof mlt_peaks_s
+ * \param self a peaks
+ * \return the number of frames, at the frame rate of the profile, that have peaks
+ */
+
+mlt_position mlt_peaks_length( mlt_peaks self )
+{
+	mlt_position result = 0;
+	if ( self )
+	{
+		pthread_mutex_lock( &self->mutex );
+		result = self->samples * mlt_profile_fps( self->profile ) / self->frequency;
+		pthread_mutex_unlock( &self->mutex );
+	}
+	return result;
+}
+
+/** Get the peaks of one channel over a range of positions.
+ *
+ * The range is divided into \p count equal bins, which are filled from the
+ * coarsest level that still resolves them. Bins without measured audio are set to zero.
+ *
+ * \public \memberof mlt_peaks_s
+ * \param self a peaks
+ * \param channel the 0-based channel index
+ * \param in the first frame of the range
+ * \param out the last frame of the range
+ * \param count the number of bins to fill
+ * \param[out] min the minimum sample of each bin as a fraction of full scale (optional)
+ * \param[out] max the maximum sample of each bin (optional)
+ * \param[out] rms the RMS level of each bin (optional)
+ * \return the number of bins that have measured audio
+ */
+
+int mlt_peaks_get( mlt_peaks self, int channel, mlt_position in, mlt_position out, int count, float *min, float *max, float *rms )
+{
+	double fps, start, span;
+	int64_t size = PEAKS_BASE;
+	int level = 0;
+	int result = 0;
+	int i;
+
+	if ( !self || channel < 0 || channel >= mlt_peaks_channels( self ) || count <= 0 || out < in )
+		return 0;
+
+	fps = mlt_profile_fps( self->profile );
+	start = (double) in * self->frequency / fps;
+	span = (double) ( out + 1 - in ) * self->frequency / fps / count;
+
+	// Pick the coarsest level whose bins are no wider than the output bins
+	while ( level + 1 < PEAKS_LEVELS && size * PEAKS_FACTOR <= span )
+	{
+		size *= PEAKS_FACTOR;
+		level++;
+	}
+
+	pthread_mutex_lock( &self->mutex );
+
+	// While building, the finest level is the most complete
+	if ( !self->complete )
+		while ( level > 0 && self->counts[level] * size < self->counts[0] * PEAKS_BASE )
+			size /= PEAKS_FACTOR, level--;
+
+	for ( i = 0; i < count; i++ )
+	{
+		int64_t first = ( start + i * span ) / size;
+		int64_t last = ceil( ( start + ( i + 1 ) * span ) / size );
+		float lo = 0.0f, hi = 0.0f;
+		double sumsq = 0.0;
+		int n = 0;
+		int64_t b;
+
+		if ( last <= first )
+			last = first + 1;
+		if ( last > self->counts[level] )
+			last = self->counts[level];
+		for ( b = first; b < last; b++ )
+		{
+			peak *p = &self->levels[level][ b * self->channels + channel ];
+			float value;
+			value = p->min / 32767.0f;
+			if ( !n || value < lo )
+				lo = value;
+			value = p->max / 32767.0f;
+			if ( !n || value > hi )
+				hi = value;
+			value = p->rms / 32767.0f;
+			sumsq += value * value;
+			n++;
+		}
+		if ( min )
+			min[i] = lo;
+		if ( max )
+			max[i] = hi;
+		if ( rms )
+			rms[i] = n ? sqrt( sumsq / n ) : 0.0f;
+		if ( n )
+			result++;
+	}
+
+	pthread_mutex_unlock( &self->mutex );
+
+	return result;
+}
+
+/** Close the peaks, stopping the background build.
+ *
+ * \public \memberof mlt_peaks_s
+ * \param self a peaks
+ */
+
+void mlt_peaks_close( mlt_peaks self )
+{
+	int i;
+
+	if ( !self )
+		return;
+	if ( self->thread_running )
+	{
+		self->abort = 1;
+		pthread_join( self->thread, NULL );
+	}
+	if ( self->map )
+	{
+#ifndef WIN32
+		munmap( self->map, self->map_size );
+#else
+		free( self->map );
+#endif
+	}
+	else
+	{
+		for ( i = 0; i < PEAKS_LEVELS; i++ )
+			free( self->levels[i] );
+	}
+	pthread_mutex_destroy( &self->mutex );
+	free( self->resource );
+	free( self->path );
+	free( self );
+}
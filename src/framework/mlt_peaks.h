@@ -0,0 +1,36 @@
+/**
+ * \file mlt_peaks.h
+ * \brief multi-resolution audio peak cache
+ * \see mlt_peaks_s
+ *
+ * Copyright (C) 2015 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MLT_PEAKS_H
+#define MLT_PEAKS_H
+
+#include "mlt_types.h"
+
+extern mlt_peaks mlt_peaks_open( mlt_profile profile, const char *resource );
+extern int mlt_peaks_is_complete( mlt_peaks self );
+extern int mlt_peaks_channels( mlt_peaks self );
+extern int mlt_peaks_frequency( mlt_peaks self );
+extern mlt_position mlt_peaks_length( mlt_peaks self );
+extern int mlt_peaks_get( mlt_peaks self, int channel, mlt_position in, mlt_position out, int count, float *min, float *max, float *rms );
+extern void mlt_peaks_close( mlt_peaks self );
+
+#endif
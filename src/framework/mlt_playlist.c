@@ -34,6 +34,9 @@
 /** \brief Virtual playlist entry used by mlt_playlist_s
 */
 
+/** the position index, a Fenwick tree kept as the producer's private instance object */
+#define PLAYLIST_INDEX( self ) ( ( mlt_position* )( self )->parent.local )
+
 struct playlist_entry_s
 {
 	mlt_producer producer;
@@ -102,6 +105,8 @@ mlt_playlist mlt_playlist_init( )
 		self->size = 10;
 		self->list = calloc( self->size, sizeof( playlist_entry * ) );
 		if ( self->list == NULL ) goto error2;
+		self->parent.local = calloc( self->size + 1, sizeof( mlt_position ) );
+		if ( self->parent.local == NULL ) goto error2;
 		
 		mlt_events_register( MLT_PLAYLIST_PROPERTIES( self ), "playlist-next", (mlt_transmitter) mlt_playlist_next );
 		mlt_events_register( MLT_PLAYLIST_PROPERTIES( self ), "playlist-current-changed", (mlt_transmitter) mlt_playlist_current_changed );
@@ -110,6 +115,7 @@ mlt_playlist mlt_playlist_init( )
 	return self;
 error2:
 	free( self->list );
+	free( self->parent.local );
 error1:
 	free( self );
 	return NULL;
@@ -171,57 +177,153 @@ mlt_properties mlt_playlist_properties( mlt_playlist self )
 	return MLT_PRODUCER_PROPERTIES( &self->parent );
 }
 
-/** Refresh the playlist after a clip has been changed.
+/** Refresh one entry from its producer.
  *
  * \private \memberof mlt_playlist_s
  * \param self a playlist
- * \return false
+ * \param i the index of the playlist entry
  */
 
-static int mlt_playlist_virtual_refresh( mlt_playlist self )
+static void mlt_playlist_refresh_entry( mlt_playlist self, int i )
 {
-	// Obtain the properties
-	mlt_properties properties = MLT_PLAYLIST_PROPERTIES( self );
-	int i = 0;
-	mlt_position frame_count = 0;
-
-	for ( i = 0; i < self->count; i ++ )
+	// Get the producer
+	mlt_producer producer = self->list[ i ]->producer;
+	if ( producer )
 	{
-		// Get the producer
-		mlt_producer producer = self->list[ i ]->producer;
-		if ( producer )
-		{
-			int current_length = mlt_producer_get_playtime( producer );
+		int current_length = mlt_producer_get_playtime( producer );
 
-			// Check if the length of the producer has changed
-			if ( self->list[ i ]->frame_in != mlt_producer_get_in( producer ) ||
-				self->list[ i ]->frame_out != mlt_producer_get_out( producer ) )
+		// Check if the length of the producer has changed
+		if ( self->list[ i ]->frame_in != mlt_producer_get_in( producer ) ||
+			self->list[ i ]->frame_out != mlt_producer_get_out( producer ) )
+		{
+			// This clip should be removed...
+			if ( current_length < 1 )
 			{
-				// This clip should be removed...
-				if ( current_length < 1 )
-				{
-					self->list[ i ]->frame_in = 0;
-					self->list[ i ]->frame_out = -1;
-					self->list[ i ]->frame_count = 0;
-				}
-				else
-				{
-					self->list[ i ]->frame_in = mlt_producer_get_in( producer );
-					self->list[ i ]->frame_out = mlt_producer_get_out( producer );
-					self->list[ i ]->frame_count = current_length;
-				}
-
-				// Update the producer_length
-				self->list[ i ]->producer_length = current_length;
+				self->list[ i ]->frame_in = 0;
+				self->list[ i ]->frame_out = -1;
+				self->list[ i ]->frame_count = 0;
 			}
+			else
+			{
+				self->list[ i ]->frame_in = mlt_producer_get_in( producer );
+				self->list[ i ]->frame_out = mlt_producer_get_out( producer );
+				self->list[ i ]->frame_count = current_length;
+			}
+
+			// Update the producer_length
+			self->list[ i ]->producer_length = current_length;
 		}
+	}
+
+	// Calculate the frame_count
+	self->list[ i ]->frame_count = ( self->list[ i ]->frame_out - self->list[ i ]->frame_in + 1 ) * self->list[ i ]->repeat;
+}
+
+/** Rebuild the position index from the entries.
+ *
+ * The index is a Fenwick tree over the frame counts of the entries: element
+ * i, counting from 1, holds the total of the (i & -i) entries that end with
+ * entry i - 1. It gives the start of an entry and the entry at a position
+ * in O(log n), and takes a change of one entry's length in O(log n).
+ *
+ * \private \memberof mlt_playlist_s
+ * \param self a playlist
+ */
+
+static void mlt_playlist_index_build( mlt_playlist self )
+{
+	mlt_position *index = PLAYLIST_INDEX( self );
+	int i;
+
+	for ( i = 1; i <= self->count; i ++ )
+		index[ i ] = self->list[ i - 1 ]->frame_count;
+	for ( i = 1; i <= self->count; i ++ )
+		if ( i + ( i & -i ) <= self->count )
+			index[ i + ( i & -i ) ] += index[ i ];
+}
+
+/** Add to the length of an entry in the position index.
+ *
+ * \private \memberof mlt_playlist_s
+ * \param self a playlist
+ * \param clip the index of the playlist entry
+ * \param delta the change in its frame count
+ */
+
+static void mlt_playlist_index_add( mlt_playlist self, int clip, mlt_position delta )
+{
+	mlt_position *index = PLAYLIST_INDEX( self );
+	int i;
 
-		// Calculate the frame_count
-		self->list[ i ]->frame_count = ( self->list[ i ]->frame_out - self->list[ i ]->frame_in + 1 ) * self->list[ i ]->repeat;
+	for ( i = clip + 1; i <= self->count; i += i & -i )
+		index[ i ] += delta;
+}
 
-		// Update the frame_count for self clip
-		frame_count += self->list[ i ]->frame_count;
+/** Get the total length of the entries before one.
+ *
+ * \private \memberof mlt_playlist_s
+ * \param self a playlist
+ * \param clip the index of the playlist entry
+ * \return the time at which the entry starts
+ */
+
+static mlt_position mlt_playlist_index_sum( mlt_playlist self, int clip )
+{
+	mlt_position *index = PLAYLIST_INDEX( self );
+	mlt_position total = 0;
+	int i;
+
+	for ( i = clip; i > 0; i -= i & -i )
+		total += index[ i ];
+
+	return total;
+}
+
+/** Find the entry at a position.
+ *
+ * Entries with no length are skipped, so this is the first entry that ends
+ * after the position.
+ *
+ * \private \memberof mlt_playlist_s
+ * \param self a playlist
+ * \param position a time relative to the beginning of the playlist
+ * \param[out] start the time at which the entry found starts
+ * \return the index of the playlist entry, or the count if the position is past the end
+ */
+
+static int mlt_playlist_index_find( mlt_playlist self, mlt_position position, mlt_position *start )
+{
+	mlt_position *index = PLAYLIST_INDEX( self );
+	mlt_position total = 0;
+	int clip = 0;
+	int step = 1;
+
+	while ( step * 2 <= self->count )
+		step *= 2;
+	for ( ; step > 0 && self->count > 0; step /= 2 )
+	{
+		if ( clip + step <= self->count && total + index[ clip + step ] <= position )
+		{
+			clip += step;
+			total += index[ clip ];
+		}
 	}
+	*start = total;
+
+	return clip;
+}
+
+/** Update the length properties from the position index.
+ *
+ * \private \memberof mlt_playlist_s
+ * \param self a playlist
+ * \return false
+ */
+
+static int mlt_playlist_virtual_length( mlt_playlist self )
+{
+	mlt_properties properties = MLT_PLAYLIST_PROPERTIES( self );
+	mlt_position frame_count = mlt_playlist_index_sum( self, self->count );
 
 	// Refresh all properties
 	mlt_events_block( properties, properties );
@@ -232,6 +334,42 @@ static int mlt_playlist_virtual_refresh( mlt_playlist self )
 	return 0;
 }
 
+/** Refresh the playlist from all its entries.
+ *
+ * \private \memberof mlt_playlist_s
+ * \param self a playlist
+ * \return false
+ */
+
+static int mlt_playlist_virtual_refresh( mlt_playlist self )
+{
+	int i = 0;
+
+	for ( i = 0; i < self->count; i ++ )
+		mlt_playlist_refresh_entry( self, i );
+	mlt_playlist_index_build( self );
+
+	return mlt_playlist_virtual_length( self );
+}
+
+/** Refresh the playlist after a change to one entry.
+ *
+ * \private \memberof mlt_playlist_s
+ * \param self a playlist
+ * \param clip the index of the playlist entry
+ * \return false
+ */
+
+static int mlt_playlist_virtual_refresh_clip( mlt_playlist self, int clip )
+{
+	mlt_position before = mlt_playlist_index_sum( self, clip + 1 ) - mlt_playlist_index_sum( self, clip );
+
+	mlt_playlist_refresh_entry( self, clip );
+	mlt_playlist_index_add( self, clip, self->list[ clip ]->frame_count - before );
+
+	return mlt_playlist_virtual_length( self );
+}
+
 /** Listener for producers on the playlist.
  *
  * Refreshes the playlist whenever an entry receives producer-changed.
@@ -336,9 +474,10 @@ static int mlt_playlist_virtual_append( mlt_playlist self, mlt_producer source,
 	if ( self->count >= self->size )
 	{
 		int i;
-		self->list = realloc( self->list, ( self->size + 10 ) * sizeof( playlist_entry * ) );
-		for ( i = self->size; i < self->size + 10; i ++ ) self->list[ i ] = NULL;
-		self->size += 10;
+		self->list = realloc( self->list, self->size * 2 * sizeof( playlist_entry * ) );
+		for ( i = self->size; i < self->size * 2; i ++ ) self->list[ i ] = NULL;
+		self->parent.local = realloc( self->parent.local, ( self->size * 2 + 1 ) * sizeof( mlt_position ) );
+		self->size *= 2;
 	}
 
 	// Create the entry
@@ -356,9 +495,14 @@ static int mlt_playlist_virtual_append( mlt_playlist self, mlt_producer source,
 		mlt_properties_set( properties, "eof", "pause" );
 		mlt_producer_set_speed( producer, 0 );
 		self->count ++;
+
+		// Index the new entry with no length for now
+		PLAYLIST_INDEX( self )[ self->count ] = mlt_playlist_index_sum( self, self->count - 1 ) -
+			mlt_playlist_index_sum( self, self->count - ( self->count & -self->count ) );
+		return mlt_playlist_virtual_refresh_clip( self, self->count - 1 );
 	}
 
-	return mlt_playlist_virtual_refresh( self );
+	return mlt_playlist_virtual_length( self );
 }
 
 /** Locate a producer by index.
@@ -375,26 +519,17 @@ static mlt_producer mlt_playlist_locate( mlt_playlist self, mlt_position *positi
 {
 	// Default producer to NULL
 	mlt_producer producer = NULL;
+	mlt_position start = 0;
 
-	// Loop for each producer until found
-	for ( *clip = 0; *clip < self->count; *clip += 1 )
+	// Note that 0 length clips get skipped automatically
+	*clip = mlt_playlist_index_find( self, *position, &start );
+	*position -= start;
+	*total += start;
+
+	if ( *clip < self->count )
 	{
-		// Increment the total
 		*total += self->list[ *clip ]->frame_count;
-
-		// Check if the position indicates that we have found the clip
-		// Note that 0 length clips get skipped automatically
-		if ( *position < self->list[ *clip ]->frame_count )
-		{
-			// Found it, now break
-			producer = self->list[ *clip ]->producer;
-			break;
-		}
-		else
-		{
-			// Decrement position by length of self entry
-			*position -= self->list[ *clip ]->frame_count;
-		}
+		producer = self->list[ *clip ]->producer;
 	}
 
 	return producer;
@@ -529,6 +664,23 @@ static mlt_service mlt_playlist_virtual_seek( mlt_playlist self, int *progressiv
 		int count = self->list[ i ]->frame_count / self->list[ i ]->repeat;
 		*progressive = count == 1;
 		mlt_producer_seek( producer, (int)position % count );
+
+		// Open the next lazy producer if it comes up within the lookahead window
+		mlt_position lookahead = mlt_properties_get( properties, "lazy_lookahead" ) ?
+			mlt_properties_get_position( properties, "lazy_lookahead" ) :
+			( mlt_position )( mlt_producer_get_fps( MLT_PLAYLIST_PRODUCER( self ) ) + 0.5 );
+		mlt_position distance = self->list[ i ]->frame_count - position;
+		int j;
+		for ( j = i + 1; j < self->count && distance <= lookahead; j ++ )
+		{
+			mlt_producer next = mlt_producer_cut_parent( self->list[ j ]->producer );
+			if ( mlt_producer_is_lazy( next ) )
+			{
+				mlt_producer_lazy_open( next );
+				break;
+			}
+			distance += self->list[ j ]->frame_count;
+		}
 	}
 	else if ( !strcmp( eof, "pause" ) && total > 0 )
 	{
@@ -583,24 +735,14 @@ static mlt_producer mlt_playlist_virtual_set_out( mlt_playlist self )
 
 	// Map playlist position to real producer in virtual playlist
 	mlt_position position = mlt_producer_frame( &self->parent );
+	mlt_position start = 0;
 
-	// Loop through the virtual playlist
-	int i = 0;
+	// Find the entry in the virtual playlist
+	int i = mlt_playlist_index_find( self, position, &start );
 
-	for ( i = 0; i < self->count; i ++ )
-	{
-		if ( position < self->list[ i ]->frame_count )
-		{
-			// Found it, now break
-			producer = self->list[ i ]->producer;
-			break;
-		}
-		else
-		{
-			// Decrement position by length of this entry
-			position -= self->list[ i ]->frame_count;
-		}
-	}
+	position -= start;
+	if ( i < self->count )
+		producer = self->list[ i ]->producer;
 
 	// Seek in real producer to relative position
 	if ( i < self->count && self->list[ i ]->frame_out != position )
@@ -610,7 +752,7 @@ static mlt_producer mlt_playlist_virtual_set_out( mlt_playlist self )
 		self->list[ i ]->frame_count = self->list[ i ]->frame_out - self->list[ i ]->frame_in + 1;
 
 		// Refresh the playlist
-		mlt_playlist_virtual_refresh( self );
+		mlt_playlist_virtual_refresh_clip( self, i );
 	}
 
 	return producer;
@@ -627,25 +769,9 @@ int mlt_playlist_current_clip( mlt_playlist self )
 {
 	// Map playlist position to real producer in virtual playlist
 	mlt_position position = mlt_producer_frame( &self->parent );
+	mlt_position start = 0;
 
-	// Loop through the virtual playlist
-	int i = 0;
-
-	for ( i = 0; i < self->count; i ++ )
-	{
-		if ( position < self->list[ i ]->frame_count )
-		{
-			// Found it, now break
-			break;
-		}
-		else
-		{
-			// Decrement position by length of this entry
-			position -= self->list[ i ]->frame_count;
-		}
-	}
-
-	return i;
+	return mlt_playlist_index_find( self, position, &start );
 }
 
 /** Obtain the current clips producer.
@@ -676,9 +802,7 @@ mlt_producer mlt_playlist_current( mlt_playlist self )
 
 mlt_position mlt_playlist_clip( mlt_playlist self, mlt_whence whence, int index )
 {
-	mlt_position position = 0;
 	int absolute_clip = index;
-	int i = 0;
 
 	// Determine the absolute clip
 	switch ( whence )
@@ -703,10 +827,7 @@ mlt_position mlt_playlist_clip( mlt_playlist self, mlt_whence whence, int index
 		absolute_clip = self->count;
 
 	// Now determine the position
-	for ( i = 0; i < absolute_clip; i ++ )
-		position += self->list[ i ]->frame_count;
-
-	return position;
+	return mlt_playlist_index_sum( self, absolute_clip );
 }
 
 /** Get all the info about the clip specified.
@@ -900,6 +1021,7 @@ int mlt_playlist_remove( mlt_playlist self, int where )
 		for ( i = where + 1; i < self->count; i ++ )
 			self->list[ i - 1 ] = self->list[ i ];
 		self->count --;
+		mlt_playlist_index_build( self );
 
 		if ( entry->preservation_hack == 0 )
 		{
@@ -998,6 +1120,7 @@ int mlt_playlist_move( mlt_playlist self, int src, int dest )
 				self->list[ i ] = self->list[ i + 1 ];
 		}
 		self->list[ dest ] = src_entry;
+		mlt_playlist_index_build( self );
 
 		mlt_playlist_get_clip_info( self, &current_info, current );
 		mlt_producer_seek( MLT_PLAYLIST_PRODUCER( self ), current_info.start + position );
@@ -1023,7 +1146,7 @@ int mlt_playlist_repeat_clip( mlt_playlist self, int clip, int repeat )
 	{
 		playlist_entry *entry = self->list[ clip ];
 		entry->repeat = repeat;
-		mlt_playlist_virtual_refresh( self );
+		mlt_playlist_virtual_refresh_clip( self, clip );
 	}
 	return error;
 }
@@ -1077,9 +1200,12 @@ int mlt_playlist_resize_clip( mlt_playlist self, int clip, mlt_position in, mlt_
 			out = t;
 		}
 
+		// Only this entry changes, so skip the full refresh the cut would trigger
+		mlt_event_block( entry->event );
 		mlt_producer_set_in_and_out( producer, in, out );
+		mlt_event_unblock( entry->event );
 		mlt_events_unblock( properties, properties );
-		mlt_playlist_virtual_refresh( self );
+		mlt_playlist_virtual_refresh_clip( self, clip );
 	}
 	return error;
 }
@@ -2184,6 +2310,7 @@ void mlt_playlist_close( mlt_playlist self )
 		mlt_producer_close( &self->blank );
 		mlt_producer_close( &self->parent );
 		free( self->list );
+		free( self->parent.local );
 		free( self );
 	}
 }
@@ -65,6 +65,8 @@ typedef struct playlist_entry_s playlist_entry;
  * \properties \em hide Set to 1 to hide the video (make it an audio-only track),
  * 2 to hide the audio (make it a video-only track), or 3 to hide audio and video (hidden track).
  * This property only applies when using a multitrack or transition.
+ * \properties \em lazy_lookahead the number of frames before a lazy producer comes up
+ * at which to open it, defaults to one second
  * \event \em playlist-next The playlist fires this when it moves to the next item in the list.
  * The listener receives one argument that is the index of the entry that just completed.
  */
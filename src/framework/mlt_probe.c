@@ -0,0 +1,422 @@
+/**
+ * \file mlt_probe.c
+ * \brief cache of what producers learn when they open media
+ * \see mlt_probe_get
+ *
+ * Copyright (C) 2015 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "mlt_probe.h"
+#include "mlt_properties.h"
+#include "mlt_profile.h"
+#include "mlt_factory.h"
+#include "mlt_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/** the first line of a probe file */
+#define PROBE_MAGIC "MLTPROBE 1"
+
+/* Probes are kept for the life of the factory in a properties list of the
+ * global properties, keyed by service, frame rate and resource. Probes of
+ * files are also written to one file each in the directory named by the
+ * MLT_PROBE_CACHE environment variable, so that other processes and later
+ * sessions can use them. Every probe is stamped with the size and
+ * modification time of its file and ignored once they change. Nothing tells
+ * when other resources, such as URLs and devices, change, so their probes are
+ * not kept.
+ */
+
+/** Serialises access to the probes of this process. */
+
+static pthread_mutex_t probe_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Describe the state of the file behind a resource.
+ *
+ * The resource may be prefixed by a service name as in "avformat:clip.mp4".
+ * \private \memberof mlt_probe
+ * \param resource a resource
+ * \param[out] stamp the modification time and size, or an empty string if there is no file
+ * \param size the size of \p stamp
+ */
+
+static void probe_stamp( const char *resource, char *stamp, size_t size )
+{
+	struct stat info;
+	const char *colon = strchr( resource, ':' );
+
+	if ( ( !stat( resource, &info ) || ( colon && !stat( colon + 1, &info ) ) ) && S_ISREG( info.st_mode ) )
+		snprintf( stamp, size, "%lld:%lld", ( long long )info.st_mtime, ( long long )info.st_size );
+	else
+		stamp[0] = '\0';
+}
+
+/** Get the key of a probe.
+ *
+ * Lengths in frames depend on the frame rate, so it is part of the key.
+ * \private \memberof mlt_probe
+ * \param profile the profile or NULL
+ * \param service the service name or NULL
+ * \param resource the resource
+ * \return a new string that the caller must free
+ */
+
+static char *probe_key( mlt_profile profile, const char *service, const char *resource )
+{
+	char *key;
+
+	if ( !service )
+		service = "";
+	key = malloc( strlen( service ) + strlen( resource ) + 26 );
+	if ( key )
+		sprintf( key, "%s\t%d/%d\t%s", service, profile ? profile->frame_rate_num : 0,
+			profile ? profile->frame_rate_den : 0, resource );
+	return key;
+}
+
+/** Copy the public properties that have a value.
+ *
+ * \private \memberof mlt_probe
+ * \param dest the properties to copy to
+ * \param src the properties to copy from
+ */
+
+static void probe_copy( mlt_properties dest, mlt_properties src )
+{
+	int count = mlt_properties_count( src );
+	int i;
+
+	for ( i = 0; i < count; i ++ )
+	{
+		char *name = mlt_properties_get_name( src, i );
+		char *value = mlt_properties_get_value( src, i );
+		if ( name[0] != '_' && value )
+			mlt_properties_set( dest, name, value );
+	}
+}
+
+/** Keep a probe for the rest of the process.
+ *
+ * \private \memberof mlt_probe
+ * \param key the key of the probe
+ * \param probe the probe, which the cache takes
+ */
+
+static void probe_remember( const char *key, mlt_properties probe )
+{
+	pthread_mutex_lock( &probe_mutex );
+	mlt_properties probes = mlt_properties_get_data( mlt_global_properties(), "_mlt_probes", NULL );
+	if ( !probes && mlt_global_properties() )
+	{
+		probes = mlt_properties_new( );
+		mlt_properties_set_data( mlt_global_properties(), "_mlt_probes", probes, 0, ( mlt_destructor )mlt_properties_close, NULL );
+	}
+	if ( probes )
+		mlt_properties_set_data( probes, key, probe, 0, ( mlt_destructor )mlt_properties_close, NULL );
+	else
+		mlt_properties_close( probe );
+	pthread_mutex_unlock( &probe_mutex );
+}
+
+/** Get the name of the probe file for a key.
+ *
+ * \private \memberof mlt_probe
+ * \param key the key of the probe
+ * \return a new string that the caller must free, or NULL if probes are not written
+ */
+
+static char *probe_path( const char *key )
+{
+	const char *directory = getenv( "MLT_PROBE_CACHE" );
+	uint64_t hash = 14695981039346656037ULL;
+	char *path;
+
+	if ( !directory || !*directory )
+		return NULL;
+
+	// FNV-1a
+	for ( ; *key; key ++ )
+	{
+		hash ^= ( unsigned char )*key;
+		hash *= 1099511628211ULL;
+	}
+	path = malloc( strlen( directory ) + 24 );
+	if ( path )
+		sprintf( path, "%s/%016llx.probe", directory, ( unsigned long long )hash );
+	return path;
+}
+
+/** Read a probe file.
+ *
+ * \private \memberof mlt_probe
+ * \param path the probe file
+ * \param key the key of the probe
+ * \param stamp the stamp of the resource
+ * \return the probe or NULL if there is no valid probe file
+ */
+
+static mlt_properties probe_read( const char *path, const char *key, const char *stamp )
+{
+	mlt_properties probe = NULL;
+	FILE *file = fopen( path, "rb" );
+	char *text = NULL;
+	long size = 0;
+
+	if ( file && !fseek( file, 0, SEEK_END ) && ( size = ftell( file ) ) > 0 && !fseek( file, 0, SEEK_SET ) )
+		text = malloc( size + 1 );
+	if ( text && fread( text, 1, size, file ) == ( size_t )size )
+	{
+		char *line = text;
+		char *next = NULL;
+
+		text[ size ] = '\0';
+		next = strchr( line, '\n' );
+		if ( next )
+			*next ++ = '\0';
+		if ( !strcmp( line, PROBE_MAGIC ) )
+			probe = mlt_properties_new( );
+		for ( line = next; probe && line && *line; line = next )
+		{
+			char *value = strchr( line, '=' );
+			char *in, *out;
+
+			next = strchr( line, '\n' );
+			if ( next )
+				*next ++ = '\0';
+			if ( !value )
+				continue;
+			*value ++ = '\0';
+
+			// Unescape backslashes and line breaks
+			for ( in = out = value; *in; in ++ )
+			{
+				if ( *in == '\\' && in[1] )
+				{
+					in ++;
+					*out ++ = *in == 'n' ? '\n' : *in == 'r' ? '\r' : *in;
+				}
+				else
+				{
+					*out ++ = *in;
+				}
+			}
+			*out = '\0';
+			mlt_properties_set( probe, line, value );
+		}
+
+		// A file of another resource with the same hash, or of an older version of the file, does not count
+		if ( probe && ( !mlt_properties_get( probe, "_key" ) || strcmp( key, mlt_properties_get( probe, "_key" ) ) ||
+		                !mlt_properties_get( probe, "_stamp" ) || strcmp( stamp, mlt_properties_get( probe, "_stamp" ) ) ) )
+		{
+			mlt_properties_close( probe );
+			probe = NULL;
+		}
+	}
+	free( text );
+	if ( file )
+		fclose( file );
+	return probe;
+}
+
+/** Write a probe file.
+ *
+ * \private \memberof mlt_probe
+ * \param path the probe file
+ * \param probe the probe
+ */
+
+static void probe_write( const char *path, mlt_properties probe )
+{
+	char *temp = malloc( strlen( path ) + 8 );
+	FILE *file = NULL;
+	int count = mlt_properties_count( probe );
+	int i, error = 0;
+	int fd;
+
+	if ( !temp )
+		return;
+
+	// Each writer gets a file of its own so that they never write the same one
+	sprintf( temp, "%s.XXXXXX", path );
+	fd = mkstemp( temp );
+	if ( fd == -1 )
+	{
+		// Make the directory on first use
+		char *directory = strdup( path );
+		char *slash = strrchr( directory, '/' );
+		if ( slash )
+		{
+			*slash = '\0';
+#ifdef WIN32
+			mkdir( directory );
+#else
+			mkdir( directory, 0777 );
+#endif
+		}
+		free( directory );
+		sprintf( temp, "%s.XXXXXX", path );
+		fd = mkstemp( temp );
+	}
+	if ( fd != -1 )
+	{
+		file = fdopen( fd, "wb" );
+		if ( !file )
+		{
+			close( fd );
+			remove( temp );
+		}
+	}
+	if ( !file )
+	{
+		mlt_log_warning( NULL, "[mlt_probe] unable to write %s\n", path );
+		free( temp );
+		return;
+	}
+
+	fprintf( file, "%s\n", PROBE_MAGIC );
+	for ( i = 0; i < count; i ++ )
+	{
+		char *name = mlt_properties_get_name( probe, i );
+		char *value = mlt_properties_get_value( probe, i );
+		if ( value && !strpbrk( name, "=\\\r\n" ) )
+		{
+			fprintf( file, "%s=", name );
+			for ( ; *value; value ++ )
+			{
+				if ( *value == '\\' )
+					fputs( "\\\\", file );
+				else if ( *value == '\n' )
+					fputs( "\\n", file );
+				else if ( *value == '\r' )
+					fputs( "\\r", file );
+				else
+					fputc( *value, file );
+			}
+			fputc( '\n', file );
+		}
+	}
+	error = ferror( file );
+	error |= fclose( file ) != 0;
+
+	// Replace the probe file in one step so that readers never see a partial one
+#ifdef WIN32
+	if ( !error )
+		remove( path );
+#endif
+	if ( error || rename( temp, path ) )
+		remove( temp );
+	free( temp );
+}
+
+/** Get what a producer learnt when it last opened a resource.
+ *
+ * This looks in the probes of this process and then in the probe files under
+ * MLT_PROBE_CACHE. It does not open the resource. Only files have probes.
+ * \public \memberof mlt_probe
+ * \param profile the profile of the producer
+ * \param service the name of the producer service or NULL
+ * \param resource the resource
+ * \return a new properties list that the caller must close, or NULL if there is no valid probe
+ */
+
+mlt_properties mlt_probe_get( mlt_profile profile, const char *service, const char *resource )
+{
+	mlt_properties result = NULL;
+	char *key = resource ? probe_key( profile, service, resource ) : NULL;
+	char stamp[ 64 ];
+
+	if ( !key )
+		return NULL;
+	probe_stamp( resource, stamp, sizeof( stamp ) );
+	if ( !stamp[0] )
+	{
+		free( key );
+		return NULL;
+	}
+
+	pthread_mutex_lock( &probe_mutex );
+	mlt_properties probes = mlt_properties_get_data( mlt_global_properties(), "_mlt_probes", NULL );
+	mlt_properties probe = probes ? mlt_properties_get_data( probes, key, NULL ) : NULL;
+	if ( probe && !strcmp( stamp, mlt_properties_get( probe, "_stamp" ) ) )
+	{
+		result = mlt_properties_new( );
+		probe_copy( result, probe );
+	}
+	pthread_mutex_unlock( &probe_mutex );
+
+	if ( !result )
+	{
+		char *path = probe_path( key );
+		probe = path ? probe_read( path, key, stamp ) : NULL;
+		if ( probe )
+		{
+			result = mlt_properties_new( );
+			probe_copy( result, probe );
+			probe_remember( key, probe );
+		}
+		free( path );
+	}
+	free( key );
+
+	return result;
+}
+
+/** Remember what a producer learnt when it opened a resource.
+ *
+ * Only properties whose names do not start with an underscore are kept, and
+ * only when the resource is a file.
+ * \public \memberof mlt_probe
+ * \param profile the profile of the producer
+ * \param service the name of the producer service or NULL
+ * \param resource the resource
+ * \param probe the properties to remember
+ */
+
+void mlt_probe_put( mlt_profile profile, const char *service, const char *resource, mlt_properties probe )
+{
+	char *key = resource ? probe_key( profile, service, resource ) : NULL;
+	mlt_properties entry = key ? mlt_properties_new( ) : NULL;
+	char stamp[ 64 ];
+
+	if ( entry )
+	{
+		probe_stamp( resource, stamp, sizeof( stamp ) );
+		if ( stamp[0] )
+		{
+			char *path = probe_path( key );
+			probe_copy( entry, probe );
+			mlt_properties_set( entry, "_key", key );
+			mlt_properties_set( entry, "_stamp", stamp );
+			if ( path )
+				probe_write( path, entry );
+			free( path );
+			probe_remember( key, entry );
+		}
+		else
+		{
+			mlt_properties_close( entry );
+		}
+	}
+	free( key );
+}
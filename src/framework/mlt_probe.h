@@ -0,0 +1,35 @@
+/**
+ * \file mlt_probe.h
+ * \brief cache of what producers learn when they open media
+ * \see mlt_probe_get
+ *
+ * Copyright (C) 2015 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MLT_PROBE_H
+#define MLT_PROBE_H
+
+#include "mlt_types.h"
+
+/** \envvar \em MLT_PROBE_CACHE - a directory in which to keep what producers learn when they open media files.
+ * Without it, probes only last as long as the process.
+ */
+
+extern mlt_properties mlt_probe_get( mlt_profile profile, const char *service, const char *resource );
+extern void mlt_probe_put( mlt_profile profile, const char *service, const char *resource, mlt_properties probe );
+
+#endif
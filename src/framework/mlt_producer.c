@@ -26,6 +26,8 @@
 #include "mlt_parser.h"
 #include "mlt_profile.h"
 #include "mlt_log.h"
+#include "mlt_cache.h"
+#include "mlt_probe.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -36,6 +38,33 @@
 static int producer_get_frame( mlt_service self, mlt_frame_ptr frame, int index );
 static void mlt_producer_property_changed( mlt_service owner, mlt_producer self, char *name );
 static void mlt_producer_service_changed( mlt_service owner, mlt_producer self );
+static int lazy_get_frame( mlt_producer producer, mlt_frame_ptr frame, int index );
+
+/** the name of the service cache that holds the producers behind lazy producers */
+#define LAZY_CACHE "mlt_producer_lazy"
+
+/** the default number of producers that lazy producers keep open */
+#define LAZY_CACHE_SIZE (16)
+
+/** \brief Lazy producer class
+ *
+ * A lazy producer stands in for the producer that mlt_factory_producer would
+ * create from a service and resource. It only creates that producer, and so
+ * only opens the media, when a frame is needed. The producers created are held
+ * in a service cache, which closes the least recently used of them when more
+ * than MLT_LAZY_CACHE (default 16) are open; the next frame opens it again.
+ */
+
+typedef struct producer_lazy_s
+{
+	struct mlt_producer_s parent;
+	char *service;  /**< the service to create, or NULL for the default */
+	char *resource; /**< the resource to open */
+	mlt_properties edited;  /**< the names of the public properties set on the lazy producer */
+	mlt_properties changed; /**< those among them set since they were passed on, with a value of 1 */
+	int failed;     /**< true when the resource could not be opened and a placeholder stands in */
+}
+*producer_lazy;
 
 /* for debugging */
 //#define _MLT_PRODUCER_CHECKS_ 1
@@ -803,7 +832,13 @@ static mlt_producer mlt_producer_clone( mlt_producer self )
 
 	mlt_events_block( mlt_factory_event_object( ), mlt_factory_event_object( ) );
 
-	if ( service != NULL )
+	// The clone of a lazy producer is lazy too
+	if ( mlt_producer_is_lazy( self ) )
+	{
+		producer_lazy lazy = self->child;
+		clone = mlt_producer_lazy_new( profile, lazy->service, lazy->resource, properties );
+	}
+	else if ( service != NULL )
 		clone = mlt_factory_producer( profile, service, resource );
 
 	if ( clone == NULL && resource != NULL )
@@ -1068,6 +1103,325 @@ int mlt_producer_optimise( mlt_producer self )
 	return error;
 }
 
+/** Copy the public properties that have a value.
+ *
+ * \private \memberof producer_lazy_s
+ * \param dest the properties to copy to
+ * \param src the properties to copy from
+ * \param missing only copy properties that \p dest does not have
+ */
+
+static void lazy_copy( mlt_properties dest, mlt_properties src, int missing )
+{
+	int count = mlt_properties_count( src );
+	int i;
+
+	for ( i = 0; i < count; i ++ )
+	{
+		char *name = mlt_properties_get_name( src, i );
+		char *value = mlt_properties_get_value( src, i );
+		if ( name[0] != '_' && value && !( missing && mlt_properties_get( dest, name ) ) )
+			mlt_properties_set( dest, name, value );
+	}
+}
+
+/** Pass on the named properties.
+ *
+ * \private \memberof producer_lazy_s
+ * \param dest the properties to copy to
+ * \param src the properties to copy from
+ * \param names the properties whose names to copy, or only those with a value if \p pending
+ * \param pending only copy the names that have a value, and clear it
+ */
+
+static void lazy_forward( mlt_properties dest, mlt_properties src, mlt_properties names, int pending )
+{
+	int count = mlt_properties_count( names );
+	int i;
+
+	for ( i = 0; i < count; i ++ )
+	{
+		char *name = mlt_properties_get_name( names, i );
+		if ( !pending || mlt_properties_get( names, name ) )
+		{
+			if ( pending )
+				mlt_properties_set( names, name, NULL );
+			mlt_properties_set( dest, name, mlt_properties_get( src, name ) );
+		}
+	}
+}
+
+/** Create the producer that a lazy producer stands in for.
+ *
+ * When the resource cannot be opened, this creates the same placeholder that
+ * the xml producer loads in its place, and remembers the failure so that later
+ * frames do not try to open it again.
+ *
+ * \private \memberof producer_lazy_s
+ * \param self a lazy producer
+ * \return the producer or NULL if not even a placeholder could be created
+ */
+
+static mlt_producer lazy_open( producer_lazy self )
+{
+	mlt_producer producer = &self->parent;
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
+	mlt_profile profile = mlt_service_profile( MLT_PRODUCER_SERVICE( producer ) );
+	mlt_producer real = NULL;
+
+	if ( !self->failed )
+	{
+		real = mlt_factory_producer( profile, self->service, self->resource );
+		if ( !real )
+		{
+			self->failed = 1;
+			mlt_log_error( MLT_PRODUCER_SERVICE( producer ), "failed to open %s\n", self->resource );
+		}
+	}
+	if ( real )
+	{
+		mlt_properties real_properties = MLT_PRODUCER_PROPERTIES( real );
+
+		mlt_properties_set_lcnumeric( real_properties, mlt_properties_get_lcnumeric( properties ) );
+
+		// Only what was set on the lazy producer is passed on, not what probing found
+		lazy_forward( real_properties, properties, self->changed, 1 );
+		lazy_forward( real_properties, properties, self->edited, 0 );
+
+		// Make what opening found out about the media visible on the lazy producer
+		mlt_events_block( properties, self );
+		lazy_copy( properties, real_properties, 1 );
+		mlt_events_unblock( properties, self );
+		mlt_log_debug( MLT_PRODUCER_SERVICE( producer ), "opened %s\n", self->resource );
+	}
+	else
+	{
+		real = mlt_factory_producer( profile, NULL, "+INVALID.txt" );
+		if ( !real )
+			real = mlt_factory_producer( profile, NULL, "colour:red" );
+		if ( real )
+		{
+			mlt_properties real_properties = MLT_PRODUCER_PROPERTIES( real );
+			mlt_properties_set_position( real_properties, "length", mlt_producer_get_length( producer ) );
+			mlt_producer_set_in_and_out( real, mlt_producer_get_in( producer ), mlt_producer_get_out( producer ) );
+		}
+	}
+	return real;
+}
+
+/** Get the producer that a lazy producer stands in for, opening it if needed.
+ *
+ * \private \memberof producer_lazy_s
+ * \param self a lazy producer
+ * \return a cache item holding the producer, which the caller must close
+ */
+
+static mlt_cache_item lazy_item( producer_lazy self )
+{
+	mlt_service service = MLT_PRODUCER_SERVICE( &self->parent );
+	mlt_cache_item item = mlt_service_cache_get( service, LAZY_CACHE );
+
+	if ( !mlt_cache_item_data( item, NULL ) )
+	{
+		mlt_producer real = lazy_open( self );
+		mlt_cache_item_close( item );
+		item = NULL;
+		if ( real )
+		{
+			mlt_service_cache_put( service, LAZY_CACHE, real, 0, ( mlt_destructor )mlt_producer_close );
+			item = mlt_service_cache_get( service, LAZY_CACHE );
+		}
+	}
+	return item;
+}
+
+/** Get a frame from the producer that a lazy producer stands in for.
+ *
+ * \private \memberof producer_lazy_s
+ * \param producer a lazy producer or a clone of it
+ * \param[out] frame a frame by reference
+ * \param index the number of the track or stream
+ * \return true if there was an error
+ */
+
+static int lazy_get_frame( mlt_producer producer, mlt_frame_ptr frame, int index )
+{
+	producer_lazy self = producer->child;
+	mlt_cache_item item = lazy_item( self );
+	mlt_producer real = mlt_cache_item_data( item, NULL );
+
+	if ( real )
+	{
+		mlt_properties frame_properties;
+
+		if ( !self->failed )
+			lazy_forward( MLT_PRODUCER_PROPERTIES( real ), MLT_PRODUCER_PROPERTIES( producer ), self->changed, 1 );
+		mlt_producer_seek( real, mlt_producer_position( producer ) );
+		mlt_producer_set_speed( real, mlt_producer_get_speed( producer ) );
+		mlt_service_get_frame( MLT_PRODUCER_SERVICE( real ), frame, index );
+
+		// The frame comes from the lazy producer, and keeps the real one open
+		frame_properties = MLT_FRAME_PROPERTIES( *frame );
+		mlt_properties_set_data( frame_properties, "_producer", NULL, 0, NULL, NULL );
+		mlt_properties_set_data( frame_properties, "_lazy_producer", item, 0, ( mlt_destructor )mlt_cache_item_close, NULL );
+	}
+	else
+	{
+		*frame = mlt_frame_init( MLT_PRODUCER_SERVICE( producer ) );
+		mlt_frame_set_position( *frame, mlt_producer_position( producer ) );
+	}
+
+	mlt_producer_prepare_next( producer );
+
+	return 0;
+}
+
+/** Note that a property needs to be passed on.
+ *
+ * \private \memberof producer_lazy_s
+ * \param owner the properties that changed
+ * \param self a lazy producer
+ * \param name the name of the property that changed
+ */
+
+static void lazy_property_changed( mlt_properties owner, producer_lazy self, char *name )
+{
+	if ( name[0] != '_' )
+	{
+		mlt_properties_set( self->edited, name, "1" );
+		mlt_properties_set( self->changed, name, "1" );
+	}
+}
+
+/** Close a lazy producer and the producer it stands in for.
+ *
+ * \private \memberof producer_lazy_s
+ * \param self a lazy producer
+ */
+
+static void lazy_close( producer_lazy self )
+{
+	mlt_producer producer = &self->parent;
+
+	mlt_service_cache_purge( MLT_PRODUCER_SERVICE( producer ) );
+	producer->close = NULL;
+	mlt_producer_close( producer );
+	mlt_properties_close( self->edited );
+	mlt_properties_close( self->changed );
+	free( self->service );
+	free( self->resource );
+	free( self );
+}
+
+/** Create a lazy producer.
+ *
+ * A lazy producer has the properties of the producer it stands in for but
+ * creates that producer only when a frame is needed. Unless \p metadata
+ * gives the length, the resource is probed by creating the producer now; what
+ * it finds is kept for the next lazy producer of the same resource.
+ * \public \memberof mlt_producer_s
+ * \param profile the \p mlt_profile to use
+ * \param service the name of the producer service as for mlt_factory_producer, or NULL for the default
+ * \param resource the resource to open
+ * \param metadata properties to set on the lazy producer, or NULL
+ * \return a new producer or NULL if the resource could not be opened
+ */
+
+mlt_producer mlt_producer_lazy_new( mlt_profile profile, const char *service, const char *resource, mlt_properties metadata )
+{
+	producer_lazy self = calloc( 1, sizeof( struct producer_lazy_s ) );
+
+	if ( self && resource && mlt_producer_init( &self->parent, self ) == 0 )
+	{
+		mlt_producer producer = &self->parent;
+		mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
+		char *size = getenv( "MLT_LAZY_CACHE" );
+
+		self->service = service ? strdup( service ) : NULL;
+		self->resource = strdup( resource );
+		self->edited = mlt_properties_new( );
+		self->changed = mlt_properties_new( );
+		producer->get_frame = lazy_get_frame;
+		producer->close = ( mlt_destructor )lazy_close;
+		producer->close_object = self;
+		mlt_properties_set_data( properties, "_profile", profile, 0, NULL, NULL );
+		mlt_properties_set( properties, "mlt_type", "producer" );
+		mlt_service_cache_set_size( MLT_PRODUCER_SERVICE( producer ), LAZY_CACHE,
+			size && atoi( size ) > 0 ? atoi( size ) : LAZY_CACHE_SIZE );
+
+		mlt_properties probe = metadata && mlt_properties_get( metadata, "length" ) ? NULL
+			: mlt_probe_get( profile, service, resource );
+		if ( probe )
+		{
+			lazy_copy( properties, probe, 0 );
+			mlt_properties_close( probe );
+		}
+		else if ( !( metadata && mlt_properties_get( metadata, "length" ) ) )
+		{
+			mlt_producer real = mlt_factory_producer( profile, service, resource );
+			if ( !real )
+			{
+				mlt_producer_close( producer );
+				return NULL;
+			}
+			lazy_copy( properties, MLT_PRODUCER_PROPERTIES( real ), 0 );
+			mlt_probe_put( profile, service, resource, MLT_PRODUCER_PROPERTIES( real ) );
+
+			// It is open now, so keep it until the cache needs the room
+			mlt_service_cache_put( MLT_PRODUCER_SERVICE( producer ), LAZY_CACHE, real, 0, ( mlt_destructor )mlt_producer_close );
+		}
+
+		// From here on, what is set is passed on to the producers opened
+		mlt_events_listen( properties, self, "property-changed", ( mlt_listener )lazy_property_changed );
+		if ( metadata )
+		{
+			lazy_copy( properties, metadata, 0 );
+			if ( !mlt_properties_get( metadata, "out" ) )
+				mlt_properties_set_position( properties, "out", mlt_producer_get_length( producer ) - 1 );
+		}
+		return producer;
+	}
+	free( self );
+	return NULL;
+}
+
+/** Determine if a producer is a lazy producer.
+ *
+ * \public \memberof mlt_producer_s
+ * \param self a producer
+ * \return true if \p self was created by mlt_producer_lazy_new
+ */
+
+int mlt_producer_is_lazy( mlt_producer self )
+{
+	return self != NULL && self->get_frame == lazy_get_frame;
+}
+
+/** Open the producer that a lazy producer stands in for ahead of need.
+ *
+ * This also marks it as recently used. It does nothing for other producers.
+ * \public \memberof mlt_producer_s
+ * \param self a producer
+ * \return true if \p self is a lazy producer whose producer could not be opened,
+ * in which case a placeholder stands in for it
+ */
+
+int mlt_producer_lazy_open( mlt_producer self )
+{
+	int error = 0;
+
+	if ( mlt_producer_is_lazy( self ) )
+	{
+		mlt_service_lock( MLT_PRODUCER_SERVICE( self ) );
+		producer_lazy lazy = self->child;
+		mlt_cache_item item = lazy_item( lazy );
+		error = lazy->failed || mlt_cache_item_data( item, NULL ) == NULL;
+		mlt_cache_item_close( item );
+		mlt_service_unlock( MLT_PRODUCER_SERVICE( self ) );
+	}
+	return error;
+}
+
 /** Close the producer.
  *
  * Destroys the producer and deallocates its resources managed by its
@@ -63,6 +63,8 @@
  * expect the app or user to set the length. The default value of 15000 was chosen
  * to provide something useful - not too long or short and convenient to simply
  * set an out point without necessarily nedding to extend the length.
+ * \envvar \em MLT_LAZY_CACHE - the number of producers that lazy producers keep open, defaults to 16.
+ * Playing a playlist needs about two per track, the current clip and the next.
  * \todo define the media metadata taxonomy
  */
 
@@ -124,6 +126,9 @@ extern int mlt_producer_is_mix( mlt_producer self );
 extern int mlt_producer_is_blank( mlt_producer self );
 extern mlt_producer mlt_producer_cut_parent( mlt_producer self );
 extern int mlt_producer_optimise( mlt_producer self );
+extern mlt_producer mlt_producer_lazy_new( mlt_profile profile, const char *service, const char *resource, mlt_properties metadata );
+extern int mlt_producer_is_lazy( mlt_producer self );
+extern int mlt_producer_lazy_open( mlt_producer self );
 extern void mlt_producer_close( mlt_producer self );
 
 #endif
@@ -44,11 +44,15 @@
 #include <locale.h>
 #include <float.h>
 
+/** the number of properties from which a list chains its hash buckets */
+#define CHAIN_THRESHOLD (100)
+
 /** \brief private implementation of the property list */
 
 typedef struct
 {
 	int hash[ 199 ];
+	int *next;           // links the hash buckets once the list is long, see mlt_properties_add
 	char **name;
 	mlt_property *value;
 	int count;
@@ -57,6 +61,9 @@ typedef struct
 	int ref_count;
 	pthread_mutex_t mutex;
 	locale_t locale;
+	mlt_event_handle changed;  // the property-changed event, resolved on first use
+	int hold_count;            // see mlt_properties_begin_changes
+	mlt_properties held;       // the names changed while held
 }
 property_list;
 
@@ -351,6 +358,35 @@ static inline void mlt_properties_do_mirror( mlt_properties self, const char *na
 	}
 }
 
+/** Notify the listeners that a property changed.
+ *
+ * This fires the property-changed event unless nobody listens to it. While the
+ * changes are held the name is only recorded, see mlt_properties_begin_changes().
+ * \private \memberof mlt_properties_s
+ * \param self a properties list
+ * \param name the name of the property that changed
+ */
+
+static void mlt_properties_changed( mlt_properties self, const char *name )
+{
+	property_list *list = self->local;
+	if ( list->changed == NULL )
+		list->changed = mlt_events_handle( self, "property-changed" );
+	if ( mlt_event_handle_listening( list->changed ) )
+	{
+		if ( list->hold_count > 0 )
+		{
+			if ( list->held == NULL )
+				list->held = mlt_properties_new( );
+			mlt_properties_set_int( list->held, name, 1 );
+		}
+		else
+		{
+			mlt_event_handle_fire( list->changed, name, NULL );
+		}
+	}
+}
+
 /** Increment the reference count.
  *
  * \public \memberof mlt_properties_s
@@ -498,7 +534,19 @@ static inline mlt_property mlt_properties_find( mlt_properties self, const char
 	mlt_properties_lock( self );
 
 	int i = list->hash[ key ] - 1;
-	if ( i >= 0 )
+	if ( list->next )
+	{
+		// Only the names in the same hash bucket need comparing
+		for ( ; i >= 0; i = list->next[ i ] - 1 )
+		{
+			if ( !strcmp( list->name[ i ], name ) )
+			{
+				value = list->value[ i ];
+				break;
+			}
+		}
+	}
+	else if ( i >= 0 )
 	{
 		// Check if we're hashed
 		if ( list->count > 0 &&
@@ -537,15 +585,37 @@ static mlt_property mlt_properties_add( mlt_properties self, const char *name )
 		list->size += 50;
 		list->name = realloc( list->name, list->size * sizeof( const char * ) );
 		list->value = realloc( list->value, list->size * sizeof( mlt_property ) );
+		if ( list->next )
+			list->next = realloc( list->next, list->size * sizeof( int ) );
 	}
 
 	// Assign name/value pair
 	list->name[ list->count ] = strdup( name );
 	list->value[ list->count ] = mlt_property_init( );
 
-	// Assign to hash table
-	if ( list->hash[ key ] == 0 )
+	// A short list only hashes the first name of each bucket and searches
+	// the rest, but a long one chains every bucket to keep lookups quick
+	if ( !list->next && list->count >= CHAIN_THRESHOLD )
+	{
+		int i;
+		list->next = malloc( list->size * sizeof( int ) );
+		memset( list->hash, 0, sizeof( list->hash ) );
+		for ( i = 0; i < list->count; i ++ )
+		{
+			int bucket = generate_hash( list->name[ i ] );
+			list->next[ i ] = list->hash[ bucket ];
+			list->hash[ bucket ] = i + 1;
+		}
+	}
+	if ( list->next )
+	{
+		list->next[ list->count ] = list->hash[ key ];
+		list->hash[ key ] = list->count + 1;
+	}
+	else if ( list->hash[ key ] == 0 )
+	{
 		list->hash[ key ] = list->count + 1;
+	}
 
 	// Return and increment count accordingly
 	result = list->value[ list->count ++ ];
@@ -737,7 +807,7 @@ int mlt_properties_set( mlt_properties self, const char *name, const char *value
 		mlt_properties_do_mirror( self, name );
 	}
 
-	mlt_events_fire( self, "property-changed", name, NULL );
+	mlt_properties_changed( self, name );
 
 	return error;
 }
@@ -941,7 +1011,7 @@ int mlt_properties_set_int( mlt_properties self, const char *name, int value )
 		mlt_properties_do_mirror( self, name );
 	}
 
-	mlt_events_fire( self, "property-changed", name, NULL );
+	mlt_properties_changed( self, name );
 
 	return error;
 }
@@ -985,7 +1055,7 @@ int mlt_properties_set_int64( mlt_properties self, const char *name, int64_t val
 		mlt_properties_do_mirror( self, name );
 	}
 
-	mlt_events_fire( self, "property-changed", name, NULL );
+	mlt_properties_changed( self, name );
 
 	return error;
 }
@@ -1037,7 +1107,7 @@ int mlt_properties_set_double( mlt_properties self, const char *name, double val
 		mlt_properties_do_mirror( self, name );
 	}
 
-	mlt_events_fire( self, "property-changed", name, NULL );
+	mlt_properties_changed( self, name );
 
 	return error;
 }
@@ -1089,7 +1159,7 @@ int mlt_properties_set_position( mlt_properties self, const char *name, mlt_posi
 		mlt_properties_do_mirror( self, name );
 	}
 
-	mlt_events_fire( self, "property-changed", name, NULL );
+	mlt_properties_changed( self, name );
 
 	return error;
 }
@@ -1135,7 +1205,7 @@ int mlt_properties_set_data( mlt_properties self, const char *name, void *value,
 	if ( property != NULL )
 		error = mlt_property_set_data( property, value, length, destroy, serialise );
 
-	mlt_events_fire( self, "property-changed", name, NULL );
+	mlt_properties_changed( self, name );
 
 	return error;
 }
@@ -1164,6 +1234,16 @@ int mlt_properties_rename( mlt_properties self, const char *source, const char *
 		{
 			if ( !strcmp( list->name[ i ], source ) )
 			{
+				if ( list->next )
+				{
+					// Move it from the hash bucket of the old name to that of the new one
+					int *link = &list->hash[ generate_hash( source ) ];
+					while ( *link && *link != i + 1 )
+						link = &list->next[ *link - 1 ];
+					if ( *link )
+						*link = list->next[ i ];
+					list->next[ i ] = list->hash[ generate_hash( dest ) ];
+				}
 				free( list->name[ i ] );
 				list->name[ i ] = strdup( dest );
 				list->hash[ generate_hash( dest ) ] = i + 1;
@@ -1408,6 +1488,8 @@ void mlt_properties_close( mlt_properties self )
 			pthread_mutex_destroy( &list->mutex );
 			free( list->name );
 			free( list->value );
+			free( list->next );
+			mlt_properties_close( list->held );
 			free( list );
 
 			// Free self now if self has no child
@@ -2074,6 +2156,48 @@ void mlt_properties_unlock( mlt_properties self )
 		pthread_mutex_unlock( &( ( property_list* )( self->local ) )->mutex );
 }
 
+/** Begin a batch of property changes.
+ *
+ * Until the matching mlt_properties_end_changes() the property-changed event is
+ * held back, and it fires once for each property that changed when the batch ends,
+ * no matter how often the property was set. Batches may be nested.
+ * \public \memberof mlt_properties_s
+ * \param self a properties list
+ */
+
+void mlt_properties_begin_changes( mlt_properties self )
+{
+	if ( self )
+		( ( property_list* )( self->local ) )->hold_count ++;
+}
+
+/** End a batch of property changes.
+ *
+ * When the outermost batch ends, this fires the property-changed event for each
+ * property that changed during the batch, in the order in which they first changed.
+ * \public \memberof mlt_properties_s
+ * \param self a properties list
+ */
+
+void mlt_properties_end_changes( mlt_properties self )
+{
+	if ( self )
+	{
+		property_list *list = self->local;
+		if ( list->hold_count > 0 && -- list->hold_count == 0 && list->held != NULL )
+		{
+			mlt_properties held = list->held;
+			int i = 0;
+
+			// Listeners may change properties in response
+			list->held = NULL;
+			for ( i = 0; i < mlt_properties_count( held ); i ++ )
+				mlt_event_handle_fire( list->changed, mlt_properties_get_name( held, i ), NULL );
+			mlt_properties_close( held );
+		}
+	}
+}
+
 /** Get a time string associated to the name.
  *
  * Do not free the returned string. It's lifetime is controlled by the property.
@@ -2213,7 +2337,7 @@ int mlt_properties_set_color( mlt_properties self, const char *name, mlt_color c
 		mlt_properties_do_mirror( self, name );
 	}
 
-	mlt_events_fire( self, "property-changed", name, NULL );
+	mlt_properties_changed( self, name );
 
 	return error;
 }
@@ -2275,7 +2399,7 @@ int mlt_properties_anim_set( mlt_properties self, const char *name, const char *
 		mlt_properties_do_mirror( self, name );
 	}
 
-	mlt_events_fire( self, "property-changed", name, NULL );
+	mlt_properties_changed( self, name );
 
 	return error;
 }
@@ -2333,7 +2457,7 @@ int mlt_properties_anim_set_int( mlt_properties self, const char *name, int valu
 		mlt_properties_do_mirror( self, name );
 	}
 
-	mlt_events_fire( self, "property-changed", name, NULL );
+	mlt_properties_changed( self, name );
 
 	return error;
 }
@@ -2391,7 +2515,7 @@ int mlt_properties_anim_set_double( mlt_properties self, const char *name, doubl
 		mlt_properties_do_mirror( self, name );
 	}
 
-	mlt_events_fire( self, "property-changed", name, NULL );
+	mlt_properties_changed( self, name );
 
 	return error;
 }
@@ -2435,7 +2559,7 @@ extern int mlt_properties_set_rect( mlt_properties self, const char *name, mlt_r
 		mlt_properties_do_mirror( self, name );
 	}
 
-	mlt_events_fire( self, "property-changed", name, NULL );
+	mlt_properties_changed( self, name );
 
 	return error;
 }
@@ -2489,7 +2613,7 @@ extern int mlt_properties_anim_set_rect( mlt_properties self, const char *name,
 		mlt_properties_do_mirror( self, name );
 	}
 
-	mlt_events_fire( self, "property-changed", name, NULL );
+	mlt_properties_changed( self, name );
 
 	return error;
 }
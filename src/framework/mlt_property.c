@@ -53,6 +53,21 @@ typedef enum
 }
 mlt_property_type;
 
+/** Bit pattern used internally to indicate which conversions of the string are memoised.
+*/
+
+typedef enum
+{
+	mlt_cache_none = 0,   //!< nothing memoised
+	mlt_cache_int = 1,    //!< the integer and position conversion
+	mlt_cache_double = 2, //!< the floating point conversion
+	mlt_cache_int64 = 4   //!< the 64-bit integer conversion
+}
+mlt_property_cache;
+
+/** The bits of the memoised conversions below the generation of the value. */
+#define CACHE_BITS (3)
+
 /** \brief Property class
  *
  * A property is like a variant or dynamic type. They are used for many things
@@ -81,6 +96,19 @@ struct mlt_property_s
 
 	pthread_mutex_t mutex;
 	mlt_animation animation;
+
+	/// Memoised conversions of prop_string, below the generation of the value
+	unsigned int cached;
+	int caching;
+	double cache_fps;
+	locale_t cache_locale;
+	int cache_int;
+	double cache_double;
+	int64_t cache_int64;
+
+	/// Whether animation was last parsed or refreshed from the current prop_string
+	int animation_current;
+	int animation_length;
 };
 
 /** Construct a property and initialize it
@@ -95,6 +123,19 @@ mlt_property mlt_property_init( )
 	return self;
 }
 
+/** Forget the memoised conversions and start a new generation of the value.
+ *
+ * A conversion of the previous value that is still running can no longer be published.
+ * \private \memberof mlt_property_s
+ * \param self a property
+ */
+
+static inline void mlt_property_cache_reset( mlt_property self )
+{
+	unsigned int generation = ( self->cached >> CACHE_BITS ) + 1;
+	__sync_lock_test_and_set( &self->cached, generation << CACHE_BITS );
+}
+
 /** Clear (0/null) a property.
  *
  * Frees up any associated resources in the process.
@@ -126,6 +167,110 @@ static inline void mlt_property_clear( mlt_property self )
 	self->destructor = NULL;
 	self->serialiser = NULL;
 	self->animation = NULL;
+	mlt_property_cache_reset( self );
+	self->animation_current = 0;
+}
+
+/** Forget what was derived from the string after it is replaced in place.
+ *
+ * \private \memberof mlt_property_s
+ * \param self a property
+ */
+
+static inline void mlt_property_string_changed( mlt_property self )
+{
+	mlt_property_cache_reset( self );
+	self->animation_current = 0;
+}
+
+/** Get the generation of the value, to read before converting the string.
+ *
+ * \private \memberof mlt_property_s
+ * \param self a property
+ * \return the generation
+ */
+
+static inline unsigned int mlt_property_cache_generation( mlt_property self )
+{
+	return __sync_fetch_and_add( &self->cached, 0 ) >> CACHE_BITS;
+}
+
+/** Start memoising a conversion of the string.
+ *
+ * Only one thread stores a conversion at a time, and a conversion is only
+ * stored for the frame rate and locale of the first one stored, so readers
+ * never see a value change under them until the property is set again.
+ * A conversion is also refused once the value it came from was replaced.
+ * \private \memberof mlt_property_s
+ * \param self a property
+ * \param generation the generation read before converting
+ * \param contextual whether the conversion depends on the frame rate and locale
+ * \param fps frames per second
+ * \param locale the locale
+ * \return true if the caller should store the value and call mlt_property_cache_end()
+ */
+
+static int mlt_property_cache_begin( mlt_property self, unsigned int generation, int contextual, double fps, locale_t locale )
+{
+	if ( !__sync_bool_compare_and_swap( &self->caching, 0, 1 ) )
+		return 0;
+	if ( mlt_property_cache_generation( self ) != generation )
+	{
+		__sync_lock_release( &self->caching );
+		return 0;
+	}
+	if ( contextual )
+	{
+		if ( !( self->cached & ( mlt_cache_int | mlt_cache_double ) ) )
+		{
+			self->cache_fps = fps;
+			self->cache_locale = locale;
+		}
+		else if ( fps != self->cache_fps || locale != self->cache_locale )
+		{
+			__sync_lock_release( &self->caching );
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/** Publish a memoised conversion of the string.
+ *
+ * Nothing is published if a setter started a new generation meanwhile.
+ * \private \memberof mlt_property_s
+ * \param self a property
+ * \param generation the generation read before converting
+ * \param which the conversion that was stored
+ */
+
+static void mlt_property_cache_end( mlt_property self, unsigned int generation, mlt_property_cache which )
+{
+	unsigned int cached = self->cached;
+	if ( cached >> CACHE_BITS == generation )
+		__sync_bool_compare_and_swap( &self->cached, cached, cached | which );
+	__sync_lock_release( &self->caching );
+}
+
+/** Check for a memoised conversion of the string.
+ *
+ * \private \memberof mlt_property_s
+ * \param self a property
+ * \param which the conversion wanted
+ * \param fps frames per second
+ * \param locale the locale
+ * \return true if the memoised value may be used
+ */
+
+static inline int mlt_property_is_cached( mlt_property self, mlt_property_cache which, double fps, locale_t locale )
+{
+	if ( self->cached & which )
+	{
+		// Read the value and its context only after seeing it published
+		__sync_synchronize();
+		return which == mlt_cache_int64 || ( fps == self->cache_fps && locale == self->cache_locale );
+	}
+	return 0;
 }
 
 /** Set the property to an integer value.
@@ -206,6 +351,7 @@ int mlt_property_set_string( mlt_property self, const char *value )
 	else
 	{
 		self->types = mlt_prop_string;
+		mlt_property_string_changed( self );
 	}
 	pthread_mutex_unlock( &self->mutex );
 	return self->prop_string == NULL;
@@ -434,6 +580,31 @@ static int mlt_property_atoi( mlt_property self, double fps, locale_t locale )
 	}
 }
 
+/** Convert the string to an integer, memoising the result.
+ *
+ * \private \memberof mlt_property_s
+ * \param self a property
+ * \param fps frames per second, used when converting from time value
+ * \param locale the locale to use when converting from time clock value
+ * \return the resultant integer
+ */
+
+static int mlt_property_string_to_int( mlt_property self, double fps, locale_t locale )
+{
+	unsigned int generation = mlt_property_cache_generation( self );
+	int value;
+
+	if ( mlt_property_is_cached( self, mlt_cache_int, fps, locale ) )
+		return self->cache_int;
+	value = mlt_property_atoi( self, fps, locale );
+	if ( mlt_property_cache_begin( self, generation, 1, fps, locale ) )
+	{
+		self->cache_int = value;
+		mlt_property_cache_end( self, generation, mlt_cache_int );
+	}
+	return value;
+}
+
 /** Get the property as an integer.
  *
  * \public \memberof mlt_property_s
@@ -456,7 +627,7 @@ int mlt_property_get_int( mlt_property self, double fps, locale_t locale )
 	else if ( self->types & mlt_prop_rect && self->data )
 		return ( int ) ( (mlt_rect*) self->data )->x;
 	else if ( ( self->types & mlt_prop_string ) && self->prop_string )
-		return mlt_property_atoi( self, fps, locale );
+		return mlt_property_string_to_int( self, fps, locale );
 	return 0;
 }
 
@@ -524,6 +695,31 @@ static double mlt_property_atof( mlt_property self, double fps, locale_t locale
 	}
 }
 
+/** Convert the string to a floating point number, memoising the result.
+ *
+ * \private \memberof mlt_property_s
+ * \param self a property
+ * \param fps frames per second, used when converting from time value
+ * \param locale the locale to use when converting from time clock value
+ * \return the resultant real number
+ */
+
+static double mlt_property_string_to_double( mlt_property self, double fps, locale_t locale )
+{
+	unsigned int generation = mlt_property_cache_generation( self );
+	double value;
+
+	if ( mlt_property_is_cached( self, mlt_cache_double, fps, locale ) )
+		return self->cache_double;
+	value = mlt_property_atof( self, fps, locale );
+	if ( mlt_property_cache_begin( self, generation, 1, fps, locale ) )
+	{
+		self->cache_double = value;
+		mlt_property_cache_end( self, generation, mlt_cache_double );
+	}
+	return value;
+}
+
 /** Get the property as a floating point.
  *
  * \public \memberof mlt_property_s
@@ -546,7 +742,7 @@ double mlt_property_get_double( mlt_property self, double fps, locale_t locale )
 	else if ( self->types & mlt_prop_rect && self->data )
 		return ( (mlt_rect*) self->data )->x;
 	else if ( ( self->types & mlt_prop_string ) && self->prop_string )
-		return mlt_property_atof( self, fps, locale );
+		return mlt_property_string_to_double( self, fps, locale );
 	return 0;
 }
 
@@ -573,7 +769,7 @@ mlt_position mlt_property_get_position( mlt_property self, double fps, locale_t
 	else if ( self->types & mlt_prop_rect && self->data )
 		return ( mlt_position ) ( (mlt_rect*) self->data )->x;
 	else if ( ( self->types & mlt_prop_string ) && self->prop_string )
-		return ( mlt_position )mlt_property_atoi( self, fps, locale );
+		return ( mlt_position )mlt_property_string_to_int( self, fps, locale );
 	return 0;
 }
 
@@ -595,6 +791,29 @@ static inline int64_t mlt_property_atoll( const char *value )
 		return strtoll( value, NULL, 10 );
 }
 
+/** Convert the string to a 64-bit integer, memoising the result.
+ *
+ * \private \memberof mlt_property_s
+ * \param self a property
+ * \return a 64-bit integer
+ */
+
+static int64_t mlt_property_string_to_int64( mlt_property self )
+{
+	unsigned int generation = mlt_property_cache_generation( self );
+	int64_t value;
+
+	if ( mlt_property_is_cached( self, mlt_cache_int64, 0, NULL ) )
+		return self->cache_int64;
+	value = mlt_property_atoll( self->prop_string );
+	if ( mlt_property_cache_begin( self, generation, 0, 0, NULL ) )
+	{
+		self->cache_int64 = value;
+		mlt_property_cache_end( self, generation, mlt_cache_int64 );
+	}
+	return value;
+}
+
 /** Get the property as a signed integer.
  *
  * \public \memberof mlt_property_s
@@ -615,7 +834,7 @@ int64_t mlt_property_get_int64( mlt_property self )
 	else if ( self->types & mlt_prop_rect && self->data )
 		return ( int64_t ) ( (mlt_rect*) self->data )->x;
 	else if ( ( self->types & mlt_prop_string ) && self->prop_string )
-		return mlt_property_atoll( self->prop_string );
+		return mlt_property_string_to_int64( self );
 	return 0;
 }
 
@@ -1003,13 +1222,13 @@ char *mlt_property_get_time( mlt_property self, mlt_time_format format, double f
 
 /** Determine if the property holds a numeric or numeric string value.
  *
- * \private \memberof mlt_property_s
+ * \public \memberof mlt_property_s
  * \param self a property
  * \param locale the locale to use for string evaluation
  * \return true if it is numeric
  */
 
-static int is_property_numeric( mlt_property self, locale_t locale )
+int mlt_property_is_numeric( mlt_property self, locale_t locale )
 {
 	int result = ( self->types & mlt_prop_int ) ||
 			( self->types & mlt_prop_int64 ) ||
@@ -1057,6 +1276,18 @@ static int is_property_numeric( mlt_property self, locale_t locale )
 	return result;
 }
 
+/** Determine if the property holds a rectangle.
+ *
+ * \public \memberof mlt_property_s
+ * \param self a property
+ * \return true if it is a rectangle
+ */
+
+int mlt_property_is_rect( mlt_property self )
+{
+	return ( self->types & mlt_prop_rect ) != 0;
+}
+
 /** A linear interpolation function for animation.
  *
  * \private \memberof mlt_property_s
@@ -1103,7 +1334,7 @@ int mlt_property_interpolate( mlt_property self, mlt_property p[],
 {
 	int error = 0;
 	if ( interp != mlt_keyframe_discrete &&
-		is_property_numeric( p[1], locale ) && is_property_numeric( p[2], locale ) )
+		mlt_property_is_numeric( p[1], locale ) && mlt_property_is_numeric( p[2], locale ) )
 	{
 		if ( self->types & mlt_prop_rect )
 		{
@@ -1181,6 +1412,8 @@ int mlt_property_interpolate( mlt_property self, mlt_property p[],
 
 /** Create a new animation or refresh an existing one.
  *
+ * An existing animation is only compared with the string again after the
+ * string or the length changes.
  * \private \memberof mlt_property_s
  * \param self a property
  * \param fps the frame rate, which may be needed for converting a time string to frame units
@@ -1197,6 +1430,8 @@ static void refresh_animation( mlt_property self, double fps, locale_t locale, i
 		if ( self->prop_string )
 		{
 			mlt_animation_parse( self->animation, self->prop_string, length, fps, locale );
+			self->animation_current = 1;
+			self->animation_length = length;
 		}
 		else
 		{
@@ -1206,9 +1441,11 @@ static void refresh_animation( mlt_property self, double fps, locale_t locale, i
 			self->serialiser = (mlt_serialiser) mlt_animation_serialize;
 		}
 	}
-	else if ( self->prop_string )
+	else if ( self->prop_string && ( !self->animation_current || length != self->animation_length ) )
 	{
 		mlt_animation_refresh( self->animation, self->prop_string, length );
+		self->animation_current = 1;
+		self->animation_length = length;
 	}
 }
 
@@ -1308,6 +1545,7 @@ char* mlt_property_anim_get_string( mlt_property self, double fps, locale_t loca
 		mlt_animation_get_item( self->animation, &item, position );
 
 		free( self->prop_string );
+		mlt_property_string_changed( self );
 
 		pthread_mutex_unlock( &self->mutex );
 		self->prop_string = mlt_property_get_string_l( item.property, locale );
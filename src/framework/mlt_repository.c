@@ -25,21 +25,46 @@
 #include "mlt_tokeniser.h"
 #include "mlt_log.h"
 #include "mlt_factory.h"
+#include "mlt_version.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <dlfcn.h>
 #include <string.h>
 #include <limits.h>
 #include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
+/** the first line of a service index */
+#define INDEX_MAGIC "MLTSERVICES 1"
+
+/** the start of a 64-bit FNV-1a hash */
+#define HASH_START 14695981039346656037ULL
+
+/** how many levels of subdirectories a watched directory stamp covers */
+#define WATCH_DEPTH 8
+
 /** \brief Repository class
  *
  * The Repository is a collection of plugin modules and their services and service metadata.
  *
+ * Scanning the modules means opening every one of them along with the
+ * libraries they need. So the services that a scan finds are written to an
+ * index, and while the index matches the modules, services are registered
+ * from it and a module is only opened when one of its services is first
+ * created or asked for its metadata. Modules that find their services in
+ * plugin directories of their own tell the repository about them with
+ * mlt_repository_watch() so that the index also follows those directories,
+ * as do modules whose services depend on the version of a shared library.
+ *
  * \extends mlt_properties_s
  * \properties \p language a cached list of user locales
+ * \envvar \em MLT_REPOSITORY_INDEX - the file in which to keep the service index, defaults to
+ * services-<hash of the modules directory>.index in $XDG_CACHE_HOME/mlt or $HOME/.cache/mlt.
+ * Set it to an empty string to open all modules at startup.
  */
 
 struct mlt_repository_s
@@ -49,8 +74,457 @@ struct mlt_repository_s
 	mlt_properties filters;         /// a list of entry points for filters
 	mlt_properties producers;       /// a list of entry points for producers
 	mlt_properties transitions;     /// a list of entry points for transitions
+	mlt_properties environment;     /// the stamps of the environment variables that a scan watched
+	mlt_properties directories;     /// the stamps of the plugin directories that a scan watched
+	int lazy;                       /// whether the services were registered from the index
+	const char *loading;            /// the object file whose services are being registered
+	pthread_mutex_t mutex;          /// serialises opening modules on demand
 };
 
+/** Get the list of services of a service class.
+ *
+ * \private \memberof mlt_repository_s
+ * \param self a repository
+ * \param type a service class
+ * \return a properties list or NULL if error
+ */
+
+static mlt_properties get_services( mlt_repository self, mlt_service_type type )
+{
+	switch ( type )
+	{
+		case consumer_type:
+			return self->consumers;
+		case filter_type:
+			return self->filters;
+		case producer_type:
+			return self->producers;
+		case transition_type:
+			return self->transitions;
+		default:
+			return NULL;
+	}
+}
+
+/** Open a module and register its services.
+ *
+ * \private \memberof mlt_repository_s
+ * \param self a repository
+ * \param object_name the full path of the module
+ * \return true if the module registered itself
+ */
+
+static int open_module( mlt_repository self, const char *object_name )
+{
+	int flags = RTLD_NOW;
+
+	// Very temporary hack to allow the quicktime plugins to work
+	// TODO: extend repository to allow this to be used on a case by case basis
+	if ( strstr( object_name, "libmltkino" ) )
+		flags |= RTLD_GLOBAL;
+
+	// Open the shared object
+	void *object = dlopen( object_name, flags );
+	if ( object != NULL )
+	{
+		// Get the registration function
+		mlt_repository_callback symbol_ptr = dlsym( object, "mlt_register" );
+
+		// Call the registration function
+		if ( symbol_ptr != NULL )
+		{
+			self->loading = object_name;
+			symbol_ptr( self );
+			self->loading = NULL;
+
+			// Register the object file for closure
+			mlt_properties_set_data( &self->parent, object_name, object, 0, ( mlt_destructor )dlclose, NULL );
+			return 1;
+		}
+		else
+		{
+			dlclose( object );
+		}
+	}
+	else if ( strstr( object_name, "libmlt" ) )
+	{
+		mlt_log_warning( NULL, "%s: failed to dlopen %s\n  (%s)\n", __FUNCTION__, object_name, dlerror() );
+	}
+	return 0;
+}
+
+/** Describe the state of a module or library file.
+ *
+ * \private \memberof mlt_repository_s
+ * \param object_name the full path of the file
+ * \param[out] stamp the modification time and size, or "-" if not a file
+ * \param size the size of \p stamp
+ */
+
+static void module_stamp( const char *object_name, char *stamp, size_t size )
+{
+	struct stat info;
+
+	// Not the directories listed with the modules, whose times change with their contents
+	if ( !stat( object_name, &info ) && S_ISREG( info.st_mode ) )
+		snprintf( stamp, size, "%lld:%lld", ( long long )info.st_mtime, ( long long )info.st_size );
+	else
+		snprintf( stamp, size, "-" );
+}
+
+/** Add a string to a 64-bit FNV-1a hash.
+ *
+ * \private \memberof mlt_repository_s
+ * \param hash the hash so far
+ * \param text a string
+ * \return the new hash
+ */
+
+static uint64_t hash_string( uint64_t hash, const char *text )
+{
+	for ( ; *text; text ++ )
+	{
+		hash ^= ( unsigned char )*text;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/** Describe the state of an environment variable.
+ *
+ * \private \memberof mlt_repository_s
+ * \param variable the name of an environment variable
+ * \param[out] stamp a hash of the value or "-" if not set
+ * \param size the size of \p stamp
+ */
+
+static void environment_stamp( const char *variable, char *stamp, size_t size )
+{
+	const char *value = getenv( variable );
+
+	if ( value )
+		snprintf( stamp, size, "%016llx", ( unsigned long long )hash_string( HASH_START, value ) );
+	else
+		snprintf( stamp, size, "-" );
+}
+
+/** Hash the modification times of a directory and its subdirectories.
+ *
+ * Adding or removing a file changes the modification time of its directory,
+ * and the hashes of the subdirectories are summed so that the order in which
+ * they are read does not matter.
+ * \private \memberof mlt_repository_s
+ * \param directory the full path of a directory
+ * \param depth how many levels of subdirectories to include
+ * \return the hash or 0 if \p directory is not a directory
+ */
+
+static uint64_t directory_hash( const char *directory, int depth )
+{
+	struct stat info;
+	char time[ 32 ];
+	uint64_t hash;
+	DIR *dir;
+	struct dirent *entry;
+
+	if ( stat( directory, &info ) || !S_ISDIR( info.st_mode ) )
+		return 0;
+	snprintf( time, sizeof( time ), ":%lld", ( long long )info.st_mtime );
+	hash = hash_string( hash_string( HASH_START, directory ), time );
+
+	dir = depth > 0 ? opendir( directory ) : NULL;
+	while ( dir && ( entry = readdir( dir ) ) )
+	{
+		char *path;
+
+		if ( entry->d_name[0] == '.' )
+			continue;
+#ifdef _DIRENT_HAVE_D_TYPE
+		if ( entry->d_type != DT_DIR && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN )
+			continue;
+#endif
+		path = malloc( strlen( directory ) + strlen( entry->d_name ) + 2 );
+		if ( path )
+		{
+			sprintf( path, "%s/%s", directory, entry->d_name );
+			hash += directory_hash( path, depth - 1 );
+			free( path );
+		}
+	}
+	if ( dir )
+		closedir( dir );
+
+	return hash;
+}
+
+/** Describe the state of a plugin directory or library.
+ *
+ * \private \memberof mlt_repository_s
+ * \param directory the full path of a directory or file
+ * \param[out] stamp a hash of the modification times of a directory, the
+ * modification time and size of a file, or "-" if neither
+ * \param size the size of \p stamp
+ */
+
+static void directory_stamp( const char *directory, char *stamp, size_t size )
+{
+	struct stat info;
+	uint64_t hash;
+
+	if ( !stat( directory, &info ) && S_ISREG( info.st_mode ) )
+	{
+		module_stamp( directory, stamp, size );
+		return;
+	}
+	hash = directory_hash( directory, WATCH_DEPTH );
+	if ( hash )
+		snprintf( stamp, size, "%016llx", ( unsigned long long )hash );
+	else
+		snprintf( stamp, size, "-" );
+}
+
+/** Check that the stamps of an index still describe the system.
+ *
+ * \private \memberof mlt_repository_s
+ * \param stamps a list of stamps by name
+ * \param describe the function that describes a name as it is now
+ * \return true if all the stamps match
+ */
+
+static int stamps_match( mlt_properties stamps, void ( *describe )( const char *, char *, size_t ) )
+{
+	char stamp[ 64 ];
+	int i;
+
+	for ( i = 0; i < mlt_properties_count( stamps ); i ++ )
+	{
+		describe( mlt_properties_get_name( stamps, i ), stamp, sizeof( stamp ) );
+		if ( strcmp( stamp, mlt_properties_get_value( stamps, i ) ) )
+			return 0;
+	}
+	return 1;
+}
+
+/** Get the file name of the service index.
+ *
+ * \private \memberof mlt_repository_s
+ * \param directory the modules directory
+ * \return a new string that the caller must free, or NULL to not use an index
+ */
+
+static char *index_path( const char *directory )
+{
+	const char *index = getenv( "MLT_REPOSITORY_INDEX" );
+	const char *cache = getenv( "XDG_CACHE_HOME" );
+	const char *home = getenv( "HOME" );
+	uint64_t hash = hash_string( HASH_START, directory );
+	char *path;
+
+	if ( index )
+		return *index ? strdup( index ) : NULL;
+	if ( !( cache && *cache ) && !( home && *home ) )
+		return NULL;
+
+	// Each modules directory gets its own index
+	path = malloc( strlen( cache && *cache ? cache : home ) + 48 );
+	if ( path && cache && *cache )
+		sprintf( path, "%s/mlt/services-%016llx.index", cache, ( unsigned long long )hash );
+	else if ( path )
+		sprintf( path, "%s/.cache/mlt/services-%016llx.index", home, ( unsigned long long )hash );
+	return path;
+}
+
+/** Register the services of the index.
+ *
+ * The index is only used if it lists exactly the modules of the directory as they are now
+ * and the environment variables and plugin directories that the modules watched are unchanged.
+ * \private \memberof mlt_repository_s
+ * \param self a repository
+ * \param dir the list of modules
+ * \param path the service index
+ * \return the number of services registered
+ */
+
+static int read_index( mlt_repository self, mlt_properties dir, const char *path )
+{
+	FILE *file = fopen( path, "r" );
+	mlt_properties modules = mlt_properties_new( );
+	mlt_properties environment = mlt_properties_new( );
+	mlt_properties directories = mlt_properties_new( );
+	char line[ PATH_MAX + 256 ];
+	char header[ 64 ];
+	int valid = 0;
+	int services = 0;
+
+	snprintf( header, sizeof( header ), "%s %s\n", INDEX_MAGIC, mlt_version_get_string() );
+	if ( file && fgets( line, sizeof( line ), file ) )
+		valid = !strcmp( line, header );
+
+	while ( valid && fgets( line, sizeof( line ), file ) )
+	{
+		char *name = strchr( line, ' ' );
+		char *module = name ? strchr( name + 1, ' ' ) : NULL;
+		char *end = strchr( line, '\n' );
+
+		if ( !module || !end )
+		{
+			valid = 0;
+			break;
+		}
+		*name ++ = '\0';
+		*module ++ = '\0';
+		*end = '\0';
+
+		if ( !strcmp( line, "module" ) )
+		{
+			// The name of a module entry is its stamp
+			mlt_properties_set( modules, module, name );
+			continue;
+		}
+		if ( !strcmp( line, "env" ) )
+		{
+			mlt_properties_set( environment, module, name );
+			continue;
+		}
+		if ( !strcmp( line, "dir" ) )
+		{
+			mlt_properties_set( directories, module, name );
+			continue;
+		}
+
+		// The modules come first, so check them before the first service
+		if ( !services )
+		{
+			int i;
+			char stamp[ 64 ];
+
+			valid = mlt_properties_count( modules ) == mlt_properties_count( dir );
+			for ( i = 0; valid && i < mlt_properties_count( dir ); i ++ )
+			{
+				const char *object_name = mlt_properties_get_value( dir, i );
+				module_stamp( object_name, stamp, sizeof( stamp ) );
+				valid = mlt_properties_get( modules, object_name ) && !strcmp( stamp, mlt_properties_get( modules, object_name ) );
+			}
+			valid = valid && stamps_match( environment, environment_stamp ) && stamps_match( directories, directory_stamp );
+			if ( !valid )
+				break;
+		}
+
+		mlt_properties list = !strcmp( line, "consumer" ) ? self->consumers :
+		                      !strcmp( line, "filter" ) ? self->filters :
+		                      !strcmp( line, "producer" ) ? self->producers :
+		                      !strcmp( line, "transition" ) ? self->transitions : NULL;
+		if ( list )
+		{
+			mlt_properties properties = mlt_properties_new();
+			mlt_properties_set( properties, "module", module );
+			mlt_properties_set_data( list, name, properties, 0, ( mlt_destructor )mlt_properties_close, NULL );
+			services ++;
+		}
+	}
+
+	// Start again from a scan if the index was not usable after all
+	if ( !valid && services )
+	{
+		mlt_properties_close( self->consumers );
+		mlt_properties_close( self->filters );
+		mlt_properties_close( self->producers );
+		mlt_properties_close( self->transitions );
+		self->consumers = mlt_properties_new();
+		self->filters = mlt_properties_new();
+		self->producers = mlt_properties_new();
+		self->transitions = mlt_properties_new();
+	}
+	mlt_properties_close( modules );
+	mlt_properties_close( environment );
+	mlt_properties_close( directories );
+	if ( file )
+		fclose( file );
+
+	return valid ? services : 0;
+}
+
+/** Write the modules and the services they registered to the index.
+ *
+ * \private \memberof mlt_repository_s
+ * \param self a repository
+ * \param dir the list of modules
+ * \param path the service index
+ */
+
+static void write_index( mlt_repository self, mlt_properties dir, const char *path )
+{
+	static const char *types[] = { "consumer", "filter", "producer", "transition" };
+	mlt_properties lists[] = { self->consumers, self->filters, self->producers, self->transitions };
+	char *temp = malloc( strlen( path ) + 32 );
+	char *slash;
+	FILE *file;
+	int i, j, error;
+
+	if ( !temp )
+		return;
+
+	// Make the directories on first use
+	strcpy( temp, path );
+	for ( slash = strchr( temp + 1, '/' ); slash; slash = strchr( slash + 1, '/' ) )
+	{
+		*slash = '\0';
+#ifdef WIN32
+		mkdir( temp );
+#else
+		mkdir( temp, 0777 );
+#endif
+		*slash = '/';
+	}
+
+	// Each process writes its own file and then replaces the index in one step
+	sprintf( temp, "%s.%d.tmp", path, ( int )getpid() );
+	file = fopen( temp, "w" );
+	if ( !file )
+	{
+		mlt_log_debug( NULL, "%s: unable to write %s\n", __FUNCTION__, temp );
+		free( temp );
+		return;
+	}
+
+	fprintf( file, "%s %s\n", INDEX_MAGIC, mlt_version_get_string() );
+	for ( i = 0; i < mlt_properties_count( dir ); i ++ )
+	{
+		const char *object_name = mlt_properties_get_value( dir, i );
+		char stamp[ 64 ];
+		module_stamp( object_name, stamp, sizeof( stamp ) );
+		fprintf( file, "module %s %s\n", stamp, object_name );
+	}
+	for ( i = 0; i < mlt_properties_count( self->environment ); i ++ )
+		fprintf( file, "env %s %s\n", mlt_properties_get_value( self->environment, i ), mlt_properties_get_name( self->environment, i ) );
+	for ( i = 0; i < mlt_properties_count( self->directories ); i ++ )
+	{
+		const char *directory = mlt_properties_get_name( self->directories, i );
+		if ( !strchr( directory, '\n' ) )
+			fprintf( file, "dir %s %s\n", mlt_properties_get_value( self->directories, i ), directory );
+	}
+	for ( i = 0; i < 4; i ++ )
+	{
+		for ( j = 0; j < mlt_properties_count( lists[i] ); j ++ )
+		{
+			const char *name = mlt_properties_get_name( lists[i], j );
+			mlt_properties properties = mlt_properties_get_data_at( lists[i], j, NULL );
+			const char *module = properties ? mlt_properties_get( properties, "module" ) : NULL;
+			if ( module && !strpbrk( name, " \n" ) )
+				fprintf( file, "%s %s %s\n", types[i], name, module );
+		}
+	}
+	error = ferror( file );
+	error |= fclose( file ) != 0;
+#ifdef WIN32
+	if ( !error )
+		remove( path );
+#endif
+	if ( error || rename( temp, path ) )
+		remove( temp );
+	free( temp );
+}
+
 /** Construct a new repository.
  *
  * \public \memberof mlt_repository_s
@@ -71,6 +545,9 @@ mlt_repository mlt_repository_init( const char *directory )
 	self->filters = mlt_properties_new();
 	self->producers = mlt_properties_new();
 	self->transitions = mlt_properties_new();
+	self->environment = mlt_properties_new();
+	self->directories = mlt_properties_new();
+	pthread_mutex_init( &self->mutex, NULL );
 
 	// Get the directory list
 	mlt_properties dir = mlt_properties_new();
@@ -90,43 +567,25 @@ mlt_repository mlt_repository_init( const char *directory )
 	putenv(newpath);
 #endif
 
-	// Iterate over files
-	for ( i = 0; i < count; i++ )
+	// Use the index of the last scan while it is up to date
+	char *index = index_path( directory );
+	int services = index ? read_index( self, dir, index ) : 0;
+	if ( services )
 	{
-		int flags = RTLD_NOW;
-		const char *object_name = mlt_properties_get_value( dir, i);
-
-		// Very temporary hack to allow the quicktime plugins to work
-		// TODO: extend repository to allow this to be used on a case by case basis
-		if ( strstr( object_name, "libmltkino" ) )
-			flags |= RTLD_GLOBAL;
-	
-		// Open the shared object
-		void *object = dlopen( object_name, flags );
-		if ( object != NULL )
-		{
-			// Get the registration function
-			mlt_repository_callback symbol_ptr = dlsym( object, "mlt_register" );
-
-			// Call the registration function
-			if ( symbol_ptr != NULL )
-			{
-				symbol_ptr( self );
+		self->lazy = 1;
+		mlt_log_verbose( NULL, "%s: registered %d services from %s\n", __FUNCTION__, services, index );
+		plugin_count = count;
+	}
+	else
+	{
+		// Iterate over files
+		for ( i = 0; i < count; i++ )
+			plugin_count += open_module( self, mlt_properties_get_value( dir, i ) );
 
-				// Register the object file for closure
-				mlt_properties_set_data( &self->parent, object_name, object, 0, ( mlt_destructor )dlclose, NULL );
-				++plugin_count;
-			}
-			else
-			{
-				dlclose( object );
-			}
-		}
-		else if ( strstr( object_name, "libmlt" ) )
-		{
-			mlt_log_warning( NULL, "%s: failed to dlopen %s\n  (%s)\n", __FUNCTION__, object_name, dlerror() );
-		}
+		if ( index && plugin_count )
+			write_index( self, dir, index );
 	}
+	free( index );
 
 	if ( !plugin_count )
 		mlt_log_error( NULL, "%s: no plugins found in \"%s\"\n", __FUNCTION__, directory );
@@ -150,6 +609,22 @@ static mlt_properties new_service( void *symbol )
 	return properties;
 }
 
+/** Check whether the module being opened on demand may register a service.
+ *
+ * Services that the index gave to another module stay with it, as they
+ * would after a scan.
+ * \private \memberof mlt_repository_s
+ * \param self a repository
+ * \param properties the repository properties of the service or NULL
+ * \return true if the module should leave the service alone
+ */
+
+static int is_foreign( mlt_repository self, mlt_properties properties )
+{
+	const char *module = properties ? mlt_properties_get( properties, "module" ) : NULL;
+	return self->lazy && self->loading && properties && !( module && !strcmp( module, self->loading ) );
+}
+
 /** Register a service with the repository.
  *
  * Typically, this is invoked by a module within its mlt_register().
@@ -164,22 +639,23 @@ static mlt_properties new_service( void *symbol )
 void mlt_repository_register( mlt_repository self, mlt_service_type service_type, const char *service, mlt_register_callback symbol )
 {
 	// Add the entry point to the corresponding service list
-	switch ( service_type )
+	mlt_properties services = get_services( self, service_type );
+	mlt_properties properties = services ? mlt_properties_get_data( services, service, NULL ) : NULL;
+
+	if ( !services || is_foreign( self, properties ) )
+		return;
+
+	if ( properties && self->lazy && self->loading )
 	{
-		case consumer_type:
-			mlt_properties_set_data( self->consumers, service, new_service( symbol ), 0, ( mlt_destructor )mlt_properties_close, NULL );
-			break;
-		case filter_type:
-			mlt_properties_set_data( self->filters, service, new_service( symbol ), 0, ( mlt_destructor )mlt_properties_close, NULL );
-			break;
-		case producer_type:
-			mlt_properties_set_data( self->producers, service, new_service( symbol ), 0, ( mlt_destructor )mlt_properties_close, NULL );
-			break;
-		case transition_type:
-			mlt_properties_set_data( self->transitions, service, new_service( symbol ), 0, ( mlt_destructor )mlt_properties_close, NULL );
-			break;
-		default:
-			break;
+		// Complete the entry from the index in place as others may hold it
+		mlt_properties_set_data( properties, "symbol", symbol, 0, NULL, NULL );
+	}
+	else
+	{
+		properties = new_service( symbol );
+		if ( self->loading )
+			mlt_properties_set( properties, "module", self->loading );
+		mlt_properties_set_data( services, service, properties, 0, ( mlt_destructor )mlt_properties_close, NULL );
 	}
 }
 
@@ -194,27 +670,44 @@ void mlt_repository_register( mlt_repository self, mlt_service_type service_type
 
 static mlt_properties get_service_properties( mlt_repository self, mlt_service_type type, const char *service )
 {
-	mlt_properties service_properties = NULL;
-
 	// Get the entry point from the corresponding service list
-	switch ( type )
+	mlt_properties services = get_services( self, type );
+	return services ? mlt_properties_get_data( services, service, NULL ) : NULL;
+}
+
+/** Get the repository properties for a service, opening its module if needed.
+ *
+ * \private \memberof mlt_repository_s
+ * \param self a repository
+ * \param type a service class
+ * \param service the name of a service
+ * \return a properties list or NULL if error
+ */
+
+static mlt_properties get_opened_service( mlt_repository self, mlt_service_type type, const char *service )
+{
+	mlt_properties properties = get_service_properties( self, type, service );
+
+	if ( properties && !mlt_properties_get_data( properties, "symbol", NULL ) && mlt_properties_get( properties, "module" ) )
 	{
-		case consumer_type:
-			service_properties = mlt_properties_get_data( self->consumers, service, NULL );
-			break;
-		case filter_type:
-			service_properties = mlt_properties_get_data( self->filters, service, NULL );
-			break;
-		case producer_type:
-			service_properties = mlt_properties_get_data( self->producers, service, NULL );
-			break;
-		case transition_type:
-			service_properties = mlt_properties_get_data( self->transitions, service, NULL );
-			break;
-		default:
-			break;
+		pthread_mutex_lock( &self->mutex );
+		char *module = mlt_properties_get( properties, "module" );
+		if ( !mlt_properties_get_data( properties, "symbol", NULL ) && module )
+		{
+			module = strdup( module );
+			if ( !mlt_properties_get_data( &self->parent, module, NULL ) )
+			{
+				mlt_log_verbose( NULL, "%s: opening %s for %s\n", __FUNCTION__, module, service );
+				open_module( self, module );
+			}
+			// Do not try again if the module does not provide the service any more
+			if ( !mlt_properties_get_data( properties, "symbol", NULL ) )
+				mlt_properties_set( properties, "module", NULL );
+			free( module );
+		}
+		pthread_mutex_unlock( &self->mutex );
 	}
-	return service_properties;
+	return properties;
 }
 
 /** Construct a new instance of a service.
@@ -229,7 +722,7 @@ static mlt_properties get_service_properties( mlt_repository self, mlt_service_t
 
 void *mlt_repository_create( mlt_repository self, mlt_profile profile, mlt_service_type type, const char *service, const void *input )
 {
-	mlt_properties properties = get_service_properties( self, type, service );
+	mlt_properties properties = get_opened_service( self, type, service );
 	if ( properties != NULL )
 	{
 		mlt_register_callback symbol_ptr = mlt_properties_get_data( properties, "symbol", NULL );
@@ -252,7 +745,10 @@ void mlt_repository_close( mlt_repository self )
 	mlt_properties_close( self->filters );
 	mlt_properties_close( self->producers );
 	mlt_properties_close( self->transitions );
+	mlt_properties_close( self->environment );
+	mlt_properties_close( self->directories );
 	mlt_properties_close( &self->parent );
+	pthread_mutex_destroy( &self->mutex );
 	free( self );
 }
 
@@ -304,6 +800,41 @@ mlt_properties mlt_repository_transitions( mlt_repository self )
 	return self->transitions;
 }
 
+/** Make the service index depend on where a module finds its plugins.
+ *
+ * A module whose services depend on the plugins it finds at runtime calls this
+ * while it registers them, once for each environment variable that can change
+ * its search path and once for each directory that it searches. The index is
+ * then scanned again when the value of a variable or the contents of a
+ * directory, including its subdirectories, change. A module whose services
+ * are those of a shared library passes the path of the library instead of a
+ * directory, so that the index follows upgrades of the library.
+ *
+ * \public \memberof mlt_repository_s
+ * \param self a repository
+ * \param variable the name of an environment variable or NULL
+ * \param directory the full path of a plugin directory or library file, or NULL
+ */
+
+void mlt_repository_watch( mlt_repository self, const char *variable, const char *directory )
+{
+	char stamp[ 64 ];
+
+	// Only a scan writes the index
+	if ( !self || self->lazy )
+		return;
+	if ( variable )
+	{
+		environment_stamp( variable, stamp, sizeof( stamp ) );
+		mlt_properties_set( self->environment, variable, stamp );
+	}
+	if ( directory )
+	{
+		directory_stamp( directory, stamp, sizeof( stamp ) );
+		mlt_properties_set( self->directories, directory, stamp );
+	}
+}
+
 /** Register the metadata for a service.
  *
  * IMPORTANT: mlt_repository will take responsibility for deallocating the metadata properties
@@ -320,6 +851,8 @@ mlt_properties mlt_repository_transitions( mlt_repository self )
 void mlt_repository_register_metadata( mlt_repository self, mlt_service_type type, const char *service, mlt_metadata_callback callback, void *callback_data )
 {
 	mlt_properties service_properties = get_service_properties( self, type, service );
+	if ( is_foreign( self, service_properties ) )
+		return;
 	mlt_properties_set_data( service_properties, "metadata_cb", callback, 0, NULL, NULL );
 	mlt_properties_set_data( service_properties, "metadata_cb_data", callback_data, 0, NULL, NULL );
 }
@@ -338,7 +871,7 @@ void mlt_repository_register_metadata( mlt_repository self, mlt_service_type typ
 mlt_properties mlt_repository_metadata( mlt_repository self, mlt_service_type type, const char *service )
 {
 	mlt_properties metadata = NULL;
-	mlt_properties properties = get_service_properties( self, type, service );
+	mlt_properties properties = get_opened_service( self, type, service );
 
 	// If this is a valid service
 	if ( properties )
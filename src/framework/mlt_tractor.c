@@ -31,6 +31,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#if defined(USE_SSE) && defined(ARCH_X86_64)
+#include <xmmintrin.h>
+#endif
 
 #define MAX( x, y ) ((x) > (y) ? (x) : (y))
 
@@ -402,14 +405,152 @@ static int producer_get_audio( mlt_frame self, void **buffer, mlt_audio_format *
 	mlt_frame frame = mlt_frame_pop_audio( self );
 	mlt_properties frame_properties = MLT_FRAME_PROPERTIES( frame );
 	mlt_properties_set( frame_properties, "producer_consumer_fps", mlt_properties_get( properties, "producer_consumer_fps" ) );
+	mlt_properties_set_int( frame_properties, "consumer_video_off", mlt_properties_get_int( properties, "consumer_video_off" ) );
 	mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
 	mlt_frame_set_audio( self, *buffer, *format, mlt_audio_format_size( *format, *samples, *channels ), NULL );
+	mlt_properties_set_int( properties, "audio_conversions", mlt_properties_get_int( properties, "audio_conversions" ) +
+		mlt_properties_get_int( frame_properties, "audio_conversions" ) );
 	mlt_properties_set_int( properties, "audio_frequency", *frequency );
 	mlt_properties_set_int( properties, "audio_channels", *channels );
 	mlt_properties_set_int( properties, "audio_samples", *samples );
 	return 0;
 }
 
+/** Add a block of one channel to the mixing bus with a linear gain ramp.
+ *
+ * \private \memberof mlt_tractor_s
+ * \param dest the bus channel
+ * \param src the input channel
+ * \param samples the number of samples
+ * \param gain the gain applied to the first sample
+ * \param gain_step the increment of the gain per sample
+ */
+
+static void mix_bus_accumulate( float *dest, const float *src, int samples, float gain, float gain_step )
+{
+	int i = 0;
+#if defined(USE_SSE) && defined(ARCH_X86_64)
+	__m128 g = _mm_add_ps( _mm_set1_ps( gain ), _mm_mul_ps( _mm_set1_ps( gain_step ), _mm_set_ps( 3, 2, 1, 0 ) ) );
+	__m128 step = _mm_set1_ps( 4 * gain_step );
+	for ( ; i + 4 <= samples; i += 4 )
+	{
+		__m128 d = _mm_loadu_ps( dest + i );
+		__m128 s = _mm_loadu_ps( src + i );
+		_mm_storeu_ps( dest + i, _mm_add_ps( d, _mm_mul_ps( s, g ) ) );
+		g = _mm_add_ps( g, step );
+	}
+	gain += i * gain_step;
+#endif
+	for ( ; i < samples; i++ )
+	{
+		dest[ i ] += src[ i ] * gain;
+		gain += gain_step;
+	}
+}
+
+/** Get the audio of the mixing bus.
+ *
+ * Every input is fetched as planar float and summed into the bus in a single
+ * pass. Channel count mismatches are resolved once per block: a mono input
+ * feeds every bus channel, and surplus input channels are dropped.
+ *
+ * \private \memberof mlt_tractor_s
+ */
+
+static const mlt_audio_format bus_formats[] = { mlt_audio_float, mlt_audio_none };
+
+static int mix_bus_get_audio( mlt_frame self, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
+{
+	mlt_deque inputs = mlt_frame_pop_audio( self );
+	int count = mlt_deque_count( inputs );
+	float *bus = NULL;
+	int size = 0;
+	int i, c;
+
+	for ( i = 0; i < count; i ++ )
+	{
+		mlt_frame input = mlt_deque_peek( inputs, i );
+		mlt_properties input_props = MLT_FRAME_PROPERTIES( input );
+		mlt_audio_format input_format = mlt_audio_none;
+		int input_frequency = *frequency;
+		int input_channels = *channels;
+		int input_samples = *samples;
+		float *data = NULL;
+
+		mlt_properties_set( input_props, "producer_consumer_fps", mlt_properties_get( MLT_FRAME_PROPERTIES( self ), "producer_consumer_fps" ) );
+		mlt_properties_set_int( input_props, "consumer_video_off", mlt_properties_get_int( MLT_FRAME_PROPERTIES( self ), "consumer_video_off" ) );
+		mlt_frame_get_audio_accepting( input, bus_formats, (void**) &data, &input_format, &input_frequency, &input_channels, &input_samples );
+		mlt_properties_set_int( MLT_FRAME_PROPERTIES( self ), "audio_conversions", mlt_properties_get_int( MLT_FRAME_PROPERTIES( self ), "audio_conversions" ) +
+			mlt_properties_get_int( input_props, "audio_conversions" ) );
+
+		// The first input decides the layout of the bus unless it was requested
+		if ( bus == NULL )
+		{
+			*frequency = *frequency > 0 ? *frequency : input_frequency;
+			*channels = *channels > 0 ? *channels : input_channels;
+			*samples = *samples > 0 ? *samples : input_samples;
+			size = mlt_audio_format_size( mlt_audio_float, *samples, *channels );
+			bus = mlt_pool_alloc( size );
+			if ( bus == NULL )
+				break;
+			memset( bus, 0, size );
+		}
+
+		if ( data == NULL || input_format != mlt_audio_float || input_channels <= 0 ||
+			 mlt_properties_get_int( input_props, "silent_audio" ) )
+			continue;
+
+		int n = input_samples < *samples ? input_samples : *samples;
+		float gain = mlt_properties_get_double( input_props, "mix_bus.previous_gain" );
+		float gain_step = n > 0 ? ( mlt_properties_get_double( input_props, "mix_bus.gain" ) - gain ) / n : 0;
+
+		for ( c = 0; c < *channels; c ++ )
+		{
+			int source = c < input_channels ? c : input_channels == 1 ? 0 : -1;
+			if ( source >= 0 )
+				mix_bus_accumulate( bus + c * *samples, data + source * input_samples, n, gain, gain_step );
+		}
+	}
+
+	if ( bus == NULL )
+		return 1;
+
+	mlt_frame_set_audio( self, bus, mlt_audio_float, size, mlt_pool_release );
+	*buffer = bus;
+	*format = mlt_audio_float;
+	return 0;
+}
+
+/** Prepare the gain ramp of a track feeding the mixing bus.
+ *
+ * \private \memberof mlt_tractor_s
+ * \param self a tractor
+ * \param multitrack the multitrack of the tractor
+ * \param track the 0-based track index
+ * \param frame the frame of the track
+ */
+
+static void mix_bus_prepare( mlt_tractor self, mlt_multitrack multitrack, int track, mlt_frame frame )
+{
+	mlt_properties properties = MLT_TRACTOR_PROPERTIES( self );
+	mlt_properties frame_props = MLT_FRAME_PROPERTIES( frame );
+	mlt_producer producer = mlt_multitrack_track( multitrack, track );
+	mlt_properties track_props = producer ? MLT_PRODUCER_PROPERTIES( producer ) : NULL;
+	mlt_position position = mlt_producer_frame( MLT_TRACTOR_PRODUCER( self ) );
+	double gain = track_props && mlt_properties_get( track_props, "mix_gain" ) ? mlt_properties_get_double( track_props, "mix_gain" ) : 1.0;
+	char key[ 40 ];
+
+	// Ramp from the gain of the previous frame unless there was a discontinuity
+	snprintf( key, sizeof( key ), "_mix_bus.%d", track );
+	double previous = gain;
+	if ( mlt_properties_get( properties, key ) && mlt_properties_get_position( properties, "_mix_bus.position" ) + 1 == position )
+		previous = mlt_properties_get_double( properties, key );
+	mlt_properties_set_double( properties, key, gain );
+
+	mlt_properties_set_double( frame_props, "mix_bus.previous_gain", previous );
+	mlt_properties_set_double( frame_props, "mix_bus.gain", gain );
+}
+
 static void destroy_data_queue( void *arg )
 {
 	if ( arg != NULL )
@@ -483,6 +624,9 @@ static int producer_get_frame( mlt_producer parent, mlt_frame_ptr frame, int tra
 			// Temporary properties
 			mlt_properties temp_properties = NULL;
 
+			// The inputs of the mixing bus
+			mlt_deque mix_bus = mlt_properties_get_int( properties, "mix_bus" ) ? mlt_deque_init( ) : NULL;
+
 			// Get the multitrack's producer
 			mlt_producer target = MLT_MULTITRACK_PRODUCER( multitrack );
 			mlt_producer_seek( target, mlt_producer_frame( parent ) );
@@ -566,7 +710,14 @@ static int producer_get_frame( mlt_producer parent, mlt_frame_ptr frame, int tra
 				}
 
 				// Pick up first video and audio frames
-				if ( !done && !mlt_frame_is_test_audio( temp ) && !( mlt_properties_get_int( temp_properties, "hide" ) & 2 ) )
+				if ( mix_bus && !done && !mlt_frame_is_test_audio( temp ) && !( mlt_properties_get_int( temp_properties, "hide" ) & 2 ) )
+				{
+					// Every audible track feeds the mixing bus
+					mix_bus_prepare( self, multitrack, i, temp );
+					mlt_deque_push_back( mix_bus, temp );
+					audio = temp;
+				}
+				else if ( !done && !mlt_frame_is_test_audio( temp ) && !( mlt_properties_get_int( temp_properties, "hide" ) & 2 ) )
 				{
 					// Order of frame creation is starting to get problematic
 					if ( audio != NULL )
@@ -592,8 +743,23 @@ static int producer_get_frame( mlt_producer parent, mlt_frame_ptr frame, int tra
 				}
 			}
 
+			// A lone track at unity gain does not need the mixing bus
+			if ( mix_bus && mlt_deque_count( mix_bus ) == 1 )
+			{
+				mlt_properties audio_properties = MLT_FRAME_PROPERTIES( audio );
+				if ( mlt_properties_get_double( audio_properties, "mix_bus.previous_gain" ) == 1.0 &&
+					 mlt_properties_get_double( audio_properties, "mix_bus.gain" ) == 1.0 )
+					mlt_deque_pop_back( mix_bus );
+			}
+
 			// Now stack callbacks
-			if ( audio != NULL )
+			if ( mix_bus && mlt_deque_count( mix_bus ) > 0 )
+			{
+				mlt_properties_set_data( frame_properties, "_mix_bus", mix_bus, 0, ( mlt_destructor )mlt_deque_close, NULL );
+				mlt_frame_push_audio( *frame, mix_bus );
+				mlt_frame_push_audio( *frame, mix_bus_get_audio );
+			}
+			else if ( audio != NULL )
 			{
 				mlt_frame_push_audio( *frame, audio );
 				mlt_frame_push_audio( *frame, producer_get_audio );
@@ -620,6 +786,13 @@ static int producer_get_frame( mlt_producer parent, mlt_frame_ptr frame, int tra
 				destroy_data_queue( data_queue );
 			}
 
+			if ( mix_bus )
+			{
+				mlt_properties_set_position( properties, "_mix_bus.position", mlt_producer_frame( parent ) );
+				if ( mlt_deque_count( mix_bus ) == 0 )
+					mlt_deque_close( mix_bus );
+			}
+
 			mlt_frame_set_position( *frame, mlt_producer_frame( parent ) );
 			mlt_properties_set_int( MLT_FRAME_PROPERTIES( *frame ), "test_audio", audio == NULL );
 			mlt_properties_set_int( MLT_FRAME_PROPERTIES( *frame ), "test_image", video == NULL );
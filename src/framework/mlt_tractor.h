@@ -37,6 +37,8 @@
  * \properties \em global_feed a flag to indicate whether this tractor feeds to the consumer or stops here
  * \properties \em global_queue is something for the data_feed functionality in the core module
  * \properties \em data_queue is something for the data_feed functionality in the core module
+ * \properties \em mix_bus a flag to sum the audio of every audible track in one pass instead of
+ * taking the audio of the top-most track; the \em mix_gain property of a track sets its linear gain
  */
 
 struct mlt_tractor_s
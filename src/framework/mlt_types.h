@@ -148,6 +148,7 @@ typedef struct mlt_frame_s *mlt_frame, **mlt_frame_ptr; /**< pointer to Frame ob
 typedef struct mlt_property_s *mlt_property;            /**< pointer to Property object */
 typedef struct mlt_properties_s *mlt_properties;        /**< pointer to Properties object */
 typedef struct mlt_event_struct *mlt_event;             /**< pointer to Event object */
+typedef struct mlt_event_handle_struct *mlt_event_handle; /**< pointer to Event handle object */
 typedef struct mlt_service_s *mlt_service;              /**< pointer to Service object */
 typedef struct mlt_producer_s *mlt_producer;            /**< pointer to Producer object */
 typedef struct mlt_playlist_s *mlt_playlist;            /**< pointer to Playlist object */
@@ -166,6 +167,8 @@ typedef struct mlt_repository_s *mlt_repository;        /**< pointer to Reposito
 typedef struct mlt_cache_s *mlt_cache;                  /**< pointer to Cache object */
 typedef struct mlt_cache_item_s *mlt_cache_item;        /**< pointer to CacheItem object */
 typedef struct mlt_animation_s *mlt_animation;          /**< pointer to Property Animation object */
+typedef struct mlt_peaks_s *mlt_peaks;                  /**< pointer to Peaks object */
+typedef struct mlt_audio_ring_s *mlt_audio_ring;        /**< pointer to Audio Ring object */
 
 typedef void ( *mlt_destructor )( void * );             /**< pointer to destructor function */
 typedef char *( *mlt_serialiser )( void *, int length );/**< pointer to serialization function */
@@ -212,7 +212,11 @@ static int convert_image( mlt_frame frame, uint8_t **image, mlt_image_format *fo
 		}
 		*image = output;
 		*format = output_format;
+
+		// Converting keeps the alpha values
+		int uniform_alpha = mlt_frame_get_uniform_alpha( frame );
 		mlt_frame_set_image( frame, output, size, mlt_pool_release );
+		mlt_frame_set_uniform_alpha( frame, uniform_alpha );
 		mlt_properties_set_int( properties, "format", output_format );
 
 		if ( output_format == mlt_image_rgb24a || output_format == mlt_image_opengl )
@@ -127,8 +127,10 @@ static int filter_scale( mlt_frame frame, uint8_t **image, mlt_image_format *for
 		sws_scale( context, (const uint8_t* const*) input.data, input.linesize, 0, iheight, output.data, output.linesize);
 		sws_freeContext( context );
 	
-		// Now update the frame
+		// Now update the frame, whose alpha stays uniform when scaled
+		int uniform_alpha = mlt_frame_get_uniform_alpha( frame );
 		mlt_frame_set_image( frame, output.data[0], owidth * ( oheight + 1 ) * bpp, mlt_pool_release );
+		mlt_frame_set_uniform_alpha( frame, uniform_alpha );
 	
 		// Return the output
 		*image = output.data[0];
@@ -25,6 +25,7 @@
 #include <framework/mlt_deque.h>
 #include <framework/mlt_factory.h>
 #include <framework/mlt_cache.h>
+#include <framework/mlt_probe.h>
 
 // ffmpeg Header files
 #include <libavformat/avformat.h>
@@ -45,6 +46,8 @@
 #include <pthread.h>
 #include <limits.h>
 #include <math.h>
+#include <errno.h>
+#include <sys/time.h>
 
 #if LIBAVCODEC_VERSION_MAJOR < 55
 #define AV_CODEC_ID_H264    CODEC_ID_H264
@@ -56,9 +59,19 @@
 #define MAX_AUDIO_STREAMS (32)
 #define MAX_VDPAU_SURFACES (10)
 #define MAX_AUDIO_FRAME_SIZE (192000) // 1 second of 48khz 32bit audio
+#define AUDIO_DECODE_AHEAD (500) // milliseconds of audio to decode in the background
+#define AUDIO_THREAD_IDLE (2) // seconds without a request before the background decoding stops
 
 #define INCOMPLETE_FILENAME_SUFFIX ".incompletelock"
 
+/** An entry in the audio packet index.
+*/
+typedef struct
+{
+	int64_t sample; // the stream position of the first sample in the packet
+	int64_t pts;    // the packet timestamp in the stream time base
+} audio_packet;
+
 struct producer_avformat_s
 {
 	mlt_producer parent;
@@ -84,6 +97,18 @@ struct producer_avformat_s
 	size_t audio_buffer_size[ MAX_AUDIO_STREAMS ];
 	uint8_t *decode_buffer[ MAX_AUDIO_STREAMS ];
 	int audio_used[ MAX_AUDIO_STREAMS ];
+	int64_t audio_start[ MAX_AUDIO_STREAMS ]; // the stream position of the first sample in audio_buffer
+	int64_t audio_next[ MAX_AUDIO_STREAMS ];  // the stream position after the last sample served
+	audio_packet *audio_packets[ MAX_AUDIO_STREAMS ];
+	int audio_packets_count[ MAX_AUDIO_STREAMS ];
+	int audio_packets_size[ MAX_AUDIO_STREAMS ];
+	int audio_eof;
+	int audio_ahead;           // milliseconds to decode ahead of audio_next
+	int audio_thread_running;  // the background decoding thread must be joined
+	int audio_thread_quit;     // the background decoding thread is asked to stop or stopped when idle
+	int audio_waiting;         // the number of requests waiting for the audio mutex
+	pthread_t audio_thread;
+	pthread_cond_t audio_cond;
 	int audio_streams;
 	int audio_max_stream;
 	int total_channels;
@@ -104,6 +129,7 @@ struct producer_avformat_s
 	AVRational video_time_base;
 	mlt_frame last_good_frame; // for video error concealment
 	int last_good_position;    // for video error concealment
+	int audio_only;            // the consumer never asks for images
 #ifdef VDPAU
 	struct
 	{
@@ -135,6 +161,17 @@ static void producer_set_up_audio( producer_avformat self, mlt_frame frame );
 static void apply_properties( void *obj, mlt_properties properties, int flags );
 static int video_codec_init( producer_avformat self, int index, mlt_properties properties );
 static void get_audio_streams_info( producer_avformat self );
+static void audio_thread_start( producer_avformat self );
+static void audio_thread_stop( producer_avformat self );
+
+static int pix_fmt_has_alpha( enum AVPixelFormat pix_fmt )
+{
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get( pix_fmt );
+
+	// A palette may hold alpha without the descriptor saying so
+	return pix_fmt == AV_PIX_FMT_PAL8 || ( desc && ( desc->flags & AV_PIX_FMT_FLAG_ALPHA ) );
+}
+
 static mlt_audio_format pick_audio_format( int sample_fmt );
 static int pick_av_pixel_format( int *pix_fmt );
 
@@ -180,7 +217,22 @@ mlt_producer producer_avformat_init( mlt_profile profile, const char *service, c
 			mlt_properties_set_position( properties, "length", 0 );
 			mlt_properties_set_position( properties, "out", 0 );
 
-			if ( strcmp( service, "avformat-novalidate" ) )
+			// Use what opening the file found before if it has not changed since
+			mlt_properties probe = strcmp( service, "avformat-novalidate" ) ? mlt_probe_get( profile, "avformat", file ) : NULL;
+			int probed = probe != NULL;
+			if ( probed )
+			{
+				int i;
+				for ( i = 0; i < mlt_properties_count( probe ); i ++ )
+				{
+					char *name = mlt_properties_get_name( probe, i );
+					// The first timestamps are only for find_first_pts
+					if ( strncmp( name, "first_pts.", 10 ) )
+						mlt_properties_set( properties, name, mlt_properties_get_value( probe, i ) );
+				}
+				mlt_properties_close( probe );
+			}
+			else if ( strcmp( service, "avformat-novalidate" ) )
 			{
 				// Open the file
 				mlt_properties_from_utf8( properties, "resource", "_resource" );
@@ -202,11 +254,18 @@ mlt_producer producer_avformat_init( mlt_profile profile, const char *service, c
 					self->video_format = NULL;
 				}
 			}
-			if ( producer )
+			if ( producer && !probed )
 			{
 				// Default the user-selectable indices from the auto-detected indices
 				mlt_properties_set_int( properties, "audio_index",  self->audio_index );
 				mlt_properties_set_int( properties, "video_index",  self->video_index );
+
+				// Remember what opening the file found for the next producer of it
+				if ( self->seekable && strcmp( service, "avformat-novalidate" ) )
+					mlt_probe_put( profile, "avformat", file, properties );
+			}
+			if ( producer )
+			{
 #ifdef VDPAU
 				mlt_service_cache_set_size( MLT_PRODUCER_SERVICE(producer), "producer_avformat", 5 );
 #endif
@@ -676,6 +735,7 @@ static int producer_open( producer_avformat self, mlt_profile profile, const cha
 		pthread_mutex_init( &self->video_mutex, NULL );
 		pthread_mutex_init( &self->packets_mutex, NULL );
 		pthread_mutex_init( &self->open_mutex, NULL );
+		pthread_cond_init( &self->audio_cond, NULL );
 		self->is_mutex_init = 1;
 	}
 
@@ -793,15 +853,20 @@ static int producer_open( producer_avformat self, mlt_profile profile, const cha
 
 static void prepare_reopen( producer_avformat self )
 {
+	audio_thread_stop( self );
 	mlt_service_lock( MLT_PRODUCER_SERVICE( self->parent ) );
 	pthread_mutex_lock( &self->audio_mutex );
 	pthread_mutex_lock( &self->open_mutex );
 
+	// The new contexts need their streams discarded again
+	self->audio_only = 0;
+
 	int i;
 	for ( i = 0; i < MAX_AUDIO_STREAMS; i++ )
 	{
 		mlt_pool_release( self->audio_buffer[i] );
 		self->audio_buffer[i] = NULL;
+		self->audio_used[i] = 0;
 		av_free( self->decode_buffer[i] );
 		self->decode_buffer[i] = NULL;
 		if ( self->audio_codec[i] )
@@ -866,10 +931,23 @@ static void find_first_pts( producer_avformat self, int video_index )
 {
 	// find initial PTS
 	AVFormatContext *context = self->video_format? self->video_format : self->audio_format;
+	mlt_profile profile = mlt_service_profile( MLT_PRODUCER_SERVICE( self->parent ) );
+	char *resource = mlt_properties_get( MLT_PRODUCER_PROPERTIES( self->parent ), "resource" );
+	mlt_properties probe = mlt_probe_get( profile, "avformat", resource );
+	char key[ 32 ];
 	int ret = 0;
 	int toscan = 500;
 	AVPacket pkt;
 
+	// Skip the scan if it was done when the file was opened before
+	snprintf( key, sizeof( key ), "first_pts.%d", video_index );
+	if ( probe && mlt_properties_get( probe, key ) )
+	{
+		self->first_pts = mlt_properties_get_int64( probe, key );
+		mlt_properties_close( probe );
+		return;
+	}
+
 	av_init_packet( &pkt );
 	while ( ret >= 0 && toscan-- > 0 )
 	{
@@ -896,6 +974,13 @@ static void find_first_pts( producer_avformat self, int video_index )
 		av_free_packet( &pkt );
 	}
 	av_seek_frame( context, -1, 0, AVSEEK_FLAG_BACKWARD );
+
+	if ( probe && self->first_pts != AV_NOPTS_VALUE )
+	{
+		mlt_properties_set_int64( probe, key, self->first_pts );
+		mlt_probe_put( profile, "avformat", resource, probe );
+	}
+	mlt_properties_close( probe );
 }
 
 static int seek_video( producer_avformat self, mlt_position position,
@@ -1344,6 +1429,7 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 				mlt_frame_set_alpha( frame, *buffer, size, NULL );
 			*buffer = mlt_properties_get_data( orig_props, "image", &size );
 			mlt_frame_set_image( frame, *buffer, size, NULL );
+			mlt_frame_set_uniform_alpha( frame, mlt_frame_get_uniform_alpha( original ) );
 			mlt_properties_set_data( frame_properties, "avformat.image_cache", original, 0, (mlt_destructor) mlt_frame_close, NULL );
 			*format = mlt_properties_get_int( orig_props, "format" );
 
@@ -1666,6 +1752,10 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 	// set alpha
 	if ( alpha )
 		mlt_frame_set_alpha( frame, alpha, (*width) * (*height), mlt_pool_release );
+	// an alpha channel converted from a format without one is opaque
+	else if ( image_size > 0 && ( *format == mlt_image_rgb24a || *format == mlt_image_opengl ) &&
+		!pix_fmt_has_alpha( codec_context->pix_fmt ) )
+		mlt_frame_set_uniform_alpha( frame, 255 );
 
 	if ( image_size > 0 )
 	{
@@ -1694,6 +1784,7 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 			mlt_frame_set_alpha( frame, *buffer, size, NULL );
 		*buffer = mlt_properties_get_data( orig_props, "image", &size );
 		mlt_frame_set_image( frame, *buffer, size, NULL );
+		mlt_frame_set_uniform_alpha( frame, mlt_frame_get_uniform_alpha( original ) );
 		mlt_properties_set_data( frame_properties, "avformat.conceal_error", original, 0, (mlt_destructor) mlt_frame_close, NULL );
 		*format = mlt_properties_get_int( orig_props, "format" );
 
@@ -2028,51 +2119,26 @@ static void producer_set_up_video( producer_avformat self, mlt_frame frame )
 		pthread_mutex_unlock( &self->video_mutex );
 }
 
-static int seek_audio( producer_avformat self, mlt_position position, double timecode )
+/** Stop demuxing everything but audio once the consumer has said it wants no images.
+*/
+static void discard_non_audio( producer_avformat self, AVFormatContext *context )
 {
-	int paused = 0;
+	AVPacket *pkt;
+	unsigned int i;
 
-	pthread_mutex_lock( &self->packets_mutex );
+	self->audio_only = 1;
+	for ( i = 0; i < context->nb_streams; i++ )
+		if ( context->streams[ i ]->codec->codec_type != AVMEDIA_TYPE_AUDIO )
+			context->streams[ i ]->discard = AVDISCARD_ALL;
 
-	// Seek if necessary
-	if ( self->seekable && ( position != self->audio_expected || self->last_position < 0 ) )
+	// Nobody will collect the video packets queued while reading audio
+	pthread_mutex_lock( &self->packets_mutex );
+	while ( self->vpackets && ( pkt = mlt_deque_pop_back( self->vpackets ) ) )
 	{
-		if ( self->last_position == POSITION_INITIAL )
-		{
-			int video_index = self->video_index;
-			if ( video_index == -1 )
-				video_index = first_video_index( self );
-			if ( video_index >= 0 )
-				find_first_pts( self, video_index );
-		}
-
-		if ( position + 1 == self->audio_expected  &&
-			mlt_properties_get_int( MLT_PRODUCER_PROPERTIES( self->parent ), "mute_on_pause" ) )
-		{
-			// We're paused - silence required
-			paused = 1;
-		}
-		else if ( position < self->audio_expected || position - self->audio_expected >= 12 )
-		{
-			AVFormatContext *context = self->audio_format;
-			int64_t timestamp = ( int64_t )( timecode * AV_TIME_BASE + 0.5 );
-			if ( context->start_time != AV_NOPTS_VALUE )
-				timestamp += context->start_time;
-			if ( timestamp < 0 )
-				timestamp = 0;
-
-			// Set to the real timecode
-			if ( av_seek_frame( context, -1, timestamp, AVSEEK_FLAG_BACKWARD ) != 0 )
-				paused = 1;
-
-			// Clear the usage in the audio buffer
-			int i = MAX_AUDIO_STREAMS + 1;
-			while ( --i )
-				self->audio_used[i - 1] = 0;
-		}
+		av_free_packet( pkt );
+		free( pkt );
 	}
 	pthread_mutex_unlock( &self->packets_mutex );
-	return paused;
 }
 
 static int sample_bytes( AVCodecContext *context )
@@ -2109,11 +2175,295 @@ static void planar_to_interleaved( uint8_t *dest, uint8_t *src, int samples, int
 }
 #endif
 
-static int decode_audio( producer_avformat self, int *ignore, AVPacket pkt, int samples, double timecode, double fps )
+static int audio_frame_bytes( producer_avformat self, int index )
+{
+	return self->audio_codec[ index ]->channels * sample_bytes( self->audio_codec[ index ] );
+}
+
+/** Convert a packet timestamp to a stream position in samples.
+*/
+
+static int64_t audio_pts_to_sample( producer_avformat self, int index, int64_t pts )
+{
+	AVFormatContext *context = self->audio_format;
+	AVRational time_base = context->streams[ index ]->time_base;
+	AVRational sample_base = { 1, self->audio_codec[ index ]->sample_rate };
+
+	// Measure from the same origin as the video
+	if ( self->first_pts != AV_NOPTS_VALUE )
+	{
+		int video_index = self->video_index >= 0 ? self->video_index : first_video_index( self );
+		if ( video_index >= 0 )
+			pts -= av_rescale_q( self->first_pts, context->streams[ video_index ]->time_base, time_base );
+		else
+			pts -= self->first_pts;
+	}
+	else if ( context->start_time != AV_NOPTS_VALUE )
+	{
+		pts -= av_rescale_q( context->start_time, AV_TIME_BASE_Q, time_base );
+	}
+	return av_rescale_q( pts, time_base, sample_base );
+}
+
+/** Find the last indexed packet that starts at or before a stream position.
+*/
+
+static audio_packet *audio_packet_find( producer_avformat self, int index, int64_t sample )
+{
+	audio_packet *packets = self->audio_packets[ index ];
+	int low = 0;
+	int high = self->audio_packets_count[ index ];
+
+	while ( low < high )
+	{
+		int middle = ( low + high ) / 2;
+		if ( packets[ middle ].sample <= sample )
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low > 0 ? &packets[ low - 1 ] : NULL;
+}
+
+/** Add a demuxed packet to the audio packet index.
+ *
+ * The index is filled in as the stream is read and kept in order. Entries
+ * are at least a quarter second apart, which keeps it small while leaving
+ * little audio to decode and throw away after seeking to one.
+*/
+
+static void audio_packet_add( producer_avformat self, int index, int64_t sample, int64_t pts )
+{
+	int spacing = self->audio_codec[ index ]->sample_rate / 4;
+	int count = self->audio_packets_count[ index ];
+	audio_packet *before = audio_packet_find( self, index, sample );
+	int i = before ? before - self->audio_packets[ index ] + 1 : 0;
+
+	if ( before && sample - before->sample < spacing )
+		return;
+	if ( i < count && self->audio_packets[ index ][ i ].sample - sample < spacing )
+		return;
+	if ( count == self->audio_packets_size[ index ] )
+	{
+		int size = count ? count * 2 : 256;
+		audio_packet *packets = realloc( self->audio_packets[ index ], size * sizeof( audio_packet ) );
+		if ( !packets )
+			return;
+		self->audio_packets[ index ] = packets;
+		self->audio_packets_size[ index ] = size;
+	}
+	memmove( &self->audio_packets[ index ][ i + 1 ], &self->audio_packets[ index ][ i ], ( count - i ) * sizeof( audio_packet ) );
+	self->audio_packets[ index ][ i ].sample = sample;
+	self->audio_packets[ index ][ i ].pts = pts;
+	self->audio_packets_count[ index ] = count + 1;
+}
+
+/** Forget the decoded audio after the demuxer has moved.
+*/
+
+static void audio_reset( producer_avformat self )
+{
+	int i;
+	for ( i = 0; i < MAX_AUDIO_STREAMS; i++ )
+	{
+		self->audio_used[ i ] = 0;
+		if ( self->audio_codec[ i ] )
+			avcodec_flush_buffers( self->audio_codec[ i ] );
+	}
+	self->audio_eof = 0;
+}
+
+/** Move the audio demuxer to before a stream position.
+ *
+ * An indexed packet nearby gives a timestamp known to come before the
+ * position, with a little room for the decoder to settle. Otherwise this
+ * seeks by time code and decode_audio places the samples by their packet
+ * timestamps.
+*/
+
+static int audio_seek( producer_avformat self, int index, int64_t sample, double timecode )
 {
-	// Fetch the audio_format
 	AVFormatContext *context = self->audio_format;
+	int frequency = self->audio_codec[ index ]->sample_rate;
+	audio_packet *packet = audio_packet_find( self, index, sample - frequency / 20 );
+	int error;
+
+	if ( packet && sample - packet->sample < frequency * 2 )
+	{
+		error = av_seek_frame( context, index, packet->pts, AVSEEK_FLAG_BACKWARD );
+	}
+	else
+	{
+		int64_t timestamp = ( int64_t )( timecode * AV_TIME_BASE + 0.5 );
+		if ( context->start_time != AV_NOPTS_VALUE )
+			timestamp += context->start_time;
+		if ( timestamp < 0 )
+			timestamp = 0;
+		error = av_seek_frame( context, -1, timestamp, AVSEEK_FLAG_BACKWARD );
+	}
+	audio_reset( self );
 
+	return error;
+}
+
+/** Determine whether the decoded audio can reach a stream position without seeking.
+*/
+
+static int audio_window_reaches( producer_avformat self, int index, int64_t want, int64_t threshold )
+{
+	if ( self->audio_used[ index ] == 0 && !self->audio_eof )
+		return 0;
+	if ( want < self->audio_start[ index ] )
+		return 0;
+	return self->audio_eof || want <= self->audio_start[ index ] + self->audio_used[ index ] + threshold;
+}
+
+/** Copy samples out of the decoded audio, with silence where there are none.
+*/
+
+static void audio_window_copy( producer_avformat self, int index, int64_t want, int samples, uint8_t *dest, int stride )
+{
+	int bytes = audio_frame_bytes( self, index );
+	int64_t offset = want - self->audio_start[ index ];
+	uint8_t *src = self->audio_buffer[ index ];
+	int i;
+
+	if ( stride == bytes )
+	{
+		int head = offset < 0 ? FFMIN( -offset, samples ) : 0;
+		int64_t available = self->audio_used[ index ] - FFMAX( offset, 0 );
+		int count = FFMAX( FFMIN( available, samples - head ), 0 );
+
+		memset( dest, 0, head * bytes );
+		if ( count )
+			memcpy( dest + head * bytes, src + FFMAX( offset, 0 ) * bytes, count * bytes );
+		memset( dest + ( head + count ) * bytes, 0, ( samples - head - count ) * bytes );
+	}
+	else
+	{
+		for ( i = 0; i < samples; i++, offset++, dest += stride )
+		{
+			if ( offset >= 0 && offset < self->audio_used[ index ] )
+				memcpy( dest, src + offset * bytes, bytes );
+			else
+				memset( dest, 0, bytes );
+		}
+	}
+}
+
+/** Drop the decoded audio before a stream position.
+ *
+ * A seekable source keeps half a second behind the position, so stepping
+ * back a little is served without seeking, and moves the rest down only
+ * once another quarter second has built up.
+*/
+
+static void audio_window_trim( producer_avformat self, int index, int64_t position )
+{
+	int frequency = self->audio_codec[ index ]->sample_rate;
+	int64_t drop;
+
+	if ( self->seekable )
+	{
+		position -= frequency / 2;
+		if ( position - self->audio_start[ index ] < frequency / 4 )
+			return;
+	}
+	drop = position - self->audio_start[ index ];
+	if ( drop <= 0 )
+		return;
+	if ( drop < self->audio_used[ index ] )
+	{
+		int bytes = audio_frame_bytes( self, index );
+		self->audio_used[ index ] -= drop;
+		memmove( self->audio_buffer[ index ], self->audio_buffer[ index ] + drop * bytes, self->audio_used[ index ] * bytes );
+	}
+	else
+	{
+		self->audio_used[ index ] = 0;
+	}
+	self->audio_start[ index ] = position;
+}
+
+/** Get the stream position of the first sample a frame wants.
+*/
+
+static int64_t audio_want( producer_avformat self, int index, mlt_position position, double timecode )
+{
+	int64_t want;
+
+	// Carry on from the previous frame when playing straight through
+	if ( ( self->seekable && position == self->audio_expected && self->audio_used[ index ] > 0 ) ||
+		 ( !self->seekable && !self->video_format ) )
+		return self->audio_next[ index ];
+
+	want = ( int64_t )( timecode * self->audio_codec[ index ]->sample_rate + 0.5 );
+
+	// A live source can not go back
+	if ( !self->seekable && self->audio_used[ index ] > 0 && want < self->audio_start[ index ] )
+		want = self->audio_start[ index ];
+
+	return want;
+}
+
+static int seek_audio( producer_avformat self, mlt_position position, double timecode, int index, int index_max, int64_t *want )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+	int paused = 0;
+
+	pthread_mutex_lock( &self->packets_mutex );
+
+	// Seek if necessary
+	if ( self->seekable )
+	{
+		if ( self->last_position == POSITION_INITIAL && self->first_pts == AV_NOPTS_VALUE )
+		{
+			int video_index = self->video_index;
+			if ( video_index == -1 )
+				video_index = first_video_index( self );
+			if ( video_index >= 0 )
+			{
+				find_first_pts( self, video_index );
+
+				// That read through the audio demuxer if there is no other
+				if ( !self->video_format )
+					audio_reset( self );
+			}
+			// Nothing else will clear the initial position without video
+			if ( self->video_index == -1 )
+				self->last_position = 0;
+		}
+
+		if ( position + 1 == self->audio_expected  &&
+			mlt_properties_get_int( properties, "mute_on_pause" ) )
+		{
+			// We're paused - silence required
+			paused = 1;
+		}
+		else
+		{
+			int seek_threshold = mlt_properties_get_int( properties, "seek_threshold" );
+			double fps = mlt_producer_get_fps( self->parent );
+			int i;
+
+			if ( seek_threshold <= 0 )
+				seek_threshold = 12;
+
+			// Seek only when some stream can not be read on to the position
+			for ( i = index; i < index_max; i++ )
+				if ( self->audio_codec[ i ] &&
+					 !audio_window_reaches( self, i, want[ i ], ( int64_t )( seek_threshold * self->audio_codec[ i ]->sample_rate / fps ) ) )
+					break;
+			if ( i < index_max && audio_seek( self, i, want[ i ], timecode ) != 0 )
+				paused = 1;
+		}
+	}
+	pthread_mutex_unlock( &self->packets_mutex );
+	return paused;
+}
+
+static int decode_audio( producer_avformat self, AVPacket pkt )
+{
 	// Get the current stream index
 	int index = pkt.stream_index;
 
@@ -2128,6 +2478,16 @@ static int decode_audio( producer_avformat self, int *ignore, AVPacket pkt, int
 	int audio_used = self->audio_used[ index ];
 	int ret = 0;
 
+	// Locate the packet in the stream, except when reading a live audio source straight through
+	int64_t pts = best_pts( self, pkt.pts, pkt.dts );
+	int64_t sample = AV_NOPTS_VALUE;
+	if ( pts != AV_NOPTS_VALUE && ( self->seekable || self->video_format ) )
+	{
+		sample = audio_pts_to_sample( self, index, pts );
+		if ( self->seekable && ( pkt.flags & AV_PKT_FLAG_KEY ) )
+			audio_packet_add( self, index, sample, pts );
+	}
+
 	while ( pkt.data && pkt.size > 0 )
 	{
 		int sizeof_sample = sample_bytes( codec_context );
@@ -2171,6 +2531,10 @@ static int decode_audio( producer_avformat self, int *ignore, AVPacket pkt, int
 			// Figure out how many samples will be needed after resampling
 			int convert_samples = data_size / channels / sizeof_sample;
 
+			// The first samples after a seek say where the decoded audio starts
+			if ( audio_used == 0 && sample != AV_NOPTS_VALUE )
+				self->audio_start[ index ] = sample;
+
 			// Resize audio buffer to prevent overflow
 			if ( ( audio_used + convert_samples ) * channels * sizeof_sample > self->audio_buffer_size[ index ] )
 			{
@@ -2195,47 +2559,7 @@ static int decode_audio( producer_avformat self, int *ignore, AVPacket pkt, int
 				memcpy( dest, decode_buffer, data_size );
 			}
 			audio_used += convert_samples;
-
-			// Handle ignore
-			while ( *ignore && audio_used )
-			{
-				*ignore -= 1;
-				audio_used -= audio_used > samples ? samples : audio_used;
-				memmove( audio_buffer, &audio_buffer[ samples * channels * sizeof_sample ],
-						 audio_used * sizeof_sample );
-			}
-		}
-	}
-
-	// If we're behind, ignore this packet
-	// Skip this on non-seekable, audio-only inputs.
-	if ( pkt.pts >= 0 && ( self->seekable || self->video_format ) && *ignore == 0 && audio_used > samples / 2 )
-	{
-		int64_t pts = pkt.pts;
-		if ( self->first_pts != AV_NOPTS_VALUE )
-			pts -= self->first_pts;
-		else if ( context->start_time != AV_NOPTS_VALUE )
-			pts -= context->start_time;
-		double timebase = av_q2d( context->streams[ index ]->time_base );
-		int64_t int_position = ( int64_t )( timebase * pts * fps + 0.5 );
-		int64_t req_position = ( int64_t )( timecode * fps + 0.5 );
-
-		mlt_log_debug( MLT_PRODUCER_SERVICE(self->parent),
-			"A pkt.pts %"PRId64" pkt.dts %"PRId64" req_pos %"PRId64" cur_pos %"PRId64" pkt_pos %"PRId64"\n",
-			pkt.pts, pkt.dts, req_position, self->current_position, int_position );
-
-		if ( int_position > 0 )
-		{
-			if ( int_position < req_position )
-				// We are behind, so skip some
-				*ignore = req_position - int_position;
-			else if ( self->audio_index != INT_MAX && int_position > req_position + 2 )
-				// We are ahead, so seek backwards some more
-				seek_audio( self, req_position, timecode - 1.0 );
 		}
-		// Cancel the find_first_pts() in seek_audio()
-		if ( self->video_index == -1 && self->last_position == POSITION_INITIAL )
-			self->last_position = int_position;
 	}
 
 	self->audio_used[ index ] = audio_used;
@@ -2250,7 +2574,10 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 	// Get the producer
 	producer_avformat self = mlt_frame_pop_audio( frame );
 
+	// Tell the background decoding to hand over the audio
+	__sync_fetch_and_add( &self->audio_waiting, 1 );
 	pthread_mutex_lock( &self->audio_mutex );
+	__sync_fetch_and_sub( &self->audio_waiting, 1 );
 	
 	// Obtain the frame number of this frame
 	mlt_position position = mlt_frame_original_position( frame );
@@ -2263,22 +2590,21 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 	if ( mlt_properties_get( MLT_FRAME_PROPERTIES(frame), "producer_consumer_fps" ) )
 		fps = mlt_properties_get_double( MLT_FRAME_PROPERTIES(frame), "producer_consumer_fps" );
 
-	// Number of frames to ignore (for ffwd)
-	int ignore[ MAX_AUDIO_STREAMS ] = { 0 };
+	// The stream position of the first sample wanted from each track
+	int64_t want[ MAX_AUDIO_STREAMS ] = { 0 };
 
 	// Flag for paused (silence)
-	int paused = seek_audio( self, position, real_timecode );
-
-	// Initialize ignore for all streams from the seek return value
-	int i = MAX_AUDIO_STREAMS;
-	while ( i-- )
-		ignore[i] = ignore[0];
+	int paused = 0;
+	int i;
 
 	// Fetch the audio_format
 	AVFormatContext *context = self->audio_format;
 	if ( !context )
 		goto exit_get_audio;
 
+	if ( !self->audio_only && mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "consumer_video_off" ) )
+		discard_non_audio( self, context );
+
 	int sizeof_sample = sizeof( int16_t );
 	
 	// Determine the tracks to use
@@ -2294,31 +2620,36 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 	}
 
 	// Initialize the buffers
-	for ( ; index < index_max && index < MAX_AUDIO_STREAMS; index++ )
+	for ( i = index; i < index_max && i < MAX_AUDIO_STREAMS; i++ )
 	{
 		// Get codec context
-		AVCodecContext *codec_context = self->audio_codec[ index ];
+		AVCodecContext *codec_context = self->audio_codec[ i ];
 
-		if ( codec_context && !self->audio_buffer[ index ] )
+		if ( codec_context && !self->audio_buffer[ i ] )
 		{
 			if ( self->audio_index != INT_MAX && !mlt_properties_get( MLT_PRODUCER_PROPERTIES(self->parent), "request_channel_layout" ) )
 				codec_context->request_channel_layout = av_get_default_channel_layout( *channels );
 			sizeof_sample = sample_bytes( codec_context );
 
 			// Check for audio buffer and create if necessary
-			self->audio_buffer_size[ index ] = MAX_AUDIO_FRAME_SIZE * sizeof_sample;
-			self->audio_buffer[ index ] = mlt_pool_alloc( self->audio_buffer_size[ index ] );
+			self->audio_buffer_size[ i ] = MAX_AUDIO_FRAME_SIZE * sizeof_sample;
+			self->audio_buffer[ i ] = mlt_pool_alloc( self->audio_buffer_size[ i ] );
 
 			// Check for decoder buffer and create if necessary
-			self->decode_buffer[ index ] = av_malloc( self->audio_buffer_size[ index ] );
+			self->decode_buffer[ i ] = av_malloc( self->audio_buffer_size[ i ] );
 		}
+		if ( codec_context )
+			want[ i ] = audio_want( self, i, position, real_timecode );
 	}
 
+	paused = seek_audio( self, position, real_timecode, index, index_max, want );
+
 	// Get the audio if required
 	if ( !paused && *frequency > 0 )
 	{
 		int ret	= 0;
 		int got_audio = 0;
+		int retries = 0;
 		AVPacket pkt;
 
 		av_init_packet( &pkt );
@@ -2327,26 +2658,21 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 		if ( self->audio_index != INT_MAX )
 			*samples = mlt_sample_calculator( fps, self->audio_codec[ self->audio_index ]->sample_rate, position );
 
+		// Without timestamps, the next samples decoded are taken to be the ones wanted
+		for ( i = index; i < index_max; i++ )
+			if ( self->audio_codec[ i ] && !self->audio_used[ i ] )
+				self->audio_start[ i ] = want[ i ];
+
 		while ( ret >= 0 && !got_audio )
 		{
-			// Check if the buffer already contains the samples required
-			if ( self->audio_index != INT_MAX &&
-				 self->audio_used[ self->audio_index ] >= *samples &&
-				 ignore[ self->audio_index ] == 0 )
-			{
-				got_audio = 1;
+			// Check if the buffers already contain the samples required
+			got_audio = 1;
+			for ( i = index; got_audio && i < index_max; i++ )
+				if ( self->audio_codec[ i ] && !self->audio_eof &&
+					 self->audio_start[ i ] + self->audio_used[ i ] < want[ i ] + *samples )
+					got_audio = 0;
+			if ( got_audio )
 				break;
-			}
-			else if ( self->audio_index == INT_MAX )
-			{
-				// Check if there is enough audio for all streams
-				got_audio = 1;
-				for ( index = 0; got_audio && index < index_max; index++ )
-					if ( ( self->audio_codec[ index ] && self->audio_used[ index ] < *samples ) || ignore[ index ] )
-						got_audio = 0;
-				if ( got_audio )
-					break;
-			}
 
 			// Read a packet
 			pthread_mutex_lock( &self->packets_mutex );
@@ -2359,7 +2685,7 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 			else
 			{
 				ret = av_read_frame( context, &pkt );
-				if ( ret >= 0 && !self->seekable && pkt.stream_index == self->video_index )
+				if ( ret >= 0 && !self->seekable && pkt.stream_index == self->video_index && !self->audio_only )
 				{
 					if ( !av_dup_packet( &pkt ) )
 					{
@@ -2374,6 +2700,8 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 					mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
 					if ( ret != AVERROR_EOF )
 						mlt_log_verbose( MLT_PRODUCER_SERVICE(producer), "av_read_frame returned error %d inside get_audio\n", ret );
+					else if ( self->seekable )
+						self->audio_eof = 1;
 					if ( !self->seekable && mlt_properties_get_int( properties, "reconnect" ) )
 					{
 						// Try to reconnect to live sources by closing context and codecs,
@@ -2392,14 +2720,26 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 			pthread_mutex_unlock( &self->packets_mutex );
 
 			// We only deal with audio from the selected audio index
-			index = pkt.stream_index;
-			if ( index < MAX_AUDIO_STREAMS && ret >= 0 && pkt.data && pkt.size > 0 && ( index == self->audio_index ||
-				 ( self->audio_index == INT_MAX && context->streams[ index ]->codec->codec_type == AVMEDIA_TYPE_AUDIO ) ) )
+			int stream = pkt.stream_index;
+			if ( stream < MAX_AUDIO_STREAMS && ret >= 0 && pkt.data && pkt.size > 0 && ( stream == self->audio_index ||
+				 ( self->audio_index == INT_MAX && context->streams[ stream ]->codec->codec_type == AVMEDIA_TYPE_AUDIO ) ) )
 			{
-				ret = decode_audio( self, &ignore[index], pkt, *samples, real_timecode, fps );
+				ret = decode_audio( self, pkt );
+
+				// A seek by time code can land after the position, so go back further
+				if ( self->seekable && retries < 2 && self->audio_used[ stream ] > 0 && self->audio_start[ stream ] > want[ stream ] )
+				{
+					retries++;
+					pthread_mutex_lock( &self->packets_mutex );
+					audio_seek( self, stream, want[ stream ] - retries * self->audio_codec[ stream ]->sample_rate, real_timecode - retries );
+					pthread_mutex_unlock( &self->packets_mutex );
+					for ( i = index; i < index_max; i++ )
+						if ( self->audio_codec[ i ] )
+							self->audio_start[ i ] = want[ i ];
+				}
 			}
 
-			if ( self->seekable || index != self->video_index )
+			if ( self->seekable || stream != self->video_index || self->audio_only )
 				av_free_packet( &pkt );
 
 		}
@@ -2416,12 +2756,12 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 		}
 		else if ( self->audio_index == INT_MAX )
 		{
-			for ( index = 0; index < index_max; index++ )
-				if ( self->audio_codec[ index ] )
+			for ( i = index; i < index_max; i++ )
+				if ( self->audio_codec[ i ] )
 				{
 					// XXX: This only works if all audio tracks have the same sample format.
-					*format = pick_audio_format( self->audio_codec[ index ]->sample_fmt );
-					sizeof_sample = sample_bytes( self->audio_codec[ index ] );
+					*format = pick_audio_format( self->audio_codec[ i ]->sample_fmt );
+					sizeof_sample = sample_bytes( self->audio_codec[ i ] );
 					break;
 				}
 		}
@@ -2435,52 +2775,28 @@ static int producer_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 		if ( self->audio_index == INT_MAX )
 		{
 			uint8_t *dest = *buffer;
-			int i;
-			for ( i = 0; i < *samples; i++ )
-			{
-				for ( index = 0; index < index_max; index++ )
-				if ( self->audio_codec[ index ] )
+			for ( i = index; i < index_max; i++ )
+				if ( self->audio_codec[ i ] )
 				{
-					int current_channels = self->audio_codec[ index ]->channels;
-					uint8_t *src = self->audio_buffer[ index ] + i * current_channels * sizeof_sample;
-					memcpy( dest, src, current_channels * sizeof_sample );
-					dest += current_channels * sizeof_sample;
+					audio_window_copy( self, i, want[ i ], *samples, dest, *channels * sizeof_sample );
+					dest += audio_frame_bytes( self, i );
 				}
-			}
-			for ( index = 0; index < index_max; index++ )
-			if ( self->audio_codec[ index ] && self->audio_used[ index ] >= *samples )
-			{
-				int current_channels = self->audio_codec[ index ]->channels;
-				uint8_t *src = self->audio_buffer[ index ] + *samples * current_channels * sizeof_sample;
-				self->audio_used[index] -= *samples;
-				memmove( self->audio_buffer[ index ], src, self->audio_used[ index ] * current_channels * sizeof_sample );
-			}
 		}
 		// Copy a single track to the output buffer
 		else
 		{
-			index = self->audio_index;
+			audio_window_copy( self, index, want[ index ], *samples, *buffer, *channels * sizeof_sample );
+		}
 
-			// Now handle the audio if we have enough
-			if ( self->audio_used[ index ] > 0 )
+		// Move on past the samples served
+		for ( i = index; i < index_max; i++ )
+			if ( self->audio_codec[ i ] )
 			{
-				uint8_t *src = self->audio_buffer[ index ];
-				// copy samples from audio_buffer
-				size = self->audio_used[ index ] < *samples ? self->audio_used[ index ] : *samples;
-				memcpy( *buffer, src, size * *channels * sizeof_sample );
-				// supply the remaining requested samples as silence
-				if ( *samples > self->audio_used[ index ] )
-					memset( *buffer + size * *channels * sizeof_sample, 0, ( *samples - self->audio_used[ index ] ) * *channels * sizeof_sample );
-				// reposition the samples within audio_buffer
-				self->audio_used[ index ] -= size;
-				memmove( src, src + size * *channels * sizeof_sample, self->audio_used[ index ] * *channels * sizeof_sample );
+				self->audio_next[ i ] = want[ i ] + *samples;
+				audio_window_trim( self, i, self->audio_next[ i ] );
 			}
-			else
-			{
-				// Otherwise fill with silence
-				memset( *buffer, 0, *samples * *channels * sizeof_sample );
-			}
-		}
+
+		audio_thread_start( self );
 	}
 	else
 	{
@@ -2498,6 +2814,118 @@ exit_get_audio:
 	return 0;
 }
 
+/** Decode one more packet ahead of the audio served.
+ *
+ * \return true if there may be more to do
+*/
+
+static int audio_refill( producer_avformat self )
+{
+	int index = self->audio_index;
+	AVPacket pkt;
+	int ret;
+
+	if ( index < 0 || index >= MAX_AUDIO_STREAMS || !self->audio_codec[ index ] || !self->audio_buffer[ index ] ||
+		 !self->audio_format || self->audio_eof || self->audio_used[ index ] == 0 )
+		return 0;
+	if ( self->audio_start[ index ] + self->audio_used[ index ] >=
+		 self->audio_next[ index ] + ( int64_t ) self->audio_codec[ index ]->sample_rate * self->audio_ahead / 1000 )
+		return 0;
+
+	av_init_packet( &pkt );
+	pthread_mutex_lock( &self->packets_mutex );
+	ret = av_read_frame( self->audio_format, &pkt );
+	pthread_mutex_unlock( &self->packets_mutex );
+	if ( ret < 0 )
+	{
+		if ( ret == AVERROR_EOF )
+			self->audio_eof = 1;
+		return 0;
+	}
+	if ( pkt.stream_index == index && pkt.data && pkt.size > 0 )
+		decode_audio( self, pkt );
+	av_free_packet( &pkt );
+
+	return 1;
+}
+
+/** Decode ahead of the audio served until asked to stop or left idle.
+ *
+ * Between packets, this waits for a request that is waiting for the audio
+ * to be served, which wakes it again through audio_thread_start.
+*/
+
+static void *audio_decode_ahead( void *arg )
+{
+	producer_avformat self = arg;
+	struct timeval now;
+	struct timespec tm;
+
+	pthread_mutex_lock( &self->audio_mutex );
+	while ( !self->audio_thread_quit )
+	{
+		if ( __sync_fetch_and_add( &self->audio_waiting, 0 ) || !audio_refill( self ) )
+		{
+			gettimeofday( &now, NULL );
+			tm.tv_sec = now.tv_sec + AUDIO_THREAD_IDLE;
+			tm.tv_nsec = now.tv_usec * 1000;
+			if ( pthread_cond_timedwait( &self->audio_cond, &self->audio_mutex, &tm ) == ETIMEDOUT )
+				self->audio_thread_quit = 1;
+		}
+	}
+	pthread_mutex_unlock( &self->audio_mutex );
+
+	return NULL;
+}
+
+/** Keep decoding ahead of the audio served in the background.
+ *
+ * This needs the audio to have a demuxer of its own, as seekable sources do,
+ * so that reading packets ahead never takes any from the video. Call it
+ * with the audio mutex held.
+*/
+
+static void audio_thread_start( producer_avformat self )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+	int index = self->audio_index;
+
+	if ( self->audio_thread_running && !self->audio_thread_quit )
+	{
+		pthread_cond_signal( &self->audio_cond );
+		return;
+	}
+
+	// The thread stopped when idle, and has released the mutex held here
+	if ( self->audio_thread_running )
+	{
+		pthread_join( self->audio_thread, NULL );
+		self->audio_thread_running = 0;
+	}
+	if ( self->seekable && self->audio_format != self->video_format &&
+		index >= 0 && index < MAX_AUDIO_STREAMS && self->audio_codec[ index ] && self->audio_used[ index ] > 0 )
+	{
+		self->audio_ahead = mlt_properties_get( properties, "audio_decode_ahead" ) ?
+			mlt_properties_get_int( properties, "audio_decode_ahead" ) : AUDIO_DECODE_AHEAD;
+		self->audio_thread_quit = 0;
+		if ( self->audio_ahead > 0 && !pthread_create( &self->audio_thread, NULL, audio_decode_ahead, self ) )
+			self->audio_thread_running = 1;
+	}
+}
+
+static void audio_thread_stop( producer_avformat self )
+{
+	if ( self->audio_thread_running )
+	{
+		pthread_mutex_lock( &self->audio_mutex );
+		self->audio_thread_quit = 1;
+		pthread_cond_signal( &self->audio_cond );
+		pthread_mutex_unlock( &self->audio_mutex );
+		pthread_join( self->audio_thread, NULL );
+		self->audio_thread_running = 0;
+	}
+}
+
 /** Initialize the audio codec context.
 */
 
@@ -2593,6 +3021,7 @@ static void producer_set_up_audio( producer_avformat self, mlt_frame frame )
 	// Update the audio properties if the index changed
 	if ( context && index > -1 && self->audio_index > -1 && index != self->audio_index )
 	{
+		audio_thread_stop( self );
 		pthread_mutex_lock( &self->open_mutex );
 		if ( self->audio_codec[ self->audio_index ] )
 			avcodec_close( self->audio_codec[ self->audio_index ] );
@@ -2685,6 +3114,8 @@ static void producer_avformat_close( producer_avformat self )
 {
 	mlt_log_debug( NULL, "producer_avformat_close\n" );
 
+	audio_thread_stop( self );
+
 	// Cleanup av contexts
 	av_free_packet( &self->pkt );
 	av_free( self->video_frame );
@@ -2696,6 +3127,7 @@ static void producer_avformat_close( producer_avformat self )
 	{
 		mlt_pool_release( self->audio_buffer[i] );
 		av_free( self->decode_buffer[i] );
+		free( self->audio_packets[i] );
 		if ( self->audio_codec[i] )
 			avcodec_close( self->audio_codec[i] );
 		self->audio_codec[i] = NULL;
@@ -2726,6 +3158,7 @@ static void producer_avformat_close( producer_avformat self )
 		pthread_mutex_destroy( &self->video_mutex );
 		pthread_mutex_destroy( &self->packets_mutex );
 		pthread_mutex_destroy( &self->open_mutex );
+		pthread_cond_destroy( &self->audio_cond );
 	}
 
 	// Cleanup the packet queues
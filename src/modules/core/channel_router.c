@@ -0,0 +1,500 @@
+/*
+ * channel_router.c -- matrix based audio channel routing
+ * Copyright (C) 2015 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "channel_router.h"
+#include <framework/mlt.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(USE_SSE) && defined(ARCH_X86_64)
+#include <emmintrin.h>
+#endif
+
+/** The channel operations of adjacent filters, composed into one matrix.
+ *
+ * Each channel filter pushes the same get_audio function with its own
+ * operation. When the next function on the audio stack is the router too,
+ * that one is asked to defer: instead of touching the audio it leaves its
+ * composed matrix on the frame. The outermost router of the run multiplies
+ * its operation in and passes over the audio once.
+ */
+
+/** The most points of a frame at which a route gives its gains. */
+#define ROUTER_MAX_KNOTS 8
+
+typedef struct
+{
+	int inputs;
+	int outputs;
+	int knots;                                   // the number of points with gains, at least 2
+	double at[ ROUTER_MAX_KNOTS ];               // the fraction of the frame at each point, from 0 to 1
+	channel_matrix gains[ ROUTER_MAX_KNOTS ];    // the gains at each point, ramping linearly between them
+	int bends;                                   // the extra points given by the current operation
+	double bend_at[ ROUTER_MAX_KNOTS - 2 ];
+	channel_matrix bend[ ROUTER_MAX_KNOTS - 2 ];
+} channel_route;
+
+static int router_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples );
+
+void channel_matrix_identity( channel_matrix matrix, int channels )
+{
+	int i;
+	memset( matrix, 0, sizeof( channel_matrix ) );
+	for ( i = 0; i < channels && i < ROUTER_MAX_CHANNELS; i++ )
+		matrix[i][i] = 1.0f;
+}
+
+/** Add a channel operation to the frame's audio stack.
+*/
+
+void channel_router_push( mlt_frame frame, channel_router_op op, void *data )
+{
+	mlt_frame_push_audio( frame, data );
+	mlt_frame_push_audio( frame, op );
+	mlt_frame_push_audio( frame, router_get_audio );
+}
+
+/** Give the gains of the running operation at a point inside the frame.
+ *
+ * Points must be given in increasing order, and only from within an operation.
+*/
+
+void channel_router_bend( mlt_frame frame, double position, channel_matrix gains )
+{
+	channel_route *route = mlt_properties_get_data( MLT_FRAME_PROPERTIES( frame ), "_channel_router", NULL );
+	if ( route && route->bends < ROUTER_MAX_KNOTS - 2 && position > 0.0 && position < 1.0 &&
+		 ( !route->bends || position > route->bend_at[ route->bends - 1 ] ) )
+	{
+		route->bend_at[ route->bends ] = position;
+		memcpy( route->bend[ route->bends ], gains, sizeof( channel_matrix ) );
+		route->bends++;
+	}
+}
+
+/** Multiply an operation of \p outputs rows into a route matrix.
+*/
+
+static void compose( channel_matrix matrix, channel_matrix op, int outputs, int inner, int inputs )
+{
+	channel_matrix result;
+	int o, k, i;
+
+	memset( result, 0, sizeof( result ) );
+	for ( o = 0; o < outputs; o++ )
+		for ( k = 0; k < inner; k++ )
+			if ( op[o][k] != 0.0f )
+				for ( i = 0; i < inputs; i++ )
+					result[o][i] += op[o][k] * matrix[k][i];
+	memcpy( matrix, result, sizeof( result ) );
+}
+
+/** Get the gains of a piecewise linear ramp at a fraction of the frame.
+*/
+
+static void knot_value( int knots, const double *at, channel_matrix **gains, double position, channel_matrix result, int outputs, int inputs )
+{
+	int k = 0, o, i;
+	double f;
+
+	while ( k + 2 < knots && at[ k + 1 ] <= position )
+		k++;
+	f = at[ k + 1 ] > at[k] ? ( position - at[k] ) / ( at[ k + 1 ] - at[k] ) : 0.0;
+	memset( result, 0, sizeof( channel_matrix ) );
+	for ( o = 0; o < outputs; o++ )
+		for ( i = 0; i < inputs; i++ )
+			result[o][i] = ( *gains[k] )[o][i] + f * ( ( *gains[ k + 1 ] )[o][i] - ( *gains[k] )[o][i] );
+}
+
+/** Multiply an operation, given at its own points, into a route.
+ *
+ * The result has the points of both, so bends of either survive.
+ * \return the composed route, which replaces \p route
+*/
+
+static channel_route *route_compose( channel_route *route, int outputs, channel_matrix start, channel_matrix end )
+{
+	channel_route *result = calloc( 1, sizeof( channel_route ) );
+	channel_matrix *route_gains[ ROUTER_MAX_KNOTS ], *op_gains[ ROUTER_MAX_KNOTS ];
+	double op_at[ ROUTER_MAX_KNOTS ];
+	channel_matrix op;
+	int op_knots = 0, r = 0, k = 0;
+
+	if ( !result )
+		return NULL;
+
+	op_at[ op_knots ] = 0.0;
+	op_gains[ op_knots++ ] = (channel_matrix*) start;
+	for ( k = 0; k < route->bends; k++ )
+	{
+		op_at[ op_knots ] = route->bend_at[k];
+		op_gains[ op_knots++ ] = &route->bend[k];
+	}
+	op_at[ op_knots ] = 1.0;
+	op_gains[ op_knots++ ] = (channel_matrix*) end;
+	for ( k = 0; k < route->knots; k++ )
+		route_gains[k] = &route->gains[k];
+
+	// Merge the points of both, which start at 0 and end at 1
+	result->at[ result->knots++ ] = 0.0;
+	r = k = 1;
+	while ( r < route->knots - 1 || k < op_knots - 1 )
+	{
+		double next = r < route->knots - 1 && ( k >= op_knots - 1 || route->at[r] <= op_at[k] ) ? route->at[ r++ ] : op_at[ k++ ];
+		if ( next > result->at[ result->knots - 1 ] && result->knots < ROUTER_MAX_KNOTS - 1 )
+			result->at[ result->knots++ ] = next;
+	}
+	result->at[ result->knots++ ] = 1.0;
+
+	for ( k = 0; k < result->knots; k++ )
+	{
+		knot_value( route->knots, route->at, route_gains, result->at[k], result->gains[k], route->outputs, route->inputs );
+		knot_value( op_knots, op_at, op_gains, result->at[k], op, outputs, route->outputs );
+		compose( result->gains[k], op, outputs, route->outputs, route->inputs );
+	}
+	result->inputs = route->inputs;
+	result->outputs = outputs;
+
+	return result;
+}
+
+static int route_is_identity( channel_route *route )
+{
+	int o, i, k;
+	if ( route->inputs != route->outputs )
+		return 0;
+	for ( k = 0; k < route->knots; k++ )
+		for ( o = 0; o < route->outputs; o++ )
+			for ( i = 0; i < route->inputs; i++ )
+				if ( route->gains[k][o][i] != ( o == i ) )
+					return 0;
+	return 1;
+}
+
+/** Find the input each output copies, or -1 for silence.
+ *
+ * \return false if some output mixes or scales its inputs
+ */
+
+static int route_selection( channel_route *route, int *selection )
+{
+	int o, i, k;
+	for ( o = 0; o < route->outputs; o++ )
+	{
+		selection[o] = -1;
+		for ( i = 0; i < route->inputs; i++ )
+		{
+			for ( k = 1; k < route->knots; k++ )
+				if ( route->gains[k][o][i] != route->gains[0][o][i] )
+					return 0;
+			if ( route->gains[0][o][i] == 1.0f && selection[o] == -1 )
+				selection[o] = i;
+			else if ( route->gains[0][o][i] != 0.0f )
+				return 0;
+		}
+	}
+	return 1;
+}
+
+#define GATHER( type ) \
+	{ \
+		type *s = (type*) src, *d = (type*) dest; \
+		for ( i = 0; i < samples; i++, s += inputs ) \
+			for ( o = 0; o < outputs; o++ ) \
+				*d++ = selection[o] >= 0 ? s[ selection[o] ] : 0; \
+	}
+
+/** Copy channels in the native sample format.
+*/
+
+static void route_gather( const uint8_t *src, uint8_t *dest, mlt_audio_format format, int inputs, int outputs, int samples, int *selection )
+{
+	int bytes = mlt_audio_format_size( format, 1, 1 );
+	int i, o;
+
+	if ( format == mlt_audio_s32 || format == mlt_audio_float )
+	{
+		for ( o = 0; o < outputs; o++ )
+		{
+			if ( selection[o] >= 0 )
+				memcpy( dest + o * samples * bytes, src + selection[o] * samples * bytes, samples * bytes );
+			else
+				memset( dest + o * samples * bytes, 0, samples * bytes );
+		}
+	}
+	else if ( bytes == 2 )
+		GATHER( int16_t )
+	else if ( bytes == 4 )
+		GATHER( int32_t )
+	else
+		GATHER( uint8_t )
+}
+
+/** Widen audio to planar float.
+*/
+
+static float *load_planar( void *buffer, mlt_audio_format format, int channels, int samples )
+{
+	float *dest = mlt_pool_alloc( mlt_audio_format_size( mlt_audio_float, samples, channels ) );
+	int c, i;
+
+	if ( dest )
+	for ( c = 0; c < channels; c++ )
+	{
+		float *d = dest + c * samples;
+		switch ( format )
+		{
+		case mlt_audio_s16:
+			for ( i = 0; i < samples; i++ )
+				d[i] = ( (int16_t*) buffer )[ i * channels + c ] / 32768.0f;
+			break;
+		case mlt_audio_s32le:
+			for ( i = 0; i < samples; i++ )
+				d[i] = ( (int32_t*) buffer )[ i * channels + c ] / 2147483648.0f;
+			break;
+		case mlt_audio_s32:
+			for ( i = 0; i < samples; i++ )
+				d[i] = ( (int32_t*) buffer )[ c * samples + i ] / 2147483648.0f;
+			break;
+		case mlt_audio_f32le:
+			for ( i = 0; i < samples; i++ )
+				d[i] = ( (float*) buffer )[ i * channels + c ];
+			break;
+		case mlt_audio_u8:
+			for ( i = 0; i < samples; i++ )
+				d[i] = ( ( (uint8_t*) buffer )[ i * channels + c ] - 128 ) / 128.0f;
+			break;
+		default:
+			mlt_pool_release( dest );
+			return NULL;
+		}
+	}
+	return dest;
+}
+
+/** Narrow planar float audio back to another format.
+*/
+
+static void *store_planar( float *src, mlt_audio_format format, int channels, int samples )
+{
+	void *dest = mlt_pool_alloc( mlt_audio_format_size( format, samples, channels ) );
+	int c, i;
+
+	if ( dest )
+	for ( c = 0; c < channels; c++ )
+	{
+		float *s = src + c * samples;
+		for ( i = 0; i < samples; i++ )
+		{
+			float x = s[i] > 1.0f ? 1.0f : s[i] < -1.0f ? -1.0f : s[i];
+			switch ( format )
+			{
+			case mlt_audio_s16:
+				( (int16_t*) dest )[ i * channels + c ] = x * 32767.0f;
+				break;
+			case mlt_audio_s32le:
+				( (int32_t*) dest )[ i * channels + c ] = x * 2147483647.0;
+				break;
+			case mlt_audio_s32:
+				( (int32_t*) dest )[ c * samples + i ] = x * 2147483647.0;
+				break;
+			case mlt_audio_f32le:
+				( (float*) dest )[ i * channels + c ] = s[i];
+				break;
+			default:
+				( (uint8_t*) dest )[ i * channels + c ] = x * 127.0f + 128;
+				break;
+			}
+		}
+	}
+	return dest;
+}
+
+/** Add a channel scaled by a linear gain ramp to an output channel.
+*/
+
+static inline void mix_ramp( float *dest, const float *src, int samples, float gain, float step )
+{
+	int i = 0;
+#if defined(USE_SSE) && defined(ARCH_X86_64)
+	__m128 g = _mm_set_ps( gain + 3 * step, gain + 2 * step, gain + step, gain );
+	__m128 g_step = _mm_set1_ps( 4 * step );
+	for ( ; i + 4 <= samples; i += 4 )
+	{
+		__m128 x = _mm_mul_ps( _mm_loadu_ps( src + i ), g );
+		_mm_storeu_ps( dest + i, _mm_add_ps( _mm_loadu_ps( dest + i ), x ) );
+		g = _mm_add_ps( g, g_step );
+	}
+#endif
+	for ( ; i < samples; i++ )
+		dest[i] += src[i] * ( gain + i * step );
+}
+
+/** Apply the composed matrix to the audio in one pass.
+*/
+
+static void route_apply( mlt_frame frame, channel_route *route, void **buffer, mlt_audio_format *format, int *channels, int samples )
+{
+	int selection[ ROUTER_MAX_CHANNELS ];
+	int outputs = route->outputs;
+
+	if ( route_is_identity( route ) )
+		return;
+
+	if ( route_selection( route, selection ) )
+	{
+		// Pure copies, swaps and drops need no arithmetic
+		int size = mlt_audio_format_size( *format, samples, outputs );
+		void *dest = size > 0 ? mlt_pool_alloc( size ) : NULL;
+		if ( dest )
+		{
+			route_gather( *buffer, dest, *format, route->inputs, outputs, samples, selection );
+			mlt_frame_set_audio( frame, dest, *format, size, mlt_pool_release );
+			*buffer = dest;
+			*channels = outputs;
+		}
+		return;
+	}
+
+	float *src = *format == mlt_audio_float ? *buffer : load_planar( *buffer, *format, route->inputs, samples );
+	int size = mlt_audio_format_size( mlt_audio_float, samples, outputs );
+	float *dest = mlt_pool_alloc( size );
+	int o, i, k;
+
+	if ( !src || !dest )
+	{
+		mlt_log_error( NULL, "[channel router] Invalid audio format\n" );
+		if ( src != *buffer )
+			mlt_pool_release( src );
+		mlt_pool_release( dest );
+		return;
+	}
+
+	for ( o = 0; o < outputs; o++ )
+	{
+		float *d = dest + o * samples;
+		int copied = 0;
+		memset( d, 0, samples * sizeof( float ) );
+		for ( i = 0; i < route->inputs; i++ )
+		{
+			float gain = route->gains[0][o][i];
+			int constant = 1;
+			for ( k = 1; k < route->knots; k++ )
+				constant = constant && route->gains[k][o][i] == gain;
+			if ( gain == 0.0f && constant )
+				continue;
+			if ( gain == 1.0f && constant && !copied )
+			{
+				memcpy( d, src + i * samples, samples * sizeof( float ) );
+			}
+			else
+			{
+				// Ramp linearly from each point to the next
+				for ( k = 0; k + 1 < route->knots; k++ )
+				{
+					int first = route->at[k] * samples + 0.5;
+					int last = route->at[ k + 1 ] * samples + 0.5;
+					if ( last > first )
+						mix_ramp( d + first, src + i * samples + first, last - first, route->gains[k][o][i],
+							( route->gains[ k + 1 ][o][i] - route->gains[k][o][i] ) / ( last - first ) );
+				}
+			}
+			copied = 1;
+		}
+	}
+	if ( src != *buffer )
+		mlt_pool_release( src );
+
+	// Stay in float unless nothing downstream could convert it back
+	if ( *format != mlt_audio_float && !frame->convert_audio )
+	{
+		void *narrow = store_planar( dest, *format, outputs, samples );
+		mlt_pool_release( dest );
+		size = mlt_audio_format_size( *format, samples, outputs );
+		mlt_frame_set_audio( frame, narrow, *format, size, mlt_pool_release );
+		*buffer = narrow;
+	}
+	else
+	{
+		mlt_frame_set_audio( frame, dest, mlt_audio_float, size, mlt_pool_release );
+		*buffer = dest;
+		*format = mlt_audio_float;
+	}
+	*channels = outputs;
+}
+
+static int router_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
+{
+	channel_router_op op = mlt_frame_pop_audio( frame );
+	void *data = mlt_frame_pop_audio( frame );
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+	int requested = *channels;
+
+	// A router that called us directly applies our operation with its own
+	int defer = mlt_properties_get_int( properties, "_channel_router.defer" );
+
+	// Likewise fold the next service's operation into ours when it is a router
+	void *next = mlt_deque_peek_back( MLT_FRAME_AUDIO_STACK( frame ) );
+	mlt_properties_set_int( properties, "_channel_router.defer", next == (void*) router_get_audio );
+	// Take the audio in whatever format it comes, since a route may not even need arithmetic
+	const mlt_audio_format accepted[] = { *format != mlt_audio_none ? *format : mlt_audio_float, mlt_audio_float,
+		mlt_audio_s16, mlt_audio_s32le, mlt_audio_s32, mlt_audio_f32le, mlt_audio_u8, mlt_audio_none };
+	int error = mlt_frame_get_audio_accepting( frame, accepted, buffer, format, frequency, channels, samples );
+	mlt_properties_set_int( properties, "_channel_router.defer", 0 );
+	if ( error || *channels <= 0 || *channels > ROUTER_MAX_CHANNELS || *samples <= 0 )
+		return error;
+
+	channel_route *route = mlt_properties_get_data( properties, "_channel_router", NULL );
+	if ( !route )
+	{
+		route = calloc( 1, sizeof( channel_route ) );
+		if ( !route )
+			return 0;
+		route->inputs = route->outputs = *channels;
+		route->knots = 2;
+		route->at[1] = 1.0;
+		channel_matrix_identity( route->gains[0], *channels );
+		channel_matrix_identity( route->gains[1], *channels );
+		mlt_properties_set_data( properties, "_channel_router", route, sizeof( channel_route ), free, NULL );
+	}
+
+	// Compose this operation into the route
+	channel_matrix start, end;
+	memset( start, 0, sizeof( start ) );
+	memset( end, 0, sizeof( end ) );
+	route->bends = 0;
+	int outputs = op( data, frame, route->outputs, requested, start, end );
+	if ( outputs > 0 && outputs <= ROUTER_MAX_CHANNELS )
+	{
+		channel_route *composed = route_compose( route, outputs, start, end );
+		if ( composed )
+		{
+			mlt_properties_set_data( properties, "_channel_router", composed, sizeof( channel_route ), free, NULL );
+			route = composed;
+		}
+	}
+
+	if ( !defer )
+	{
+		route_apply( frame, route, buffer, format, channels, *samples );
+		mlt_properties_set_data( properties, "_channel_router", NULL, 0, NULL, NULL );
+	}
+
+	return 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * channel_router.h -- matrix based audio channel routing
+ * Copyright (C) 2015 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _CHANNEL_ROUTER_H_
+#define _CHANNEL_ROUTER_H_
+
+#include <framework/mlt_frame.h>
+
+#define ROUTER_MAX_CHANNELS 32
+
+/** A gain matrix indexed by [output channel][input channel]. */
+
+typedef float channel_matrix[ ROUTER_MAX_CHANNELS ][ ROUTER_MAX_CHANNELS ];
+
+/** Describe one channel operation as a gain matrix.
+ *
+ * The matrices are zeroed on entry. The operation fills \p start with the
+ * gains at the first sample of the frame and \p end with the gains after the
+ * last, between which the router ramps linearly. Gains that do not change
+ * linearly can add points in between with channel_router_bend.
+ *
+ * \param data the pointer given to channel_router_push
+ * \param frame the frame
+ * \param channels the number of channels going into the operation
+ * \param requested the number of channels asked of the filter
+ * \param start the gains at the start of the frame
+ * \param end the gains at the end of the frame
+ * \return the number of channels coming out of the operation
+ */
+
+typedef int ( *channel_router_op )( void *data, mlt_frame frame, int channels, int requested, channel_matrix start, channel_matrix end );
+
+extern void channel_router_push( mlt_frame frame, channel_router_op op, void *data );
+extern void channel_router_bend( mlt_frame frame, double position, channel_matrix gains );
+extern void channel_matrix_identity( channel_matrix matrix, int channels );
+
+#endif
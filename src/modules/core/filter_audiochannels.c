@@ -20,107 +20,27 @@
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
 #include <framework/mlt_log.h>
+#include "channel_router.h"
 
 #include <string.h>
 
-static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
-{
-	// Used to return number of channels in the source
-	int channels_avail = *channels;
-
-	// Get the producer's audio
-	int error = mlt_frame_get_audio( frame, buffer, format, frequency, &channels_avail, samples );
-	if ( error ) return error;
+/** Describe the conversion to the requested number of channels.
+ *
+ * Missing channels repeat the existing ones in turn, and extra channels are
+ * dropped from the end.
+ */
 
-	if ( channels_avail < *channels )
-	{
-		int size = mlt_audio_format_size( *format, *samples, *channels );
-		int16_t *new_buffer = mlt_pool_alloc( size );
+static int audiochannels_op( void *data, mlt_frame frame, int channels, int requested, channel_matrix start, channel_matrix end )
+{
+	int i;
 
-		// Duplicate the existing channels
-		if ( *format == mlt_audio_s16 )
-		{
-			int i, j, k = 0;
-			for ( i = 0; i < *samples; i++ )
-			{
-				for ( j = 0; j < *channels; j++ )
-				{
-					new_buffer[ ( i * *channels ) + j ] = ((int16_t*)(*buffer))[ ( i * channels_avail ) + k ];
-					k = ( k + 1 ) % channels_avail;
-				}
-			}
-		}
-		else if ( *format == mlt_audio_s32le || *format == mlt_audio_f32le )
-		{
-			int32_t *p = (int32_t*) new_buffer;
-			int i, j, k = 0;
-			for ( i = 0; i < *samples; i++ )
-			{
-				for ( j = 0; j < *channels; j++ )
-				{
-					p[ ( i * *channels ) + j ] = ((int32_t*)(*buffer))[ ( i * channels_avail ) + k ];
-					k = ( k + 1 ) % channels_avail;
-				}
-			}
-		}
-		else if ( *format == mlt_audio_u8 )
-		{
-			uint8_t *p = (uint8_t*) new_buffer;
-			int i, j, k = 0;
-			for ( i = 0; i < *samples; i++ )
-			{
-				for ( j = 0; j < *channels; j++ )
-				{
-					p[ ( i * *channels ) + j ] = ((uint8_t*)(*buffer))[ ( i * channels_avail ) + k ];
-					k = ( k + 1 ) % channels_avail;
-				}
-			}
-		}
-		else
-		{
-			// non-interleaved - s32 or float
-			int size_avail = mlt_audio_format_size( *format, *samples, channels_avail );
-			int32_t *p = (int32_t*) new_buffer;
-			int i = *channels / channels_avail;
-			while ( i-- )
-			{
-				memcpy( p, *buffer, size_avail );
-				p += size_avail / sizeof(*p);
-			}
-			i = *channels % channels_avail;
-			if ( i )
-			{
-				size_avail = mlt_audio_format_size( *format, *samples, i );
-				memcpy( p, *buffer, size_avail );
-			}
-		}
-		// Update the audio buffer now - destroys the old
-		mlt_frame_set_audio( frame, new_buffer, *format, size, mlt_pool_release );
-		*buffer = new_buffer;
-	}
-	else if ( channels_avail > *channels )
-	{
-		int size = mlt_audio_format_size( *format, *samples, *channels );
-		int16_t *new_buffer = mlt_pool_alloc( size );
+	if ( requested <= 0 || requested > ROUTER_MAX_CHANNELS )
+		requested = channels;
+	for ( i = 0; i < requested; i++ )
+		start[i][ i % channels ] = 1.0f;
+	memcpy( end, start, sizeof( channel_matrix ) );
 
-		// Drop all but the first *channels
-		if ( *format == mlt_audio_s16 )
-		{
-			int i, j;
-			for ( i = 0; i < *samples; i++ )
-				for ( j = 0; j < *channels; j++ )
-					new_buffer[ ( i * *channels ) + j ]	= ((int16_t*)(*buffer))[ ( i * channels_avail ) + j ];
-		}
-		else
-		{
-			// non-interleaved
-			memcpy( new_buffer, *buffer, size );
-		}
-		// Update the audio buffer now - destroys the old
-		mlt_frame_set_audio( frame, new_buffer, *format, size, mlt_pool_release );
-		*buffer = new_buffer;
-	}
-	return error;
+	return requested;
 }
 
 /** Filter processing.
@@ -128,7 +48,7 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 
 static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 {
-	mlt_frame_push_audio( frame, filter_get_audio );
+	channel_router_push( frame, audiochannels_op, filter );
 	return frame;
 }
 
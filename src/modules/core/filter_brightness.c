@@ -26,12 +26,11 @@
 
 #define CLAMP( x, min, max ) (x) < (min) ? (min) : (x) > (max) ? (max) : (x)
 
-/** Do it :-).
+/** Get the brightness level of the frame.
 */
 
-static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+static double get_level( mlt_filter filter, mlt_frame frame )
 {
-	mlt_filter filter =  (mlt_filter) mlt_frame_pop_service( frame );
 	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
 	mlt_position position = mlt_filter_get_position( filter, frame );
 	mlt_position length = mlt_filter_get_length2( filter, frame );
@@ -58,6 +57,20 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		}
 	}
 
+	return level;
+}
+
+/** Do it :-).
+*/
+
+static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+{
+	mlt_filter filter =  (mlt_filter) mlt_frame_pop_service( frame );
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	mlt_position position = mlt_filter_get_position( filter, frame );
+	mlt_position length = mlt_filter_get_length2( filter, frame );
+	double level = get_level( filter, frame );
+
 	// Do not cause an image conversion unless there is real work to do.
 	if ( level != 1.0 )
 		*format = mlt_image_yuv422;
@@ -115,8 +128,31 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 
 static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 {
-	mlt_frame_push_service( frame, filter );
-	mlt_frame_push_get_image( frame, filter_get_image );
+	if ( mlt_properties_get( MLT_FILTER_PROPERTIES( filter ), "alpha" ) )
+	{
+		mlt_frame_push_service( frame, filter );
+		mlt_frame_push_get_image( frame, filter_get_image );
+	}
+	else
+	{
+		// Without alpha this is a point operation that is fused with its neighbours
+		double level = get_level( filter, frame );
+
+		if ( level != 1.0 )
+		{
+			uint8_t lut[3][256];
+			int32_t m = level * ( 1 << 16 );
+			int32_t n = 128 * ( ( 1 << 16 ) - m );
+			int i;
+
+			for ( i = 0; i < 256; i++ )
+			{
+				lut[0][i] = CLAMP( (i * m) >> 16, 16, 235 );
+				lut[1][i] = lut[2][i] = CLAMP( (i * m + n) >> 16, 16, 240 );
+			}
+			mlt_frame_push_lut( frame, mlt_image_yuv422, lut );
+		}
+	}
 
 	return frame;
 }
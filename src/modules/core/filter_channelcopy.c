@@ -20,135 +20,40 @@
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
 #include <framework/mlt_log.h>
+#include "channel_router.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-/** Get the audio.
+/** Describe the copy or swap.
 */
 
-static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
+static int channelcopy_op( void *data, mlt_frame frame, int channels, int requested, channel_matrix start, channel_matrix end )
 {
 	// Get the properties of the a frame
 	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
 
-	// Get the filter service
-	mlt_filter filter = mlt_frame_pop_audio( frame );
-
 	int from = mlt_properties_get_int( properties, "channelcopy.from" );
 	int to = mlt_properties_get_int( properties, "channelcopy.to" );
 	int swap = mlt_properties_get_int( properties, "channelcopy.swap" );
 
-	// Get the producer's audio
-	mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
+	channel_matrix_identity( start, channels );
 
 	// Copy channels as necessary
-	if ( from != to)
-	switch ( *format )
+	if ( from != to && from >= 0 && from < channels && to >= 0 && to < channels )
 	{
-		case mlt_audio_u8:
-		{
-			uint8_t *f = (uint8_t*) *buffer + from;
-			uint8_t *t = (uint8_t*) *buffer + to;
-			uint8_t x;
-			int i;
-
-			if ( swap )
-				for ( i = 0; i < *samples; i++, f += *channels, t += *channels )
-				{
-					x = *t;
-					*t = *f;
-					*f = x;
-				}
-			else
-				for ( i = 0; i < *samples; i++, f += *channels, t += *channels )
-					*t = *f;
-			break;
-		}
-		case mlt_audio_s16:
-		{
-			int16_t *f = (int16_t*) *buffer + from;
-			int16_t *t = (int16_t*) *buffer + to;
-			int16_t x;
-			int i;
-
-			if ( swap )
-				for ( i = 0; i < *samples; i++, f += *channels, t += *channels )
-				{
-					x = *t;
-					*t = *f;
-					*f = x;
-				}
-			else
-				for ( i = 0; i < *samples; i++, f += *channels, t += *channels )
-					*t = *f;
-			break;
-		}
-		case mlt_audio_s32:
-		{
-			int32_t *f = (int32_t*) *buffer + from * *samples;
-			int32_t *t = (int32_t*) *buffer + to * *samples;
-
-			if ( swap )
-			{
-				int32_t *x = malloc( *samples * sizeof(int32_t) );
-				memcpy( x, t, *samples * sizeof(int32_t) );
-				memcpy( t, f, *samples * sizeof(int32_t) );
-				memcpy( f, x, *samples * sizeof(int32_t) );
-				free( x );
-			}
-			else
-			{
-				memcpy( t, f, *samples * sizeof(int32_t) );
-			}
-			break;
-		}
-		case mlt_audio_s32le:
-		case mlt_audio_f32le:
-		{
-			int32_t *f = (int32_t*) *buffer + from;
-			int32_t *t = (int32_t*) *buffer + to;
-			int32_t x;
-			int i;
-
-			if ( swap )
-				for ( i = 0; i < *samples; i++, f += *channels, t += *channels )
-				{
-					x = *t;
-					*t = *f;
-					*f = x;
-				}
-			else
-				for ( i = 0; i < *samples; i++, f += *channels, t += *channels )
-					*t = *f;
-			break;
-		}
-		case mlt_audio_float:
+		start[to][to] = 0.0f;
+		start[to][from] = 1.0f;
+		if ( swap )
 		{
-			float *f = (float*) *buffer + from * *samples;
-			float *t = (float*) *buffer + to * *samples;
-
-			if ( swap )
-			{
-				float *x = malloc( *samples * sizeof(float) );
-				memcpy( x, t, *samples * sizeof(float) );
-				memcpy( t, f, *samples * sizeof(float) );
-				memcpy( f, x, *samples * sizeof(float) );
-				free( x );
-			}
-			else
-			{
-				memcpy( t, f, *samples * sizeof(float) );
-			}
-			break;
+			start[from][from] = 0.0f;
+			start[from][to] = 1.0f;
 		}
-		default:
-			mlt_log_error( MLT_FILTER_SERVICE( filter ), "Invalid audio format\n" );
-			break;
 	}
+	memcpy( end, start, sizeof( channel_matrix ) );
 
-	return 0;
+	return channels;
 }
 
 /** Filter processing.
@@ -165,8 +70,7 @@ static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 	mlt_properties_set_int( frame_props, "channelcopy.swap", mlt_properties_get_int( properties, "swap" ) );
 
 	// Override the get_audio method
-	mlt_frame_push_audio( frame, filter );
-	mlt_frame_push_audio( frame, filter_get_audio );
+	channel_router_push( frame, channelcopy_op, filter );
 
 	return frame;
 }
@@ -23,29 +23,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-/** Do it :-).
+/** Filter processing.
 */
 
-static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
+static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 {
-	*format = mlt_image_yuv422;
-	int error = mlt_frame_get_image( frame, image, format, width, height, 1 );
-	if ( error == 0 )
+	uint8_t lut[3][256];
+	int i;
+
+	for ( i = 0; i < 256; i++ )
 	{
-		uint8_t *p = *image;
-		uint8_t *q = *image + *width * *height * 2;
-		while ( p ++ != q )
-			*p ++ = 128;
+		lut[0][i] = i;
+		lut[1][i] = lut[2][i] = 128;
 	}
-	return error;
-}
+	mlt_frame_push_lut( frame, mlt_image_yuv422, lut );
 
-/** Filter processing.
-*/
-
-static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
-{
-	mlt_frame_push_get_image( frame, filter_get_image );
 	return frame;
 }
 
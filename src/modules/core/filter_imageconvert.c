@@ -70,13 +70,13 @@ static int convert_yuv422_to_rgb24a( uint8_t *yuv, uint8_t *rgba, uint8_t *alpha
 		rgba[0] = r;
 		rgba[1] = g;
 		rgba[2] = b;
-		rgba[3] = *alpha++;
+		rgba[3] = alpha ? *alpha++ : 0xff;
 		yy = yuv[2];
 		YUV2RGB_601( yy, uu, vv, r, g, b );
 		rgba[4] = r;
 		rgba[5] = g;
 		rgba[6] = b;
-		rgba[7] = *alpha++;
+		rgba[7] = alpha ? *alpha++ : 0xff;
 		yuv += 4;
 		rgba += 8;
 	}
@@ -285,7 +285,8 @@ static int convert_rgb24a_to_rgb24( uint8_t *rgba, uint8_t *rgb, uint8_t *alpha,
 		*d++ = s[0];
 		*d++ = s[1];
 		*d++ = s[2];
-		*alpha++ = s[3];
+		if ( alpha )
+			*alpha++ = s[3];
 		s += 4;
 	}
 	return 0;
@@ -322,22 +323,27 @@ static int convert_image( mlt_frame frame, uint8_t **buffer, mlt_image_format *f
 			int size = width * height * bpp_table[ requested_format - 1 ];
 			int alpha_size = width * height;
 			uint8_t *image = mlt_pool_alloc( size );
+			// There is no need to extract or synthesise the alpha of an opaque image
+			int opaque = mlt_frame_is_opaque( frame );
 			uint8_t *alpha = ( *format == mlt_image_rgb24a ||
-			                   *format == mlt_image_opengl )
+			                   *format == mlt_image_opengl ) && !opaque
 			                 ? mlt_pool_alloc( width * height ) : NULL;
 			if ( requested_format == mlt_image_rgb24a || requested_format == mlt_image_opengl )
 			{
 				if ( alpha )
 					mlt_pool_release( alpha );
-				alpha = mlt_frame_get_alpha_mask( frame );
+				alpha = opaque ? mlt_frame_get_alpha( frame ) : mlt_frame_get_alpha_mask( frame );
 				mlt_properties_get_data( properties, "alpha", &alpha_size );
 			}
 
 			if ( !( error = converter( *buffer, image, alpha, width, height ) ) )
 			{
+				// Converting keeps the alpha values
+				int uniform_alpha = mlt_frame_get_uniform_alpha( frame );
 				mlt_frame_set_image( frame, image, size, mlt_pool_release );
 				if ( alpha && ( *format == mlt_image_rgb24a || *format == mlt_image_opengl ) )
 					mlt_frame_set_alpha( frame, alpha, alpha_size, mlt_pool_release );
+				mlt_frame_set_uniform_alpha( frame, uniform_alpha );
 				*buffer = image;
 				*format = requested_format;
 			}
@@ -20,124 +20,30 @@
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
 #include <framework/mlt_log.h>
+#include "channel_router.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-/** Get the audio.
+/** Describe the mixdown of all channels into each output.
 */
 
-static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
+static int mono_op( void *data, mlt_frame frame, int channels, int requested, channel_matrix start, channel_matrix end )
 {
 	// Get the properties of the a frame
 	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
 	int channels_out = mlt_properties_get_int( properties, "mono.channels" );
-	int i, j, size;
+	int i, j;
 
-	// Get the producer's audio
-	mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
+	if ( channels_out <= 0 || channels_out > ROUTER_MAX_CHANNELS )
+		channels_out = channels;
+	for ( i = 0; i < channels_out; i++ )
+		for ( j = 0; j < channels; j++ )
+			start[i][j] = 1.0f / channels;
+	memcpy( end, start, sizeof( channel_matrix ) );
 
-	if ( channels_out == -1 )
-		channels_out = *channels;
-	size = mlt_audio_format_size( *format, *samples, channels_out );
-
-	switch ( *format )
-	{
-		case mlt_audio_u8:
-		{
-			uint8_t *new_buffer = mlt_pool_alloc( size );
-			for ( i = 0; i < *samples; i++ )
-			{
-				uint8_t mixdown = 0;
-				for ( j = 0; j < *channels; j++ )
-					mixdown += ((uint8_t*) *buffer)[ ( i * *channels ) + j ] / *channels;
-				for ( j = 0; j < channels_out; j++ )
-					new_buffer[ ( i * channels_out ) + j ] = mixdown;
-			}
-			*buffer = new_buffer;
-			break;
-		}
-		case mlt_audio_s16:
-		{
-			int16_t *new_buffer = mlt_pool_alloc( size );
-			for ( i = 0; i < *samples; i++ )
-			{
-				int16_t mixdown = 0;
-				for ( j = 0; j < *channels; j++ )
-					mixdown += ((int16_t*) *buffer)[ ( i * *channels ) + j ] / *channels;
-				for ( j = 0; j < channels_out; j++ )
-					new_buffer[ ( i * channels_out ) + j ] = mixdown;
-			}
-			*buffer = new_buffer;
-			break;
-		}
-		case mlt_audio_s32le:
-		{
-			int32_t *new_buffer = mlt_pool_alloc( size );
-			for ( i = 0; i < *samples; i++ )
-			{
-				int32_t mixdown = 0;
-				for ( j = 0; j < *channels; j++ )
-					mixdown += ((int32_t*) *buffer)[ ( i * *channels ) + j ] / *channels;
-				for ( j = 0; j < channels_out; j++ )
-					new_buffer[ ( i * channels_out ) + j ] = mixdown;
-			}
-			*buffer = new_buffer;
-			break;
-		}
-		case mlt_audio_f32le:
-		{
-			float *new_buffer = mlt_pool_alloc( size );
-			for ( i = 0; i < *samples; i++ )
-			{
-				float mixdown = 0;
-				for ( j = 0; j < *channels; j++ )
-					mixdown += ((float*) *buffer)[ ( i * *channels ) + j ] / *channels;
-				for ( j = 0; j < channels_out; j++ )
-					new_buffer[ ( i * channels_out ) + j ] = mixdown;
-			}
-			*buffer = new_buffer;
-			break;
-		}
-		case mlt_audio_s32:
-		{
-			int32_t *new_buffer = mlt_pool_alloc( size );
-			for ( i = 0; i < *samples; i++ )
-			{
-				int32_t mixdown = 0;
-				for ( j = 0; j < *channels; j++ )
-					mixdown += ((int32_t*) *buffer)[ ( j * *channels ) + i ] / *channels;
-				for ( j = 0; j < channels_out; j++ )
-					new_buffer[ ( j * *samples ) + i ] = mixdown;
-			}
-			*buffer = new_buffer;
-			break;
-		}
-		case mlt_audio_float:
-		{
-			float *new_buffer = mlt_pool_alloc( size );
-			for ( i = 0; i < *samples; i++ )
-			{
-				float mixdown = 0;
-				for ( j = 0; j < *channels; j++ )
-					mixdown += ((float*) *buffer)[ ( j * *channels ) + i ] / *channels;
-				for ( j = 0; j < channels_out; j++ )
-					new_buffer[ ( j * *samples ) + i ] = mixdown;
-			}
-			*buffer = new_buffer;
-			break;
-		}
-		default:
-			mlt_log_error( NULL, "[filter mono] Invalid audio format\n" );
-			break;
-	}
-	if ( size > *samples * channels_out )
-	{
-		mlt_frame_set_audio( frame, *buffer, *format, size, mlt_pool_release );
-		*channels = channels_out;
-	}
-
-	return 0;
+	return channels_out;
 }
 
 /** Filter processing.
@@ -152,7 +58,7 @@ static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 	mlt_properties_set_int( frame_props, "mono.channels", mlt_properties_get_int( properties, "channels" ) );
 
 	// Override the get_audio method
-	mlt_frame_push_audio( frame, filter_get_audio );
+	channel_router_push( frame, mono_op, filter );
 
 	return frame;
 }
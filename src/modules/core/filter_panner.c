@@ -20,6 +20,7 @@
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
 #include <framework/mlt_log.h>
+#include "channel_router.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,170 +28,148 @@
 #include <math.h>
 
 
-/** Get the audio.
+/** Fill a gain matrix for one mix level.
 */
 
-static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
+static void panner_matrix( channel_matrix matrix, int channels, int active_channel, int gang, double weight )
 {
-	mlt_properties properties = mlt_frame_pop_audio( frame );
-	mlt_filter filter = mlt_frame_pop_audio( frame );
-	mlt_properties filter_props = MLT_FILTER_PROPERTIES( filter );
-	mlt_properties frame_props = MLT_FRAME_PROPERTIES( frame );
-
-	// We can only mix s16
-	*format = mlt_audio_s16;
-	mlt_frame_get_audio( frame, (void**) buffer, format, frequency, channels, samples );
-
-	// Apply silence
-	int silent = mlt_properties_get_int( frame_props, "silent_audio" );
-	mlt_properties_set_int( frame_props, "silent_audio", 0 );
-	if ( silent )
-		memset( *buffer, 0, *samples * *channels * sizeof( int16_t ) );
-
-	int src_size = 0;
-	int16_t *src = mlt_properties_get_data( filter_props, "scratch_buffer", &src_size );
-	int16_t *dest = *buffer;
-	double v; // sample accumulator
-	int i, out, in;
 	double factors[6][6]; // mixing weights [in][out]
-	double mix_start = 0.5, mix_end = 0.5;
-	if ( mlt_properties_get( properties, "previous_mix" ) != NULL )
-		mix_start = mlt_properties_get_double( properties, "previous_mix" );
-	if ( mlt_properties_get( properties, "mix" ) != NULL )
-		mix_end = mlt_properties_get_double( properties, "mix" );
-	double weight = mix_start;
-	double weight_step = ( mix_end - mix_start ) / *samples;
-	int active_channel = mlt_properties_get_int( properties, "channel" );
-	int gang = mlt_properties_get_int( properties, "gang" ) ? 2 : 1;
-	// Use an inline low-pass filter to help avoid clipping
-	double Fc = 0.5;
-	double B = exp(-2.0 * M_PI * Fc);
-	double A = 1.0 - B;
-	double vp[6];
-
-	// Setup or resize a scratch buffer
-	if ( !src || src_size < *samples * *channels * sizeof(int16_t) )
-	{
-		// We allocate 4 more samples than we need to deal with jitter in the sample count per frame.
-		src_size = ( *samples + 4 ) * *channels * sizeof(int16_t);
-		src = mlt_pool_alloc( src_size );
-		if ( !src )
-			return 0;
-		mlt_properties_set_data( filter_props, "scratch_buffer", src, src_size, mlt_pool_release, NULL );
-	}
-
-	// We must use a pristine copy as the source
-	memcpy( src, *buffer, *samples * *channels * sizeof(int16_t) );
+	int i, out, in;
 
 	// Initialize the mix factors
 	for ( i = 0; i < 6; i++ )
 		for ( out = 0; out < 6; out++ )
 			factors[i][out] = 0.0;
 
-	for ( out = 0; out < *channels; out++ )
-		vp[out] = (double) dest[out];
-
-	for ( i = 0; i < *samples; i++ )
+	// Compute the mix factors
+	switch ( active_channel )
 	{
-		// Recompute the mix factors
-		switch ( active_channel )
+		case -1: // Front L/R balance
+		case -2: // Rear L/R balance
 		{
-			case -1: // Front L/R balance
-			case -2: // Rear L/R balance
+			// Gang front/rear balance if requested
+			int g, active = active_channel;
+			for ( g = 0; g < gang; g++, active-- )
 			{
-				// Gang front/rear balance if requested
-				int g, active = active_channel;
-				for ( g = 0; g < gang; g++, active-- )
+				int left = active == -1 ? 0 : 2;
+				int right = left + 1;
+				if ( weight < 0.0 )
 				{
-					int left = active == -1 ? 0 : 2;
-					int right = left + 1;
-					if ( weight < 0.0 )
-					{
-						factors[left][left] = 1.0;
-						factors[right][right] = weight + 1.0 < 0.0 ? 0.0 : weight + 1.0;
-					}
-					else
-					{
-						factors[left][left] = 1.0 - weight < 0.0 ? 0.0 : 1.0 - weight;
-						factors[right][right] = 1.0;
-					}
+					factors[left][left] = 1.0;
+					factors[right][right] = weight + 1.0 < 0.0 ? 0.0 : weight + 1.0;
 				}
-				break;
-			}
-			case -3: // Left fade
-			case -4: // right fade
-			{
-				// Gang left/right fade if requested
-				int g, active = active_channel;
-				for ( g = 0; g < gang; g++, active-- )
+				else
 				{
-					int front = active == -3 ? 0 : 1;
-					int rear = front + 2;
-					if ( weight < 0.0 )
-					{
-						factors[front][front] = 1.0;
-						factors[rear][rear] = weight + 1.0 < 0.0 ? 0.0 : weight + 1.0;
-					}
-					else
-					{
-						factors[front][front] = 1.0 - weight < 0.0 ? 0.0 : 1.0 - weight;
-						factors[rear][rear] = 1.0;
-					}
+					factors[left][left] = 1.0 - weight < 0.0 ? 0.0 : 1.0 - weight;
+					factors[right][right] = 1.0;
 				}
-				break;
 			}
-			case 0: // left
-			case 2:
+			break;
+		}
+		case -3: // Left fade
+		case -4: // right fade
+		{
+			// Gang left/right fade if requested
+			int g, active = active_channel;
+			for ( g = 0; g < gang; g++, active-- )
 			{
-				int left = active_channel;
-				int right = left + 1;
-				factors[right][right] = 1.0;
-				if ( weight < 0.0 ) // output left toward left
+				int front = active == -3 ? 0 : 1;
+				int rear = front + 2;
+				if ( weight < 0.0 )
 				{
-					factors[left][left] = 0.5 - weight * 0.5;
-					factors[left][right] = ( 1.0 + weight ) * 0.5;
+					factors[front][front] = 1.0;
+					factors[rear][rear] = weight + 1.0 < 0.0 ? 0.0 : weight + 1.0;
 				}
-				else // output left toward right
+				else
 				{
-					factors[left][left] = ( 1.0 - weight ) * 0.5;
-					factors[left][right] = 0.5 + weight * 0.5;
+					factors[front][front] = 1.0 - weight < 0.0 ? 0.0 : 1.0 - weight;
+					factors[rear][rear] = 1.0;
 				}
-				break;
 			}
-			case 1: // right
-			case 3:
+			break;
+		}
+		case 0: // left
+		case 2:
+		{
+			int left = active_channel;
+			int right = left + 1;
+			factors[right][right] = 1.0;
+			if ( weight < 0.0 ) // output left toward left
 			{
-				int right = active_channel;
-				int left = right - 1;
-				factors[left][left] = 1.0;
-				if ( weight < 0.0 ) // output right toward left
-				{
-					factors[right][left] = 0.5 - weight * 0.5;
-					factors[right][right] = ( 1.0 + weight ) * 0.5;
-				}
-				else // output right toward right
-				{
-					factors[right][left] = ( 1.0 - weight ) * 0.5;
-					factors[right][right] = 0.5 + weight * 0.5;
-				}
-				break;
+				factors[left][left] = 0.5 - weight * 0.5;
+				factors[left][right] = ( 1.0 + weight ) * 0.5;
 			}
+			else // output left toward right
+			{
+				factors[left][left] = ( 1.0 - weight ) * 0.5;
+				factors[left][right] = 0.5 + weight * 0.5;
+			}
+			break;
 		}
-
-		// Do the mixing
-		for ( out = 0; out < *channels && out < 6; out++ )
+		case 1: // right
+		case 3:
 		{
-			v = 0;
-			for ( in = 0; in < *channels && in < 6; in++ )
-				v += factors[in][out] * src[ i * *channels + in ];
+			int right = active_channel;
+			int left = right - 1;
+			factors[left][left] = 1.0;
+			if ( weight < 0.0 ) // output right toward left
+			{
+				factors[right][left] = 0.5 - weight * 0.5;
+				factors[right][right] = ( 1.0 + weight ) * 0.5;
+			}
+			else // output right toward right
+			{
+				factors[right][left] = ( 1.0 - weight ) * 0.5;
+				factors[right][right] = 0.5 + weight * 0.5;
+			}
+			break;
+		}
+	}
+
+	for ( out = 0; out < channels; out++ )
+	{
+		if ( out < 6 )
+			for ( in = 0; in < channels && in < 6; in++ )
+				matrix[out][in] = factors[in][out];
+		else
+			matrix[out][out] = 1.0f;
+	}
+}
+
+/** Describe the pan as gains ramping from the previous mix level to the current.
+*/
 
-			v = v < -32767 ? -32767 : v > 32768 ? 32768 : v;
-			vp[out] = dest[ i * *channels + out ] = (int16_t) ( v * A + vp[ out ] * B );
+static int panner_op( void *data, mlt_frame frame, int channels, int requested, channel_matrix start, channel_matrix end )
+{
+	mlt_properties properties = data;
+	mlt_properties frame_props = MLT_FRAME_PROPERTIES( frame );
+	double mix_start = 0.5, mix_end = 0.5;
+	if ( mlt_properties_get( properties, "previous_mix" ) != NULL )
+		mix_start = mlt_properties_get_double( properties, "previous_mix" );
+	if ( mlt_properties_get( properties, "mix" ) != NULL )
+		mix_end = mlt_properties_get_double( properties, "mix" );
+	int active_channel = mlt_properties_get_int( properties, "channel" );
+	int gang = mlt_properties_get_int( properties, "gang" ) ? 2 : 1;
+
+	// Apply silence
+	int silent = mlt_properties_get_int( frame_props, "silent_audio" );
+	mlt_properties_set_int( frame_props, "silent_audio", 0 );
+	if ( !silent )
+	{
+		panner_matrix( start, channels, active_channel, gang, mix_start );
+		panner_matrix( end, channels, active_channel, gang, mix_end );
+
+		// The gains bend at the center, so a pan across it ramps through there
+		if ( ( mix_start < 0.0 && mix_end > 0.0 ) || ( mix_start > 0.0 && mix_end < 0.0 ) )
+		{
+			channel_matrix center;
+			memset( center, 0, sizeof( center ) );
+			panner_matrix( center, channels, active_channel, gang, 0.0 );
+			channel_router_bend( frame, mix_start / ( mix_start - mix_end ), center );
 		}
-		weight += weight_step;
 	}
 
-	return 0;
+	return channels;
 }
 
 
@@ -288,9 +267,7 @@ static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 		instance_props, 0, (mlt_destructor) mlt_properties_close, NULL );
 
 	// Override the get_audio method
-	mlt_frame_push_audio( frame, filter );
-	mlt_frame_push_audio( frame, instance_props );
-	mlt_frame_push_audio( frame, filter_get_audio );
+	channel_router_push( frame, panner_op, instance_props );
 	
 	return frame;
 }
@@ -26,6 +26,12 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#if defined(USE_SSE) && defined(ARCH_X86_64)
+#include <emmintrin.h>
+#endif
 
 /** virtual function declaration for an image scaler
  *
@@ -102,8 +108,469 @@ static int filter_scale( mlt_frame frame, uint8_t **image, mlt_image_format *for
 		out_line += ostride;
 	}
  
-	// Now update the frame
+	// Now update the frame, whose alpha stays uniform when scaled
+	int uniform_alpha = mlt_frame_get_uniform_alpha( frame );
 	mlt_frame_set_image( frame, output, owidth * ( oheight + 1 ) * 2, mlt_pool_release );
+	mlt_frame_set_uniform_alpha( frame, uniform_alpha );
+	*image = output;
+
+	return 0;
+}
+
+/** Polyphase scaler.
+ *
+ * The separable scaler filters vertically first, on whole rows of bytes, into a
+ * 16-bit intermediate row and then filters each component horizontally out of
+ * that row. Coefficients are 14-bit fixed point and are computed once per
+ * (input size, output size, method) and shared by all instances of the filter.
+ */
+
+#define SCALE_BITS  14
+#define INTER_BITS  6
+#define MAX_THREADS 16
+#define MAX_COEFFS  64
+
+typedef enum
+{
+	scale_nearest,
+	scale_bilinear,
+	scale_bicubic,
+	scale_lanczos
+} scale_method;
+
+typedef struct scale_coeffs_s
+{
+	int in;
+	int out;
+	scale_method method;
+	int taps;
+	int *offset;
+	int16_t *coeff;
+	int refcount;
+	struct scale_coeffs_s *next;
+} *scale_coeffs;
+
+static pthread_mutex_t coeffs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static scale_coeffs coeffs_list = NULL;
+static int coeffs_count = 0;
+
+static scale_method scale_method_from_name( const char *interps )
+{
+	if ( !strcmp( interps, "nearest" ) || !strcmp( interps, "neighbor" ) )
+		return scale_nearest;
+	else if ( !strcmp( interps, "bicubic" ) || !strcmp( interps, "bicublin" ) )
+		return scale_bicubic;
+	else if ( !strcmp( interps, "hyper" ) || !strcmp( interps, "lanczos" ) || !strcmp( interps, "sinc" ) )
+		return scale_lanczos;
+	return scale_bilinear;
+}
+
+static double scale_support( scale_method method )
+{
+	switch ( method )
+	{
+	case scale_bicubic: return 2.0;
+	case scale_lanczos: return 3.0;
+	default:            return 1.0;
+	}
+}
+
+static double scale_kernel( scale_method method, double x )
+{
+	x = fabs( x );
+	switch ( method )
+	{
+	case scale_bicubic:
+		// Keys cubic with a = -0.5 (Catmull-Rom)
+		if ( x < 1.0 )
+			return ( 1.5 * x - 2.5 ) * x * x + 1.0;
+		if ( x < 2.0 )
+			return ( ( -0.5 * x + 2.5 ) * x - 4.0 ) * x + 2.0;
+		return 0.0;
+	case scale_lanczos:
+		if ( x < 1e-8 )
+			return 1.0;
+		if ( x < 3.0 )
+			return 3.0 * sin( M_PI * x ) * sin( M_PI * x / 3.0 ) / ( M_PI * M_PI * x * x );
+		return 0.0;
+	default:
+		return x < 1.0 ? 1.0 - x : 0.0;
+	}
+}
+
+static scale_coeffs scale_coeffs_new( int in, int out, scale_method method )
+{
+	scale_coeffs self = calloc( 1, sizeof( struct scale_coeffs_s ) );
+	double scale = (double) in / out;
+	double fscale = scale > 1.0 ? scale : 1.0;
+	double radius = scale_support( method ) * fscale;
+	int full_taps = (int) ceil( radius ) * 2;
+	int taps = full_taps < in ? full_taps : in;
+	double *weights = malloc( full_taps * sizeof( double ) );
+	int i, k;
+
+	self->in = in;
+	self->out = out;
+	self->method = method;
+	self->taps = taps;
+	self->offset = malloc( out * sizeof( int ) );
+	self->coeff = calloc( out * taps, sizeof( int16_t ) );
+
+	for ( i = 0; i < out; i++ )
+	{
+		double center = ( i + 0.5 ) * scale - 0.5;
+		int start = (int) floor( center - radius ) + 1;
+		int first = start < 0 ? 0 : start > in - taps ? in - taps : start;
+		int16_t *coeff = self->coeff + i * taps;
+		double sum = 0.0;
+		int total = 0;
+		int largest = 0;
+
+		for ( k = 0; k < full_taps; k++ )
+		{
+			weights[k] = scale_kernel( method, ( start + k - center ) / fscale );
+			sum += weights[k];
+		}
+		// Fold taps that fall outside of the source onto the edge samples
+		for ( k = 0; k < full_taps; k++ )
+		{
+			int pos = start + k;
+			pos = pos < 0 ? 0 : pos >= in ? in - 1 : pos;
+			weights[k] /= sum;
+			coeff[ pos - first ] += lrint( weights[k] * ( 1 << SCALE_BITS ) );
+		}
+		// Make the fixed point coefficients sum to exactly one
+		for ( k = 0; k < taps; k++ )
+		{
+			total += coeff[k];
+			if ( coeff[k] > coeff[largest] )
+				largest = k;
+		}
+		coeff[largest] += ( 1 << SCALE_BITS ) - total;
+		self->offset[i] = first;
+	}
+	free( weights );
+
+	return self;
+}
+
+static void scale_coeffs_free( scale_coeffs self )
+{
+	free( self->offset );
+	free( self->coeff );
+	free( self );
+}
+
+/** Get shared coefficients for a (in, out, method) triple - release with scale_coeffs_close.
+*/
+
+static scale_coeffs scale_coeffs_open( int in, int out, scale_method method )
+{
+	scale_coeffs self, prev = NULL;
+
+	pthread_mutex_lock( &coeffs_mutex );
+	for ( self = coeffs_list; self; prev = self, self = self->next )
+	{
+		if ( self->in == in && self->out == out && self->method == method )
+		{
+			// Move to the front of the list
+			if ( prev )
+			{
+				prev->next = self->next;
+				self->next = coeffs_list;
+				coeffs_list = self;
+			}
+			break;
+		}
+	}
+	if ( !self )
+	{
+		self = scale_coeffs_new( in, out, method );
+		self->next = coeffs_list;
+		coeffs_list = self;
+		coeffs_count++;
+
+		// Drop the least recently used tables that are no longer in use
+		if ( coeffs_count > MAX_COEFFS )
+		{
+			scale_coeffs *item = &coeffs_list;
+			while ( *item )
+			{
+				scale_coeffs next = ( *item )->next;
+				if ( !next && ( *item )->refcount == 0 && *item != self )
+				{
+					scale_coeffs_free( *item );
+					*item = NULL;
+					coeffs_count--;
+					break;
+				}
+				item = &( *item )->next;
+			}
+		}
+	}
+	self->refcount++;
+	pthread_mutex_unlock( &coeffs_mutex );
+
+	return self;
+}
+
+static void scale_coeffs_close( scale_coeffs self )
+{
+	pthread_mutex_lock( &coeffs_mutex );
+	self->refcount--;
+	pthread_mutex_unlock( &coeffs_mutex );
+}
+
+/** A component is a strided sequence of samples within a row of a plane.
+*/
+
+typedef struct
+{
+	int offset;
+	int step;
+	int iwidth;
+	int owidth;
+	scale_coeffs horizontal;
+} scale_component;
+
+typedef struct
+{
+	uint8_t *src;
+	int src_stride;
+	int src_bytes;
+	uint8_t *dst;
+	int dst_stride;
+	int oheight;
+	scale_coeffs vertical;
+	int count;
+	scale_component components[4];
+} scale_plane;
+
+typedef struct
+{
+	scale_plane *planes;
+	int count;
+	int index;
+	int jobs;
+	int started;
+	pthread_t thread;
+} scale_slice;
+
+static void scale_vertical( const scale_plane *plane, int y, int16_t *tmp )
+{
+	const scale_coeffs v = plane->vertical;
+	const int16_t *coeff = v->coeff + y * v->taps;
+	const uint8_t *src = plane->src + v->offset[y] * plane->src_stride;
+	const int stride = plane->src_stride;
+	const int bytes = plane->src_bytes;
+	const int round = 1 << ( SCALE_BITS - INTER_BITS - 1 );
+	int x = 0, k;
+
+#if defined(USE_SSE) && defined(ARCH_X86_64)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rounding = _mm_set1_epi32( round );
+	for ( ; x + 8 <= bytes; x += 8 )
+	{
+		__m128i acc_lo = rounding;
+		__m128i acc_hi = rounding;
+		for ( k = 0; k < v->taps; k += 2 )
+		{
+			__m128i a = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)( src + k * stride + x ) ), zero );
+			__m128i b = zero;
+			int c = (uint16_t) coeff[k];
+			if ( k + 1 < v->taps )
+			{
+				b = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)( src + ( k + 1 ) * stride + x ) ), zero );
+				c |= (int) coeff[k + 1] << 16;
+			}
+			__m128i cc = _mm_set1_epi32( c );
+			acc_lo = _mm_add_epi32( acc_lo, _mm_madd_epi16( _mm_unpacklo_epi16( a, b ), cc ) );
+			acc_hi = _mm_add_epi32( acc_hi, _mm_madd_epi16( _mm_unpackhi_epi16( a, b ), cc ) );
+		}
+		acc_lo = _mm_srai_epi32( acc_lo, SCALE_BITS - INTER_BITS );
+		acc_hi = _mm_srai_epi32( acc_hi, SCALE_BITS - INTER_BITS );
+		_mm_storeu_si128( (__m128i*)( tmp + x ), _mm_packs_epi32( acc_lo, acc_hi ) );
+	}
+#endif
+	for ( ; x < bytes; x++ )
+	{
+		int sum = round;
+		for ( k = 0; k < v->taps; k++ )
+			sum += coeff[k] * src[ k * stride + x ];
+		tmp[x] = sum >> ( SCALE_BITS - INTER_BITS );
+	}
+}
+
+static void scale_horizontal( const scale_component *c, const int16_t *tmp, uint8_t *dst )
+{
+	const scale_coeffs h = c->horizontal;
+	const int taps = h->taps;
+	const int step = c->step;
+	const int16_t *coeff = h->coeff;
+	const int round = 1 << ( SCALE_BITS + INTER_BITS - 1 );
+	int x, k;
+
+	tmp += c->offset;
+	dst += c->offset;
+	for ( x = 0; x < c->owidth; x++, coeff += taps, dst += step )
+	{
+		const int16_t *p = tmp + h->offset[x] * step;
+		int sum = round;
+		for ( k = 0; k < taps; k++ )
+			sum += coeff[k] * p[ k * step ];
+		sum >>= SCALE_BITS + INTER_BITS;
+		*dst = sum < 0 ? 0 : sum > 255 ? 255 : sum;
+	}
+}
+
+static void *scale_slice_proc( void *arg )
+{
+	scale_slice *slice = arg;
+	int p, y, i;
+
+	for ( p = 0; p < slice->count; p++ )
+	{
+		const scale_plane *plane = &slice->planes[p];
+		int start = plane->oheight * slice->index / slice->jobs;
+		int end = plane->oheight * ( slice->index + 1 ) / slice->jobs;
+		int16_t *tmp = malloc( ( plane->src_bytes + 16 ) * sizeof( int16_t ) );
+
+		for ( y = start; y < end; y++ )
+		{
+			scale_vertical( plane, y, tmp );
+			for ( i = 0; i < plane->count; i++ )
+				scale_horizontal( &plane->components[i], tmp, plane->dst + y * plane->dst_stride );
+		}
+		free( tmp );
+	}
+	return NULL;
+}
+
+static void scale_planes( scale_plane *planes, int count, int threads )
+{
+	scale_slice slices[ MAX_THREADS ];
+	int jobs = threads, i;
+
+	if ( jobs <= 0 )
+		jobs = sysconf( _SC_NPROCESSORS_ONLN );
+	// Keep slices at a reasonable height
+	if ( jobs > planes[0].oheight / 32 )
+		jobs = planes[0].oheight / 32;
+	jobs = jobs < 1 ? 1 : jobs > MAX_THREADS ? MAX_THREADS : jobs;
+
+	for ( i = 0; i < jobs; i++ )
+	{
+		slices[i].planes = planes;
+		slices[i].count = count;
+		slices[i].index = i;
+		slices[i].jobs = jobs;
+		slices[i].started = i > 0 && !pthread_create( &slices[i].thread, NULL, scale_slice_proc, &slices[i] );
+	}
+	scale_slice_proc( &slices[0] );
+	for ( i = 1; i < jobs; i++ )
+	{
+		if ( slices[i].started )
+			pthread_join( slices[i].thread, NULL );
+		else
+			scale_slice_proc( &slices[i] );
+	}
+}
+
+static void scale_plane_init( scale_plane *plane, uint8_t *src, int iwidth, int iheight, uint8_t *dst, int owidth, int oheight, int bpp, scale_method method )
+{
+	memset( plane, 0, sizeof( *plane ) );
+	plane->src = src;
+	plane->src_stride = iwidth * bpp;
+	plane->src_bytes = iwidth * bpp;
+	plane->dst = dst;
+	plane->dst_stride = owidth * bpp;
+	plane->oheight = oheight;
+	plane->vertical = scale_coeffs_open( iheight, oheight, method );
+}
+
+static void scale_plane_add( scale_plane *plane, int offset, int step, int iwidth, int owidth, scale_method method )
+{
+	scale_component *c = &plane->components[ plane->count++ ];
+	c->offset = offset;
+	c->step = step;
+	c->iwidth = iwidth;
+	c->owidth = owidth;
+	c->horizontal = scale_coeffs_open( iwidth, owidth, method );
+}
+
+static void scale_plane_close( scale_plane *plane )
+{
+	int i;
+	scale_coeffs_close( plane->vertical );
+	for ( i = 0; i < plane->count; i++ )
+		scale_coeffs_close( plane->components[i].horizontal );
+}
+
+static int filter_scale_polyphase( mlt_filter filter, mlt_frame frame, uint8_t **image, mlt_image_format *format, int iwidth, int iheight, int owidth, int oheight )
+{
+	scale_method method = scale_method_from_name( mlt_properties_get( MLT_FRAME_PROPERTIES( frame ), "rescale.interp" ) );
+	int threads = mlt_properties_get_int( MLT_FILTER_PROPERTIES( filter ), "threads" );
+	int size = mlt_image_format_size( *format, owidth, oheight, NULL );
+	scale_plane planes[3];
+	int count = 1, i;
+	uint8_t *output;
+
+	if ( method == scale_nearest )
+		return *format == mlt_image_yuv422 ? filter_scale( frame, image, format, iwidth, iheight, owidth, oheight ) : 1;
+
+	output = mlt_pool_alloc( size );
+
+	switch ( *format )
+	{
+	case mlt_image_yuv422:
+		// The rows keep their odd width, only the last column is not scaled
+		scale_plane_init( &planes[0], *image, iwidth, iheight, output, owidth, oheight, 2, method );
+		scale_plane_add( &planes[0], 0, 2, iwidth - iwidth % 2, owidth, method );
+		scale_plane_add( &planes[0], 1, 4, iwidth / 2, owidth / 2, method );
+		scale_plane_add( &planes[0], 3, 4, iwidth / 2, owidth / 2, method );
+		break;
+	case mlt_image_yuv420p:
+	{
+		uint8_t *src = *image;
+		uint8_t *dst = output;
+		count = 3;
+		scale_plane_init( &planes[0], src, iwidth, iheight, dst, owidth, oheight, 1, method );
+		scale_plane_add( &planes[0], 0, 1, iwidth, owidth, method );
+		src += iwidth * iheight;
+		dst += owidth * oheight;
+		for ( i = 1; i < 3; i++ )
+		{
+			scale_plane_init( &planes[i], src, iwidth / 2, iheight / 2, dst, owidth / 2, oheight / 2, 1, method );
+			scale_plane_add( &planes[i], 0, 1, iwidth / 2, owidth / 2, method );
+			src += ( iwidth / 2 ) * ( iheight / 2 );
+			dst += ( owidth / 2 ) * ( oheight / 2 );
+		}
+		break;
+	}
+	case mlt_image_rgb24:
+		scale_plane_init( &planes[0], *image, iwidth, iheight, output, owidth, oheight, 3, method );
+		for ( i = 0; i < 3; i++ )
+			scale_plane_add( &planes[0], i, 3, iwidth, owidth, method );
+		break;
+	case mlt_image_rgb24a:
+	case mlt_image_opengl:
+		scale_plane_init( &planes[0], *image, iwidth, iheight, output, owidth, oheight, 4, method );
+		for ( i = 0; i < 4; i++ )
+			scale_plane_add( &planes[0], i, 4, iwidth, owidth, method );
+		break;
+	default:
+		mlt_pool_release( output );
+		return 1;
+	}
+
+	scale_planes( planes, count, threads );
+	for ( i = 0; i < count; i++ )
+		scale_plane_close( &planes[i] );
+
+	// Now update the frame, whose alpha stays uniform when scaled
+	int uniform_alpha = mlt_frame_get_uniform_alpha( frame );
+	mlt_frame_set_image( frame, output, size, mlt_pool_release );
+	mlt_frame_set_uniform_alpha( frame, uniform_alpha );
 	*image = output;
 
 	return 0;
@@ -114,8 +581,22 @@ static void scale_alpha( mlt_frame frame, int iwidth, int iheight, int owidth, i
 	// Scale the alpha
 	uint8_t *output = NULL;
 	uint8_t *input = mlt_frame_get_alpha( frame );
+	scale_method method = scale_method_from_name( mlt_properties_get( MLT_FRAME_PROPERTIES( frame ), "rescale.interp" ) );
 
-	if ( input != NULL )
+	if ( input != NULL && method != scale_nearest )
+	{
+		scale_plane plane;
+
+		output = mlt_pool_alloc( owidth * oheight );
+		scale_plane_init( &plane, input, iwidth, iheight, output, owidth, oheight, 1, method );
+		scale_plane_add( &plane, 0, 1, iwidth, owidth, method );
+		scale_planes( &plane, 1, 1 );
+		scale_plane_close( &plane );
+
+		// Set it back on the frame
+		mlt_frame_set_alpha( frame, output, owidth * oheight, mlt_pool_release );
+	}
+	else if ( input != NULL )
 	{
 		uint8_t *out_line, *in_line;
 		register int i, j, x, y;
@@ -213,9 +694,15 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 		if ( iheight != oheight && ( strcmp( interps, "nearest" ) || ( iheight % oheight != 0 ) ) )
 			mlt_properties_set_int( properties, "consumer_deinterlace", 1 );
 
-		// Convert the image to yuv422 when using the local scaler
+		// Convert the image to a format the local scaler supports
 		if ( scaler_method == filter_scale )
-			*format = mlt_image_yuv422;
+		{
+			if ( scale_method_from_name( interps ) == scale_nearest )
+				*format = mlt_image_yuv422;
+			else if ( *format != mlt_image_yuv422 && *format != mlt_image_yuv420p && *format != mlt_image_rgb24 &&
+			          *format != mlt_image_rgb24a && *format != mlt_image_opengl )
+				*format = mlt_image_yuv422;
+		}
 
 		// Get the image as requested
 		mlt_frame_get_image( frame, image, format, &iwidth, &iheight, writable );
@@ -229,7 +716,15 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 				iwidth, iheight, owidth, oheight, mlt_image_format_name( *format ), interps );
 
 			// If valid colorspace
-			if ( *format == mlt_image_yuv422 || *format == mlt_image_rgb24 ||
+			if ( scaler_method == filter_scale )
+			{
+				if ( !filter_scale_polyphase( filter, frame, image, format, iwidth, iheight, owidth, oheight ) )
+				{
+					*width = owidth;
+					*height = oheight;
+				}
+			}
+			else if ( *format == mlt_image_yuv422 || *format == mlt_image_rgb24 ||
 			     *format == mlt_image_rgb24a || *format == mlt_image_opengl )
 			{
 				// Call the virtual function
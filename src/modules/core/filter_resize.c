@@ -140,6 +140,21 @@ static uint8_t *frame_resize_image( mlt_frame frame, int owidth, int oheight, in
 	if ( iwidth < owidth || iheight < oheight )
 	{
 		uint8_t alpha_value = mlt_properties_get_int( properties, "resize_alpha" );
+		int uniform_alpha = mlt_frame_get_uniform_alpha( frame );
+
+		// A frame of uniform alpha need not carry a mask, but the padding may differ
+		if ( alpha == NULL && uniform_alpha >= 0 && uniform_alpha != alpha_value && bpp == 2 )
+		{
+			alpha_size = iwidth * iheight;
+			alpha = mlt_pool_alloc( alpha_size );
+			memset( alpha, uniform_alpha, alpha_size );
+			mlt_frame_set_alpha( frame, alpha, alpha_size, mlt_pool_release );
+		}
+		// The padding of an image with an alpha channel is transparent
+		else if ( bpp == 4 && uniform_alpha > 0 )
+		{
+			mlt_frame_set_uniform_alpha( frame, -1 );
+		}
 
 		// Create the output image
 		uint8_t *output = mlt_pool_alloc( owidth * ( oheight + 1 ) * bpp );
@@ -147,8 +162,10 @@ static uint8_t *frame_resize_image( mlt_frame frame, int owidth, int oheight, in
 		// Call the generic resize
 		resize_image( output, owidth, oheight, input, iwidth, iheight, bpp );
 
-		// Now update the frame
+		// Now update the frame, whose alpha is still uniform if the padding matches
+		uniform_alpha = mlt_frame_get_uniform_alpha( frame );
 		mlt_frame_set_image( frame, output, owidth * ( oheight + 1 ) * bpp, mlt_pool_release );
+		mlt_frame_set_uniform_alpha( frame, uniform_alpha );
 
 		// We should resize the alpha too
 		if ( alpha && alpha_size >= iwidth * iheight )
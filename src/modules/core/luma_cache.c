@@ -0,0 +1,508 @@
+/*
+ * luma_cache.c -- process wide cache of luma wipe maps
+ * Copyright (C) 2003-2015 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "luma_cache.h"
+#include <framework/mlt.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <pthread.h>
+
+static pthread_mutex_t luma_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t luma_cond = PTHREAD_COND_INITIALIZER;
+static mlt_properties luma_maps = NULL;
+
+/** Load the luma map from PGM stream.
+*/
+
+static void luma_read_pgm( FILE *f, uint16_t **map, int *width, int *height )
+{
+	uint8_t *data = NULL;
+	while (1)
+	{
+		char line[128];
+		char comment[128];
+		int i = 2;
+		int maxval;
+		int bpp;
+		uint16_t *p;
+
+		line[127] = '\0';
+
+		// get the magic code
+		if ( fgets( line, 127, f ) == NULL )
+			break;
+
+		// skip comments
+		while ( sscanf( line, " #%s", comment ) > 0 )
+			if ( fgets( line, 127, f ) == NULL )
+				break;
+
+		if ( line[0] != 'P' || line[1] != '5' )
+			break;
+
+		// skip white space and see if a new line must be fetched
+		for ( i = 2; i < 127 && line[i] != '\0' && isspace( line[i] ); i++ );
+		if ( ( line[i] == '\0' || line[i] == '#' ) && fgets( line, 127, f ) == NULL )
+			break;
+
+		// skip comments
+		while ( sscanf( line, " #%s", comment ) > 0 )
+			if ( fgets( line, 127, f ) == NULL )
+				break;
+
+		// get the dimensions
+		if ( line[0] == 'P' )
+			i = sscanf( line, "P5 %d %d %d", width, height, &maxval );
+		else
+			i = sscanf( line, "%d %d %d", width, height, &maxval );
+
+		// get the height value, if not yet
+		if ( i < 2 )
+		{
+			if ( fgets( line, 127, f ) == NULL )
+				break;
+
+			// skip comments
+			while ( sscanf( line, " #%s", comment ) > 0 )
+				if ( fgets( line, 127, f ) == NULL )
+					break;
+
+			i = sscanf( line, "%d", height );
+			if ( i == 0 )
+				break;
+			else
+				i = 2;
+		}
+
+		// get the maximum gray value, if not yet
+		if ( i < 3 )
+		{
+			if ( fgets( line, 127, f ) == NULL )
+				break;
+
+			// skip comments
+			while ( sscanf( line, " #%s", comment ) > 0 )
+				if ( fgets( line, 127, f ) == NULL )
+					break;
+
+			i = sscanf( line, "%d", &maxval );
+			if ( i == 0 )
+				break;
+		}
+
+		// determine if this is one or two bytes per pixel
+		bpp = maxval > 255 ? 2 : 1;
+
+		// allocate temporary storage for the raw data
+		data = mlt_pool_alloc( *width * *height * bpp );
+		if ( data == NULL )
+			break;
+
+		// read the raw data
+		if ( fread( data, *width * *height * bpp, 1, f ) != 1 )
+			break;
+
+		// allocate the luma bitmap
+		*map = p = (uint16_t*)mlt_pool_alloc( *width * *height * sizeof( uint16_t ) );
+		if ( *map == NULL )
+			break;
+
+		// proces the raw data into the luma bitmap
+		for ( i = 0; i < *width * *height * bpp; i += bpp )
+		{
+			if ( bpp == 1 )
+				*p++ = data[ i ] << 8;
+			else
+				*p++ = ( data[ i ] << 8 ) + data[ i + 1 ];
+		}
+
+		break;
+	}
+
+	if ( data != NULL )
+		mlt_pool_release( data );
+}
+
+/** Generate a luma map from any YUV image.
+*/
+
+static void luma_read_yuv422( uint8_t *image, uint16_t **map, int width, int height )
+{
+	int i;
+
+	// allocate the luma bitmap
+	uint16_t *p = *map = ( uint16_t* )mlt_pool_alloc( width * height * sizeof( uint16_t ) );
+	if ( *map == NULL )
+		return;
+
+	// proces the image data into the luma bitmap
+	for ( i = 0; i < width * height * 2; i += 2 )
+		*p++ = ( image[ i ] - 16 ) * 299; // 299 = 65535 / 219
+}
+
+/** Scale 16bit greyscale luma map using nearest neighbor.
+*/
+
+static void scale_luma( uint16_t *dest_buf, int dest_width, int dest_height, const uint16_t *src_buf, int src_width, int src_height, int invert )
+{
+	register int i, j;
+	register int x_step = ( src_width << 16 ) / dest_width;
+	register int y_step = ( src_height << 16 ) / dest_height;
+	register int x, y = 0;
+
+	for ( i = 0; i < dest_height; i++ )
+	{
+		const uint16_t *src = src_buf + ( y >> 16 ) * src_width;
+		x = 0;
+
+		for ( j = 0; j < dest_width; j++ )
+		{
+			*dest_buf++ = src[ x >> 16 ] ^ invert;
+			x += x_step;
+		}
+		y += y_step;
+	}
+}
+
+/** Load a luma map at its original size from a PGM file or any producer.
+*/
+
+static uint16_t *load_luma( mlt_service service, mlt_properties properties, const char *resource, mlt_properties passed, int *width, int *height )
+{
+	uint16_t *bitmap = NULL;
+	const char *extension = strrchr( resource, '.' );
+
+	*width = 0;
+	*height = 0;
+
+	// See if it is a PGM
+	if ( extension != NULL && strcmp( extension, ".pgm" ) == 0 )
+	{
+		// Convert file name string encoding.
+		mlt_properties_set( passed, "_luma_utf8", resource );
+		mlt_properties_from_utf8( passed, "_luma_utf8", "_luma_local8" );
+
+		// Open PGM
+		FILE *f = fopen( mlt_properties_get( passed, "_luma_local8" ), "rb" );
+		if ( f != NULL )
+		{
+			// Load from PGM
+			luma_read_pgm( f, &bitmap, width, height );
+			fclose( f );
+		}
+	}
+	else
+	{
+		// Get the factory producer service
+		char *factory = mlt_properties_get( properties, "factory" );
+
+		// Create the producer
+		mlt_profile profile = mlt_service_profile( service );
+		mlt_producer producer = mlt_factory_producer( profile, factory, resource );
+
+		// If we have one
+		if ( producer != NULL )
+		{
+			// Get the producer properties
+			mlt_properties producer_properties = MLT_PRODUCER_PROPERTIES( producer );
+
+			// Ensure that we loop
+			mlt_properties_set( producer_properties, "eof", "loop" );
+
+			// Now pass all producer properties from the transition down
+			mlt_properties_inherit( producer_properties, passed );
+
+			// We will get the alpha frame from the producer
+			mlt_frame luma_frame = NULL;
+
+			// Get the luma frame
+			if ( mlt_service_get_frame( MLT_PRODUCER_SERVICE( producer ), &luma_frame, 0 ) == 0 )
+			{
+				uint8_t *luma_image = NULL;
+				mlt_image_format luma_format = mlt_image_yuv422;
+
+				// Get image from the luma producer
+				mlt_properties_set( MLT_FRAME_PROPERTIES( luma_frame ), "rescale.interp", "none" );
+				mlt_frame_get_image( luma_frame, &luma_image, &luma_format, width, height, 0 );
+
+				// Generate the luma map
+				if ( luma_image != NULL && luma_format == mlt_image_yuv422 )
+					luma_read_yuv422( luma_image, &bitmap, *width, *height );
+
+				// Cleanup the luma frame
+				mlt_frame_close( luma_frame );
+			}
+
+			// Cleanup the luma producer
+			mlt_producer_close( producer );
+		}
+	}
+
+	return bitmap;
+}
+
+/** Find a map and add a reference, waiting for it if another thread is loading it.
+ *
+ * This must be called with luma_mutex held. A map that failed to load is
+ * returned with a NULL bitmap.
+ */
+
+static luma_map luma_map_find( const char *key )
+{
+	luma_map self = luma_maps ? mlt_properties_get_data( luma_maps, key, NULL ) : NULL;
+	if ( self != NULL )
+	{
+		self->refcount++;
+		while ( self->loading )
+			pthread_cond_wait( &luma_cond, &luma_mutex );
+	}
+	return self;
+}
+
+/** Add a map that is still to be loaded by the calling thread.
+ *
+ * This must be called with luma_mutex held.
+ */
+
+static luma_map luma_map_insert( char *key, luma_map parent )
+{
+	luma_map self = calloc( 1, sizeof( struct luma_map_s ) );
+	self->key = key;
+	self->refcount = 1;
+	self->parent = parent;
+	self->loading = 1;
+	if ( luma_maps == NULL )
+		luma_maps = mlt_properties_new( );
+	mlt_properties_set_data( luma_maps, key, self, 0, NULL, NULL );
+	return self;
+}
+
+/** Publish the bitmap of a map added with luma_map_insert.
+ *
+ * This must be called with luma_mutex held. A map without a bitmap is
+ * forgotten so that the next request tries to load it again.
+ */
+
+static void luma_map_loaded( luma_map self, uint16_t *bitmap, int width, int height )
+{
+	self->bitmap = bitmap;
+	self->width = width;
+	self->height = height;
+	self->loading = 0;
+	if ( bitmap == NULL )
+		mlt_properties_set_data( luma_maps, self->key, NULL, 0, NULL, NULL );
+	pthread_cond_broadcast( &luma_cond );
+}
+
+static void luma_map_unref( luma_map self )
+{
+	while ( self != NULL && --self->refcount == 0 )
+	{
+		luma_map parent = self->parent;
+
+		if ( mlt_properties_get_data( luma_maps, self->key, NULL ) == self )
+			mlt_properties_set_data( luma_maps, self->key, NULL, 0, NULL, NULL );
+		if ( self->bitmap != NULL )
+			mlt_pool_release( (void*) self->bitmap );
+		free( self->key );
+		free( self );
+		self = parent;
+	}
+}
+
+/** Get a reference to a luma map.
+ *
+ * \param service the service that requests the map, used for its profile
+ * \param properties the properties that contain \p prefix properties for the producer and "factory"
+ * \param resource the PGM file or producer resource; "%name" is looked up in the lumas directory
+ * \param prefix the prefix of properties to pass to a producer
+ * \param invert whether to invert the map
+ * \param width the width of the map or 0 for the original size
+ * \param height the height of the map or 0 for the original size
+ * \return a map that must be released with luma_map_close or NULL if it could not be loaded
+ */
+
+luma_map luma_map_open( mlt_service service, mlt_properties properties, const char *resource, const char *prefix, int invert, int width, int height )
+{
+	luma_map self = NULL;
+	luma_map original = NULL;
+	mlt_properties passed;
+	char temp[ 512 ];
+	char *key, *orig_key;
+	size_t size;
+	int i;
+
+	if ( resource == NULL || resource[0] == '\0' )
+		return NULL;
+
+	if ( strchr( resource, '%' ) )
+	{
+		// TODO: Clean up quick and dirty compressed/existence check
+		FILE *test;
+		snprintf( temp, sizeof( temp ), "%s/lumas/%s/%s", mlt_environment( "MLT_DATA" ), mlt_environment( "MLT_NORMALISATION" ), strchr( resource, '%' ) + 1 );
+		test = fopen( temp, "r" );
+		if ( test == NULL )
+			strncat( temp, ".png", sizeof( temp ) - strlen( temp ) - 1 );
+		else
+			fclose( test );
+		resource = temp;
+	}
+
+	// Producer properties change the image, so they are part of the key
+	passed = mlt_properties_new( );
+	mlt_properties_pass( passed, properties, prefix );
+	size = strlen( resource ) + 64;
+	for ( i = 0; i < mlt_properties_count( passed ); i++ )
+	{
+		const char *value = mlt_properties_get_value( passed, i );
+		size += strlen( mlt_properties_get_name( passed, i ) ) + ( value ? strlen( value ) : 0 ) + 2;
+	}
+	orig_key = malloc( size );
+	snprintf( orig_key, size, "%s\n%s", resource, mlt_properties_get( properties, "factory" ) ? mlt_properties_get( properties, "factory" ) : "" );
+	for ( i = 0; i < mlt_properties_count( passed ); i++ )
+	{
+		const char *value = mlt_properties_get_value( passed, i );
+		strcat( orig_key, "\n" );
+		strcat( orig_key, mlt_properties_get_name( passed, i ) );
+		strcat( orig_key, "=" );
+		strcat( orig_key, value ? value : "" );
+	}
+	key = malloc( size );
+	snprintf( key, size, "%s\n%d:%dx%d", orig_key, !!invert, width, height );
+	strcat( orig_key, "\n0:0x0" );
+
+	// Maps are loaded and scaled outside of the lock, so a luma producer may
+	// itself use lumas and other transitions are not held up by the load
+	pthread_mutex_lock( &luma_mutex );
+
+	self = luma_map_find( key );
+	if ( self == NULL )
+	{
+		original = luma_map_find( orig_key );
+		if ( original == NULL )
+		{
+			int orig_width, orig_height;
+			uint16_t *bitmap;
+
+			original = luma_map_insert( orig_key, NULL );
+			orig_key = NULL;
+			pthread_mutex_unlock( &luma_mutex );
+			bitmap = load_luma( service, properties, resource, passed, &orig_width, &orig_height );
+			pthread_mutex_lock( &luma_mutex );
+			luma_map_loaded( original, bitmap, orig_width, orig_height );
+		}
+		if ( original->bitmap == NULL )
+		{
+			luma_map_unref( original );
+			original = NULL;
+		}
+
+		if ( original == NULL || ( !invert && ( width == 0 || width == original->width ) && ( height == 0 || height == original->height ) ) )
+		{
+			// The original is what was asked for
+			self = original;
+		}
+		else
+		{
+			// Scale luma map - the scaled map keeps its original alive
+			uint16_t *bitmap;
+			self = luma_map_insert( key, original );
+			key = NULL;
+			width = width ? width : original->width;
+			height = height ? height : original->height;
+			pthread_mutex_unlock( &luma_mutex );
+			bitmap = mlt_pool_alloc( width * height * sizeof( uint16_t ) );
+			scale_luma( bitmap, width, height, original->bitmap, original->width, original->height, invert ? 0xffff : 0 );
+			pthread_mutex_lock( &luma_mutex );
+			luma_map_loaded( self, bitmap, width, height );
+		}
+	}
+	if ( self != NULL && self->bitmap == NULL )
+	{
+		luma_map_unref( self );
+		self = NULL;
+	}
+
+	pthread_mutex_unlock( &luma_mutex );
+
+	free( key );
+	free( orig_key );
+	mlt_properties_close( passed );
+
+	return self;
+}
+
+/** Get another reference to a luma map.
+*/
+
+luma_map luma_map_ref( luma_map self )
+{
+	if ( self != NULL )
+	{
+		pthread_mutex_lock( &luma_mutex );
+		self->refcount++;
+		pthread_mutex_unlock( &luma_mutex );
+	}
+	return self;
+}
+
+/** Release a reference to a luma map.
+*/
+
+void luma_map_close( luma_map self )
+{
+	if ( self != NULL )
+	{
+		pthread_mutex_lock( &luma_mutex );
+		luma_map_unref( self );
+		pthread_mutex_unlock( &luma_mutex );
+	}
+}
+
+/** Get a reference to the luma map held by a transition.
+ *
+ * The map is opened with luma_map_open() when the resource, invert or size
+ * requested differ from the previous call, and it is held in "_luma.map" on
+ * \p properties until then. A map that could not be loaded is not retried until
+ * the request changes. Producer properties with \p prefix only apply when the
+ * map is opened.
+ *
+ * \return a map that must be released with luma_map_close or NULL
+ */
+
+luma_map luma_map_fetch( mlt_service service, mlt_properties properties, const char *resource, const char *prefix, int invert, int width, int height )
+{
+	char request[ 64 ];
+	const char *previous_resource = mlt_properties_get( properties, "_luma.resource" );
+	const char *previous_request = mlt_properties_get( properties, "_luma.request" );
+
+	snprintf( request, sizeof( request ), "%d:%dx%d", !!invert, width, height );
+	if ( resource == NULL || previous_resource == NULL || previous_request == NULL ||
+		 strcmp( resource, previous_resource ) || strcmp( request, previous_request ) )
+	{
+		luma_map map = luma_map_open( service, properties, resource, prefix, invert, width, height );
+		mlt_properties_set_data( properties, "_luma.map", map, 0, (mlt_destructor) luma_map_close, NULL );
+		mlt_properties_set( properties, "_luma.resource", resource );
+		mlt_properties_set( properties, "_luma.request", request );
+	}
+	return luma_map_ref( mlt_properties_get_data( properties, "_luma.map", NULL ) );
+}
@@ -0,0 +1,51 @@
+/*
+ * luma_cache.h -- process wide cache of luma wipe maps
+ * Copyright (C) 2003-2015 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _LUMA_CACHE_H_
+#define _LUMA_CACHE_H_
+
+#include <framework/mlt_service.h>
+
+/** A shared, read-only 16-bit luma map.
+ *
+ * Maps are reference counted and keyed by resource, invert and size, so all
+ * transitions in the process that use the same wipe at the same size share one
+ * bitmap. The bitmap must not be modified.
+ */
+
+typedef struct luma_map_s *luma_map;
+
+struct luma_map_s
+{
+	const uint16_t *bitmap;
+	int width;
+	int height;
+
+	char *key;
+	int refcount;
+	luma_map parent;
+	int loading;
+};
+
+extern luma_map luma_map_open( mlt_service service, mlt_properties properties, const char *resource, const char *prefix, int invert, int width, int height );
+extern luma_map luma_map_fetch( mlt_service service, mlt_properties properties, const char *resource, const char *prefix, int invert, int width, int height );
+extern luma_map luma_map_ref( luma_map self );
+extern void luma_map_close( luma_map self );
+
+#endif
@@ -171,9 +171,9 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 		mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
 	}
 
-	// Create the alpha channel
+	// Create the alpha channel unless the colour is opaque
 	int alpha_size = *width * *height;
-	uint8_t *alpha = mlt_pool_alloc( alpha_size );
+	uint8_t *alpha = color.a == 255 ? NULL : mlt_pool_alloc( alpha_size );
 
 	// Initialise the alpha
 	if ( alpha )
@@ -185,7 +185,9 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 
 	// Now update properties so we free the copy after
 	mlt_frame_set_image( frame, *buffer, size, mlt_pool_release );
-	mlt_frame_set_alpha( frame, alpha, alpha_size, mlt_pool_release );
+	if ( alpha )
+		mlt_frame_set_alpha( frame, alpha, alpha_size, mlt_pool_release );
+	mlt_frame_set_uniform_alpha( frame, color.a );
 	mlt_properties_set_double( properties, "aspect_ratio", mlt_properties_get_double( producer_props, "aspect_ratio" ) );
 	mlt_properties_set_int( properties, "meta.media.width", *width );
 	mlt_properties_set_int( properties, "meta.media.height", *height );
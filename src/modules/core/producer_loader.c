@@ -29,7 +29,7 @@
 static mlt_properties dictionary = NULL;
 static mlt_properties normalisers = NULL;
 
-static mlt_producer create_from( mlt_profile profile, char *file, char *services )
+static mlt_producer create_from( mlt_profile profile, char *file, char *services, char **used )
 {
 	mlt_producer producer = NULL;
 	char *temp = strdup( services );
@@ -40,6 +40,13 @@ static mlt_producer create_from( mlt_profile profile, char *file, char *services
 		if ( p != NULL )
 			*p ++ = '\0';
 
+		// Report which of the services worked, prefix and all
+		if ( used )
+		{
+			free( *used );
+			*used = strdup( service );
+		}
+
 		// If  the service name has a colon as field delimiter, then treat the
 		// second field as a prefix for the file/url.
 		char *prefix = strchr( service, ':' );
@@ -60,6 +67,11 @@ static mlt_producer create_from( mlt_profile profile, char *file, char *services
 	}
 	while ( producer == NULL && service != NULL );
 	free( temp );
+	if ( used && !producer )
+	{
+		free( *used );
+		*used = NULL;
+	}
 	return producer;
 }
 
@@ -115,12 +127,30 @@ static mlt_producer create_producer( mlt_profile profile, char *file )
 		if ( strncmp( lookup, "file://", 7 ) == 0 )
 			p += 7;
 			
+		// Try the service that loaded the unchanged file before, skipping the
+		// services ahead of it that could not
+		mlt_properties probe = mlt_probe_get( backup_profile, "loader", file );
+		if ( probe && mlt_properties_get( probe, "service" ) )
+			result = create_from( profile, file, mlt_properties_get( probe, "service" ), NULL );
+		mlt_properties_close( probe );
+
 		// Iterate through the dictionary
 		for ( i = 0; result == NULL && i < mlt_properties_count( dictionary ); i ++ )
 		{
 			char *name = mlt_properties_get_name( dictionary, i );
 			if ( fnmatch( name, p, 0 ) == 0 )
-				result = create_from( profile, file, mlt_properties_get_value( dictionary, i ) );
+			{
+				char *used = NULL;
+				result = create_from( profile, file, mlt_properties_get_value( dictionary, i ), &used );
+				if ( used )
+				{
+					probe = mlt_properties_new( );
+					mlt_properties_set( probe, "service", used );
+					mlt_probe_put( backup_profile, "loader", file, probe );
+					mlt_properties_close( probe );
+					free( used );
+				}
+			}
 		}	
 
 		// Check if the producer changed the profile - xml does this.
@@ -18,6 +18,7 @@
  */
 
 #include "transition_composite.h"
+#include "luma_cache.h"
 #include <framework/mlt.h>
 
 #include <stdio.h>
@@ -209,135 +210,6 @@ static inline int32_t smoothstep( int32_t edge1, int32_t edge2, uint32_t a )
 	return ( ( ( a * a ) >> 16 )  * ( ( 3 << 16 ) - ( 2 * a ) ) ) >> 16;
 }
 
-/** Load the luma map from PGM stream.
-*/
-
-static void luma_read_pgm( FILE *f, uint16_t **map, int *width, int *height )
-{
-	uint8_t *data = NULL;
-	while (1)
-	{
-		char line[128];
-		char comment[128];
-		int i = 2;
-		int maxval;
-		int bpp;
-		uint16_t *p;
-
-		line[127] = '\0';
-
-		// get the magic code
-		if ( fgets( line, 127, f ) == NULL )
-			break;
-
-		// skip comments
-		while ( sscanf( line, " #%s", comment ) > 0 )
-			if ( fgets( line, 127, f ) == NULL )
-				break;
-
-		if ( line[0] != 'P' || line[1] != '5' )
-			break;
-
-		// skip white space and see if a new line must be fetched
-		for ( i = 2; i < 127 && line[i] != '\0' && isspace( line[i] ); i++ );
-		if ( ( line[i] == '\0' || line[i] == '#' ) && fgets( line, 127, f ) == NULL )
-			break;
-
-		// skip comments
-		while ( sscanf( line, " #%s", comment ) > 0 )
-			if ( fgets( line, 127, f ) == NULL )
-				break;
-
-		// get the dimensions
-		if ( line[0] == 'P' )
-			i = sscanf( line, "P5 %d %d %d", width, height, &maxval );
-		else
-			i = sscanf( line, "%d %d %d", width, height, &maxval );
-
-		// get the height value, if not yet
-		if ( i < 2 )
-		{
-			if ( fgets( line, 127, f ) == NULL )
-				break;
-
-			// skip comments
-			while ( sscanf( line, " #%s", comment ) > 0 )
-				if ( fgets( line, 127, f ) == NULL )
-					break;
-
-			i = sscanf( line, "%d", height );
-			if ( i == 0 )
-				break;
-			else
-				i = 2;
-		}
-
-		// get the maximum gray value, if not yet
-		if ( i < 3 )
-		{
-			if ( fgets( line, 127, f ) == NULL )
-				break;
-
-			// skip comments
-			while ( sscanf( line, " #%s", comment ) > 0 )
-				if ( fgets( line, 127, f ) == NULL )
-					break;
-
-			i = sscanf( line, "%d", &maxval );
-			if ( i == 0 )
-				break;
-		}
-
-		// determine if this is one or two bytes per pixel
-		bpp = maxval > 255 ? 2 : 1;
-
-		// allocate temporary storage for the raw data
-		data = mlt_pool_alloc( *width * *height * bpp );
-		if ( data == NULL )
-			break;
-
-		// read the raw data
-		if ( fread( data, *width * *height * bpp, 1, f ) != 1 )
-			break;
-
-		// allocate the luma bitmap
-		*map = p = (uint16_t*)mlt_pool_alloc( *width * *height * sizeof( uint16_t ) );
-		if ( *map == NULL )
-			break;
-
-		// proces the raw data into the luma bitmap
-		for ( i = 0; i < *width * *height * bpp; i += bpp )
-		{
-			if ( bpp == 1 )
-				*p++ = data[ i ] << 8;
-			else
-				*p++ = ( data[ i ] << 8 ) + data[ i + 1 ];
-		}
-
-		break;
-	}
-
-	if ( data != NULL )
-		mlt_pool_release( data );
-}
-
-/** Generate a luma map from any YUV image.
-*/
-
-static void luma_read_yuv422( uint8_t *image, uint16_t **map, int width, int height )
-{
-	int i;
-	
-	// allocate the luma bitmap
-	uint16_t *p = *map = ( uint16_t* )mlt_pool_alloc( width * height * sizeof( uint16_t ) );
-	if ( *map == NULL )
-		return;
-
-	// proces the image data into the luma bitmap
-	for ( i = 0; i < width * height * 2; i += 2 )
-		*p++ = ( image[ i ] - 16 ) * 299; // 299 = 65535 / 219
-}
-
 static inline int calculate_mix( uint16_t *luma, int j, int softness, int weight, int alpha, uint32_t step )
 {
 	return ( ( luma ? smoothstep( luma[ j ], luma[ j ] + softness, step ) : weight ) * ( alpha + 1 ) ) >> 8;
@@ -359,6 +231,15 @@ void composite_line_yuv( uint8_t *dest, uint8_t *src, int width, uint8_t *alpha_
 	register int j = 0;
 	register int mix;
 
+	// An opaque source at full strength is a plain copy
+	if ( !luma && !alpha_b && weight == ( 1 << 16 ) )
+	{
+		memcpy( dest, src, width * 2 );
+		if ( alpha_a )
+			memset( alpha_a, 0xff, width );
+		return;
+	}
+
 #if defined(USE_SSE) && defined(ARCH_X86_64)
 	if ( !luma && width > 7 )
 	{
@@ -582,180 +463,14 @@ static int composite_yuv( uint8_t *p_dest, int width_dest, int height_dest, uint
 }
 
 
-/** Scale 16bit greyscale luma map using nearest neighbor.
+/** Get a reference to the luma map scaled to the b frame size.
 */
 
-static inline void
-scale_luma ( uint16_t *dest_buf, int dest_width, int dest_height, const uint16_t *src_buf, int src_width, int src_height, int invert )
+static luma_map get_luma( mlt_transition self, mlt_properties properties, int width, int height )
 {
-	register int i, j;
-	register int x_step = ( src_width << 16 ) / dest_width;
-	register int y_step = ( src_height << 16 ) / dest_height;
-	register int x, y = 0;
-
-	for ( i = 0; i < dest_height; i++ )
-	{
-		const uint16_t *src = src_buf + ( y >> 16 ) * src_width;
-		x = 0;
-		
-		for ( j = 0; j < dest_width; j++ )
-		{
-			*dest_buf++ = src[ x >> 16 ] ^ invert;
-			x += x_step;
-		}
-		y += y_step;
-	}
-}
-
-static uint16_t* get_luma( mlt_transition self, mlt_properties properties, int width, int height )
-{
-	// The cached luma map information
-	int luma_width = mlt_properties_get_int( properties, "_luma.width" );
-	int luma_height = mlt_properties_get_int( properties, "_luma.height" );
-	uint16_t *luma_bitmap = mlt_properties_get_data( properties, "_luma.bitmap", NULL );
-	int invert = mlt_properties_get_int( properties, "luma_invert" );
-	
-	// If the filename property changed, reload the map
 	char *resource = mlt_properties_get( properties, "luma" );
-
-	char temp[ 512 ];
-
-	if ( luma_width == 0 || luma_height == 0 )
-	{
-		luma_width = width;
-		luma_height = height;
-	}
-
-	if ( resource && resource[0] && strchr( resource, '%' ) )
-	{
-		// TODO: Clean up quick and dirty compressed/existence check
-		FILE *test;
-		sprintf( temp, "%s/lumas/%s/%s", mlt_environment( "MLT_DATA" ), mlt_environment( "MLT_NORMALISATION" ), strchr( resource, '%' ) + 1 );
-		test = fopen( temp, "r" );
-		if ( test == NULL )
-			strcat( temp, ".png" );
-		else
-			fclose( test );
-		resource = temp;
-	}
-
-	if ( resource && resource[0] )
-	{
-		char *old_luma = mlt_properties_get( properties, "_luma" );
-		int old_invert = mlt_properties_get_int( properties, "_luma_invert" );
-
-		if ( invert != old_invert || ( old_luma && old_luma[0] && strcmp( resource, old_luma ) ) )
-		{
-			mlt_properties_set_data( properties, "_luma.orig_bitmap", NULL, 0, NULL, NULL );
-			luma_bitmap = NULL;
-		}
-	}
-	else {
-		char *old_luma = mlt_properties_get( properties, "_luma" );
-		if ( old_luma && old_luma[0] )
-		{
-			mlt_properties_set_data( properties, "_luma.orig_bitmap", NULL, 0, NULL, NULL );
-			luma_bitmap = NULL;
-			mlt_properties_set( properties, "_luma", NULL);
-		}
-	}
-
-	if ( resource && resource[0] && ( luma_bitmap == NULL || luma_width != width || luma_height != height ) )
-	{
-		uint16_t *orig_bitmap = mlt_properties_get_data( properties, "_luma.orig_bitmap", NULL );
-		luma_width = mlt_properties_get_int( properties, "_luma.orig_width" );
-		luma_height = mlt_properties_get_int( properties, "_luma.orig_height" );
-
-		// Load the original luma once
-		if ( orig_bitmap == NULL )
-		{
-			char *extension = strrchr( resource, '.' );
-			
-			// See if it is a PGM
-			if ( extension != NULL && strcmp( extension, ".pgm" ) == 0 )
-			{
-				// Convert file name string encoding.
-				mlt_properties_set( properties, "_luma_utf8", resource );
-				mlt_properties_from_utf8( properties, "_luma_utf8", "_luma_local8" );
-
-				// Open PGM
-				FILE *f = fopen( mlt_properties_get( properties, "_luma_local8" ), "rb" );
-				if ( f != NULL )
-				{
-					// Load from PGM
-					luma_read_pgm( f, &orig_bitmap, &luma_width, &luma_height );
-					fclose( f );
-					
-					// Remember the original size for subsequent scaling
-					mlt_properties_set_data( properties, "_luma.orig_bitmap", orig_bitmap, luma_width * luma_height * 2, mlt_pool_release, NULL );
-					mlt_properties_set_int( properties, "_luma.orig_width", luma_width );
-					mlt_properties_set_int( properties, "_luma.orig_height", luma_height );
-				}
-			}
-			else
-			{
-				// Get the factory producer service
-				char *factory = mlt_properties_get( properties, "factory" );
-	
-				// Create the producer
-				mlt_profile profile = mlt_service_profile( MLT_TRANSITION_SERVICE( self ) );
-				mlt_producer producer = mlt_factory_producer( profile, factory, resource );
-	
-				// If we have one
-				if ( producer != NULL )
-				{
-					// Get the producer properties
-					mlt_properties producer_properties = MLT_PRODUCER_PROPERTIES( producer );
-	
-					// Ensure that we loop
-					mlt_properties_set( producer_properties, "eof", "loop" );
-	
-					// Now pass all producer. properties on the transition down
-					mlt_properties_pass( producer_properties, properties, "luma." );
-	
-					// We will get the alpha frame from the producer
-					mlt_frame luma_frame = NULL;
-	
-					// Get the luma frame
-					if ( mlt_service_get_frame( MLT_PRODUCER_SERVICE( producer ), &luma_frame, 0 ) == 0 )
-					{
-						uint8_t *luma_image;
-						mlt_image_format luma_format = mlt_image_yuv422;
-	
-						// Get image from the luma producer
-						mlt_properties_set( MLT_FRAME_PROPERTIES( luma_frame ), "rescale.interp", "none" );
-						mlt_frame_get_image( luma_frame, &luma_image, &luma_format, &luma_width, &luma_height, 0 );
-	
-						// Generate the luma map
-						if ( luma_image != NULL && luma_format == mlt_image_yuv422 )
-							luma_read_yuv422( luma_image, &orig_bitmap, luma_width, luma_height );
-	
-						// Remember the original size for subsequent scaling
-						mlt_properties_set_data( properties, "_luma.orig_bitmap", orig_bitmap, luma_width * luma_height * 2, mlt_pool_release, NULL );
-						mlt_properties_set_int( properties, "_luma.orig_width", luma_width );
-						mlt_properties_set_int( properties, "_luma.orig_height", luma_height );
-						
-						// Cleanup the luma frame
-						mlt_frame_close( luma_frame );
-					}
-	
-					// Cleanup the luma producer
-					mlt_producer_close( producer );
-				}
-			}
-		}
-		// Scale luma map
-		luma_bitmap = mlt_pool_alloc( width * height * sizeof( uint16_t ) );
-		scale_luma( luma_bitmap, width, height, orig_bitmap, luma_width, luma_height, invert * ( ( 1 << 16 ) - 1 ) );
-
-		// Remember the scaled luma size to prevent unnecessary scaling
-		mlt_properties_set_int( properties, "_luma.width", width );
-		mlt_properties_set_int( properties, "_luma.height", height );
-		mlt_properties_set_data( properties, "_luma.bitmap", luma_bitmap, width * height * 2, mlt_pool_release, NULL );
-		mlt_properties_set( properties, "_luma", resource );
-		mlt_properties_set_int( properties, "_luma_invert", invert );
-	}
-	return luma_bitmap;
+	int invert = mlt_properties_get_int( properties, "luma_invert" );
+	return luma_map_fetch( MLT_TRANSITION_SERVICE( self ), properties, resource, "luma.", invert, width, height );
 }
 
 /** Get the properly sized image from b_frame.
@@ -1223,8 +938,9 @@ static int transition_get_image( mlt_frame a_frame, uint8_t **image, mlt_image_f
 			
 			double luma_softness = mlt_properties_get_double( properties, "softness" );
 			mlt_service_lock( MLT_TRANSITION_SERVICE( self ) );
-			uint16_t *luma_bitmap = get_luma( self, properties, width_b, height_b );
+			luma_map luma = get_luma( self, properties, width_b, height_b );
 			mlt_service_unlock( MLT_TRANSITION_SERVICE( self ) );
+			uint16_t *luma_bitmap = luma ? (uint16_t*) luma->bitmap : NULL;
 			char *operator = mlt_properties_get( properties, "operator" );
 
 			alpha_b = alpha_b == NULL ? mlt_frame_get_alpha( b_frame ) : alpha_b;
@@ -1244,10 +960,34 @@ static int transition_get_image( mlt_frame a_frame, uint8_t **image, mlt_image_f
 
 			// Allow the user to completely obliterate the alpha channels from both frames
 			if ( mlt_properties_get( properties, "alpha_a" ) && alpha_a )
+			{
 				memset( alpha_a, mlt_properties_get_int( properties, "alpha_a" ), *width * *height );
+				mlt_frame_set_uniform_alpha( a_frame, mlt_properties_get_int( properties, "alpha_a" ) );
+			}
 
 			if ( mlt_properties_get( properties, "alpha_b" ) && alpha_b )
+			{
 				memset( alpha_b, mlt_properties_get_int( properties, "alpha_b" ), width_b * height_b );
+				mlt_frame_set_uniform_alpha( b_frame, mlt_properties_get_int( properties, "alpha_b" ) );
+			}
+
+			// Skip the per-pixel alpha of opaque frames. The source alpha is only read,
+			// and the plain composite keeps an opaque destination opaque, but the
+			// operators write the destination alpha.
+			{
+				mlt_frame dest_frame = invert ? b_frame : a_frame;
+				uint8_t **alpha_src = invert ? &alpha_a : &alpha_b;
+				uint8_t **alpha_dest = invert ? &alpha_b : &alpha_a;
+
+				if ( mlt_frame_is_opaque( invert ? a_frame : b_frame ) )
+					*alpha_src = NULL;
+				if ( line_fn == composite_line_yuv && mlt_frame_is_opaque( dest_frame ) )
+					*alpha_dest = NULL;
+				else if ( mlt_frame_is_opaque( dest_frame ) )
+					*alpha_dest = mlt_frame_get_alpha_mask( dest_frame );
+				else if ( *alpha_dest != NULL )
+					mlt_frame_set_uniform_alpha( dest_frame, -1 );
+			}
 
 			for ( field = 0; field < ( progressive ? 1 : 2 ); field++ )
 			{
@@ -1290,6 +1030,8 @@ static int transition_get_image( mlt_frame a_frame, uint8_t **image, mlt_image_f
 				else
 					composite_yuv( *image, *width, *height, image_b, width_b, height_b, alpha_b, alpha_a, result, progressive ? -1 : field, luma_bitmap, luma_softness, line_fn );
 			}
+
+			luma_map_close( luma );
 		}
 	}
 	else
@@ -24,40 +24,111 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#if defined(USE_SSE) && defined(ARCH_X86_64)
+#include <xmmintrin.h>
+#endif
 
 
-static int mix_audio( mlt_frame frame, mlt_frame that, float weight_start, float weight_end, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
+/** Crossfade one planar channel with a linear weight ramp.
+*/
+
+static void mix_channel( float *dest, const float *src, int samples, float weight, float weight_step )
+{
+	int i = 0;
+#if defined(USE_SSE) && defined(ARCH_X86_64)
+	__m128 w = _mm_add_ps( _mm_set1_ps( weight ), _mm_mul_ps( _mm_set1_ps( weight_step ), _mm_set_ps( 3, 2, 1, 0 ) ) );
+	__m128 step = _mm_set1_ps( 4 * weight_step );
+	for ( ; i + 4 <= samples; i += 4 )
+	{
+		__m128 d = _mm_loadu_ps( dest + i );
+		__m128 s = _mm_loadu_ps( src + i );
+		_mm_storeu_ps( dest + i, _mm_add_ps( d, _mm_mul_ps( _mm_sub_ps( s, d ), w ) ) );
+		w = _mm_add_ps( w, step );
+	}
+	weight += i * weight_step;
+#endif
+	for ( ; i < samples; i++ )
+	{
+		dest[ i ] += ( src[ i ] - dest[ i ] ) * weight;
+		weight += weight_step;
+	}
+}
+
+/** Shrink a planar buffer in place to fewer samples per channel.
+*/
+
+static void compact_planes( float *buffer, int channels, int samples_from, int samples_to )
 {
-	int ret = 0;
-	int16_t *src, *dest;
-	int frequency_src = *frequency, frequency_dest = *frequency;
-	int channels_src = *channels, channels_dest = *channels;
-	int samples_src = *samples, samples_dest = *samples;
-	int i, j;
-	double d = 0, s = 0;
+	int c;
+	if ( samples_to < samples_from )
+		for ( c = 1; c < channels; c++ )
+			memmove( buffer + c * samples_to, buffer + c * samples_from, samples_to * sizeof( float ) );
+}
 
-	mlt_frame_get_audio( that, (void**) &src, format, &frequency_src, &channels_src, &samples_src );
-	mlt_frame_get_audio( frame, (void**) &dest, format, &frequency_dest, &channels_dest, &samples_dest );
+/** The audio formats mixed natively.
+*/
+
+static const mlt_audio_format mix_formats[] = { mlt_audio_float, mlt_audio_none };
+
+/** Fetch the audio of both frames as planar float, clearing any that is flagged silent.
+*/
+
+static int get_both_audio( mlt_frame frame, mlt_frame that, float **src, float **dest, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples, int *frequency_src, int *channels_src, int *samples_src )
+{
+	mlt_audio_format format_src = mlt_audio_float, format_dest = mlt_audio_float;
+	int frequency_dest = *frequency, channels_dest = *channels, samples_dest = *samples;
+
+	*frequency_src = *frequency;
+	*channels_src = *channels;
+	*samples_src = *samples;
+	mlt_frame_get_audio_accepting( that, mix_formats, (void**) src, &format_src, frequency_src, channels_src, samples_src );
+	mlt_frame_get_audio_accepting( frame, mix_formats, (void**) dest, &format_dest, &frequency_dest, &channels_dest, &samples_dest );
+
+	// Account for the conversions of the b frame on the a frame
+	mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "audio_conversions",
+		mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "audio_conversions" ) +
+		mlt_properties_get_int( MLT_FRAME_PROPERTIES( that ), "audio_conversions" ) );
+
+	*frequency = frequency_dest;
+	*channels = channels_dest;
+	*samples = samples_dest;
+
+	// Without a float converter, pass the audio of the a frame through unmixed
+	if ( format_src != mlt_audio_float || format_dest != mlt_audio_float || !*src || !*dest )
+	{
+		*buffer = *dest;
+		*format = format_dest;
+		return 1;
+	}
 
 	int silent = mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "silent_audio" );
 	mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "silent_audio", 0 );
 	if ( silent )
-		memset( dest, 0, samples_dest * channels_dest * sizeof( int16_t ) );
+		memset( *dest, 0, samples_dest * channels_dest * sizeof( float ) );
 
 	silent = mlt_properties_get_int( MLT_FRAME_PROPERTIES( that ), "silent_audio" );
 	mlt_properties_set_int( MLT_FRAME_PROPERTIES( that ), "silent_audio", 0 );
 	if ( silent )
-		memset( src, 0, samples_src * channels_src * sizeof( int16_t ) );
+		memset( *src, 0, *samples_src * *channels_src * sizeof( float ) );
 
-	// determine number of samples to process
-	*samples = samples_src < samples_dest ? samples_src : samples_dest;
-	*channels = channels_src < channels_dest ? channels_src : channels_dest;
-	*buffer = dest;
-	*frequency = frequency_dest;
+	return 0;
+}
 
-	// Compute a smooth ramp over start to end
-	float weight = weight_start;
-	float weight_step = ( weight_end - weight_start ) / *samples;
+static int mix_audio( mlt_frame frame, mlt_frame that, float weight_start, float weight_end, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
+{
+	float *src, *dest;
+	int frequency_src, channels_src, samples_src;
+	int channels_dest = *channels, samples_dest = *samples;
+	int c;
+
+	if ( get_both_audio( frame, that, &src, &dest, buffer, format, frequency, &channels_dest, &samples_dest, &frequency_src, &channels_src, &samples_src ) )
+	{
+		*channels = channels_dest;
+		*samples = samples_dest;
+		return 1;
+	}
+
+	*format = mlt_audio_float;
 
 	if ( src == dest )
 	{
@@ -65,54 +136,46 @@ static int mix_audio( mlt_frame frame, mlt_frame that, float weight_start, float
 		*channels = channels_src;
 		*buffer = src;
 		*frequency = frequency_src;
-		return ret;
+		return 0;
 	}
 
+	// determine number of samples to process
+	*samples = samples_src < samples_dest ? samples_src : samples_dest;
+	*channels = channels_src < channels_dest ? channels_src : channels_dest;
+	*buffer = dest;
+
+	// Compute a smooth ramp over start to end
+	float weight_step = ( weight_end - weight_start ) / *samples;
+
 	// Mixdown
-	for ( i = 0; i < *samples; i++ )
-	{
-		for ( j = 0; j < *channels; j++ )
-		{
-			if ( j < channels_dest )
-				d = (double) dest[ i * channels_dest + j ];
-			if ( j < channels_src )
-				s = (double) src[ i * channels_src + j ];
-			dest[ i * channels_dest + j ] = s * weight + d * ( 1.0 - weight );
-		}
-		weight += weight_step;
-	}
+	for ( c = 0; c < *channels; c++ )
+		mix_channel( dest + c * samples_dest, src + c * samples_src, *samples, weight_start, weight_step );
+	compact_planes( dest, *channels, samples_dest, *samples );
 
-	return ret;
+	return 0;
 }
 
 // Replacement for broken mlt_frame_audio_mix - this filter uses an inline low pass filter
 // to allow mixing without volume hacking
 static int combine_audio( mlt_frame frame, mlt_frame that, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
 {
-	int ret = 0;
-	int16_t *src, *dest;
-	int frequency_src = *frequency, frequency_dest = *frequency;
-	int channels_src = *channels, channels_dest = *channels;
-	int samples_src = *samples, samples_dest = *samples;
-	int i, j;
-	double vp[ 6 ];
-	double b_weight = 1.0;
+	float *src, *dest;
+	int frequency_src, channels_src, samples_src;
+	int channels_dest = *channels, samples_dest = *samples;
+	int i, c;
+	float b_weight = 1.0;
 
 	if ( mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "meta.mixdown" ) )
 		b_weight = 1.0 - mlt_properties_get_double( MLT_FRAME_PROPERTIES( frame ), "meta.volume" );
 
-	mlt_frame_get_audio( that, (void**) &src, format, &frequency_src, &channels_src, &samples_src );
-	mlt_frame_get_audio( frame, (void**) &dest, format, &frequency_dest, &channels_dest, &samples_dest );
-
-	int silent = mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "silent_audio" );
-	mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "silent_audio", 0 );
-	if ( silent )
-		memset( dest, 0, samples_dest * channels_dest * sizeof( int16_t ) );
+	if ( get_both_audio( frame, that, &src, &dest, buffer, format, frequency, &channels_dest, &samples_dest, &frequency_src, &channels_src, &samples_src ) )
+	{
+		*channels = channels_dest;
+		*samples = samples_dest;
+		return 1;
+	}
 
-	silent = mlt_properties_get_int( MLT_FRAME_PROPERTIES( that ), "silent_audio" );
-	mlt_properties_set_int( MLT_FRAME_PROPERTIES( that ), "silent_audio", 0 );
-	if ( silent )
-		memset( src, 0, samples_src * channels_src * sizeof( int16_t ) );
+	*format = mlt_audio_float;
 
 	if ( src == dest )
 	{
@@ -120,34 +183,35 @@ static int combine_audio( mlt_frame frame, mlt_frame that, void **buffer, mlt_au
 		*channels = channels_src;
 		*buffer = src;
 		*frequency = frequency_src;
-		return ret;
+		return 0;
 	}
 
 	// determine number of samples to process
 	*samples = samples_src < samples_dest ? samples_src : samples_dest;
 	*channels = channels_src < channels_dest ? channels_src : channels_dest;
 	*buffer = dest;
-	*frequency = frequency_dest;
-
-	for ( j = 0; j < *channels; j++ )
-		vp[ j ] = ( double )dest[ j ];
 
-	double Fc = 0.5;
-	double B = exp(-2.0 * M_PI * Fc);
-	double A = 1.0 - B;
-	double v;
+	float Fc = 0.5;
+	float B = exp(-2.0 * M_PI * Fc);
+	float A = 1.0 - B;
 
-	for ( i = 0; i < *samples; i++ )
+	for ( c = 0; c < *channels; c++ )
 	{
-		for ( j = 0; j < *channels; j++ )
+		float *d = dest + c * samples_dest;
+		float *s = src + c * samples_src;
+		float vp = d[ 0 ];
+		float v;
+
+		for ( i = 0; i < *samples; i++ )
 		{
-			v = ( double )( b_weight * dest[ i * channels_dest + j ] + src[ i * channels_src + j ] );
-			v = v < -32767 ? -32767 : v > 32768 ? 32768 : v;
-			vp[ j ] = dest[ i * channels_dest + j ] = ( int16_t )( v * A + vp[ j ] * B );
+			v = b_weight * d[ i ] + s[ i ];
+			v = v < -1.0f ? -1.0f : v > 1.0f ? 1.0f : v;
+			vp = d[ i ] = v * A + vp * B;
 		}
 	}
+	compact_planes( dest, *channels, samples_dest, *samples );
 
-	return ret;
+	return 0;
 }
 
 /** Get the audio.
@@ -164,8 +228,8 @@ static int transition_get_audio( mlt_frame frame, void **buffer, mlt_audio_forma
 	// Get the properties of the b frame
 	mlt_properties b_props = MLT_FRAME_PROPERTIES( b_frame );
 
-	// We can only mix s16
-	*format = mlt_audio_s16;
+	// Mix natively in planar float
+	*format = mlt_audio_float;
 
 	if ( mlt_properties_get_int( MLT_TRANSITION_PROPERTIES( effect ), "combine" ) == 0 )
 	{
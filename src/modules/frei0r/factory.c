@@ -419,6 +419,10 @@ MLT_REPOSITORY
 	mlt_properties_set_data( mlt_global_properties(), "frei0r.param_name_map",
 		mlt_properties_parse_yaml( dirname ), 0, (mlt_destructor) mlt_properties_close, NULL );
 
+	// The plugins found depend on the search path and what is installed in it
+	mlt_repository_watch( repository, "FREI0R_PATH", NULL );
+	mlt_repository_watch( repository, "MLT_FREI0R_PLUGIN_PATH", NULL );
+
 	while (dircount--){
 
 		mlt_properties direntries = mlt_properties_new();
@@ -428,6 +432,7 @@ MLT_REPOSITORY
 			snprintf(dirname, PATH_MAX, "%s", directory);
 		else
 			snprintf(dirname, PATH_MAX, "%s%s", getenv("HOME"), strchr(directory, '/'));
+		mlt_repository_watch( repository, NULL, dirname );
 		mlt_properties_dir_list(direntries, dirname ,"*" LIBSUF, 1);
 
 		for (i=0; i<mlt_properties_count(direntries);i++){
@@ -25,9 +25,9 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include <jack/jack.h>
-#include <jack/ringbuffer.h>
 
-#define BUFFER_LEN (204800 * 6)
+// The number of sample frames deinterleaved at a time in the process callback
+#define SCRATCH_LEN (1024)
 
 pthread_mutex_t g_activate_mutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -52,7 +52,9 @@ struct consumer_jack_s
 	pthread_mutex_t refresh_mutex;
 	int refresh_count;
 	int counter;
-	jack_ringbuffer_t **ringbuffers;
+	mlt_audio_ring audio_ring;
+	float *audio_scratch;
+	int audio_channels;
 	jack_port_t **ports;
 };
 
@@ -115,6 +117,9 @@ mlt_consumer consumer_jack_init( mlt_profile profile, mlt_service_type type, con
 			// Set default volume
 			mlt_properties_set_double( properties, "volume", 1.0 );
 
+			// Default audio latency in milliseconds
+			mlt_properties_set_int( properties, "audio_latency", 200 );
+
 			// Ensure we don't join on a non-running object
 			self->joined = 1;
 
@@ -197,20 +202,18 @@ static int consumer_stop( mlt_consumer parent )
 		// Cleanup JACK
 		if ( self->playing )
 			jack_deactivate( self->jack );
-		if ( self->ringbuffers )
+		if ( self->ports )
 		{
-			int n = mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( parent ), "channels" );
+			int n = self->audio_channels;
 			while ( n-- )
-			{
-				jack_ringbuffer_free( self->ringbuffers[n] );
 				jack_port_unregister( self->jack, self->ports[n] );
-			}
-			mlt_pool_release( self->ringbuffers );
-		}
-		self->ringbuffers = NULL;
-		if ( self->ports )
 			mlt_pool_release( self->ports );
+		}
 		self->ports = NULL;
+		mlt_audio_ring_close( self->audio_ring );
+		self->audio_ring = NULL;
+		mlt_pool_release( self->audio_scratch );
+		self->audio_scratch = NULL;
 	}
 
 	return 0;
@@ -226,22 +229,29 @@ static int jack_process( jack_nframes_t frames, void * data )
 {
 	int error = 0;
 	consumer_jack self = (consumer_jack) data;
-	mlt_properties properties = MLT_CONSUMER_PROPERTIES( &self->parent );
-	int channels = mlt_properties_get_int( properties, "channels" );
-	int i;
+	int channels = self->audio_channels;
+	float *dest[ channels ];
+	int done = 0;
+	int i, j;
 
-	if ( !self->ringbuffers )
+	if ( !self->audio_ring )
 		return 1;
 
 	for ( i = 0; i < channels; i++ )
-	{
-		size_t jack_size = ( frames * sizeof(float) );
-		size_t ring_size = jack_ringbuffer_read_space( self->ringbuffers[i] );
-		char *dest = jack_port_get_buffer( self->ports[i], frames );
+		dest[i] = jack_port_get_buffer( self->ports[i], frames );
 
-		jack_ringbuffer_read( self->ringbuffers[i], dest, ring_size < jack_size ? ring_size : jack_size );
-		if ( ring_size < jack_size )
-			memset( dest + ring_size, 0, jack_size - ring_size );
+	// Take what the render thread has queued, padded with silence, and
+	// spread it across the ports
+	while ( done < frames )
+	{
+		int count = frames - done < SCRATCH_LEN ? frames - done : SCRATCH_LEN;
+		float *p = self->audio_scratch;
+
+		mlt_audio_ring_read( self->audio_ring, p, count );
+		for ( j = 0; j < count; j++ )
+			for ( i = 0; i < channels; i++ )
+				dest[i][ done + j ] = *p++;
+		done += count;
 	}
 
 	return error;
@@ -258,7 +268,10 @@ static void initialise_jack_ports( consumer_jack self )
 	int channels = mlt_properties_get_int( properties, "channels" );
 
 	// Allocate buffers and ports
-	self->ringbuffers = mlt_pool_alloc( sizeof( jack_ringbuffer_t *) * channels );
+	mlt_audio_ring audio_ring = mlt_audio_ring_init( mlt_audio_f32le, mlt_properties_get_int( properties, "frequency" ),
+		channels, mlt_properties_get_int( properties, "audio_latency" ) );
+	self->audio_scratch = mlt_pool_alloc( mlt_audio_format_size( mlt_audio_f32le, SCRATCH_LEN, channels ) );
+	self->audio_channels = channels;
 	self->ports = mlt_pool_alloc( sizeof(jack_port_t *) * channels );
 
 	// Start Jack processing - required before registering ports
@@ -270,7 +283,6 @@ static void initialise_jack_ports( consumer_jack self )
 	// Register Jack ports
 	for ( i = 0; i < channels; i++ )
 	{
-		self->ringbuffers[i] = jack_ringbuffer_create( BUFFER_LEN * sizeof(float) );
 		snprintf( mlt_name, sizeof( mlt_name ), "out_%d", i + 1 );
 		self->ports[i] = jack_port_register( self->jack, mlt_name, JACK_DEFAULT_AUDIO_TYPE,
 				JackPortIsOutput | JackPortIsTerminal, 0 );
@@ -297,13 +309,17 @@ static void initialise_jack_ports( consumer_jack self )
 	}
 	if ( ports )
 		jack_free( ports );
+
+	// Let the process callback start reading once the ports are in place
+	__sync_synchronize();
+	self->audio_ring = audio_ring;
 }
 
 static int consumer_play_audio( consumer_jack self, mlt_frame frame, int init_audio, int *duration )
 {
 	// Get the properties of this consumer
 	mlt_properties properties = MLT_CONSUMER_PROPERTIES( &self->parent );
-	mlt_audio_format afmt = mlt_audio_float;
+	mlt_audio_format afmt = mlt_audio_f32le;
 
 	// Set the preferred params of the test card signal
 	double speed = mlt_properties_get_double( MLT_FRAME_PROPERTIES(frame), "_speed" );
@@ -332,7 +348,7 @@ static int consumer_play_audio( consumer_jack self, mlt_frame frame, int init_au
 	if ( init_audio == 0 && ( speed == 1.0 || speed == 0.0 ) )
 	{
 		int i;
-		size_t mlt_size = samples * sizeof(float);
+		int written = 0;
 		float volume = mlt_properties_get_double( properties, "volume" );
 
 		if ( !scrub && speed == 0.0 )
@@ -346,12 +362,17 @@ static int consumer_play_audio( consumer_jack self, mlt_frame frame, int init_au
 				*p++ *= volume;
 		}
 
-		// Write into output ringbuffer
-		for ( i = 0; i < channels; i++ )
+		// Wait for the ring to drain to the latency target, without holding any lock
+		while ( self->running && self->audio_ring && written < samples )
+			written += mlt_audio_ring_write( self->audio_ring, buffer + written * channels, samples - written, 100 );
+
+		// Report the ring's state
+		if ( self->audio_ring )
 		{
-			size_t ring_size = jack_ringbuffer_write_space( self->ringbuffers[i] );
-			if ( ring_size >= mlt_size )
-				jack_ringbuffer_write( self->ringbuffers[i], (char*)( buffer + i * samples ), mlt_size );
+			mlt_events_block( properties, properties );
+			mlt_properties_set_int( properties, "audio_fill", mlt_audio_ring_latency( self->audio_ring ) );
+			mlt_properties_set_int( properties, "audio_underruns", mlt_audio_ring_underruns( self->audio_ring ) );
+			mlt_events_unblock( properties, properties );
 		}
 	}
 
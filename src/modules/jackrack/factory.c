@@ -148,7 +148,7 @@ MLT_REPOSITORY
 {
 #ifdef GPL
 	GSList *list;
-	g_jackrack_plugin_mgr = plugin_mgr_new();
+	g_jackrack_plugin_mgr = plugin_mgr_new( repository );
 
 	for ( list = g_jackrack_plugin_mgr->all_plugins; list; list = g_slist_next( list ) )
 	{
@@ -213,7 +213,7 @@ plugin_mgr_get_dir_plugins (plugin_mgr_t * plugin_mgr, const char * dir)
 }
 
 static void
-plugin_mgr_get_path_plugins (plugin_mgr_t * plugin_mgr)
+plugin_mgr_get_path_plugins (plugin_mgr_t * plugin_mgr, mlt_repository repository)
 {
   char * ladspa_path, * dir;
   
@@ -236,8 +236,13 @@ plugin_mgr_get_path_plugins (plugin_mgr_t * plugin_mgr)
     ladspa_path = g_strdup ("/usr/local/lib/ladspa:/usr/lib/ladspa:/usr/lib64/ladspa");
 #endif
   
+  /* the plugins found depend on the search path and what is installed in it */
+  mlt_repository_watch (repository, "LADSPA_PATH", NULL);
   for (dir = strtok (ladspa_path, ":"); dir; dir = strtok (NULL, ":"))
-    plugin_mgr_get_dir_plugins (plugin_mgr, dir);
+    {
+      mlt_repository_watch (repository, NULL, dir);
+      plugin_mgr_get_dir_plugins (plugin_mgr, dir);
+    }
 
   g_free (ladspa_path);
 }
@@ -254,7 +259,7 @@ plugin_mgr_sort (gconstpointer a, gconstpointer b)
 }
 
 plugin_mgr_t *
-plugin_mgr_new ()
+plugin_mgr_new (mlt_repository repository)
 {
   plugin_mgr_t * pm;
   char dirname[PATH_MAX];
@@ -266,7 +271,7 @@ plugin_mgr_new ()
 
   snprintf (dirname, PATH_MAX, "%s/jackrack/blacklist.txt", mlt_environment ("MLT_DATA"));
   pm->blacklist = mlt_properties_load (dirname);
-  plugin_mgr_get_path_plugins (pm);
+  plugin_mgr_get_path_plugins (pm, repository);
   
   if (!pm->all_plugins)
     mlt_log_warning( NULL, "No LADSPA plugins were found!\n\nCheck your LADSPA_PATH environment variable.\n");
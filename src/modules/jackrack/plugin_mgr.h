@@ -29,6 +29,7 @@
 
 #include "plugin_desc.h"
 #include "framework/mlt_properties.h"
+#include "framework/mlt_repository.h"
 
 typedef struct _plugin_mgr plugin_mgr_t;
 
@@ -43,7 +44,7 @@ struct _plugin_mgr
 
 struct _ui;
 
-plugin_mgr_t * plugin_mgr_new ();
+plugin_mgr_t * plugin_mgr_new (mlt_repository repository);
 void           plugin_mgr_destroy (plugin_mgr_t * plugin_mgr);
 
 void plugin_mgr_set_plugins (plugin_mgr_t * plugin_mgr, unsigned long rack_channels);
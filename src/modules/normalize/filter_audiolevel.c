@@ -57,9 +57,9 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 {
 	mlt_filter filter = mlt_frame_pop_audio( frame );
 	int iec_scale = mlt_properties_get_int( MLT_FILTER_PROPERTIES(filter), "iec_scale" );
-	*format = mlt_audio_s16;
-	int error = mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
-	if ( error || !buffer ) return error;
+	static const mlt_audio_format formats[] = { mlt_audio_float, mlt_audio_s16, mlt_audio_none };
+	int error = mlt_frame_get_audio_accepting( frame, formats, buffer, format, frequency, channels, samples );
+	if ( error || !buffer || !*buffer ) return error;
 
 	int num_channels = *channels;
 	int num_samples = *samples > 200 ? 200 : *samples;
@@ -67,6 +67,7 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 	int c, s;
 	char key[ 50 ];
 	int16_t *pcm = (int16_t*) *buffer;
+	float *pcm_float = (float*) *buffer;
 
 	for ( c = 0; c < *channels; c++ )
 	{
@@ -75,7 +76,9 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 
 		for ( s = 0; s < num_samples; s++ )
 		{
-			int sample = abs( pcm[c + s * num_channels] / 128 );
+			int sample = *format == mlt_audio_float ?
+				abs( (int) ( pcm_float[c * *samples + s] * 32767 ) / 128 ) :
+				abs( pcm[c + s * num_channels] / 128 );
 			val += sample;
 			if ( sample == 128 )
 				num_oversample++;
@@ -26,14 +26,32 @@
 #include <ctype.h>
 #include <string.h>
 
+#if defined(USE_SSE) && defined(ARCH_X86_64)
+#include <emmintrin.h>
+#endif
+
 #define MAX_CHANNELS 6
 #define EPSILON 0.00001
 
+// The number of samples per step of the limiter's gain envelope
+#define LIMITER_BLOCK 64
+
+// The fastest recovery of the limiter gain per block
+#define LIMITER_RELEASE 0.01
+
+/** The gain of one block of samples, planned under the service lock. */
+
+typedef struct
+{
+	float peak;   // the largest sample of all channels
+	float gain;   // the gain at the first sample
+	float step;   // the gain increment per sample
+	int clip;     // whether to clip to full scale
+} gain_ramp;
+
 /* The following normalise functions come from the normalize utility:
    Copyright (C) 1999--2002 Chris Vaill */
 
-#define samp_width 16
-
 #ifndef ROUND
 # define ROUND(x) floor((x) + 0.5)
 #endif
@@ -103,56 +121,110 @@ static inline double get_smoothed_data( double *buf, int count )
 
 /** Get the max power level (using RMS) and peak level of the audio segment.
  */
-double signal_max_power( int16_t *buffer, int channels, int samples, int16_t *peak )
+static double signal_max_power( const float *buffer, int channels, int samples, float *peak )
 {
-	// Determine numeric limits
-	int bytes_per_samp = (samp_width - 1) / 8 + 1;
-	int16_t max = (1 << (bytes_per_samp * 8 - 1)) - 1;
-	int16_t min = -max - 1;
-	
-	double *sums = (double *) calloc( channels, sizeof(double) );
-	int c, i;
-	int16_t sample;
-	double pow, maxpow = 0;
-
-	/* initialize peaks to effectively -inf and +inf */
-	int16_t max_sample = min;
-	int16_t min_sample = max;
-  
-	for ( i = 0; i < samples; i++ )
+	double maxpow = 0;
+	float max_sample = 0;
+	int c;
+
+	for ( c = 0; c < channels; c++ )
 	{
-		for ( c = 0; c < channels; c++ )
+		const float *p = buffer + c * samples;
+		double pow = 0;
+		int i = 0;
+#if defined(USE_SSE) && defined(ARCH_X86_64)
+		int j;
+		__m128 sum = _mm_setzero_ps();
+		__m128 max = _mm_setzero_ps();
+		const __m128 abs_mask = _mm_castsi128_ps( _mm_set1_epi32( 0x7fffffff ) );
+		float result[4];
+
+		// Accumulate in float over short runs to keep the precision of double
+		for ( ; i + 4 <= samples; )
 		{
-			sample = *buffer++;
-			sums[ c ] += (double) sample * (double) sample;
-			
-			/* track peak */
-			if ( sample > max_sample )
-				max_sample = sample;
-			else if ( sample < min_sample )
-				min_sample = sample;
+			int end = i + 4096 < samples ? i + 4096 : samples;
+			sum = _mm_setzero_ps();
+			for ( ; i + 4 <= end; i += 4 )
+			{
+				__m128 x = _mm_loadu_ps( p + i );
+				sum = _mm_add_ps( sum, _mm_mul_ps( x, x ) );
+				max = _mm_max_ps( max, _mm_and_ps( x, abs_mask ) );
+			}
+			_mm_storeu_ps( result, sum );
+			pow += (double) result[0] + result[1] + result[2] + result[3];
 		}
-	}
-	for ( c = 0; c < channels; c++ )
-	{
-		pow = sums[ c ] / (double) samples;
+		_mm_storeu_ps( result, max );
+		for ( j = 0; j < 4; j++ )
+			if ( result[j] > max_sample )
+				max_sample = result[j];
+#endif
+		for ( ; i < samples; i++ )
+		{
+			pow += (double) p[i] * p[i];
+			if ( fabsf( p[i] ) > max_sample )
+				max_sample = fabsf( p[i] );
+		}
+		pow /= (double) samples;
 		if ( pow > maxpow )
 			maxpow = pow;
 	}
-			
-	free( sums );
-	
-	/* scale the pow value to be in the range 0.0 -- 1.0 */
-	maxpow /= ( (double) min * (double) min);
 
-	if ( -min_sample > max_sample )
-		*peak = min_sample / (double) min;
-	else
-		*peak = max_sample / (double) max;
+	*peak = max_sample;
 
 	return sqrt( maxpow );
 }
 
+/** Apply a linear gain ramp to a run of samples, optionally clipping to full scale.
+ */
+static inline void apply_gain_ramp( float *p, int count, float gain, float gain_step, int clip )
+{
+	int i = 0;
+#if defined(USE_SSE) && defined(ARCH_X86_64)
+	__m128 g = _mm_set_ps( gain + 3 * gain_step, gain + 2 * gain_step, gain + gain_step, gain );
+	__m128 step = _mm_set1_ps( 4 * gain_step );
+	__m128 hi = _mm_set1_ps( clip ? 1.0f : INFINITY );
+	__m128 lo = _mm_set1_ps( clip ? -1.0f : -INFINITY );
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		__m128 x = _mm_mul_ps( _mm_loadu_ps( p + i ), g );
+		_mm_storeu_ps( p + i, _mm_max_ps( lo, _mm_min_ps( hi, x ) ) );
+		g = _mm_add_ps( g, step );
+	}
+#endif
+	for ( ; i < count; i++ )
+	{
+		float x = p[i] * ( gain + i * gain_step );
+		p[i] = clip ? ( x > 1.0f ? 1.0f : x < -1.0f ? -1.0f : x ) : x;
+	}
+}
+
+/** Get the peak of all channels over a run of samples.
+ */
+static inline float block_peak( const float *buffer, int channels, int samples, int start, int count )
+{
+	float peak = 0;
+	int c, i;
+	for ( c = 0; c < channels; c++ )
+	{
+		const float *p = buffer + c * samples + start;
+		i = 0;
+#if defined(USE_SSE) && defined(ARCH_X86_64)
+		const __m128 abs_mask = _mm_castsi128_ps( _mm_set1_epi32( 0x7fffffff ) );
+		__m128 max = _mm_setzero_ps();
+		float result[4];
+		int j;
+		for ( ; i + 4 <= count; i += 4 )
+			max = _mm_max_ps( max, _mm_and_ps( _mm_loadu_ps( p + i ), abs_mask ) );
+		_mm_storeu_ps( result, max );
+		for ( j = 0; j < 4; j++ )
+			peak = result[j] > peak ? result[j] : peak;
+#endif
+		for ( ; i < count; i++ )
+			peak = fabsf( p[i] ) > peak ? fabsf( p[i] ) : peak;
+	}
+	return peak;
+}
+
 /* ------ End normalize functions --------------------------------------- */
 
 /** Get the audio.
@@ -176,8 +248,7 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 	int normalise =  mlt_properties_get_int( instance_props, "normalise" );
 	double amplitude =  mlt_properties_get_double( instance_props, "amplitude" );
 	int i, j;
-	double sample;
-	int16_t peak;
+	float peak;
 	
 	// Use animated value for gain if "level" property is set 
 	char* level_property = mlt_properties_get( filter_props, "level" );
@@ -192,14 +263,43 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 	if ( mlt_properties_get( instance_props, "limiter" ) != NULL )
 		limiter_level = mlt_properties_get_double( instance_props, "limiter" );
 	
-	// Get the producer's audio
-	*format = mlt_audio_s16;
-	mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
+	// Get the producer's audio in planar float
+	static const mlt_audio_format formats[] = { mlt_audio_float, mlt_audio_s16, mlt_audio_none };
+	mlt_frame_get_audio_accepting( frame, formats, buffer, format, frequency, channels, samples );
+	if ( *format == mlt_audio_s16 && *buffer )
+	{
+		// No converter on this frame: widen the samples here
+		int size = mlt_audio_format_size( mlt_audio_float, *samples, *channels );
+		float *dest = mlt_pool_alloc( size );
+		int16_t *src = *buffer;
+		for ( i = 0; i < *samples; i++ )
+			for ( j = 0; j < *channels; j++ )
+				dest[ j * *samples + i ] = src[ i * *channels + j ] / 32768.0f;
+		mlt_frame_set_audio( frame, dest, mlt_audio_float, size, mlt_pool_release );
+		*buffer = dest;
+		*format = mlt_audio_float;
+	}
+	if ( *format != mlt_audio_float || !*buffer || *samples <= 0 )
+		return 0;
 
-	// Determine numeric limits
-	int bytes_per_samp = (samp_width - 1) / 8 + 1;
-	int samplemax = (1 << (bytes_per_samp * 8 - 1)) - 1;
-	int samplemin = -samplemax - 1;
+	float *data = *buffer;
+	int blocks = ( *samples + LIMITER_BLOCK - 1 ) / LIMITER_BLOCK;
+	gain_ramp *ramps = malloc( blocks * sizeof( gain_ramp ) );
+	double power = 0;
+	if ( !ramps )
+		return 0;
+
+	// Measure the audio before taking the lock, the limiter only needs the block peaks
+	if ( normalise )
+	{
+		power = signal_max_power( data, *channels, *samples, &peak );
+		for ( i = 0; i < blocks; i++ )
+		{
+			int start = i * LIMITER_BLOCK;
+			int count = start + LIMITER_BLOCK < *samples ? LIMITER_BLOCK : *samples - start;
+			ramps[i].peak = block_peak( data, *channels, *samples, start, count );
+		}
+	}
 
 	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
 
@@ -212,8 +312,8 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 		{
 			int smooth_index = mlt_properties_get_int( filter_props, "_smooth_index" );
 			
-			// Compute the signal power and put into smoothing buffer
-			smooth_buffer[ smooth_index ] = signal_max_power( *buffer, *channels, *samples, &peak );
+			// Put the signal power into smoothing buffer
+			smooth_buffer[ smooth_index ] = power;
 
 			if ( smooth_buffer[ smooth_index ] > EPSILON )
 			{
@@ -225,7 +325,7 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 		}
 		else
 		{
-			gain *= amplitude / signal_max_power( (int16_t*) *buffer, *channels, *samples, &peak );
+			gain *= amplitude / power;
 		}
 	}
 
@@ -235,52 +335,85 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 	// Initialise filter's previous gain value to prevent an inadvertant jump from 0
 	mlt_position last_position = mlt_properties_get_position( filter_props, "_last_position" );
 	mlt_position current_position = mlt_frame_get_position( frame );
-	if ( mlt_properties_get( filter_props, "_previous_gain" ) == NULL
-	     || current_position != last_position + 1 )
+	int continuous = mlt_properties_get( filter_props, "_previous_gain" ) != NULL
+	     && current_position == last_position + 1;
+	if ( !continuous )
 		mlt_properties_set_double( filter_props, "_previous_gain", gain );
 
 	// Start the gain out at the previous
 	double previous_gain = mlt_properties_get_double( filter_props, "_previous_gain" );
+	double limiter_gain = continuous ? mlt_properties_get_double( filter_props, "_limiter_gain" ) : -1.0;
 
 	// Determine ramp increment
 	double gain_step = ( gain - previous_gain ) / *samples;
 
+	// Plan the gain a block at a time. In normalise mode, the limiter looks one
+	// block ahead for the peak, so that the ramps of its gain envelope reach
+	// the reduction a peak needs by the time it arrives. Each ramp starts where
+	// the previous one ended, so the envelope never steps.
+	double previous_target = limiter_gain;
+	for ( i = 0; i < blocks; i++ )
+	{
+		int start = i * LIMITER_BLOCK;
+		int count = start + LIMITER_BLOCK < *samples ? LIMITER_BLOCK : *samples - start;
+		double start_gain = previous_gain + gain_step * start;
+		double end_gain = previous_gain + gain_step * ( start + count );
+		double start_limit = 1.0, end_limit = 1.0;
+
+		if ( normalise )
+		{
+			float next_peak = i + 1 < blocks ? ramps[ i + 1 ].peak : 0;
+			double peak_gain = start_gain > end_gain ? start_gain : end_gain;
+			double envelope = ( ramps[i].peak > next_peak ? ramps[i].peak : next_peak ) * peak_gain;
+			double target = 1.0;
+
+			// Use the limiter function instead of clipping when amplifying
+			if ( peak_gain > 1.0 && envelope > limiter_level )
+				target = limiter( envelope, limiter_level ) / envelope;
+
+			// Without a previous envelope, start at the reduction of the first block
+			if ( limiter_gain < 0 )
+				limiter_gain = previous_target = target;
+
+			start_limit = limiter_gain;
+			end_limit = target < previous_target ? target : previous_target;
+			if ( end_limit > start_limit + LIMITER_RELEASE )
+				end_limit = start_limit + LIMITER_RELEASE;
+			limiter_gain = end_limit;
+			previous_target = target;
+
+			// The lookahead does not cross frames, so a peak at the start of
+			// a frame can arrive before the ramp reaches its reduction
+			ramps[i].clip = start_limit > target;
+		}
+		else
+		{
+			ramps[i].clip = gain > 1.0;
+		}
+
+		ramps[i].gain = start_gain * start_limit;
+		ramps[i].step = ( end_gain * end_limit - ramps[i].gain ) / count;
+	}
+	if ( limiter_gain < 0 )
+		limiter_gain = 1.0;
+
 	// Save the current gain for the next iteration
 	mlt_properties_set_double( filter_props, "_previous_gain", gain );
+	mlt_properties_set_double( filter_props, "_limiter_gain", limiter_gain );
 	mlt_properties_set_position( filter_props, "_last_position", current_position );
 
 	mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
 
-	// Ramp from the previous gain to the current
-	gain = previous_gain;
-
-	int16_t *p = (int16_t*) *buffer;
-
-	// Apply the gain
-	for ( i = 0; i < *samples; i++ )
+	// Apply the planned ramps without holding the lock
+	for ( i = 0; i < blocks; i++ )
 	{
+		int start = i * LIMITER_BLOCK;
+		int count = start + LIMITER_BLOCK < *samples ? LIMITER_BLOCK : *samples - start;
 		for ( j = 0; j < *channels; j++ )
-		{
-			sample = *p * gain;
-			*p = ROUND( sample );
-		
-			if ( gain > 1.0 )
-			{
-				/* use limiter function instead of clipping */
-				if ( normalise )
-					*p = ROUND( samplemax * limiter( sample / (double) samplemax, limiter_level ) );
-				
-				/* perform clipping */
-				else if ( sample > samplemax )
-					*p = samplemax;
-				else if ( sample < samplemin )
-					*p = samplemin;
-			}
-			p++;
-		}
-		gain += gain_step;
+			apply_gain_ramp( data + j * *samples + start, count, ramps[i].gain, ramps[i].step, ramps[i].clip );
 	}
-	
+	free( ramps );
+
 	return 0;
 }
 
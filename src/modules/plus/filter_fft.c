@@ -98,13 +98,9 @@ static int filter_get_audio( mlt_frame frame, void** buffer, mlt_audio_format* f
 	int c = 0;
 	int s = 0;
 
-	// Sanity
-	if ( *format != mlt_audio_s16 && *format != mlt_audio_float )
-	{
-		*format = mlt_audio_float;
-	}
-	// Get the audio
-	mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
+	// Get the audio in either of the formats analysed natively
+	static const mlt_audio_format formats[] = { mlt_audio_float, mlt_audio_s16, mlt_audio_none };
+	mlt_frame_get_audio_accepting( frame, formats, buffer, format, frequency, channels, samples );
 
 	// The service must stay locked while using the private FFT data
 	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
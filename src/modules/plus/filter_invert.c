@@ -71,9 +71,25 @@ static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format
 
 static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 {
-	// Push the frame filter
-	mlt_frame_push_service( frame, filter );
-	mlt_frame_push_get_image( frame, filter_get_image );
+	if ( mlt_properties_get_int( MLT_FILTER_PROPERTIES( filter ), "alpha" ) )
+	{
+		// Push the frame filter
+		mlt_frame_push_service( frame, filter );
+		mlt_frame_push_get_image( frame, filter_get_image );
+	}
+	else
+	{
+		// Without the alpha mask this is a point operation that is fused with its neighbours
+		uint8_t lut[3][256];
+		int i;
+
+		for ( i = 0; i < 256; i++ )
+		{
+			lut[0][i] = clamp( 251 - i, 16, 235 );
+			lut[1][i] = lut[2][i] = clamp( 256 - i, 16, 240 );
+		}
+		mlt_frame_push_lut( frame, mlt_image_yuv422, lut );
+	}
 	return frame;
 }
 
@@ -20,6 +20,7 @@
 #include <framework/mlt.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 
 typedef struct
 {
@@ -101,78 +102,24 @@ static void refresh_lut( mlt_filter filter, mlt_frame frame )
 	}
 }
 
-static void apply_lut( mlt_filter filter, uint8_t* image, mlt_image_format format, int width, int height )
+static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 {
 	private_data* private = (private_data*)filter->child;
-	int total = width * height + 1;
-	uint8_t* sample = image;
-
-	switch( format )
-	{
-	case mlt_image_rgb24:
-		while( --total )
-		{
-			*sample = private->rlut[ *sample ];
-			sample++;
-			*sample = private->glut[ *sample ];
-			sample++;
-			*sample = private->blut[ *sample ];
-			sample++;
-		}
-		break;
-	case mlt_image_rgb24a:
-		while( --total )
-		{
-			*sample = private->rlut[ *sample ];
-			sample++;
-			*sample = private->glut[ *sample ];
-			sample++;
-			*sample = private->blut[ *sample ];
-			sample++;
-			sample++; // Skip alpha
-		}
-		break;
-	default:
-		mlt_log_error( MLT_FILTER_SERVICE( filter ), "Invalid image format: %s\n", mlt_image_format_name( format ) );
-		break;
-	}
-}
-
-static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
-{
-	mlt_filter filter = (mlt_filter) mlt_frame_pop_service( frame );
-	int error = 0;
+	uint8_t lut[3][256];
 
 	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
 
 	// Regenerate the LUT if necessary
 	refresh_lut( filter, frame );
-
-	// Make sure the format is acceptable
-	if( *format != mlt_image_rgb24 && *format != mlt_image_rgb24a )
-	{
-		*format = mlt_image_rgb24;
-	}
-
-	// Get the image
-	writable = 1;
-	error = mlt_frame_get_image( frame, image, format, width, height, writable );
-
-	// Apply the LUT
-	if( !error )
-	{
-		apply_lut( filter, *image, *format, *width, *height );
-	}
+	memcpy( lut[0], private->rlut, 256 );
+	memcpy( lut[1], private->glut, 256 );
+	memcpy( lut[2], private->blut, 256 );
 
 	mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
 
-	return error;
-}
+	// Apply the LUT, fused with neighbouring point filters
+	mlt_frame_push_lut( frame, mlt_image_rgb24, lut );
 
-static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
-{
-	mlt_frame_push_service( frame, filter );
-	mlt_frame_push_get_image( frame, filter_get_image );
 	return frame;
 }
 
@@ -19,12 +19,26 @@
  */
 
 #include <framework/mlt.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include "ebur128/ebur128.h"
 
 #define MAX_RESULT_SIZE 512
+#define MAX_CACHE_LINE 4096
+
+// Serialises access to cache files shared by several filters. Between
+// processes, a lock on a file beside the cache does the same.
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// The properties of the clip that select what the analysis hears
+static const char* stream_properties[] = { "audio_index", "astream", NULL };
 
 typedef struct
 {
@@ -43,6 +57,23 @@ typedef struct
 	analyze_data* analyze;
 	apply_data* apply;
 	mlt_position last_position;
+	// The clip covered by the filter, used as the cache key
+	int prepared;
+	char* service;
+	char* resource;
+	char* streams;
+	char* cache;
+	mlt_properties source;
+	int64_t size;
+	int64_t mtime;
+	mlt_position in;
+	mlt_position out;
+	// The standalone analysis job
+	pthread_t thread;
+	int thread_running;
+	int thread_done;
+	int thread_abort;
+	char thread_result[MAX_RESULT_SIZE];
 } private_data;
 
 static void destroy_analyze_data( mlt_filter filter )
@@ -61,6 +92,424 @@ static void init_analyze_data( mlt_filter filter, int channels, int samplerate )
 	private->last_position = 0;
 }
 
+static void format_results( ebur128_state* state, int channels, char* result )
+{
+	double loudness = 0.0;
+	double range = 0.0;
+	double tmpPeak = 0.0;
+	double peak = 0.0;
+	int i = 0;
+
+	ebur128_loudness_global( state, &loudness );
+	ebur128_loudness_range( state, &range );
+
+	for ( i = 0; i < channels; i++ )
+	{
+		ebur128_sample_peak( state, i, &tmpPeak );
+		if( tmpPeak > peak )
+		{
+			peak = tmpPeak;
+		}
+	}
+
+	snprintf( result, MAX_RESULT_SIZE, "L: %lf\tR: %lf\tP %lf", loudness, range, peak );
+	result[ MAX_RESULT_SIZE - 1 ] = '\0';
+}
+
+/** Split a cache line into its key fields and the results.
+ *
+ * Each line of the cache holds the resource, its size and modification time,
+ * the in point, the out point and the audio streams separated by tabs,
+ * followed by the results.
+ * \return the results or NULL if the line is malformed
+ */
+
+static char* cache_split( char* line, char** fields )
+{
+	char* p = line;
+	int i;
+
+	line[ strcspn( line, "\r\n" ) ] = '\0';
+	for ( i = 0; i < 6 && p; i++ )
+	{
+		fields[i] = p;
+		p = strchr( p, '\t' );
+		if ( p )
+			*p++ = '\0';
+	}
+	return i == 6 ? p : NULL;
+}
+
+/** Determine if a cache line is for the clip, whatever the state of its file.
+*/
+
+static int cache_same_clip( char** fields, private_data* private )
+{
+	return !strcmp( fields[0], private->resource ) && atoi( fields[3] ) == private->in && atoi( fields[4] ) == private->out &&
+		!strcmp( fields[5], private->streams );
+}
+
+/** Take the lock on a cache file.
+ *
+ * The lock is taken on a separate file because the cache itself is replaced
+ * whenever it is written.
+ * \return the file descriptor to pass to cache_unlock
+ */
+
+static int cache_lock( private_data* private )
+{
+	int fd = -1;
+
+	pthread_mutex_lock( &cache_mutex );
+#ifndef WIN32
+	char* name = malloc( strlen( private->cache ) + 6 );
+	sprintf( name, "%s.lock", private->cache );
+	fd = open( name, O_RDWR | O_CREAT, 0666 );
+	if ( fd != -1 && lockf( fd, F_LOCK, 0 ) )
+	{
+		close( fd );
+		fd = -1;
+	}
+	free( name );
+#endif
+	return fd;
+}
+
+/** Release the lock on a cache file.
+*/
+
+static void cache_unlock( int fd )
+{
+#ifndef WIN32
+	if ( fd != -1 )
+	{
+		lockf( fd, F_ULOCK, 0 );
+		close( fd );
+	}
+#endif
+	pthread_mutex_unlock( &cache_mutex );
+}
+
+/** Find the results for a clip in a cache file.
+ *
+ * An entry only matches while the file keeps its size and modification time.
+ */
+
+static int cache_lookup( private_data* private, char* result )
+{
+	char line[MAX_CACHE_LINE];
+	int found = 0;
+	int lock = cache_lock( private );
+	FILE* file;
+
+	file = fopen( private->cache, "r" );
+	if ( file )
+	{
+		while ( !found && fgets( line, sizeof( line ), file ) )
+		{
+			char* fields[6];
+			char* results = cache_split( line, fields );
+			if ( results && cache_same_clip( fields, private ) &&
+				 strtoll( fields[1], NULL, 10 ) == private->size && strtoll( fields[2], NULL, 10 ) == private->mtime )
+			{
+				strncpy( result, results, MAX_RESULT_SIZE - 1 );
+				result[ MAX_RESULT_SIZE - 1 ] = '\0';
+				found = 1;
+			}
+		}
+		fclose( file );
+	}
+	cache_unlock( lock );
+
+	return found;
+}
+
+/** Replace the results for a clip in a cache file.
+ *
+ * The file is rewritten without any previous entry for the clip and renamed
+ * into place, so it holds one entry per clip.
+ */
+
+static void cache_store( private_data* private, const char* result )
+{
+	char line[MAX_CACHE_LINE];
+	char copy[MAX_CACHE_LINE];
+	char* temp = malloc( strlen( private->cache ) + 8 );
+	FILE* input;
+	FILE* output = NULL;
+	int lock = cache_lock( private );
+	int fd;
+
+	sprintf( temp, "%s.XXXXXX", private->cache );
+	fd = mkstemp( temp );
+	if ( fd != -1 )
+		output = fdopen( fd, "w" );
+	if ( output )
+	{
+		input = fopen( private->cache, "r" );
+		if ( input )
+		{
+			while ( fgets( line, sizeof( line ), input ) )
+			{
+				char* fields[6];
+				strcpy( copy, line );
+				if ( !cache_split( copy, fields ) || !cache_same_clip( fields, private ) )
+					fputs( line, output );
+			}
+			fclose( input );
+		}
+		fprintf( output, "%s\t%" PRId64 "\t%" PRId64 "\t%d\t%d\t%s\t%s\n", private->resource, private->size, private->mtime,
+			private->in, private->out, private->streams, result );
+		if ( fclose( output ) || rename( temp, private->cache ) )
+		{
+			remove( temp );
+			output = NULL;
+		}
+	}
+	else if ( fd != -1 )
+	{
+		close( fd );
+		remove( temp );
+	}
+	cache_unlock( lock );
+	if ( !output )
+		mlt_log_warning( NULL, "[loudness] unable to write cache %s\n", private->cache );
+	free( temp );
+}
+
+/** Record the results and add them to the cache.
+*/
+
+static void store_results( mlt_filter filter, const char* result )
+{
+	private_data* private = (private_data*)filter->child;
+
+	mlt_log_info( MLT_FILTER_SERVICE( filter ), "Stored results: %s\n", result );
+	mlt_properties_set( MLT_FILTER_PROPERTIES( filter ), "results", result );
+	if ( private->cache )
+		cache_store( private, result );
+}
+
+/** The formats the analysis job takes without conversion.
+ *
+ * Producers opened by the job are not normalised, so it copes with the
+ * common native formats itself rather than rely on a converter.
+ */
+
+static const mlt_audio_format analyze_formats[] = { mlt_audio_f32le, mlt_audio_float, mlt_audio_s16, mlt_audio_s32le, mlt_audio_none };
+
+static float* add_frames( ebur128_state* state, void* buffer, mlt_audio_format format, int channels, int samples, float* interleaved, int* interleaved_size )
+{
+	switch ( format )
+	{
+	case mlt_audio_f32le:
+		ebur128_add_frames_float( state, buffer, samples );
+		break;
+	case mlt_audio_s16:
+		ebur128_add_frames_short( state, buffer, samples );
+		break;
+	case mlt_audio_s32le:
+		ebur128_add_frames_int( state, buffer, samples );
+		break;
+	case mlt_audio_float:
+		if ( *interleaved_size < samples * channels )
+		{
+			free( interleaved );
+			*interleaved_size = samples * channels;
+			interleaved = malloc( *interleaved_size * sizeof( float ) );
+		}
+		if ( interleaved )
+		{
+			float* planes = buffer;
+			int c, s;
+			for ( c = 0; c < channels; c++ )
+				for ( s = 0; s < samples; s++ )
+					interleaved[ s * channels + c ] = planes[ c * samples + s ];
+			ebur128_add_frames_float( state, interleaved, samples );
+		}
+		else
+		{
+			*interleaved_size = 0;
+		}
+		break;
+	default:
+		break;
+	}
+	return interleaved;
+}
+
+/** Analyze a clip on its own producer, pulling audio only.
+ *
+ * The job opens a private instance of the clip so that it may run ahead of,
+ * and in parallel with, the rendering thread and other analysis jobs.
+ */
+
+static void* analyze_thread( void* arg )
+{
+	mlt_filter filter = (mlt_filter)arg;
+	private_data* private = (private_data*)filter->child;
+	mlt_profile profile = mlt_service_profile( MLT_FILTER_SERVICE( filter ) );
+	mlt_producer producer = mlt_factory_producer( profile, private->service, private->resource );
+	ebur128_state* state = NULL;
+	int state_channels = 0;
+	int state_frequency = 0;
+	float* interleaved = NULL;
+	int interleaved_size = 0;
+
+	if ( producer )
+	{
+		mlt_properties producer_properties = MLT_PRODUCER_PROPERTIES( producer );
+		mlt_position out = private->out;
+		mlt_position position;
+		double fps = mlt_producer_get_fps( producer );
+
+		// Hear what the clip plays, such as the audio stream it selects
+		mlt_properties_inherit( producer_properties, private->source );
+
+		// Nothing here ever asks for an image, but avoid opening the video
+		// decoder at all where the producer allows it.
+		mlt_properties_set_int( producer_properties, "video_index", -1 );
+		if ( out > mlt_producer_get_out( producer ) )
+			out = mlt_producer_get_out( producer );
+		mlt_producer_seek( producer, private->in );
+
+		for ( position = private->in; position <= out && !private->thread_abort; position++ )
+		{
+			mlt_frame frame = NULL;
+			mlt_audio_format format = mlt_audio_none;
+			int frequency = 48000;
+			int channels = 0;
+			int samples = mlt_sample_calculator( fps, frequency, position );
+			void* buffer = NULL;
+
+			if ( mlt_service_get_frame( MLT_PRODUCER_SERVICE( producer ), &frame, 0 ) || !frame )
+				break;
+			if ( !mlt_frame_get_audio_accepting( frame, analyze_formats, &buffer, &format, &frequency, &channels, &samples ) &&
+				 buffer && format != mlt_audio_none && channels > 0 && frequency > 0 )
+			{
+				if ( !state )
+					state = ebur128_init( (unsigned int)channels, (unsigned long)frequency, EBUR128_MODE_I | EBUR128_MODE_LRA | EBUR128_MODE_SAMPLE_PEAK );
+				else if ( channels != state_channels || frequency != state_frequency )
+					ebur128_change_parameters( state, (unsigned int)channels, (unsigned long)frequency );
+				state_channels = channels;
+				state_frequency = frequency;
+				if ( state )
+					interleaved = add_frames( state, buffer, format, channels, samples, interleaved, &interleaved_size );
+			}
+			mlt_frame_close( frame );
+		}
+		mlt_producer_close( producer );
+	}
+
+	free( interleaved );
+	if ( state )
+	{
+		if ( !private->thread_abort )
+			format_results( state, state_channels, private->thread_result );
+		ebur128_destroy( &state );
+	}
+	__sync_fetch_and_add( &private->thread_done, 1 );
+
+	return NULL;
+}
+
+/** Collect the results of an analysis job that has finished.
+ *
+ * This does not wait for a job that is still running.
+ */
+
+static void collect_analyze_thread( mlt_filter filter )
+{
+	private_data* private = (private_data*)filter->child;
+
+	if ( private->thread_running && __sync_fetch_and_add( &private->thread_done, 0 ) )
+	{
+		pthread_join( private->thread, NULL );
+		private->thread_running = 0;
+		if ( private->thread_result[0] )
+			store_results( filter, private->thread_result );
+		else if ( !private->thread_abort )
+			mlt_log_error( MLT_FILTER_SERVICE( filter ), "Analysis Failed: No audio from %s\n", private->resource );
+	}
+}
+
+/** Identify the clip and pick up cached results or start the analysis job.
+*/
+
+static void prepare_results( mlt_filter filter, mlt_frame frame )
+{
+	private_data* private = (private_data*)filter->child;
+	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	mlt_producer producer = mlt_producer_cut_parent( mlt_frame_get_original_producer( frame ) );
+	char* results = mlt_properties_get( properties, "results" );
+	char* cache = mlt_properties_get( properties, "cache" );
+	char result[MAX_RESULT_SIZE];
+	struct stat file_stat;
+	char streams[MAX_RESULT_SIZE] = "";
+	mlt_properties producer_properties;
+	char* service;
+	char* resource;
+	int i;
+
+	private->prepared = 1;
+	if ( !producer )
+		return;
+
+	producer_properties = MLT_PRODUCER_PROPERTIES( producer );
+	service = mlt_properties_get( producer_properties, "mlt_service" );
+	resource = mlt_properties_get( producer_properties, "resource" );
+	private->service = strdup( service ? service : "" );
+	private->resource = strdup( resource ? resource : "" );
+
+	// The analysis producer gets the clip's public properties, except those
+	// that describe the producer itself or what opening it found.
+	private->source = mlt_properties_new( );
+	for ( i = 0; i < mlt_properties_count( producer_properties ); i++ )
+	{
+		char* name = mlt_properties_get_name( producer_properties, i );
+		char* value = mlt_properties_get_value( producer_properties, i );
+		if ( value && name[0] != '_' && strncmp( name, "meta.", 5 ) &&
+			 strcmp( name, "mlt_service" ) && strcmp( name, "mlt_type" ) && strcmp( name, "resource" ) &&
+			 strcmp( name, "in" ) && strcmp( name, "out" ) && strcmp( name, "length" ) && strcmp( name, "eof" ) )
+			mlt_properties_set( private->source, name, value );
+	}
+	for ( i = 0; stream_properties[i]; i++ )
+	{
+		char* value = mlt_properties_get( producer_properties, stream_properties[i] );
+		snprintf( streams + strlen( streams ), sizeof( streams ) - strlen( streams ), "%s%s=%s",
+			i ? "," : "", stream_properties[i], value ? value : "" );
+	}
+	private->streams = strdup( streams );
+	private->in = mlt_frame_original_position( frame ) - mlt_filter_get_position( filter, frame );
+	private->out = private->in + mlt_filter_get_length2( filter, frame ) - 1;
+
+	// Results are only cached on request. A changed file invalidates them.
+	if ( cache && strcmp( cache, "" ) )
+		private->cache = strdup( cache );
+	if ( !stat( private->resource, &file_stat ) )
+	{
+		private->size = file_stat.st_size;
+		private->mtime = file_stat.st_mtime;
+	}
+
+	if ( results && strcmp( results, "" ) )
+		return;
+
+	if ( private->cache && cache_lookup( private, result ) )
+	{
+		mlt_log_info( MLT_FILTER_SERVICE( filter ), "Cached results for %s: %s\n", private->resource, result );
+		mlt_properties_set( properties, "results", result );
+	}
+	else if ( mlt_properties_get_int( properties, "analyze" ) && strcmp( private->service, "" ) && strcmp( private->resource, "" ) )
+	{
+		private->thread_result[0] = '\0';
+		private->thread_done = 0;
+		private->thread_abort = 0;
+		if ( !pthread_create( &private->thread, NULL, analyze_thread, filter ) )
+			private->thread_running = 1;
+	}
+}
+
 static void destroy_apply_data( mlt_filter filter )
 {
 	private_data* private = (private_data*)filter->child;
@@ -114,29 +563,9 @@ static void analyze( mlt_filter filter, mlt_frame frame, void **buffer, mlt_audi
 
 		if ( pos + 1 == mlt_filter_get_length2( filter, frame ) )
 		{
-			mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
-			double loudness = 0.0;
-			double range = 0.0;
-			double tmpPeak = 0.0;
-			double peak = 0.0;
-			int i = 0;
 			char result[MAX_RESULT_SIZE];
-			ebur128_loudness_global( private->analyze->state, &loudness );
-			ebur128_loudness_range( private->analyze->state, &range );
-
-			for ( i = 0; i < *channels; i++ )
-			{
-				ebur128_sample_peak( private->analyze->state, i, &tmpPeak );
-				if( tmpPeak > peak )
-				{
-					peak = tmpPeak;
-				}
-			}
-
-			snprintf( result, MAX_RESULT_SIZE, "L: %lf\tR: %lf\tP %lf", loudness, range, peak );
-			result[ MAX_RESULT_SIZE - 1 ] = '\0';
-			mlt_log_info( MLT_FILTER_SERVICE( filter ), "Stored results: %s", result );
-			mlt_properties_set( properties, "results", result );
+			format_results( private->analyze->state, *channels, result );
+			store_results( filter, result );
 			destroy_analyze_data( filter );
 		}
 
@@ -177,6 +606,7 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 {
 	mlt_filter filter = mlt_frame_pop_audio( frame );
 	mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+	private_data* private = (private_data*)filter->child;
 
 	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
 
@@ -184,12 +614,16 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 	*format = mlt_audio_f32le;
 	mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
 
+	// The results of a standalone analysis job apply once it has finished.
+	// Until then the audio passes through at its original level.
+	collect_analyze_thread( filter );
+
 	char* results = mlt_properties_get( properties, "results" );
 	if( results && strcmp( results, "" ) )
 	{
 		apply( filter, frame, buffer, format, frequency, channels, samples );
 	}
-	else
+	else if ( !private->thread_running )
 	{
 		analyze( filter, frame, buffer, format, frequency, channels, samples );
 	}
@@ -204,6 +638,13 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 
 static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 {
+	private_data* private = (private_data*)filter->child;
+
+	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
+	if ( !private->prepared )
+		prepare_results( filter, frame );
+	mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
+
 	mlt_frame_push_audio( frame, filter );
 	mlt_frame_push_audio( frame, filter_get_audio );
 	return frame;
@@ -218,10 +659,24 @@ static void filter_close( mlt_filter filter )
 
 	if ( private )
 	{
+		if ( private->thread_running )
+		{
+			private->thread_abort = 1;
+			pthread_join( private->thread, NULL );
+		}
 		if ( private->analyze )
 		{
 			destroy_analyze_data( filter );
 		}
+		if ( private->apply )
+		{
+			destroy_apply_data( filter );
+		}
+		free( private->service );
+		free( private->resource );
+		free( private->streams );
+		free( private->cache );
+		mlt_properties_close( private->source );
 		free( private );
 	}
 	filter->child = NULL;
@@ -29,7 +29,7 @@
 
 /** Fill channel lut with integers parsed from property string.
 */
-static void fill_channel_lut(int lut[], char* channel_table_str)
+static void fill_channel_lut(uint8_t lut[], char* channel_table_str)
 {
 	mlt_tokeniser tokeniser = mlt_tokeniser_init();
 	mlt_tokeniser_parse_new( tokeniser, channel_table_str, ";" );
@@ -58,56 +58,20 @@ static void fill_channel_lut(int lut[], char* channel_table_str)
 	mlt_tokeniser_close( tokeniser );
 }
 
-/** Do it :-).
-*/
-static int filter_get_image( mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int writable )
-{
-	// Get the image
-	mlt_filter filter = mlt_frame_pop_service( frame );
-
-	*format = mlt_image_rgb24;
-	int error = mlt_frame_get_image( frame, image, format, width, height, 0 );
-
-	// Only process if we have no error and a valid colour space
-	if ( error == 0 )
-	{
-
-		// Create lut tables from properties for each RGB channel
-		char* r_str = mlt_properties_get( MLT_FILTER_PROPERTIES( filter ), "R_table" );
-		int r_lut[256];
-		fill_channel_lut( r_lut, r_str );
-
-		char* g_str = mlt_properties_get( MLT_FILTER_PROPERTIES( filter ), "G_table" );
-		int g_lut[256];
-		fill_channel_lut( g_lut, g_str );
-
-		char* b_str = mlt_properties_get( MLT_FILTER_PROPERTIES( filter ), "B_table" );
-		int b_lut[256];
-		fill_channel_lut( b_lut, b_str );
-
-		// Apply look-up tables into image
-		int i = *width * *height + 1;
-		uint8_t *p = *image;
-		uint8_t *r = *image;
-		while ( --i )
-		{
-			*p ++ = r_lut[ *r ++ ];
-			*p ++ = g_lut[ *r ++ ];
-			*p ++ = b_lut[ *r ++ ];
-		}
-	}
-
-	return error;
-}
-
 /** Filter processing.
 */
 
 static mlt_frame filter_process( mlt_filter filter, mlt_frame frame )
 {
-	// Push the frame filter
-	mlt_frame_push_service( frame, filter );
-	mlt_frame_push_get_image( frame, filter_get_image );
+	// Create lut tables from properties for each RGB channel
+	uint8_t lut[3][256];
+	fill_channel_lut( lut[0], mlt_properties_get( MLT_FILTER_PROPERTIES( filter ), "R_table" ) );
+	fill_channel_lut( lut[1], mlt_properties_get( MLT_FILTER_PROPERTIES( filter ), "G_table" ) );
+	fill_channel_lut( lut[2], mlt_properties_get( MLT_FILTER_PROPERTIES( filter ), "B_table" ) );
+
+	// Apply look-up tables into image, fused with neighbouring point filters
+	mlt_frame_push_lut( frame, mlt_image_rgb24, lut );
+
 	return frame;
 }
 
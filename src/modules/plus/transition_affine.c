@@ -25,9 +25,17 @@
 #include <ctype.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#if defined(USE_SSE) && defined(ARCH_X86_64)
+#include <emmintrin.h>
+#endif
 
 #include "interp.h"
 
+#define MAX_THREADS 16
+
 static float alignment_parse( char* align )
 {
 	int ret = 0.0f;
@@ -366,6 +374,184 @@ static inline void get_affine( affine_t *affine, mlt_transition transition, floa
 	}
 }
 
+typedef enum
+{
+	sample_nearest,
+	sample_bilinear,
+	sample_bicubic
+} sample_method;
+
+/** The work of one horizontal band of the output image.
+*/
+
+typedef struct
+{
+	float matrix[3][3];
+	float dz;
+	float lower_x, lower_y;
+	float x_offset, y_offset;
+	uint8_t *a_image;
+	int a_width;
+	uint8_t *b_image;
+	int b_width, b_height;
+	float mix;
+	int b_alpha;
+	sample_method method;
+	int start, end;
+	int started;
+	pthread_t thread;
+} affine_slice;
+
+/** Find the columns [*j0, *j1) for which lo <= v0 + j * dv < hi, with a column of slack.
+*/
+
+static void clip_run( float v0, float dv, float lo, float hi, int width, int *j0, int *j1 )
+{
+	if ( dv == 0.0f )
+	{
+		if ( v0 < lo || v0 >= hi )
+			*j1 = *j0;
+		return;
+	}
+	else
+	{
+		float a = ( lo - v0 ) / dv;
+		float b = ( hi - v0 ) / dv;
+		float first = floorf( MIN( a, b ) ) - 1;
+		float last = ceilf( MAX( a, b ) ) + 1;
+		if ( first > *j0 )
+			*j0 = first > width ? width : (int) first;
+		if ( last < *j1 )
+			*j1 = last < *j0 ? *j0 : (int) last;
+	}
+}
+
+/** Blend one bilinear sample of a 32-bit image into a pixel.
+ *
+ * Weights are 7-bit fixed point in each direction so the four taps of all
+ * channels are accumulated with 16-bit multiplies.
+ */
+
+static inline void sample_bilinear_b32( const uint8_t *src, int stride, float x, float y, int mix, uint8_t *v, int is_alpha )
+{
+	int m = (int) x;
+	int n = (int) y;
+	int fx = ( x - m ) * 128.0f;
+	int fy = ( y - n ) * 128.0f;
+	const uint8_t *s0 = src + n * stride + m * 4;
+	const uint8_t *s1 = s0 + stride;
+	int w00 = ( 128 - fx ) * ( 128 - fy );
+	int w01 = fx * ( 128 - fy );
+	int w10 = ( 128 - fx ) * fy;
+	int w11 = fx * fy;
+	int c[4];
+
+#if defined(USE_SSE) && defined(ARCH_X86_64)
+	const __m128i zero = _mm_setzero_si128();
+	__m128i top = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*) s0 ), zero );
+	__m128i bottom = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*) s1 ), zero );
+	// Interleave the left and right taps of each channel for the multiply-add
+	__m128i t = _mm_unpacklo_epi16( top, _mm_srli_si128( top, 8 ) );
+	__m128i b = _mm_unpacklo_epi16( bottom, _mm_srli_si128( bottom, 8 ) );
+	__m128i sum = _mm_add_epi32( _mm_madd_epi16( t, _mm_set1_epi32( ( w01 << 16 ) | w00 ) ),
+	                             _mm_madd_epi16( b, _mm_set1_epi32( ( w11 << 16 ) | w10 ) ) );
+	sum = _mm_srli_epi32( _mm_add_epi32( sum, _mm_set1_epi32( 1 << 13 ) ), 14 );
+	_mm_storeu_si128( (__m128i*) c, sum );
+#else
+	int i;
+	for ( i = 0; i < 4; i++ )
+		c[i] = ( s0[i] * w00 + s0[i + 4] * w01 + s1[i] * w10 + s1[i + 4] * w11 + ( 1 << 13 ) ) >> 14;
+#endif
+
+	// mix is 8-bit fixed point opacity, so alpha is 0 to 65025
+	int alpha = c[3] * mix;
+	int inverse = 255 * 255 - alpha;
+	v[0] = ( v[0] * inverse + c[0] * alpha + 32512 ) / 65025;
+	v[1] = ( v[1] * inverse + c[1] * alpha + 32512 ) / 65025;
+	v[2] = ( v[2] * inverse + c[2] * alpha + 32512 ) / 65025;
+	if ( is_alpha ) v[3] = c[3];
+}
+
+static void *affine_slice_proc( void *arg )
+{
+	affine_slice *slice = arg;
+	float bx_max = slice->b_width - 1;
+	float by_max = slice->b_height - 1;
+	float ddx = slice->matrix[0][0] / slice->dz;
+	float ddy = slice->matrix[1][0] / slice->dz;
+	int mix = slice->mix * 255.0f + 0.5f;
+	int stride = slice->b_width * 4;
+	int i, j;
+
+	for ( i = slice->start; i < slice->end; i++ )
+	{
+		float y = slice->lower_y + i;
+		float dx0 = MapX( slice->matrix, slice->lower_x, y ) / slice->dz + slice->x_offset;
+		float dy0 = MapY( slice->matrix, slice->lower_x, y ) / slice->dz + slice->y_offset;
+		int j0 = 0;
+		int j1 = slice->a_width;
+		uint8_t *p;
+
+		// Reject the columns that map outside of the b image
+		clip_run( dx0, ddx, 0, bx_max, slice->a_width, &j0, &j1 );
+		clip_run( dy0, ddy, 0, by_max, slice->a_width, &j0, &j1 );
+
+		p = slice->a_image + ( i * slice->a_width + j0 ) * 4;
+		for ( j = j0; j < j1; j++, p += 4 )
+		{
+			float dx = dx0 + j * ddx;
+			float dy = dy0 + j * ddy;
+			if ( dx >= 0 && dx < bx_max && dy >= 0 && dy < by_max )
+			{
+				switch ( slice->method )
+				{
+				case sample_nearest:
+					interpNN_b32( slice->b_image, slice->b_width, slice->b_height, dx, dy, slice->mix, p, slice->b_alpha );
+					break;
+				case sample_bilinear:
+					sample_bilinear_b32( slice->b_image, stride, dx, dy, mix, p, slice->b_alpha );
+					break;
+				case sample_bicubic:
+					interpBC_b32( slice->b_image, slice->b_width, slice->b_height, dx, dy, slice->mix, p, slice->b_alpha );
+					break;
+				}
+			}
+		}
+	}
+	return NULL;
+}
+
+/** Transform the b image on to the a image in horizontal bands.
+*/
+
+static void affine_render( affine_slice *base, int height, int threads )
+{
+	affine_slice slices[ MAX_THREADS ];
+	int jobs = threads > 0 ? threads : sysconf( _SC_NPROCESSORS_ONLN );
+	int i;
+
+	// Keep bands at a reasonable height
+	if ( jobs > height / 16 )
+		jobs = height / 16;
+	jobs = jobs < 1 ? 1 : jobs > MAX_THREADS ? MAX_THREADS : jobs;
+
+	for ( i = 0; i < jobs; i++ )
+	{
+		slices[i] = *base;
+		slices[i].start = height * i / jobs;
+		slices[i].end = height * ( i + 1 ) / jobs;
+		slices[i].started = i > 0 && !pthread_create( &slices[i].thread, NULL, affine_slice_proc, &slices[i] );
+	}
+	affine_slice_proc( &slices[0] );
+	for ( i = 1; i < jobs; i++ )
+	{
+		if ( slices[i].started )
+			pthread_join( slices[i].thread, NULL );
+		else
+			affine_slice_proc( &slices[i] );
+	}
+}
+
 /** Get the image.
 */
 
@@ -472,11 +658,8 @@ static int transition_get_image( mlt_frame a_frame, uint8_t **image, mlt_image_f
 	// Check that both images are of the correct format and process
 	if ( *format == mlt_image_rgb24a && b_format == mlt_image_rgb24a )
 	{
-		float x, y;
-		float dx, dy;
 		float dz;
 		float sw, sh;
-		uint8_t *p = *image;
 
 		// Get values from the transition
 		float scale_x = mlt_properties_get_double( properties, "scale_x" );
@@ -492,8 +675,8 @@ static int transition_get_image( mlt_frame a_frame, uint8_t **image, mlt_image_f
 		float x_offset = (float) b_width / 2.0;
 		float y_offset = (float) b_height / 2.0;
 		affine_t affine;
-		interpp interp = interpBL_b32;
-		int i, j; // loop counters
+		affine_slice slice;
+		sample_method method = sample_bilinear;
 
 		// Recalculate vars if alignment supplied.
 		if ( mlt_properties_get( properties, "halign" ) || mlt_properties_get( properties, "valign" ) )
@@ -555,31 +738,35 @@ static int transition_get_image( mlt_frame a_frame, uint8_t **image, mlt_image_f
 
 		// Set the interpolation function
 		if ( interps == NULL || strcmp( interps, "nearest" ) == 0 || strcmp( interps, "neighbor" ) == 0 )
-			interp = interpNN_b32;
+			method = sample_nearest;
 		else if ( strcmp( interps, "tiles" ) == 0 || strcmp( interps, "fast_bilinear" ) == 0 )
-			interp = interpNN_b32;
+			method = sample_nearest;
 		else if ( strcmp( interps, "bilinear" ) == 0 )
-			interp = interpBL_b32;
+			method = sample_bilinear;
 		else if ( strcmp( interps, "bicubic" ) == 0 )
-			interp = interpBC_b32;
+			method = sample_bicubic;
 		 // TODO: lanczos 8x8
 		else if ( strcmp( interps, "hyper" ) == 0 || strcmp( interps, "sinc" ) == 0 || strcmp( interps, "lanczos" ) == 0 )
-			interp = interpBC_b32;
+			method = sample_bicubic;
 		else if ( strcmp( interps, "spline" ) == 0 ) // TODO: spline 4x4 or 6x6
-			interp = interpBC_b32;
+			method = sample_bicubic;
 
 		// Do the transform with interpolation
-		for ( i = 0, y = lower_y; i < *height; i++, y++ )
-		{
-			for ( j = 0, x = lower_x; j < *width; j++, x++ )
-			{
-				dx = MapX( affine.matrix, x, y ) / dz + x_offset;
-				dy = MapY( affine.matrix, x, y ) / dz + y_offset;
-				if ( dx >= 0 && dx < (b_width - 1) && dy >=0 && dy < (b_height - 1) )
-					interp( b_image, b_width, b_height, dx, dy, result.mix/100.0, p, b_alpha );
-				p += 4;
-			}
-		}
+		memcpy( slice.matrix, affine.matrix, sizeof( slice.matrix ) );
+		slice.dz = dz;
+		slice.lower_x = lower_x;
+		slice.lower_y = lower_y;
+		slice.x_offset = x_offset;
+		slice.y_offset = y_offset;
+		slice.a_image = *image;
+		slice.a_width = *width;
+		slice.b_image = b_image;
+		slice.b_width = b_width;
+		slice.b_height = b_height;
+		slice.mix = result.mix / 100.0;
+		slice.b_alpha = b_alpha;
+		slice.method = method;
+		affine_render( &slice, *height, mlt_properties_get_int( properties, "threads" ) );
 	}
 	free( interps );
 
@@ -25,12 +25,319 @@
 #include <stdlib.h>
 #include <samplerate.h>
 #include <string.h>
+#include <math.h>
+#if defined(USE_SSE) && defined(ARCH_X86_64)
+#include <xmmintrin.h>
+#endif
 
 // BUFFER_LEN is based on a maximum of 96KHz, 5 fps, 8 channels
 // TODO: dynamically allocate larger buffer size
 #define BUFFER_LEN ((96000/5) * 8 * sizeof(float))
 #define RESAMPLE_TYPE SRC_SINC_FASTEST
 
+// The largest interpolation factor served by a polyphase filter bank,
+// enough for 11025 -> 48000; other ratios use libsamplerate.
+#define MAX_PHASES (1024)
+
+/** Taps per phase and Kaiser window beta of the quality presets. */
+
+static const struct
+{
+	const char *name;
+	int taps;
+	double beta;
+	int src_type;
+} presets[] =
+{
+	{ "fast", 16, 6.0, SRC_SINC_FASTEST },
+	{ "medium", 32, 8.0, SRC_SINC_MEDIUM_QUALITY },
+	{ "best", 64, 10.0, SRC_SINC_BEST_QUALITY },
+};
+
+/** The state of the polyphase resampler, carried from frame to frame. */
+
+typedef struct
+{
+	int in_rate;        // the input sample rate
+	int out_rate;       // the output sample rate
+	int quality;        // the index of the preset
+	int phases;         // the interpolation factor L
+	int step;           // the decimation factor M
+	int taps;           // the number of taps in each phase, a multiple of 4
+	float *bank;        // phases * taps coefficients
+	int phase;          // the phase of the next output sample
+	int channels;       // the number of channels in history
+	int history_len;    // the input samples held over from the last frame, per channel
+	float *history;     // channels * taps samples
+	float *work;        // scratch for history and one frame of input
+	int work_size;      // the number of floats allocated in work
+} polyphase;
+
+static int gcd( int a, int b )
+{
+	while ( b )
+	{
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/** Zeroth order modified Bessel function of the first kind, for the Kaiser window. */
+
+static double bessel_i0( double x )
+{
+	double sum = 1.0, term = 1.0;
+	int k;
+	for ( k = 1; k < 32; k++ )
+	{
+		term *= ( x / ( 2 * k ) ) * ( x / ( 2 * k ) );
+		sum += term;
+	}
+	return sum;
+}
+
+static void polyphase_close( polyphase *self )
+{
+	if ( self )
+	{
+		free( self->bank );
+		free( self->history );
+		free( self->work );
+		free( self );
+	}
+}
+
+/** Build the filter bank of a Kaiser windowed sinc for a ratio.
+ *
+ * Phase p holds the taps that produce an output sample p / L input samples
+ * after the centre of the window, so that output n comes from phase
+ * ( n * M ) % L at input index ( n * M ) / L.
+ */
+
+static polyphase *polyphase_open( int in_rate, int out_rate, int quality )
+{
+	int divisor = gcd( in_rate, out_rate );
+	int phases = out_rate / divisor;
+	int step = in_rate / divisor;
+	polyphase *self;
+	double cutoff, i0_beta;
+	int p, k;
+
+	if ( phases > MAX_PHASES )
+		return NULL;
+	self = calloc( 1, sizeof( polyphase ) );
+	if ( !self )
+		return NULL;
+
+	// Lower the cutoff to the output Nyquist when decimating, and widen the
+	// window to keep the transition band
+	cutoff = phases < step ? (double) phases / step : 1.0;
+	self->in_rate = in_rate;
+	self->out_rate = out_rate;
+	self->quality = quality;
+	self->phases = phases;
+	self->step = step;
+	self->taps = ( (int) ceil( presets[quality].taps / cutoff ) + 3 ) & ~3;
+	if ( posix_memalign( (void**) &self->bank, 16, phases * self->taps * sizeof( float ) ) )
+	{
+		free( self );
+		return NULL;
+	}
+
+	i0_beta = bessel_i0( presets[quality].beta );
+	for ( p = 0; p < phases; p++ )
+	{
+		double sum = 0.0;
+		float *row = self->bank + p * self->taps;
+
+		for ( k = 0; k < self->taps; k++ )
+		{
+			double t = k - ( self->taps / 2 - 1 ) - (double) p / phases;
+			double x = t / ( self->taps / 2 );
+			double h = 0.0;
+
+			if ( fabs( x ) < 1.0 )
+			{
+				double arg = M_PI * cutoff * t;
+				h = cutoff * ( t == 0.0 ? 1.0 : sin( arg ) / arg );
+				h *= bessel_i0( presets[quality].beta * sqrt( 1.0 - x * x ) ) / i0_beta;
+			}
+			row[k] = h;
+			sum += h;
+		}
+
+		// Normalise each phase to unity gain at DC
+		for ( k = 0; sum != 0.0 && k < self->taps; k++ )
+			row[k] /= sum;
+	}
+
+	return self;
+}
+
+static inline float dot_product( const float *a, const float *b, int n )
+{
+#if defined(USE_SSE) && defined(ARCH_X86_64)
+	__m128 acc = _mm_setzero_ps();
+	float result[4];
+	int k;
+	for ( k = 0; k < n; k += 4 )
+		acc = _mm_add_ps( acc, _mm_mul_ps( _mm_load_ps( a + k ), _mm_loadu_ps( b + k ) ) );
+	_mm_storeu_ps( result, acc );
+	return result[0] + result[1] + result[2] + result[3];
+#else
+	float sum = 0.0f;
+	int k;
+	for ( k = 0; k < n; k++ )
+		sum += a[k] * b[k];
+	return sum;
+#endif
+}
+
+/** Prepare the history for a number of channels.
+ *
+ * A change in layout starts from silence again.
+ *
+ * \return true on error
+ */
+
+static int polyphase_set_channels( polyphase *self, int channels )
+{
+	if ( channels != self->channels )
+	{
+		free( self->history );
+		self->history = calloc( channels * self->taps, sizeof( float ) );
+		self->channels = self->history ? channels : 0;
+		self->history_len = self->taps / 2 - 1;
+		self->phase = 0;
+	}
+	return self->history == NULL;
+}
+
+/** Resample one frame of planar float audio.
+ *
+ * \param self the resampler state, prepared for the number of channels
+ * \param in the input planes
+ * \param channels the number of channels
+ * \param samples the number of input samples per channel
+ * \param out the output planes, with room for polyphase_max_output() samples per channel
+ * \param out_stride the distance between the output planes in samples
+ * \return the number of output samples per channel
+ */
+
+static int polyphase_process( polyphase *self, const float *in, int channels, int samples, float *out, int out_stride )
+{
+	int avail = self->history_len + samples;
+	int count = 0;
+	int c;
+
+	if ( self->work_size < avail )
+	{
+		free( self->work );
+		self->work = malloc( avail * sizeof( float ) );
+		self->work_size = self->work ? avail : 0;
+		if ( !self->work )
+			return 0;
+	}
+
+	for ( c = 0; c < channels; c++ )
+	{
+		float *history = self->history + c * self->taps;
+		float *dest = out + c * out_stride;
+		int phase = self->phase;
+		int index = 0;
+
+		memcpy( self->work, history, self->history_len * sizeof( float ) );
+		memcpy( self->work + self->history_len, in + c * samples, samples * sizeof( float ) );
+		count = 0;
+		while ( index + self->taps <= avail )
+		{
+			dest[ count++ ] = dot_product( self->bank + phase * self->taps, self->work + index, self->taps );
+			phase += self->step;
+			index += phase / self->phases;
+			phase %= self->phases;
+		}
+
+		// Hold over the input still needed by the next output sample
+		memcpy( history, self->work + index, ( avail - index ) * sizeof( float ) );
+		if ( c == channels - 1 )
+		{
+			self->phase = phase;
+			self->history_len = avail - index;
+		}
+	}
+
+	return count;
+}
+
+/** Get the largest number of output samples for a number of input samples. */
+
+static int polyphase_max_output( polyphase *self, int samples )
+{
+	return (int) ( ( (int64_t) ( self->history_len + samples ) * self->phases ) / self->step ) + 1;
+}
+
+/** Resample with the polyphase filter bank.
+ *
+ * \return true if the ratio is not served by a filter bank
+ */
+
+static int resample_polyphase( mlt_filter filter, mlt_frame frame, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples, int output_rate, int quality )
+{
+	mlt_properties filter_properties = MLT_FILTER_PROPERTIES( filter );
+	polyphase *self = mlt_properties_get_data( filter_properties, "_polyphase", NULL );
+
+	if ( !self || self->in_rate != *frequency || self->out_rate != output_rate || self->quality != quality )
+	{
+		self = polyphase_open( *frequency, output_rate, quality );
+		mlt_properties_set_data( filter_properties, "_polyphase", self, 0, (mlt_destructor) polyphase_close, NULL );
+		if ( !self )
+			return 1;
+	}
+
+	// The filter bank works directly on planar float
+	if ( *format != mlt_audio_float )
+		frame->convert_audio( frame, buffer, format, mlt_audio_float );
+	if ( *format != mlt_audio_float || polyphase_set_channels( self, *channels ) )
+		return 1;
+
+	int max = polyphase_max_output( self, *samples );
+	int size = mlt_audio_format_size( mlt_audio_float, max, *channels );
+	float *output = mlt_pool_alloc( size );
+	if ( !output )
+		return 1;
+
+	int count = polyphase_process( self, *buffer, *channels, *samples, output, max );
+
+	// Close the gaps between the planes
+	int c;
+	for ( c = 1; c < *channels && count < max; c++ )
+		memmove( output + c * count, output + c * max, count * sizeof( float ) );
+
+	mlt_frame_set_audio( frame, output, mlt_audio_float, size, mlt_pool_release );
+	*buffer = output;
+	*samples = count;
+	*frequency = output_rate;
+
+	return 0;
+}
+
+/** Get the index of the quality preset named by the filter.
+ *
+ * Returns -1 when no preset is chosen, which keeps the libsamplerate converter.
+*/
+
+static int get_quality( mlt_properties properties )
+{
+	const char *name = mlt_properties_get( properties, "quality" );
+	int i;
+	for ( i = 0; name && i < sizeof( presets ) / sizeof( presets[0] ); i++ )
+		if ( !strcmp( name, presets[i].name ) )
+			return i;
+	return -1;
+}
+
 /** Get the audio.
 */
 
@@ -56,15 +363,25 @@ static int resample_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 	// Return now if no work to do
 	if ( output_rate != *frequency && *frequency > 0 && *channels > 0 )
 	{
+		int quality = get_quality( filter_properties );
+		int src_type = quality < 0 ? RESAMPLE_TYPE : presets[quality].src_type;
+
 		mlt_log_debug( MLT_FILTER_SERVICE(filter), "channels %d samples %d frequency %d -> %d\n",
 			*channels, *samples, *frequency, output_rate );
 
+		mlt_service_lock( MLT_FILTER_SERVICE(filter) );
+
+		// A quality preset prefers a polyphase filter bank for the common ratios
+		if ( quality >= 0 && !resample_polyphase( filter, frame, buffer, format, frequency, channels, samples, output_rate, quality ) )
+		{
+			mlt_service_unlock( MLT_FILTER_SERVICE(filter) );
+			return 0;
+		}
+
 		// Do not convert to float unless we need to change the rate
 		if ( *format != mlt_audio_f32le )
 			frame->convert_audio( frame, buffer, format, mlt_audio_f32le );
 
-		mlt_service_lock( MLT_FILTER_SERVICE(filter) );
-
 		SRC_DATA data;
 		data.data_in = *buffer;
 		data.data_out = mlt_properties_get_data( filter_properties, "output_buffer", NULL );
@@ -74,12 +391,14 @@ static int resample_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 		data.end_of_input = 0;
 
 		SRC_STATE *state = mlt_properties_get_data( filter_properties, "state", NULL );
-		if ( !state || mlt_properties_get_int( filter_properties, "channels" ) != *channels )
+		if ( !state || mlt_properties_get_int( filter_properties, "channels" ) != *channels ||
+			 mlt_properties_get_int( filter_properties, "_src_type" ) != src_type )
 		{
-			// Recreate the resampler if the number of channels changed
-			state = src_new( RESAMPLE_TYPE, *channels, &error );
+			// Recreate the resampler if the number of channels or the quality changed
+			state = src_new( src_type, *channels, &error );
 			mlt_properties_set_data( filter_properties, "state", state, 0, (mlt_destructor) src_delete, NULL );
 			mlt_properties_set_int( filter_properties, "channels", *channels );
+			mlt_properties_set_int( filter_properties, "_src_type", src_type );
 		}
 
 		// Resample the audio
@@ -132,6 +451,7 @@ mlt_filter filter_resample_init( mlt_profile profile, mlt_service_type type, con
 			if ( arg != NULL )
 				mlt_properties_set_int( MLT_FILTER_PROPERTIES( this ), "frequency", atoi( arg ) );
 			mlt_properties_set_int( MLT_FILTER_PROPERTIES( this ), "channels", 2 );
+			mlt_properties_set_int( MLT_FILTER_PROPERTIES( this ), "_src_type", RESAMPLE_TYPE );
 			mlt_properties_set_data( MLT_FILTER_PROPERTIES( this ), "state", state, 0, (mlt_destructor)src_delete, NULL );
 			mlt_properties_set_data( MLT_FILTER_PROPERTIES( this ), "output_buffer", output_buffer, BUFFER_LEN, mlt_pool_release, NULL );
 		}
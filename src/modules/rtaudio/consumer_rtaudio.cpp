@@ -40,10 +40,8 @@ public:
 	pthread_t             thread;
 	int                   joined;
 	int                   running;
-	uint8_t               audio_buffer[4096 * 10];
-	int                   audio_avail;
-	pthread_mutex_t       audio_mutex;
-	pthread_cond_t        audio_cond;
+	mlt_audio_ring        audio_ring;
+	int                   audio_channels;
 	pthread_mutex_t       video_mutex;
 	pthread_cond_t        video_cond;
 	int                   playing;
@@ -60,7 +58,8 @@ public:
 		, queue(NULL)
 		, joined(0)
 		, running(0)
-		, audio_avail(0)
+		, audio_ring(NULL)
+		, audio_channels(0)
 		, playing(0)
 		, refresh_count(0)
 		, is_purge(false)
@@ -74,8 +73,6 @@ public:
 		mlt_deque_close( queue );
 
 		// Destroy mutexes
-		pthread_mutex_destroy( &audio_mutex );
-		pthread_cond_destroy( &audio_cond );
 		pthread_mutex_destroy( &video_mutex );
 		pthread_cond_destroy( &video_cond );
 		pthread_mutex_destroy( &refresh_mutex );
@@ -83,6 +80,7 @@ public:
 
 		if ( rt.isStreamOpen() )
 			rt.closeStream();
+		mlt_audio_ring_close( audio_ring );
 	}
 
 	bool open( const char* arg )
@@ -129,8 +127,6 @@ public:
 		mlt_properties_set_double( properties, "volume", 1.0 );
 
 		// This is the initialisation of the consumer
-		pthread_mutex_init( &audio_mutex, NULL );
-		pthread_cond_init( &audio_cond, NULL);
 		pthread_mutex_init( &video_mutex, NULL );
 		pthread_cond_init( &video_cond, NULL);
 
@@ -144,6 +140,9 @@ public:
 		// Default audio buffer
 		mlt_properties_set_int( properties, "audio_buffer", 1024 );
 
+		// Default audio latency in milliseconds
+		mlt_properties_set_int( properties, "audio_latency", 200 );
+
 		// Set the resource to the device name arg
 		mlt_properties_set( properties, "resource", arg );
 
@@ -192,11 +191,6 @@ public:
 			pthread_cond_broadcast( &video_cond );
 			pthread_mutex_unlock( &video_mutex );
 
-			// Unlatch the audio callback
-			pthread_mutex_lock( &audio_mutex );
-			pthread_cond_broadcast( &audio_cond );
-			pthread_mutex_unlock( &audio_mutex );
-
 			if ( rt.isStreamOpen() )
 			try {
 				// Stop the stream
@@ -356,8 +350,6 @@ public:
 
 		while( mlt_deque_count( queue ) )
 			mlt_frame_close( (mlt_frame) mlt_deque_pop_back( queue ) );
-
-		audio_avail = 0;
 	}
 
 	int callback( int16_t *outbuf, int16_t *inbuf,
@@ -365,42 +357,17 @@ public:
 	{
 		mlt_properties properties = MLT_CONSUMER_PROPERTIES( getConsumer() );
 		double volume = mlt_properties_get_double( properties, "volume" );
-		int channels = mlt_properties_get_int( properties, "channels" );
-		int len = mlt_audio_format_size( mlt_audio_s16, samples, channels );
-
-		pthread_mutex_lock( &audio_mutex );
-
-		// Block until audio received
-		while ( running && len > audio_avail )
-			pthread_cond_wait( &audio_cond, &audio_mutex );
 
-		if ( audio_avail >= len )
-		{
-			// Place in the audio buffer
-			memcpy( outbuf, audio_buffer, len );
-
-			// Remove len from the audio available
-			audio_avail -= len;
-
-			// Remove the samples
-			memmove( audio_buffer, audio_buffer + len, audio_avail );
-		}
+		// Take what the render thread has queued, padded with silence
+		if ( audio_ring )
+			mlt_audio_ring_read( audio_ring, outbuf, samples );
 		else
-		{
-			// Just to be safe, wipe the stream first
-			memset( outbuf, 0, len );
-
-			// Copy what we have
-			memcpy( outbuf, audio_buffer, audio_avail );
-
-			// No audio left
-			audio_avail = 0;
-		}
+			memset( outbuf, 0, mlt_audio_format_size( mlt_audio_s16, samples, audio_channels ) );
 
 		if ( volume != 1.0 )
 		{
 			int16_t *p = outbuf;
-			int i = samples * channels + 1;
+			int i = samples * audio_channels + 1;
 			while ( --i )
 				*p++ *= volume;
 		}
@@ -408,9 +375,6 @@ public:
 		// We're definitely playing now
 		playing = 1;
 
-		pthread_cond_broadcast( &audio_cond );
-		pthread_mutex_unlock( &audio_mutex );
-
 		return 0;
 	}
 
@@ -458,6 +422,10 @@ public:
 				if ( rt.isStreamOpen() ) {
 				    rt.closeStream();
 				}
+				mlt_audio_ring_close( audio_ring );
+				audio_channels = channels;
+				audio_ring = mlt_audio_ring_init( mlt_audio_s16, frequency, channels,
+					mlt_properties_get_int( properties, "audio_latency" ) );
 				rt.openStream( &parameters, NULL, RTAUDIO_SINT16,
 					frequency, &bufferFrames, &rtaudio_callback, this, &options );
 				rt.startStream();
@@ -473,20 +441,25 @@ public:
 		if ( init_audio == 0 )
 		{
 			mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
-			size_t bytes = ( samples * channels * 2 );
-			pthread_mutex_lock( &audio_mutex );
-			while ( running && bytes > ( sizeof( audio_buffer) - audio_avail ) )
-				pthread_cond_wait( &audio_cond, &audio_mutex );
-			if ( running )
+			mlt_properties consumer_props = MLT_CONSUMER_PROPERTIES( getConsumer() );
+			int written = 0;
+
+			// Queue silence when not playing at normal speed
+			if ( !scrub && mlt_properties_get_double( properties, "_speed" ) != 1 )
+				pcm = NULL;
+
+			// Wait for the ring to drain to the latency target, without holding any lock
+			while ( running && audio_ring && written < samples )
+				written += mlt_audio_ring_write( audio_ring, pcm ? pcm + written * channels : NULL, samples - written, 100 );
+
+			// Report the ring's state
+			if ( audio_ring )
 			{
-				if ( scrub || mlt_properties_get_double( properties, "_speed" ) == 1 )
-					memcpy( &audio_buffer[ audio_avail ], pcm, bytes );
-				else
-					memset( &audio_buffer[ audio_avail ], 0, bytes );
-				audio_avail += bytes;
+				mlt_events_block( consumer_props, consumer_props );
+				mlt_properties_set_int( consumer_props, "audio_fill", mlt_audio_ring_latency( audio_ring ) );
+				mlt_properties_set_int( consumer_props, "audio_underruns", mlt_audio_ring_underruns( audio_ring ) );
+				mlt_events_unblock( consumer_props, consumer_props );
 			}
-			pthread_cond_broadcast( &audio_cond );
-			pthread_mutex_unlock( &audio_mutex );
 		}
 
 		return init_audio;
@@ -24,6 +24,7 @@
 #include <framework/mlt_factory.h>
 #include <framework/mlt_filter.h>
 #include <framework/mlt_log.h>
+#include <framework/mlt_audio_ring.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -46,10 +47,8 @@ struct consumer_sdl_s
 	pthread_t thread;
 	int joined;
 	int running;
-	uint8_t audio_buffer[ 4096 * 10 ];
-	int audio_avail;
-	pthread_mutex_t audio_mutex;
-	pthread_cond_t audio_cond;
+	mlt_audio_ring audio_ring;
+	int audio_channels;
 	pthread_mutex_t video_mutex;
 	pthread_cond_t video_cond;
 	int playing;
@@ -100,8 +99,6 @@ mlt_consumer consumer_sdl_audio_init( mlt_profile profile, mlt_service_type type
 		mlt_properties_set_double( self->properties, "volume", 1.0 );
 
 		// This is the initialisation of the consumer
-		pthread_mutex_init( &self->audio_mutex, NULL );
-		pthread_cond_init( &self->audio_cond, NULL);
 		pthread_mutex_init( &self->video_mutex, NULL );
 		pthread_cond_init( &self->video_cond, NULL);
 
@@ -116,6 +113,9 @@ mlt_consumer consumer_sdl_audio_init( mlt_profile profile, mlt_service_type type
 		// Default audio buffer
 		mlt_properties_set_int( self->properties, "audio_buffer", 2048 );
 
+		// Default audio latency in milliseconds
+		mlt_properties_set_int( self->properties, "audio_latency", 200 );
+
 		// Ensure we don't join on a non-running object
 		self->joined = 1;
 		
@@ -216,12 +216,11 @@ int consumer_stop( mlt_consumer parent )
 		pthread_cond_broadcast( &self->video_cond );
 		pthread_mutex_unlock( &self->video_mutex );
 
-		// Unlatch the audio callback
-		pthread_mutex_lock( &self->audio_mutex );
-		pthread_cond_broadcast( &self->audio_cond );
-		pthread_mutex_unlock( &self->audio_mutex );
-
 		SDL_QuitSubSystem( SDL_INIT_AUDIO );
+
+		// The audio callback has stopped, so release the ring
+		mlt_audio_ring_close( self->audio_ring );
+		self->audio_ring = NULL;
 	}
 
 	return 0;
@@ -259,46 +258,25 @@ static void sdl_fill_audio( void *udata, uint8_t *stream, int len )
 	// Get the volume
 	double volume = mlt_properties_get_double( self->properties, "volume" );
 
-	pthread_mutex_lock( &self->audio_mutex );
-
-	// Block until audio received
-#ifdef __DARWIN__
-	while ( self->running && len > self->audio_avail )
-		pthread_cond_wait( &self->audio_cond, &self->audio_mutex );
-#endif
-
-	if ( self->audio_avail >= len )
-	{
-		// Place in the audio buffer
-		if ( volume != 1.0 )
-			SDL_MixAudio( stream, self->audio_buffer, len, ( int )( ( float )SDL_MIX_MAXVOLUME * volume ) );
-		else
-			memcpy( stream, self->audio_buffer, len );
-
-		// Remove len from the audio available
-		self->audio_avail -= len;
-
-		// Remove the samples
-		memmove( self->audio_buffer, self->audio_buffer + len, self->audio_avail );
-	}
+	// Take what the render thread has queued, padded with silence
+	int16_t *p = (int16_t*) stream;
+	int i = len / sizeof( int16_t ) + 1;
+	if ( self->audio_ring )
+		mlt_audio_ring_read( self->audio_ring, stream, len / ( self->audio_channels * sizeof( int16_t ) ) );
 	else
-	{
-		// Just to be safe, wipe the stream first
 		memset( stream, 0, len );
 
-		// Mix the audio
-		SDL_MixAudio( stream, self->audio_buffer, self->audio_avail,
-			( int )( ( float )SDL_MIX_MAXVOLUME * volume ) );
-
-		// No audio left
-		self->audio_avail = 0;
+	if ( volume != 1.0 )
+	{
+		while ( --i )
+		{
+			int sample = *p * volume;
+			*p++ = sample > 32767 ? 32767 : sample < -32768 ? -32768 : sample;
+		}
 	}
 
 	// We're definitely playing now
 	self->playing = 1;
-
-	pthread_cond_broadcast( &self->audio_cond );
-	pthread_mutex_unlock( &self->audio_mutex );
 }
 
 static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_audio, int *duration )
@@ -316,7 +294,6 @@ static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_aud
 	int samples = mlt_sample_calculator( mlt_properties_get_double( self->properties, "fps" ), frequency, counter++ );
 	
 	int16_t *pcm;
-	int bytes;
 
 	mlt_frame_get_audio( frame, (void**) &pcm, &afmt, &frequency, &channels, &samples );
 	*duration = ( ( samples * 1000 ) / frequency );
@@ -344,7 +321,13 @@ static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_aud
 		request.samples = audio_buffer;
 		request.callback = sdl_fill_audio;
 		request.userdata = (void *)self;
-		if ( SDL_OpenAudio( &request, &got ) != 0 )
+		if ( !self->audio_ring )
+		{
+			self->audio_channels = channels;
+			self->audio_ring = mlt_audio_ring_init( mlt_audio_s16, frequency, channels,
+				mlt_properties_get_int( properties, "audio_latency" ) );
+		}
+		if ( !self->audio_ring || SDL_OpenAudio( &request, &got ) != 0 )
 		{
 			mlt_log_error( MLT_CONSUMER_SERVICE( self ), "SDL failed to open audio: %s\n", SDL_GetError() );
 			init_audio = 2;
@@ -359,20 +342,21 @@ static int consumer_play_audio( consumer_sdl self, mlt_frame frame, int init_aud
 	if ( init_audio == 0 )
 	{
 		mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
-		bytes = ( samples * channels * 2 );
-		pthread_mutex_lock( &self->audio_mutex );
-		while ( self->running && bytes > ( sizeof( self->audio_buffer) - self->audio_avail ) )
-			pthread_cond_wait( &self->audio_cond, &self->audio_mutex );
-		if ( self->running )
-		{
-			if ( scrub || mlt_properties_get_double( properties, "_speed" ) == 1 )
-				memcpy( &self->audio_buffer[ self->audio_avail ], pcm, bytes );
-			else
-				memset( &self->audio_buffer[ self->audio_avail ], 0, bytes );
-			self->audio_avail += bytes;
-		}
-		pthread_cond_broadcast( &self->audio_cond );
-		pthread_mutex_unlock( &self->audio_mutex );
+		int written = 0;
+
+		// Queue silence when not playing at normal speed
+		if ( !scrub && mlt_properties_get_double( properties, "_speed" ) != 1 )
+			pcm = NULL;
+
+		// Wait for the ring to drain to the latency target, without holding any lock
+		while ( self->running && written < samples )
+			written += mlt_audio_ring_write( self->audio_ring, pcm ? pcm + written * channels : NULL, samples - written, 100 );
+
+		// Report the ring's state
+		mlt_events_block( self->properties, self->properties );
+		mlt_properties_set_int( self->properties, "audio_fill", mlt_audio_ring_latency( self->audio_ring ) );
+		mlt_properties_set_int( self->properties, "audio_underruns", mlt_audio_ring_underruns( self->audio_ring ) );
+		mlt_events_unblock( self->properties, self->properties );
 	}
 	else
 	{
@@ -632,8 +616,6 @@ static void *consumer_thread( void *arg )
 		frame = NULL;
 	}
 
-	self->audio_avail = 0;
-
 	return NULL;
 }
 
@@ -655,13 +637,13 @@ static void consumer_close( mlt_consumer parent )
 	mlt_deque_close( self->queue );
 
 	// Destroy mutexes
-	pthread_mutex_destroy( &self->audio_mutex );
-	pthread_cond_destroy( &self->audio_cond );
 	pthread_mutex_destroy( &self->video_mutex );
 	pthread_cond_destroy( &self->video_cond );
 	pthread_mutex_destroy( &self->refresh_mutex );
 	pthread_cond_destroy( &self->refresh_cond );
 
+	mlt_audio_ring_close( self->audio_ring );
+
 	// Finally clean up this
 	free( self );
 }
@@ -17,12 +17,16 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#define _GNU_SOURCE
 #include <framework/mlt.h>
 
 #include <string.h>
 #include <limits.h>
 #ifdef SOX14
 #include <sox.h>
+#ifndef WIN32
+#include <dlfcn.h>
+#endif
 #endif
 
 extern mlt_filter filter_sox_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
@@ -73,6 +77,13 @@ MLT_REPOSITORY
 	int i;
 	const sox_effect_handler_t *e;
 	char name[64] = "sox.";
+#ifndef WIN32
+	Dl_info info;
+
+	// The effects come from libsox, so list them again when it is upgraded
+	if ( dladdr( ( void* )sox_effect_fns, &info ) && info.dli_fname )
+		mlt_repository_watch( repository, NULL, info.dli_fname );
+#endif
 	for ( i = 0; sox_effect_fns[i]; i++ )
 	{
 		e = sox_effect_fns[i]();
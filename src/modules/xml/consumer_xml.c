@@ -24,11 +24,16 @@
 #include <unistd.h>
 #include <locale.h>
 #include <libxml/tree.h>
+#include <libxml/xmlsave.h>
 #include <pthread.h>
 #include <wchar.h>
+#include <sys/time.h>
+
+#include "snapshot.h"
 
 #define ID_SIZE 128
 #define TIME_PROPERTY "_consumer_xml"
+#define SPOOL_BUFFER_SIZE (65536)
 
 #define _x (const xmlChar*)
 #define _s (const char*)
@@ -37,6 +42,7 @@
 struct serialise_context_s
 {
 	mlt_properties id_map;
+	mlt_properties service_map;
 	int producer_count;
 	int multitrack_count;
 	int playlist_count;
@@ -50,9 +56,33 @@ struct serialise_context_s
 	int no_meta;
 	mlt_profile profile;
 	mlt_time_format time_format;
+	snapshot_writer snapshot;
+	int depth;
+	int elements;
+	xmlNodePtr stream;
+	xmlBufferPtr body;
+	FILE *spool;
+	size_t spooled;
+	int error;
+	const char *encoding;
+	int format;
+	int top;
 };
 typedef struct serialise_context_s* serialise_context;
 
+/** An element of the output, either in a document or in a snapshot.
+*/
+
+typedef struct
+{
+	xmlNode *xml;      // the node when making a document
+	const char *name;
+	int depth;         // the root is 0
+	int element;       // the number of elements started before it
+	int top;           // the element that holds it under the root
+}
+xml_node;
+
 /** Forward references to static functions.
 */
 
@@ -60,7 +90,7 @@ static int consumer_start( mlt_consumer parent );
 static int consumer_stop( mlt_consumer parent );
 static int consumer_is_stopped( mlt_consumer consumer );
 static void *consumer_thread( void *arg );
-static void serialise_service( serialise_context context, mlt_service service, xmlNode *node );
+static void serialise_service( serialise_context context, mlt_service service, xml_node node );
 
 static char* filter_restricted( const char *in )
 {
@@ -112,11 +142,13 @@ static char *xml_get_id( serialise_context context, mlt_service service, xml_typ
 	char *id = NULL;
 	int i = 0;
 	mlt_properties map = context->id_map;
+	char key[ 32 ];
 
-	// Search the map for the service
-	for ( i = 0; i < mlt_properties_count( map ); i ++ )
-		if ( mlt_properties_get_data_at( map, i, NULL ) == service )
-			break;
+	// Look up the position of the service in the map by its address
+	snprintf( key, sizeof( key ), "%p", service );
+	i = mlt_properties_get_int( context->service_map, key ) - 1;
+	if ( i < 0 )
+		i = mlt_properties_count( map );
 
 	// If the service is not in the map, and the type indicates a new id is needed...
 	if ( i >= mlt_properties_count( map ) && type != xml_existing )
@@ -160,6 +192,7 @@ static char *xml_get_id( serialise_context context, mlt_service service, xml_typ
 
 			// Set the data at the generated name
 			mlt_properties_set_data( map, temp, service, 0, NULL, NULL );
+			mlt_properties_set_int( context->service_map, key, i + 1 );
 
 			// Get the pointer to the name (i is the end of the list)
 			id = mlt_properties_get_name( map, i );
@@ -168,6 +201,7 @@ static char *xml_get_id( serialise_context context, mlt_service service, xml_typ
 		{
 			// Store the existing id in the map
 			mlt_properties_set_data( map, id, service, 0, NULL, NULL );
+			mlt_properties_set_int( context->service_map, key, i + 1 );
 		}
 	}
 	else if ( type == xml_existing )
@@ -178,6 +212,156 @@ static char *xml_get_id( serialise_context context, mlt_service service, xml_typ
 	return id;
 }
 
+/** Write out the elements under the root that are finished.
+
+	When streaming, each child of the root is made under a stand-in root
+	and written out as soon as the next one starts, so that the document
+	never holds more than one of them. libxml2 still formats and escapes
+	everything, so the result is the same as dumping the document.
+
+	The root takes attributes until the end, so the children go to a spool
+	file that follows the start tag of the root when it is complete, or to
+	the body in memory when making a string.
+*/
+
+static void stream_flush( serialise_context context )
+{
+	xmlNodePtr holder = context->stream;
+
+	if ( holder && holder->children )
+	{
+		xmlBufferPtr text = xmlBufferCreate();
+		xmlSaveCtxtPtr save = xmlSaveToBuffer( text, context->encoding, context->format ? XML_SAVE_FORMAT : 0 );
+
+		if ( save )
+		{
+			// Leave out the start and end tags of the stand-in
+			int start = context->format ? strlen( "<mlt>\n" ) : strlen( "<mlt>" );
+			int end = strlen( "</mlt>" );
+
+			xmlSaveTree( save, holder );
+			xmlSaveClose( save );
+			if ( xmlBufferLength( text ) > start + end )
+			{
+				const xmlChar *chunk = xmlBufferContent( text ) + start;
+				size_t size = xmlBufferLength( text ) - start - end;
+
+				if ( !context->spool )
+					xmlBufferAdd( context->body, chunk, size );
+				else if ( fwrite( chunk, 1, size, context->spool ) != size )
+					context->error = 1;
+				context->spooled += size;
+			}
+		}
+		xmlBufferFree( text );
+
+		while ( holder->children )
+		{
+			xmlNodePtr child = holder->children;
+			xmlUnlinkNode( child );
+			xmlFreeNode( child );
+		}
+	}
+}
+
+/** Get the document node under which to add to a node.
+
+	\return the node or NULL if it has already been written out
+*/
+
+static xmlNodePtr node_parent( serialise_context context, xml_node node )
+{
+	if ( !context->stream )
+		return node.xml;
+	if ( node.depth == 0 )
+	{
+		stream_flush( context );
+		return context->stream;
+	}
+	if ( node.top != context->top )
+	{
+		mlt_log_warning( NULL, "[consumer_xml] %s was already written\n", node.name );
+		return NULL;
+	}
+	return node.xml;
+}
+
+/** Finish the snapshot elements that are inside a node.
+*/
+
+static void node_finish( serialise_context context, xml_node node )
+{
+	for ( ; context->depth > node.depth; context->depth -- )
+		snapshot_end( context->snapshot );
+}
+
+/** Add an element to a node.
+*/
+
+static xml_node node_child( serialise_context context, xml_node parent, const char *name )
+{
+	xml_node child = { NULL, name, parent.depth + 1, ++ context->elements, parent.top };
+
+	if ( context->snapshot )
+	{
+		node_finish( context, parent );
+		snapshot_start( context->snapshot, name );
+		context->depth = child.depth;
+	}
+	else
+	{
+		xmlNodePtr xml = node_parent( context, parent );
+		if ( parent.depth == 0 )
+			child.top = context->top = child.element;
+		if ( xml )
+			child.xml = xmlNewChild( xml, NULL, _x(name), NULL );
+	}
+	return child;
+}
+
+/** Add an attribute to a node.
+
+	A snapshot is written as it goes, so only the root can still take
+	attributes once it has contents.
+*/
+
+static void node_attribute( serialise_context context, xml_node node, const char *name, const char *value )
+{
+	if ( !context->snapshot )
+	{
+		if ( node.xml && ( node.depth == 0 || node_parent( context, node ) ) )
+			xmlNewProp( node.xml, _x(name), _x(value) );
+	}
+	else if ( node.element != context->elements || snapshot_attribute( context->snapshot, name, value ) )
+	{
+		if ( node.depth == 0 )
+			snapshot_root_attribute( context->snapshot, name, value );
+		else
+			mlt_log_warning( NULL, "[consumer_xml] snapshot drops late attribute %s of %s\n", name, node.name );
+	}
+}
+
+/** Add a property element to a node.
+*/
+
+static void node_property( serialise_context context, xml_node node, const char *name, const char *value )
+{
+	if ( context->snapshot )
+	{
+		node_finish( context, node );
+		snapshot_property( context->snapshot, name, value );
+	}
+	else
+	{
+		xmlNodePtr xml = node_parent( context, node );
+		if ( xml )
+		{
+			xmlNode *p = xmlNewTextChild( xml, NULL, _x("property"), _x(value) );
+			xmlNewProp( p, _x("name"), _x(name) );
+		}
+	}
+}
+
 /** This is what will be called by the factory - anything can be passed in
 	via the argument, but keep it simple.
 */
@@ -211,10 +395,9 @@ mlt_consumer consumer_xml_init( mlt_profile profile, mlt_service_type type, cons
 	return NULL;
 }
 
-static void serialise_properties( serialise_context context, mlt_properties properties, xmlNode *node )
+static void serialise_properties( serialise_context context, mlt_properties properties, xml_node node )
 {
 	int i;
-	xmlNode *p;
 
 	// Enumerate the properties
 	for ( i = 0; i < mlt_properties_count( properties ); i++ )
@@ -247,20 +430,18 @@ static void serialise_properties( serialise_context context, mlt_properties prop
 				int rootlen = strlen( context->root );
 				// convert absolute path to relative
 				if ( rootlen && !strncmp( value, context->root, rootlen ) && value[ rootlen ] == '/' )
-					p = xmlNewTextChild( node, NULL, _x("property"), _x(value + rootlen + 1 ) );
+					node_property( context, node, name, value + rootlen + 1 );
 				else
-					p = xmlNewTextChild( node, NULL, _x("property"), _x(value) );
-				xmlNewProp( p, _x("name"), _x(name) );
+					node_property( context, node, name, value );
 				free( value );
 			}
 		}
 	}
 }
 
-static void serialise_store_properties( serialise_context context, mlt_properties properties, xmlNode *node, const char *store )
+static void serialise_store_properties( serialise_context context, mlt_properties properties, xml_node node, const char *store )
 {
 	int i;
-	xmlNode *p;
 
 	// Enumerate the properties
 	for ( i = 0; store != NULL && i < mlt_properties_count( properties ); i++ )
@@ -274,20 +455,19 @@ static void serialise_store_properties( serialise_context context, mlt_propertie
 				int rootlen = strlen( context->root );
 				// convert absolute path to relative
 				if ( rootlen && !strncmp( value, context->root, rootlen ) && value[ rootlen ] == '/' )
-					p = xmlNewTextChild( node, NULL, _x("property"), _x(value + rootlen + 1) );
+					node_property( context, node, name, value + rootlen + 1 );
 				else
-					p = xmlNewTextChild( node, NULL, _x("property"), _x(value) );
-				xmlNewProp( p, _x("name"), _x(name) );
+					node_property( context, node, name, value );
 				free( value );
 			}
 		}
 	}
 }
 
-static inline void serialise_service_filters( serialise_context context, mlt_service service, xmlNode *node )
+static inline void serialise_service_filters( serialise_context context, mlt_service service, xml_node node )
 {
 	int i;
-	xmlNode *p;
+	xml_node p;
 	mlt_filter filter = NULL;
 
 	// Enumerate the filters
@@ -300,14 +480,14 @@ static inline void serialise_service_filters( serialise_context context, mlt_ser
 			char *id = xml_get_id( context, MLT_FILTER_SERVICE( filter ), xml_filter );
 			if ( id != NULL )
 			{
-				p = xmlNewChild( node, NULL, _x("filter"), NULL );
-				xmlNewProp( p, _x("id"), _x(id) );
+				p = node_child( context, node, "filter" );
+				node_attribute( context, p, "id", id );
 				if ( mlt_properties_get( properties, "title" ) )
-					xmlNewProp( p, _x("title"), _x(mlt_properties_get( properties, "title" )) );
+					node_attribute( context, p, "title", mlt_properties_get( properties, "title" ) );
 				if ( mlt_properties_get_position( properties, "in" ) )
-					xmlNewProp( p, _x("in"), _x( mlt_properties_get_time( properties, "in", context->time_format ) ) );
+					node_attribute( context, p, "in", mlt_properties_get_time( properties, "in", context->time_format ) );
 				if ( mlt_properties_get_position( properties, "out" ) )
-					xmlNewProp( p, _x("out"), _x( mlt_properties_get_time( properties, "out", context->time_format ) ) );
+					node_attribute( context, p, "out", mlt_properties_get_time( properties, "out", context->time_format ) );
 				serialise_properties( context, properties, p );
 				serialise_service_filters( context, MLT_FILTER_SERVICE( filter ), p );
 			}
@@ -315,9 +495,9 @@ static inline void serialise_service_filters( serialise_context context, mlt_ser
 	}
 }
 
-static void serialise_producer( serialise_context context, mlt_service service, xmlNode *node )
+static void serialise_producer( serialise_context context, mlt_service service, xml_node node )
 {
-	xmlNode *child = node;
+	xml_node child = node;
 	mlt_service parent = MLT_SERVICE( mlt_producer_cut_parent( MLT_PRODUCER( service ) ) );
 
 	if ( context->pass == 0 )
@@ -328,14 +508,14 @@ static void serialise_producer( serialise_context context, mlt_service service,
 		if ( id == NULL )
 			return;
 
-		child = xmlNewChild( node, NULL, _x("producer"), NULL );
+		child = node_child( context, node, "producer" );
 
 		// Set the id
-		xmlNewProp( child, _x("id"), _x(id) );
+		node_attribute( context, child, "id", id );
 		if ( mlt_properties_get( properties, "title" ) )
-			xmlNewProp( child, _x("title"), _x(mlt_properties_get( properties, "title" )) );
-		xmlNewProp( child, _x("in"), _x(mlt_properties_get_time( properties, "in", context->time_format )) );
-		xmlNewProp( child, _x("out"), _x(mlt_properties_get_time( properties, "out", context->time_format )) );
+			node_attribute( context, child, "title", mlt_properties_get( properties, "title" ) );
+		node_attribute( context, child, "in", mlt_properties_get_time( properties, "in", context->time_format ) );
+		node_attribute( context, child, "out", mlt_properties_get_time( properties, "out", context->time_format ) );
 		serialise_properties( context, properties, child );
 		serialise_service_filters( context, service, child );
 
@@ -346,15 +526,15 @@ static void serialise_producer( serialise_context context, mlt_service service,
 	{
 		char *id = xml_get_id( context, parent, xml_existing );
 		mlt_properties properties = MLT_SERVICE_PROPERTIES( service );
-		xmlNewProp( node, _x("parent"), _x(id) );
-		xmlNewProp( node, _x("in"), _x(mlt_properties_get_time( properties, "in", context->time_format )) );
-		xmlNewProp( node, _x("out"), _x(mlt_properties_get_time( properties, "out", context->time_format )) );
+		node_attribute( context, node, "parent", id );
+		node_attribute( context, node, "in", mlt_properties_get_time( properties, "in", context->time_format ) );
+		node_attribute( context, node, "out", mlt_properties_get_time( properties, "out", context->time_format ) );
 	}
 }
 
-static void serialise_tractor( serialise_context context, mlt_service service, xmlNode *node );
+static void serialise_tractor( serialise_context context, mlt_service service, xml_node node );
 
-static void serialise_multitrack( serialise_context context, mlt_service service, xmlNode *node )
+static void serialise_multitrack( serialise_context context, mlt_service service, xml_node node )
 {
 	int i;
 
@@ -377,7 +557,7 @@ static void serialise_multitrack( serialise_context context, mlt_service service
 		// Serialise the tracks
 		for ( i = 0; i < mlt_multitrack_count( MLT_MULTITRACK( service ) ); i++ )
 		{
-			xmlNode *track = xmlNewChild( node, NULL, _x("track"), NULL );
+			xml_node track = node_child( context, node, "track" );
 			int hide = 0;
 			mlt_producer producer = mlt_multitrack_track( MLT_MULTITRACK( service ), i );
 			mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
@@ -385,30 +565,35 @@ static void serialise_multitrack( serialise_context context, mlt_service service
 			mlt_service parent = MLT_SERVICE( mlt_producer_cut_parent( producer ) );
 
 			char *id = xml_get_id( context, MLT_SERVICE( parent ), xml_existing );
-			xmlNewProp( track, _x("producer"), _x(id) );
+			node_attribute( context, track, "producer", id );
+			if ( mlt_producer_is_cut( producer ) )
+			{
+				node_attribute( context, track, "in", mlt_properties_get_time( properties, "in", context->time_format ) );
+				node_attribute( context, track, "out", mlt_properties_get_time( properties, "out", context->time_format ) );
+			}
+
+			// Attributes go before the contents of the track for a snapshot
+			hide = mlt_properties_get_int( context->hide_map, id );
+			if ( hide )
+				node_attribute( context, track, "hide", hide == 1 ? "video" : ( hide == 2 ? "audio" : "both" ) );
+
 			if ( mlt_producer_is_cut( producer ) )
 			{
-				xmlNewProp( track, _x("in"), _x( mlt_properties_get_time( properties, "in", context->time_format ) ) );
-				xmlNewProp( track, _x("out"), _x( mlt_properties_get_time( properties, "out", context->time_format ) ) );
 				serialise_store_properties( context, MLT_PRODUCER_PROPERTIES( producer ), track, context->store );
 				serialise_store_properties( context, MLT_PRODUCER_PROPERTIES( producer ), track, "xml_" );
 				if ( !context->no_meta )
 					serialise_store_properties( context, MLT_PRODUCER_PROPERTIES( producer ), track, "meta." );
 				serialise_service_filters( context, MLT_PRODUCER_SERVICE( producer ), track );
 			}
-
-			hide = mlt_properties_get_int( context->hide_map, id );
-			if ( hide )
-				xmlNewProp( track, _x("hide"), _x( hide == 1 ? "video" : ( hide == 2 ? "audio" : "both" ) ) );
 		}
 		serialise_service_filters( context, service, node );
 	}
 }
 
-static void serialise_playlist( serialise_context context, mlt_service service, xmlNode *node )
+static void serialise_playlist( serialise_context context, mlt_service service, xml_node node )
 {
 	int i;
-	xmlNode *child = node;
+	xml_node child = node;
 	mlt_playlist_clip_info info;
 	mlt_properties properties = MLT_SERVICE_PROPERTIES( service );
 
@@ -437,12 +622,12 @@ static void serialise_playlist( serialise_context context, mlt_service service,
 			}
 		}
 
-		child = xmlNewChild( node, NULL, _x("playlist"), NULL );
+		child = node_child( context, node, "playlist" );
 
 		// Set the id
-		xmlNewProp( child, _x("id"), _x(id) );
+		node_attribute( context, child, "id", id );
 		if ( mlt_properties_get( properties, "title" ) )
-			xmlNewProp( child, _x("title"), _x(mlt_properties_get( properties, "title" )) );
+			node_attribute( context, child, "title", mlt_properties_get( properties, "title" ) );
 
 		// Store application specific properties
 		serialise_store_properties( context, properties, child, context->store );
@@ -463,25 +648,25 @@ static void serialise_playlist( serialise_context context, mlt_service service,
 				char *service_s = mlt_properties_get( producer_props, "mlt_service" );
 				if ( service_s != NULL && strcmp( service_s, "blank" ) == 0 )
 				{
-					xmlNode *entry = xmlNewChild( child, NULL, _x("blank"), NULL );
+					xml_node entry = node_child( context, child, "blank" );
 					mlt_properties_set_data( producer_props, "_profile", context->profile, 0, NULL, NULL );
 					mlt_properties_set_position( producer_props, TIME_PROPERTY, info.frame_count );
-					xmlNewProp( entry, _x("length"), _x( mlt_properties_get_time( producer_props, TIME_PROPERTY, context->time_format ) ) );
+					node_attribute( context, entry, "length", mlt_properties_get_time( producer_props, TIME_PROPERTY, context->time_format ) );
 				}
 				else
 				{
 					char temp[ 20 ];
-					xmlNode *entry = xmlNewChild( child, NULL, _x("entry"), NULL );
+					xml_node entry = node_child( context, child, "entry" );
 					id = xml_get_id( context, MLT_SERVICE( producer ), xml_existing );
-					xmlNewProp( entry, _x("producer"), _x(id) );
+					node_attribute( context, entry, "producer", id );
 					mlt_properties_set_position( producer_props, TIME_PROPERTY, info.frame_in );
-					xmlNewProp( entry, _x("in"), _x( mlt_properties_get_time( producer_props, TIME_PROPERTY, context->time_format ) ) );
+					node_attribute( context, entry, "in", mlt_properties_get_time( producer_props, TIME_PROPERTY, context->time_format ) );
 					mlt_properties_set_position( producer_props, TIME_PROPERTY, info.frame_out );
-					xmlNewProp( entry, _x("out"), _x( mlt_properties_get_time( producer_props, TIME_PROPERTY, context->time_format ) ) );
+					node_attribute( context, entry, "out", mlt_properties_get_time( producer_props, TIME_PROPERTY, context->time_format ) );
 					if ( info.repeat > 1 )
 					{
 						sprintf( temp, "%d", info.repeat );
-						xmlNewProp( entry, _x("repeat"), _x(temp) );
+						node_attribute( context, entry, "repeat", temp );
 					}
 					if ( mlt_producer_is_cut( info.cut ) )
 					{
@@ -497,16 +682,16 @@ static void serialise_playlist( serialise_context context, mlt_service service,
 
 		serialise_service_filters( context, service, child );
 	}
-	else if ( xmlStrcmp( node->name, _x("tractor") ) != 0 )
+	else if ( strcmp( node.name, "tractor" ) )
 	{
 		char *id = xml_get_id( context, service, xml_existing );
-		xmlNewProp( node, _x("producer"), _x(id) );
+		node_attribute( context, node, "producer", id );
 	}
 }
 
-static void serialise_tractor( serialise_context context, mlt_service service, xmlNode *node )
+static void serialise_tractor( serialise_context context, mlt_service service, xml_node node )
 {
-	xmlNode *child = node;
+	xml_node child = node;
 	mlt_properties properties = MLT_SERVICE_PROPERTIES( service );
 
 	if ( context->pass == 0 )
@@ -521,18 +706,18 @@ static void serialise_tractor( serialise_context context, mlt_service service, x
 		if ( id == NULL )
 			return;
 
-		child = xmlNewChild( node, NULL, _x("tractor"), NULL );
+		child = node_child( context, node, "tractor" );
 
 		// Set the id
-		xmlNewProp( child, _x("id"), _x(id) );
+		node_attribute( context, child, "id", id );
 		if ( mlt_properties_get( properties, "title" ) )
-			xmlNewProp( child, _x("title"), _x(mlt_properties_get( properties, "title" )) );
+			node_attribute( context, child, "title", mlt_properties_get( properties, "title" ) );
 		if ( mlt_properties_get( properties, "global_feed" ) )
-			xmlNewProp( child, _x("global_feed"), _x(mlt_properties_get( properties, "global_feed" )) );
+			node_attribute( context, child, "global_feed", mlt_properties_get( properties, "global_feed" ) );
 		if ( mlt_properties_get_position( properties, "in" ) >= 0 )
-			xmlNewProp( child, _x("in"), _x(mlt_properties_get_time( properties, "in", context->time_format )) );
+			node_attribute( context, child, "in", mlt_properties_get_time( properties, "in", context->time_format ) );
 		if ( mlt_properties_get_position( properties, "out" ) >= 0 )
-			xmlNewProp( child, _x("out"), _x(mlt_properties_get_time( properties, "out", context->time_format )) );
+			node_attribute( context, child, "out", mlt_properties_get_time( properties, "out", context->time_format ) );
 
 		// Store application specific properties
 		serialise_store_properties( context, MLT_SERVICE_PROPERTIES( service ), child, context->store );
@@ -546,9 +731,9 @@ static void serialise_tractor( serialise_context context, mlt_service service, x
 	}
 }
 
-static void serialise_filter( serialise_context context, mlt_service service, xmlNode *node )
+static void serialise_filter( serialise_context context, mlt_service service, xml_node node )
 {
-	xmlNode *child = node;
+	xml_node child = node;
 	mlt_properties properties = MLT_SERVICE_PROPERTIES( service );
 
 	// Recurse on connected producer
@@ -561,25 +746,25 @@ static void serialise_filter( serialise_context context, mlt_service service, xm
 		if ( id == NULL )
 			return;
 
-		child = xmlNewChild( node, NULL, _x("filter"), NULL );
+		child = node_child( context, node, "filter" );
 
 		// Set the id
-		xmlNewProp( child, _x("id"), _x(id) );
+		node_attribute( context, child, "id", id );
 		if ( mlt_properties_get( properties, "title" ) )
-			xmlNewProp( child, _x("title"), _x(mlt_properties_get( properties, "title" )) );
+			node_attribute( context, child, "title", mlt_properties_get( properties, "title" ) );
 		if ( mlt_properties_get_position( properties, "in" ) )
-			xmlNewProp( child, _x("in"), _x( mlt_properties_get_time( properties, "in", context->time_format ) ) );
+			node_attribute( context, child, "in", mlt_properties_get_time( properties, "in", context->time_format ) );
 		if ( mlt_properties_get_position( properties, "out" ) )
-			xmlNewProp( child, _x("out"), _x( mlt_properties_get_time( properties, "out", context->time_format ) ) );
+			node_attribute( context, child, "out", mlt_properties_get_time( properties, "out", context->time_format ) );
 
 		serialise_properties( context, properties, child );
 		serialise_service_filters( context, service, child );
 	}
 }
 
-static void serialise_transition( serialise_context context, mlt_service service, xmlNode *node )
+static void serialise_transition( serialise_context context, mlt_service service, xml_node node )
 {
-	xmlNode *child = node;
+	xml_node child = node;
 	mlt_properties properties = MLT_SERVICE_PROPERTIES( service );
 
 	// Recurse on connected producer
@@ -592,23 +777,23 @@ static void serialise_transition( serialise_context context, mlt_service service
 		if ( id == NULL )
 			return;
 
-		child = xmlNewChild( node, NULL, _x("transition"), NULL );
+		child = node_child( context, node, "transition" );
 
 		// Set the id
-		xmlNewProp( child, _x("id"), _x(id) );
+		node_attribute( context, child, "id", id );
 		if ( mlt_properties_get( properties, "title" ) )
-			xmlNewProp( child, _x("title"), _x(mlt_properties_get( properties, "title" )) );
+			node_attribute( context, child, "title", mlt_properties_get( properties, "title" ) );
 		if ( mlt_properties_get_position( properties, "in" ) )
-			xmlNewProp( child, _x("in"), _x( mlt_properties_get_time( properties, "in", context->time_format ) ) );
+			node_attribute( context, child, "in", mlt_properties_get_time( properties, "in", context->time_format ) );
 		if ( mlt_properties_get_position( properties, "out" ) )
-			xmlNewProp( child, _x("out"), _x( mlt_properties_get_time( properties, "out", context->time_format ) ) );
+			node_attribute( context, child, "out", mlt_properties_get_time( properties, "out", context->time_format ) );
 
 		serialise_properties( context, properties, child );
 		serialise_service_filters( context, service, child );
 	}
 }
 
-static void serialise_service( serialise_context context, mlt_service service, xmlNode *node )
+static void serialise_service( serialise_context context, mlt_service service, xml_node node )
 {
 	// Iterate over consumer/producer connections
 	while ( service != NULL )
@@ -694,7 +879,7 @@ static void serialise_service( serialise_context context, mlt_service service, x
 	}
 }
 
-static void serialise_other( mlt_properties properties, struct serialise_context_s *context, xmlNodePtr root )
+static void serialise_other( mlt_properties properties, struct serialise_context_s *context, xml_node root )
 {
 	int i;
 	for ( i = 0; i < mlt_properties_count( properties ); i++ )
@@ -712,31 +897,26 @@ static void serialise_other( mlt_properties properties, struct serialise_context
 	}
 }
 
-xmlDocPtr xml_make_doc( mlt_consumer consumer, mlt_service service )
+static void serialise_document( serialise_context context, mlt_consumer consumer, mlt_service service, xml_node root )
 {
 	mlt_properties properties = MLT_SERVICE_PROPERTIES( service );
-	xmlDocPtr doc = xmlNewDoc( _x("1.0") );
-	xmlNodePtr root = xmlNewNode( NULL, _x("mlt") );
-	struct serialise_context_s *context = calloc( 1, sizeof( struct serialise_context_s ) );
 	mlt_profile profile = mlt_service_profile( MLT_CONSUMER_SERVICE( consumer ) );
 	char tmpstr[ 32 ];
 
-	xmlDocSetRootElement( doc, root );
-
 	// Indicate the numeric locale
 	if ( mlt_properties_get_lcnumeric( properties ) )
-		xmlNewProp( root, _x("LC_NUMERIC"), _x( mlt_properties_get_lcnumeric( properties ) ) );
+		node_attribute( context, root, "LC_NUMERIC", mlt_properties_get_lcnumeric( properties ) );
 	else
-		xmlNewProp( root, _x("LC_NUMERIC"), _x( setlocale( LC_NUMERIC, NULL ) ) );
+		node_attribute( context, root, "LC_NUMERIC", setlocale( LC_NUMERIC, NULL ) );
 
 	// Indicate the version
-	xmlNewProp( root, _x("version"), _x( mlt_version_get_string() ) );
+	node_attribute( context, root, "version", mlt_version_get_string() );
 
 	// If we have root, then deal with it now
 	if ( mlt_properties_get( properties, "root" ) != NULL )
 	{
 		if ( !mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( consumer ), "no_root" ) )
-			xmlNewProp( root, _x("root"), _x(mlt_properties_get( properties, "root" )) );
+			node_attribute( context, root, "root", mlt_properties_get( properties, "root" ) );
 		context->root = strdup( mlt_properties_get( properties, "root" ) );
 	}
 	else
@@ -758,40 +938,41 @@ xmlDocPtr xml_make_doc( mlt_consumer consumer, mlt_service service )
 
 	// Assign a title property
 	if ( mlt_properties_get( properties, "title" ) != NULL )
-		xmlNewProp( root, _x("title"), _x(mlt_properties_get( properties, "title" )) );
+		node_attribute( context, root, "title", mlt_properties_get( properties, "title" ) );
 	mlt_properties_set_int( properties, "global_feed", 1 );
 
 	// Add a profile child element
 	if ( profile )
 	{
-		xmlNodePtr profile_node = xmlNewChild( root, NULL, _x("profile"), NULL );
+		xml_node profile_node = node_child( context, root, "profile" );
 		if ( profile->description )
-			xmlNewProp( profile_node, _x("description"), _x(profile->description) );
+			node_attribute( context, profile_node, "description", profile->description );
 		sprintf( tmpstr, "%d", profile->width );
-		xmlNewProp( profile_node, _x("width"), _x(tmpstr) );
+		node_attribute( context, profile_node, "width", tmpstr );
 		sprintf( tmpstr, "%d", profile->height );
-		xmlNewProp( profile_node, _x("height"), _x(tmpstr) );
+		node_attribute( context, profile_node, "height", tmpstr );
 		sprintf( tmpstr, "%d", profile->progressive );
-		xmlNewProp( profile_node, _x("progressive"), _x(tmpstr) );
+		node_attribute( context, profile_node, "progressive", tmpstr );
 		sprintf( tmpstr, "%d", profile->sample_aspect_num );
-		xmlNewProp( profile_node, _x("sample_aspect_num"), _x(tmpstr) );
+		node_attribute( context, profile_node, "sample_aspect_num", tmpstr );
 		sprintf( tmpstr, "%d", profile->sample_aspect_den );
-		xmlNewProp( profile_node, _x("sample_aspect_den"), _x(tmpstr) );
+		node_attribute( context, profile_node, "sample_aspect_den", tmpstr );
 		sprintf( tmpstr, "%d", profile->display_aspect_num );
-		xmlNewProp( profile_node, _x("display_aspect_num"), _x(tmpstr) );
+		node_attribute( context, profile_node, "display_aspect_num", tmpstr );
 		sprintf( tmpstr, "%d", profile->display_aspect_den );
-		xmlNewProp( profile_node, _x("display_aspect_den"), _x(tmpstr) );
+		node_attribute( context, profile_node, "display_aspect_den", tmpstr );
 		sprintf( tmpstr, "%d", profile->frame_rate_num );
-		xmlNewProp( profile_node, _x("frame_rate_num"), _x(tmpstr) );
+		node_attribute( context, profile_node, "frame_rate_num", tmpstr );
 		sprintf( tmpstr, "%d", profile->frame_rate_den );
-		xmlNewProp( profile_node, _x("frame_rate_den"), _x(tmpstr) );
+		node_attribute( context, profile_node, "frame_rate_den", tmpstr );
 		sprintf( tmpstr, "%d", profile->colorspace );
-		xmlNewProp( profile_node, _x("colorspace"), _x(tmpstr) );
+		node_attribute( context, profile_node, "colorspace", tmpstr );
 		context->profile = profile;
 	}
 
 	// Construct the context maps
 	context->id_map = mlt_properties_new();
+	context->service_map = mlt_properties_new();
 	context->hide_map = mlt_properties_new();
 
 	// Ensure producer is a framework producer
@@ -810,13 +991,160 @@ xmlDocPtr xml_make_doc( mlt_consumer consumer, mlt_service service )
 
 	// Cleanup resource
 	mlt_properties_close( context->id_map );
+	mlt_properties_close( context->service_map );
 	mlt_properties_close( context->hide_map );
 	free( context->root );
+}
+
+xmlDocPtr xml_make_doc( mlt_consumer consumer, mlt_service service )
+{
+	xmlDocPtr doc = xmlNewDoc( _x("1.0") );
+	xml_node root = { xmlNewNode( NULL, _x("mlt") ), "mlt", 0, 0, 0 };
+	struct serialise_context_s *context = calloc( 1, sizeof( struct serialise_context_s ) );
+
+	xmlDocSetRootElement( doc, root.xml );
+	serialise_document( context, consumer, service, root );
 	free( context );
 
 	return doc;
 }
 
+/** Write a service as a snapshot.
+
+	\param file the file to write
+	\return true if the snapshot could not be written
+*/
+
+static int make_snapshot( mlt_consumer consumer, mlt_service service, FILE *file )
+{
+	struct serialise_context_s *context = calloc( 1, sizeof( struct serialise_context_s ) );
+	xml_node root = { NULL, "mlt", 0, 0, 0 };
+	int error;
+
+	context->snapshot = snapshot_writer_init( file );
+	snapshot_start( context->snapshot, "mlt" );
+	serialise_document( context, consumer, service, root );
+	node_finish( context, root );
+	snapshot_end( context->snapshot );
+	error = snapshot_writer_close( context->snapshot );
+	free( context );
+
+	return error;
+}
+
+
+/** Copy the spooled children of the root to the output.
+
+	\return true if there was an error
+*/
+
+static int copy_spool( FILE *spool, FILE *file )
+{
+	char *buffer = malloc( SPOOL_BUFFER_SIZE );
+	size_t size;
+	int error = !buffer || fflush( spool ) || fseek( spool, 0, SEEK_SET );
+
+	while ( !error && ( size = fread( buffer, 1, SPOOL_BUFFER_SIZE, spool ) ) > 0 )
+		error = fwrite( buffer, 1, size, file ) != size;
+	free( buffer );
+
+	return error || ferror( spool );
+}
+
+/** Write a service as xml without making the whole document first.
+
+	\param encoding the encoding to declare or NULL
+	\param format whether to indent the elements
+	\param file the file to write or NULL to make a string
+	\param[out] string when \p file is NULL, the xml, which the caller must free with xmlFree
+	\return true if the xml could not be written
+*/
+
+static int stream_xml( mlt_consumer consumer, mlt_service service, const char *encoding, int format, FILE *file, xmlChar **string )
+{
+	struct serialise_context_s *context = calloc( 1, sizeof( struct serialise_context_s ) );
+	xmlDocPtr doc = xmlNewDoc( _x("1.0") );
+	xml_node root = { xmlNewNode( NULL, _x("mlt") ), "mlt", 0, 0, 0 };
+	const char *open = format ? ">\n" : ">";
+	const char *close = "</mlt>\n";
+	xmlChar *head = NULL;
+	int size = 0;
+	int error;
+
+	xmlDocSetRootElement( doc, root.xml );
+
+	// Attribute values are escaped for the encoding of the document
+	if ( encoding )
+		doc->encoding = xmlStrdup( _x(encoding) );
+
+	context->stream = xmlNewDocNode( doc, NULL, _x("mlt"), NULL );
+	context->encoding = encoding;
+	context->format = format;
+	if ( file )
+		context->spool = tmpfile();
+	if ( !context->spool )
+		context->body = xmlBufferCreate();
+	serialise_document( context, consumer, service, root );
+	stream_flush( context );
+
+	// The root now has only its attributes, so it dumps as an empty element
+	xmlDocDumpFormatMemoryEnc( doc, &head, &size, encoding, format );
+	error = !head || context->error;
+	if ( !error && context->spooled && size >= 3 && !strcmp( _s(head) + size - 3, "/>\n" ) )
+	{
+		size -= 3;
+		if ( !file )
+		{
+			xmlBufferPtr result = xmlBufferCreateSize( size + strlen( open ) + context->spooled + strlen( close ) + 1 );
+			xmlBufferAdd( result, head, size );
+			xmlBufferCCat( result, open );
+			xmlBufferAdd( result, xmlBufferContent( context->body ), xmlBufferLength( context->body ) );
+			xmlBufferCCat( result, close );
+			*string = xmlBufferDetach( result );
+			xmlBufferFree( result );
+		}
+		else if ( fwrite( head, 1, size, file ) != ( size_t )size || fputs( open, file ) == EOF )
+		{
+			error = 1;
+		}
+		else if ( context->spool )
+		{
+			error = copy_spool( context->spool, file ) || fputs( close, file ) == EOF;
+		}
+		else
+		{
+			size_t length = xmlBufferLength( context->body );
+			error = fwrite( xmlBufferContent( context->body ), 1, length, file ) != length || fputs( close, file ) == EOF;
+		}
+	}
+	else if ( !error )
+	{
+		if ( !file )
+		{
+			*string = head;
+			head = NULL;
+		}
+		else
+		{
+			error = fwrite( head, 1, size, file ) != ( size_t )size;
+		}
+	}
+
+#ifdef WIN32
+	xmlFreeFunc xmlFree = NULL;
+	xmlMemGet( &xmlFree, NULL, NULL, NULL);
+#endif
+	xmlFree( head );
+	if ( context->spool )
+		fclose( context->spool );
+	if ( context->body )
+		xmlBufferFree( context->body );
+	xmlFreeNode( context->stream );
+	xmlFreeDoc( doc );
+	free( context );
+
+	return error;
+}
 
 static void output_xml( mlt_consumer consumer )
 {
@@ -824,7 +1152,10 @@ static void output_xml( mlt_consumer consumer )
 	mlt_service service = mlt_service_producer( MLT_CONSUMER_SERVICE( consumer ) );
 	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
 	char *resource =  mlt_properties_get( properties, "resource" );
+	int no_stream = mlt_properties_get_int( properties, "no_stream" );
 	xmlDocPtr doc = NULL;
+	xmlChar *buffer = NULL;
+	int length = 0;
 
 	if ( !service ) return;
 
@@ -847,25 +1178,51 @@ static void output_xml( mlt_consumer consumer )
 		free( cwd );
 	}
 
-	// Make the document
-	doc = xml_make_doc( consumer, service );
+	if ( mlt_properties_get( properties, "format" ) && !strcmp( mlt_properties_get( properties, "format" ), "snapshot" ) )
+	{
+		if ( resource == NULL || !strcmp( resource, "" ) )
+		{
+			make_snapshot( consumer, service, stdout );
+		}
+		else if ( strchr( resource, '.' ) == NULL )
+		{
+			// A snapshot is binary, so it can not be a string property
+			mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "a snapshot can only be written to a file or stdout\n" );
+		}
+		else
+		{
+			FILE *file;
+
+			mlt_properties_from_utf8( properties, "resource", "_resource" );
+			resource = mlt_properties_get( properties, "_resource" );
+			file = fopen( resource, "wb" );
+			if ( !file || make_snapshot( consumer, service, file ) )
+				mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "failed to write %s\n", resource );
+			if ( file )
+				fclose( file );
+		}
+		return;
+	}
+
+	// Make the whole document first if asked
+	if ( no_stream )
+		doc = xml_make_doc( consumer, service );
 
 	// Handle the output
 	if ( resource == NULL || !strcmp( resource, "" ) )
 	{
-		xmlDocFormatDump( stdout, doc, 1 );
+		if ( doc )
+			xmlDocFormatDump( stdout, doc, 1 );
+		else
+			stream_xml( consumer, service, NULL, 1, stdout, NULL );
 	}
 	else if ( strchr( resource, '.' ) == NULL )
 	{
-		xmlChar *buffer = NULL;
-		int length = 0;
-		xmlDocDumpMemoryEnc( doc, &buffer, &length, "utf-8" );
+		if ( doc )
+			xmlDocDumpMemoryEnc( doc, &buffer, &length, "utf-8" );
+		else
+			stream_xml( consumer, service, "utf-8", 0, NULL, &buffer );
 		mlt_properties_set( properties, resource, _s(buffer) );
-#ifdef WIN32
-		xmlFreeFunc xmlFree = NULL;
-		xmlMemGet( &xmlFree, NULL, NULL, NULL);
-#endif
-		xmlFree( buffer );
 	}
 	else
 	{
@@ -873,11 +1230,30 @@ static void output_xml( mlt_consumer consumer )
 		mlt_properties_from_utf8( properties, "resource", "_resource" );
 		resource = mlt_properties_get( properties, "_resource" );
 
-		xmlSaveFormatFileEnc( resource, doc, "utf-8", 1 );
+		if ( doc )
+		{
+			if ( xmlSaveFormatFileEnc( resource, doc, "utf-8", 1 ) < 0 )
+				mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "failed to write %s\n", resource );
+		}
+		else
+		{
+			FILE *file = fopen( resource, "wb" );
+			int error = !file || stream_xml( consumer, service, "utf-8", 1, file, NULL );
+
+			if ( file && fclose( file ) )
+				error = 1;
+			if ( error )
+				mlt_log_error( MLT_CONSUMER_SERVICE( consumer ), "failed to write %s\n", resource );
+		}
 	}
+	if ( doc )
+		xmlFreeDoc( doc );
 
-	// Close the document
-	xmlFreeDoc( doc );
+#ifdef WIN32
+	xmlFreeFunc xmlFree = NULL;
+	xmlMemGet( &xmlFree, NULL, NULL, NULL);
+#endif
+	xmlFree( buffer );
 }
 static int consumer_start( mlt_consumer consumer )
 {
@@ -26,11 +26,17 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <sys/time.h>
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
 
 #include <libxml/parser.h>
 #include <libxml/parserInternals.h> // for xmlCreateFileParserCtxt
 #include <libxml/tree.h>
 
+#include "snapshot.h"
+
 #define BRANCH_SIG_LEN 4000
 
 #define _x (const xmlChar*)
@@ -85,6 +91,10 @@ struct deserialise_context_s
 	int consumer_count;
 	int seekable;
 	mlt_consumer qglsl;
+	int lazy;
+	mlt_properties shared;
+	int lazy_count;
+	int shared_count;
 };
 typedef struct deserialise_context_s *deserialise_context;
 
@@ -502,6 +512,89 @@ static void on_end_playlist( deserialise_context context, const xmlChar *name )
 	}
 }
 
+/** Create the producer described by the properties of a producer element.
+*/
+
+static mlt_producer producer_from_properties( mlt_profile profile, mlt_properties properties )
+{
+	mlt_producer producer = NULL;
+	char *resource = mlt_properties_get( properties, "resource" );
+
+	// Let Kino-SMIL src be a synonym for resource
+	if ( resource == NULL )
+		resource = mlt_properties_get( properties, "src" );
+
+	// Instantiate the producer
+	if ( mlt_properties_get( properties, "mlt_service" ) != NULL )
+	{
+		char *service_name = trim( mlt_properties_get( properties, "mlt_service" ) );
+		if ( resource )
+		{
+			char *temp = calloc( 1, strlen( service_name ) + strlen( resource ) + 2 );
+			strcat( temp, service_name );
+			strcat( temp, ":" );
+			strcat( temp, resource );
+			producer = mlt_factory_producer( profile, NULL, temp );
+			free( temp );
+		}
+		else
+		{
+			producer = mlt_factory_producer( profile, NULL, service_name );
+		}
+	}
+
+	// Just in case the plugin requested doesn't exist...
+	if ( !producer && resource )
+		producer = mlt_factory_producer( profile, NULL, resource );
+	if ( !producer )
+		mlt_log_error( NULL, "[producer_xml] failed to load producer \"%s\"\n", resource );
+	if ( !producer )
+		producer = mlt_factory_producer( profile, NULL, "+INVALID.txt" );
+	if ( !producer )
+		producer = mlt_factory_producer( profile, NULL, "colour:red" );
+
+	return producer;
+}
+
+/** Describe a producer element so that identical ones can share a producer.
+
+	Returns NULL when the element carries filters, which must not be shared.
+*/
+
+static char *producer_key( mlt_service service )
+{
+	mlt_properties properties = MLT_SERVICE_PROPERTIES( service );
+	int count = mlt_properties_count( properties );
+	size_t size = 1;
+	char *key = NULL;
+	int i;
+
+	if ( mlt_service_filter( service, 0 ) != NULL )
+		return NULL;
+
+	for ( i = 0; i < count; i ++ )
+	{
+		char *name = mlt_properties_get_name( properties, i );
+		char *value = mlt_properties_get_value( properties, i );
+		if ( name[0] != '_' && strcmp( name, "id" ) && value )
+			size += strlen( name ) + strlen( value ) + 2;
+	}
+	key = calloc( 1, size );
+	for ( i = 0; key && i < count; i ++ )
+	{
+		char *name = mlt_properties_get_name( properties, i );
+		char *value = mlt_properties_get_value( properties, i );
+		if ( name[0] != '_' && strcmp( name, "id" ) && value )
+		{
+			strcat( key, name );
+			strcat( key, "=" );
+			strcat( key, value );
+			strcat( key, "\n" );
+		}
+	}
+	return key;
+}
+
 static void on_start_producer( deserialise_context context, const xmlChar *name, const xmlChar **atts)
 {
 	// use a dummy service to hold properties to allow arbitrary nesting
@@ -525,6 +618,8 @@ static void on_end_producer( deserialise_context context, const xmlChar *name )
 	if ( service != NULL && type == mlt_dummy_producer_type )
 	{
 		mlt_service producer = NULL;
+		int is_shared = 0;
+		int is_lazy = 0;
 
 		qualify_property( context, properties, "resource" );
 		char *resource = mlt_properties_get( properties, "resource" );
@@ -536,34 +631,52 @@ static void on_end_producer( deserialise_context context, const xmlChar *name )
 			resource = mlt_properties_get( properties, "src" );
 		}
 
-		// Instantiate the producer
-		if ( mlt_properties_get( properties, "mlt_service" ) != NULL )
+		// Propagate the properties
+		qualify_property( context, properties, "luma" );
+		qualify_property( context, properties, "luma.resource" );
+		qualify_property( context, properties, "composite.luma" );
+		qualify_property( context, properties, "producer.resource" );
+
+		if ( context->lazy )
 		{
-			char *service_name = trim( mlt_properties_get( properties, "mlt_service" ) );
-			if ( resource )
+			char *key = producer_key( service );
+			char *service_name = mlt_properties_get( properties, "mlt_service" );
+			char *temp = NULL;
+
+			if ( resource && service_name )
 			{
-				char *temp = calloc( 1, strlen( service_name ) + strlen( resource ) + 2 );
-				strcat( temp, service_name );
-				strcat( temp, ":" );
-				strcat( temp, resource );
-				producer = MLT_SERVICE( mlt_factory_producer( context->profile, NULL, temp ) );
-				free( temp );
+				service_name = trim( service_name );
+				temp = calloc( 1, strlen( service_name ) + strlen( resource ) + 2 );
+				sprintf( temp, "%s:%s", service_name, resource );
 			}
-			else
+
+			// Each element gets a producer of its own, but one identical to an
+			// earlier element shares what opening that one found
+			is_shared = key && mlt_properties_get_data( context->shared, key, NULL ) != NULL;
+
+			// Defer opening the media if the element gives the length or is shared
+			if ( resource && ( is_shared || mlt_properties_get( properties, "length" ) ) )
 			{
-				producer = MLT_SERVICE( mlt_factory_producer( context->profile, NULL, service_name ) );
+				producer = MLT_SERVICE( mlt_producer_lazy_new( context->profile, NULL, temp ? temp : resource, properties ) );
+				is_lazy = producer != NULL;
+				context->lazy_count += is_lazy;
 			}
+			if ( !producer )
+			{
+				producer = MLT_SERVICE( producer_from_properties( context->profile, properties ) );
+				if ( producer && key && resource )
+					mlt_probe_put( context->profile, NULL, temp ? temp : resource, MLT_SERVICE_PROPERTIES( producer ) );
+			}
+			if ( producer && key && !is_shared )
+				mlt_properties_set_data( context->shared, key, producer, 0, NULL, NULL );
+			is_shared = is_shared && is_lazy;
+			free( temp );
+			free( key );
+		}
+		else
+		{
+			producer = MLT_SERVICE( producer_from_properties( context->profile, properties ) );
 		}
-
-		// Just in case the plugin requested doesn't exist...
-		if ( !producer && resource )
-			producer = MLT_SERVICE( mlt_factory_producer( context->profile, NULL, resource ) );
-		if ( !producer )
-			mlt_log_error( NULL, "[producer_xml] failed to load producer \"%s\"\n", resource );
-		if ( !producer )
-			producer = MLT_SERVICE( mlt_factory_producer( context->profile, NULL, "+INVALID.txt" ) );
-		if ( !producer )
-			producer = MLT_SERVICE( mlt_factory_producer( context->profile, NULL, "colour:red" ) );
 		if ( !producer )
 		{
 			mlt_service_close( service );
@@ -576,13 +689,7 @@ static void on_end_producer( deserialise_context context, const xmlChar *name )
 		mlt_properties_set_lcnumeric( MLT_SERVICE_PROPERTIES( producer ), context->lc_numeric );
 		if ( mlt_properties_get( MLT_SERVICE_PROPERTIES( producer ), "seekable" ) )
 			context->seekable &= mlt_properties_get_int( MLT_SERVICE_PROPERTIES( producer ), "seekable" );
-
-		// Propagate the properties
-		qualify_property( context, properties, "resource" );
-		qualify_property( context, properties, "luma" );
-		qualify_property( context, properties, "luma.resource" );
-		qualify_property( context, properties, "composite.luma" );
-		qualify_property( context, properties, "producer.resource" );
+		context->shared_count += is_shared;
 
 		// Handle in/out properties separately
 		mlt_position in = -1;
@@ -607,6 +714,10 @@ static void on_end_producer( deserialise_context context, const xmlChar *name )
 		// Inherit the properties
 		mlt_properties_inherit( MLT_SERVICE_PROPERTIES( producer ), properties );
 
+		// Span the whole length like the real producer will
+		if ( is_lazy )
+			mlt_producer_set_in_and_out( MLT_PRODUCER( producer ), 0, mlt_producer_get_length( MLT_PRODUCER( producer ) ) - 1 );
+
 		// Attach all filters from service onto producer
 		attach_filters( producer, service );
 
@@ -1202,11 +1313,8 @@ static void on_end_property( deserialise_context context, const xmlChar *name )
 	}
 }
 
-static void on_start_element( void *ctx, const xmlChar *name, const xmlChar **atts)
+static void start_element( deserialise_context context, const xmlChar *name, const xmlChar **atts)
 {
-	struct _xmlParserCtxt *xmlcontext = ( struct _xmlParserCtxt* )ctx;
-	deserialise_context context = ( deserialise_context )( xmlcontext->_private );
-	
 	if ( context->pass == 0 )
 	{
 		if ( xmlStrcmp( name, _x("mlt") ) == 0 ||
@@ -1284,11 +1392,8 @@ static void on_start_element( void *ctx, const xmlChar *name, const xmlChar **at
 	}
 }
 
-static void on_end_element( void *ctx, const xmlChar *name )
+static void end_element( deserialise_context context, const xmlChar *name )
 {
-	struct _xmlParserCtxt *xmlcontext = ( struct _xmlParserCtxt* )ctx;
-	deserialise_context context = ( deserialise_context )( xmlcontext->_private );
-	
 	if ( context->is_value == 1 && context->pass == 1 && xmlStrcmp( name, _x("property") ) != 0 )
 		context_pop_node( context );
 	else if ( xmlStrcmp( name, _x("multitrack") ) == 0 )
@@ -1315,10 +1420,8 @@ static void on_end_element( void *ctx, const xmlChar *name )
 	mlt_deque_pop_back_int( context->stack_branch );
 }
 
-static void on_characters( void *ctx, const xmlChar *ch, int len )
+static void characters( deserialise_context context, const xmlChar *ch, int len )
 {
-	struct _xmlParserCtxt *xmlcontext = ( struct _xmlParserCtxt* )ctx;
-	deserialise_context context = ( deserialise_context )( xmlcontext->_private );
 	char *value = calloc( 1, len + 1 );
 	enum service_type type;
 	mlt_service service = context_pop_service( context, &type );
@@ -1360,6 +1463,71 @@ static void on_characters( void *ctx, const xmlChar *ch, int len )
 	free( value);
 }
 
+static void on_start_element( void *ctx, const xmlChar *name, const xmlChar **atts)
+{
+	struct _xmlParserCtxt *xmlcontext = ( struct _xmlParserCtxt* )ctx;
+	start_element( ( deserialise_context )( xmlcontext->_private ), name, atts );
+}
+
+static void on_end_element( void *ctx, const xmlChar *name )
+{
+	struct _xmlParserCtxt *xmlcontext = ( struct _xmlParserCtxt* )ctx;
+	end_element( ( deserialise_context )( xmlcontext->_private ), name );
+}
+
+static void on_characters( void *ctx, const xmlChar *ch, int len )
+{
+	struct _xmlParserCtxt *xmlcontext = ( struct _xmlParserCtxt* )ctx;
+	characters( ( deserialise_context )( xmlcontext->_private ), ch, len );
+}
+
+/** The snapshot reader calls these in place of the SAX parser.
+*/
+
+static void on_snapshot_start( void *context, const char *name, const char **atts )
+{
+	start_element( context, _x(name), ( const xmlChar** )atts );
+}
+
+static void on_snapshot_end( void *context, const char *name )
+{
+	end_element( context, _x(name) );
+}
+
+static void on_snapshot_characters( void *context, const char *text, int length )
+{
+	characters( context, _x(text), length );
+}
+
+/** Read a file if it is a snapshot.
+
+	\param[out] size the size of the snapshot
+	\return the snapshot, which the caller must free, or NULL if the file is not one
+*/
+
+static char *load_snapshot( const char *filename, size_t *size )
+{
+	FILE *file = fopen( filename, "rb" );
+	char magic[ SNAPSHOT_MAGIC_SIZE ];
+	char *data = NULL;
+	long length = 0;
+
+	if ( file && fread( magic, 1, sizeof( magic ), file ) == sizeof( magic ) && snapshot_is( magic, sizeof( magic ) )
+	     && !fseek( file, 0, SEEK_END ) && ( length = ftell( file ) ) > 0 && !fseek( file, 0, SEEK_SET ) )
+	{
+		data = malloc( length );
+		if ( data && fread( data, 1, length, file ) != ( size_t )length )
+		{
+			free( data );
+			data = NULL;
+		}
+		*size = length;
+	}
+	if ( file )
+		fclose( file );
+	return data;
+}
+
 /** Convert parameters parsed from resource into entity declarations.
 */
 static void params_to_entities( deserialise_context context )
@@ -1605,6 +1773,7 @@ static deserialise_context context_new( mlt_profile profile )
 		context->producer_map = mlt_properties_new();
 		context->destructors = mlt_properties_new();
 		context->params = mlt_properties_new();
+		context->shared = mlt_properties_new();
 		context->profile = profile;
 		context->seekable = 1;
 		context->stack_service = mlt_deque_init();
@@ -1621,6 +1790,7 @@ void context_close( deserialise_context context )
 	mlt_properties_close( context->producer_map );
 	mlt_properties_close( context->destructors );
 	mlt_properties_close( context->params );
+	mlt_properties_close( context->shared );
 	mlt_deque_close( context->stack_service );
 	mlt_deque_close( context->stack_types );
 	mlt_deque_close( context->stack_node );
@@ -1632,7 +1802,7 @@ void context_close( deserialise_context context )
 
 mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype, const char *id, char *data )
 {
-	xmlSAXHandler *sax, *sax_orig;
+	xmlSAXHandler *sax, *sax_orig = NULL;
 	deserialise_context context;
 	mlt_properties properties = NULL;
 	int i = 0;
@@ -1640,6 +1810,11 @@ mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype,
 	int well_formed = 0;
 	char *filename = NULL;
 	int is_filename = strcmp( id, "xml-string" );
+	char *snapshot = NULL;
+	size_t snapshot_size = 0;
+	struct timeval start;
+
+	gettimeofday( &start, NULL );
 
 	// Strip file:// prefix
 	if ( data && strlen( data ) >= 7 && strncmp( data, "file://", 7 ) == 0 )
@@ -1697,6 +1872,16 @@ mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype,
 			context_close( context );
 			return NULL;
 		}
+
+		// A snapshot needs no xml parser
+		snapshot = load_snapshot( filename, &snapshot_size );
+	}
+	else if ( snapshot_is( data, strlen( data ) ) )
+	{
+		// The string of a snapshot ends at its first zero byte
+		mlt_log_error( NULL, "[producer_xml] a snapshot can only be loaded from a file\n" );
+		context_close( context );
+		return NULL;
 	}
 
 	// We need to track the number of registered filters
@@ -1715,50 +1900,60 @@ mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype,
 	xmlSubstituteEntitiesDefault( 1 );
 	// This is used to facilitate entity substitution in the SAX parser
 	context->entity_doc = xmlNewDoc( _x("1.0") );
-	if ( is_filename )
-		xmlcontext = xmlCreateFileParserCtxt( filename );
-	else
-		xmlcontext = xmlCreateMemoryParserCtxt( data, strlen( data ) );
-
-	// Invalid context - clean up and return NULL
-	if ( xmlcontext == NULL )
+	if ( snapshot )
 	{
-		context_close( context );
-		free( sax );
-		return NULL;
+		well_formed = !snapshot_parse( snapshot, snapshot_size, on_snapshot_start, NULL, on_snapshot_characters, context );
 	}
+	else
+	{
+		if ( is_filename )
+			xmlcontext = xmlCreateFileParserCtxt( filename );
+		else
+			xmlcontext = xmlCreateMemoryParserCtxt( data, strlen( data ) );
 
-	// Parse
-	sax_orig = xmlcontext->sax;
-	xmlcontext->sax = sax;
-	xmlcontext->_private = ( void* )context;	
-	xmlParseDocument( xmlcontext );
-	well_formed = xmlcontext->wellFormed;
-	
-	// Cleanup after parsing
-	xmlcontext->sax = sax_orig;
-	xmlcontext->_private = NULL;
-	if ( xmlcontext->myDoc )
-		xmlFreeDoc( xmlcontext->myDoc );
-	xmlFreeParserCtxt( xmlcontext );
+		// Invalid context - clean up and return NULL
+		if ( xmlcontext == NULL )
+		{
+			context_close( context );
+			free( sax );
+			return NULL;
+		}
+
+		// Parse
+		sax_orig = xmlcontext->sax;
+		xmlcontext->sax = sax;
+		xmlcontext->_private = ( void* )context;	
+		xmlParseDocument( xmlcontext );
+		well_formed = xmlcontext->wellFormed;
+
+		// Cleanup after parsing
+		xmlcontext->sax = sax_orig;
+		xmlcontext->_private = NULL;
+		if ( xmlcontext->myDoc )
+			xmlFreeDoc( xmlcontext->myDoc );
+		xmlFreeParserCtxt( xmlcontext );
+	}
 
 	// Bad xml - clean up and return NULL
 	if ( !well_formed )
 	{
 		context_close( context );
 		free( sax );
+		free( snapshot );
 		return NULL;
 	}
 
 	// Setup the second pass
 	context->pass ++;
-	if ( is_filename )
+	if ( snapshot )
+		xmlcontext = NULL;
+	else if ( is_filename )
 		xmlcontext = xmlCreateFileParserCtxt( filename );
 	else
 		xmlcontext = xmlCreateMemoryParserCtxt( data, strlen( data ) );
 
 	// Invalid context - clean up and return NULL
-	if ( xmlcontext == NULL )
+	if ( xmlcontext == NULL && !snapshot )
 	{
 		context_close( context );
 		free( sax );
@@ -1782,6 +1977,9 @@ mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype,
 		&& !mlt_properties_get_data( mlt_global_properties(), "glslManager", NULL ) )
 		context->qglsl = mlt_factory_consumer( profile, "qglsl", NULL );
 
+	// Defer opening media and share identical producers, if requested
+	context->lazy = mlt_properties_get_int( context->params, "lazy" ) || getenv( "MLT_XML_LAZY" ) != NULL;
+
 	// Setup SAX callbacks for second pass
 	sax->endElement = on_end_element;
 	sax->cdataBlock = on_characters;
@@ -1790,22 +1988,33 @@ mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype,
 	sax->getEntity = on_get_entity;
 
 	// Parse
-	sax_orig = xmlcontext->sax;
-	xmlcontext->sax = sax;
-	xmlcontext->_private = ( void* )context;
-	xmlParseDocument( xmlcontext );
-	well_formed = xmlcontext->wellFormed;
+	if ( snapshot )
+	{
+		well_formed = !snapshot_parse( snapshot, snapshot_size, on_snapshot_start, on_snapshot_end, on_snapshot_characters, context );
+		free( snapshot );
+	}
+	else
+	{
+		sax_orig = xmlcontext->sax;
+		xmlcontext->sax = sax;
+		xmlcontext->_private = ( void* )context;
+		xmlParseDocument( xmlcontext );
+		well_formed = xmlcontext->wellFormed;
+	}
 
 	// Cleanup after parsing
 	xmlFreeDoc( context->entity_doc );
 	context->entity_doc = NULL;
 	free( sax );
 	xmlMemoryDump( ); // for debugging
-	xmlcontext->sax = sax_orig;
-	xmlcontext->_private = NULL;
-	if ( xmlcontext->myDoc )
-		xmlFreeDoc( xmlcontext->myDoc );
-	xmlFreeParserCtxt( xmlcontext );
+	if ( xmlcontext )
+	{
+		xmlcontext->sax = sax_orig;
+		xmlcontext->_private = NULL;
+		if ( xmlcontext->myDoc )
+			xmlFreeDoc( xmlcontext->myDoc );
+		xmlFreeParserCtxt( xmlcontext );
+	}
 
 	// Get the last producer on the stack
 	enum service_type type;
@@ -1888,6 +2097,23 @@ mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype,
 		mlt_properties_set_int( properties, "seekable", context->seekable );
 
 		retain_services( context, service );
+
+		// Report what loading cost
+		struct timeval end;
+		gettimeofday( &end, NULL );
+		mlt_properties_set_double( properties, "_xml_load_time",
+			( end.tv_sec - start.tv_sec ) * 1000.0 + ( end.tv_usec - start.tv_usec ) / 1000.0 );
+#ifndef WIN32
+		struct rusage usage;
+		if ( !getrusage( RUSAGE_SELF, &usage ) )
+			mlt_properties_set_int64( properties, "_xml_peak_rss", usage.ru_maxrss );
+#endif
+		mlt_properties_set_int( properties, "_xml_lazy", context->lazy_count );
+		mlt_properties_set_int( properties, "_xml_shared", context->shared_count );
+		mlt_log_verbose( service, "loaded in %.1f ms with peak RSS %s, %d producers deferred and %d shared\n",
+			mlt_properties_get_double( properties, "_xml_load_time" ),
+			mlt_properties_get( properties, "_xml_peak_rss" ) ? mlt_properties_get( properties, "_xml_peak_rss" ) : "unknown",
+			context->lazy_count, context->shared_count );
 	}
 	else
 	{
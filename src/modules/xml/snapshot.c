@@ -0,0 +1,748 @@
+/*
+ * snapshot.c -- a compact binary encoding of mlt xml documents
+ * Copyright (C) 2015 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* A snapshot holds the same elements, attributes and properties as the
+ * xml that consumer_xml writes, so that producer_xml can build the service
+ * network from either through the same code. After the magic bytes comes a
+ * sequence of records, each starting with one byte:
+ *
+ *   'E' name (name string)* 0    an element and its attributes
+ *   'P' name value               a property element of the innermost element
+ *   'A' name string              a further attribute of the root element
+ *   'X'                          the end of the innermost element
+ *
+ * Numbers are unsigned LEB128 varints. A string is its length followed by
+ * its bytes. A name is a varint: 1 is followed by a string that is added to
+ * the table of names, and n > 1 refers to entry n - 2 of that table. A value
+ * is one of:
+ *
+ *   'i' zigzag                   an integer
+ *   'd' decimals zigzag          a decimal number, as an integer of its digits
+ *   't' separator digits count   a time as hh:mm:ss followed by the separator
+ *                                and digits of a fraction, as a count of fractions
+ *   'c' form number              a color of 6 or 8 hex digits after # or 0x
+ *   's' string                   any other text
+ *
+ * where zigzag is a zigzag varint of a signed number and separator is a byte.
+ * The writer only uses a type if the value prints back as the same text.
+ */
+
+#include "snapshot.h"
+
+#include <framework/mlt_properties.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#define BUFFER_SIZE (65536)
+
+/** the forms of a color value */
+#define COLOR_HEX_PREFIX (1)
+#define COLOR_ALPHA (2)
+#define COLOR_UPPER (4)
+
+struct snapshot_writer_s
+{
+	FILE *file;
+	char *buffer;
+	size_t size;
+	size_t capacity;
+	mlt_properties names; // one more than the table index of each name written
+	int name_count;
+	int open;             // whether attributes may still be added to the last element
+	int error;
+};
+
+static void flush( snapshot_writer self )
+{
+	if ( self->size )
+	{
+		if ( fwrite( self->buffer, 1, self->size, self->file ) != self->size )
+			self->error = 1;
+		self->size = 0;
+	}
+}
+
+static void put_bytes( snapshot_writer self, const void *data, size_t size )
+{
+	if ( self->size + size > self->capacity )
+		flush( self );
+	if ( size > self->capacity )
+	{
+		// Too big to buffer
+		if ( fwrite( data, 1, size, self->file ) != size )
+			self->error = 1;
+		return;
+	}
+	memcpy( self->buffer + self->size, data, size );
+	self->size += size;
+}
+
+static void put_byte( snapshot_writer self, char byte )
+{
+	put_bytes( self, &byte, 1 );
+}
+
+static void put_varint( snapshot_writer self, uint64_t value )
+{
+	unsigned char bytes[ 10 ];
+	int n = 0;
+
+	do
+	{
+		bytes[ n ] = value & 0x7f;
+		value >>= 7;
+		if ( value )
+			bytes[ n ] |= 0x80;
+		n ++;
+	}
+	while ( value );
+	put_bytes( self, bytes, n );
+}
+
+static void put_string( snapshot_writer self, const char *string )
+{
+	size_t length = string ? strlen( string ) : 0;
+	put_varint( self, length );
+	put_bytes( self, string, length );
+}
+
+static void put_name( snapshot_writer self, const char *name )
+{
+	int index = mlt_properties_get_int( self->names, name );
+
+	if ( index )
+	{
+		put_varint( self, index + 1 );
+	}
+	else
+	{
+		put_varint( self, 1 );
+		put_string( self, name );
+		mlt_properties_set_int( self->names, name, ++ self->name_count );
+	}
+}
+
+static const uint64_t powers_of_ten[] =
+{
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+	100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+	10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL
+};
+
+/** A value of a property that is not stored as a string. */
+
+typedef struct
+{
+	int type;        // 'i', 'd', 't' or 'c'
+	uint64_t number; // the integer, digits, count of fractions or color
+	int detail;      // the number of decimals or digits of a fraction, or the form of a color
+	int separator;   // the separator of the fraction of a time
+}
+typed_value;
+
+static uint64_t zigzag_encode( long long value )
+{
+	return ( ( uint64_t )value << 1 ) ^ ( uint64_t )( value >> 63 );
+}
+
+static long long zigzag_decode( uint64_t value )
+{
+	return ( long long )( value >> 1 ) ^ -( long long )( value & 1 );
+}
+
+/** Print a typed value as the text it stands for.
+ *
+ * \return the length of the text
+ */
+
+static int print_value( const typed_value *value, char *text, size_t size )
+{
+	int length = 0;
+
+	switch ( value->type )
+	{
+	case 'i':
+		length = snprintf( text, size, "%lld", zigzag_decode( value->number ) );
+		break;
+	case 'd':
+	{
+		long long digits = zigzag_decode( value->number );
+		uint64_t magnitude = digits < 0 ? -( uint64_t )digits : ( uint64_t )digits;
+		uint64_t scale = powers_of_ten[ value->detail ];
+		length = snprintf( text, size, "%s%llu.%0*llu", digits < 0 ? "-" : "",
+			( unsigned long long )( magnitude / scale ), value->detail, ( unsigned long long )( magnitude % scale ) );
+		break;
+	}
+	case 't':
+	{
+		uint64_t scale = powers_of_ten[ value->detail ];
+		uint64_t seconds = value->number / scale;
+		length = snprintf( text, size, "%02llu:%02llu:%02llu%c%0*llu", ( unsigned long long )( seconds / 3600 ),
+			( unsigned long long )( seconds / 60 % 60 ), ( unsigned long long )( seconds % 60 ), value->separator,
+			value->detail, ( unsigned long long )( value->number % scale ) );
+		break;
+	}
+	case 'c':
+		length = snprintf( text, size, value->detail & COLOR_UPPER ? "%s%0*llX" : "%s%0*llx",
+			value->detail & COLOR_HEX_PREFIX ? "0x" : "#", value->detail & COLOR_ALPHA ? 8 : 6,
+			( unsigned long long )value->number );
+		break;
+	}
+	return length;
+}
+
+/** Read a run of decimal digits.
+ *
+ * \return the number of digits, or 0 if there are none or more than \p most
+ */
+
+static int parse_digits( const char **text, int most, uint64_t *number )
+{
+	const char *start = *text;
+
+	*number = 0;
+	while ( isdigit( ( unsigned char )**text ) && *text - start < most )
+		*number = *number * 10 + *( *text ) ++ - '0';
+	return isdigit( ( unsigned char )**text ) ? 0 : *text - start;
+}
+
+/** Find a type for a value.
+ *
+ * \return true if the value prints back as the same text from \p typed
+ */
+
+static int type_value( const char *value, typed_value *typed )
+{
+	const char *p = value;
+	int negative = *p == '-';
+	uint64_t whole, part;
+	int digits, decimals;
+	char text[ 64 ];
+
+	memset( typed, 0, sizeof( *typed ) );
+	p += negative;
+	digits = parse_digits( &p, 18, &whole );
+	if ( digits && *p == '\0' )
+	{
+		typed->type = 'i';
+		typed->number = zigzag_encode( negative ? -( long long )whole : ( long long )whole );
+	}
+	else if ( digits && *p == '.' )
+	{
+		p ++;
+		decimals = parse_digits( &p, 18 - digits, &part );
+		if ( !decimals || *p != '\0' )
+			return 0;
+		long long number = ( long long )( whole * powers_of_ten[ decimals ] + part );
+		typed->type = 'd';
+		typed->number = zigzag_encode( negative ? -number : number );
+		typed->detail = decimals;
+	}
+	else if ( !negative && digits && digits <= 6 && *p == ':' )
+	{
+		uint64_t minutes, seconds;
+
+		p ++;
+		if ( parse_digits( &p, 2, &minutes ) != 2 || *p ++ != ':' || parse_digits( &p, 2, &seconds ) != 2 || !*p || !strchr( ".:;", *p ) )
+			return 0;
+		typed->separator = *p ++;
+		decimals = parse_digits( &p, 9, &part );
+		if ( !decimals || *p != '\0' )
+			return 0;
+		typed->type = 't';
+		typed->number = ( ( whole * 60 + minutes ) * 60 + seconds ) * powers_of_ten[ decimals ] + part;
+		typed->detail = decimals;
+	}
+	else if ( value[0] == '#' || ( value[0] == '0' && value[1] == 'x' ) )
+	{
+		const char *hex = value + ( value[0] == '#' ? 1 : 2 );
+		size_t length = strspn( hex, "0123456789abcdefABCDEF" );
+		if ( ( length == 6 || length == 8 ) && hex[ length ] == '\0' )
+		{
+			typed->type = 'c';
+			typed->number = strtoull( hex, NULL, 16 );
+			typed->detail = ( value[0] == '#' ? 0 : COLOR_HEX_PREFIX ) | ( length == 8 ? COLOR_ALPHA : 0 ) |
+				( strpbrk( hex, "ABCDEF" ) ? COLOR_UPPER : 0 );
+		}
+	}
+
+	// Leading zeros, -0, letters of mixed case and times out of range do not print back the same
+	return typed->type && print_value( typed, text, sizeof( text ) ) == ( int )strlen( value ) && !strcmp( text, value );
+}
+
+static void close_attributes( snapshot_writer self )
+{
+	if ( self->open )
+	{
+		put_varint( self, 0 );
+		self->open = 0;
+	}
+}
+
+/** Start writing a snapshot.
+ *
+ * \param file the file to write to
+ * \return a new writer
+ */
+
+snapshot_writer snapshot_writer_init( FILE *file )
+{
+	snapshot_writer self = calloc( 1, sizeof( struct snapshot_writer_s ) );
+	if ( self )
+	{
+		self->file = file;
+		self->buffer = malloc( BUFFER_SIZE );
+		self->capacity = self->buffer ? BUFFER_SIZE : 0;
+		self->names = mlt_properties_new( );
+		if ( !self->names )
+			self->error = 1;
+		else
+			put_bytes( self, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE );
+	}
+	return self;
+}
+
+/** Start an element inside the innermost one. */
+
+void snapshot_start( snapshot_writer self, const char *name )
+{
+	close_attributes( self );
+	put_byte( self, 'E' );
+	put_name( self, name );
+	self->open = 1;
+}
+
+/** Add an attribute to the element just started.
+ *
+ * \return true if the element already has contents
+ */
+
+int snapshot_attribute( snapshot_writer self, const char *name, const char *value )
+{
+	if ( !self->open )
+		return 1;
+	put_name( self, name );
+	put_string( self, value );
+	return 0;
+}
+
+/** Add an attribute to the root element after it has contents. */
+
+void snapshot_root_attribute( snapshot_writer self, const char *name, const char *value )
+{
+	close_attributes( self );
+	put_byte( self, 'A' );
+	put_name( self, name );
+	put_string( self, value );
+}
+
+/** Add a property to the innermost element. */
+
+void snapshot_property( snapshot_writer self, const char *name, const char *value )
+{
+	typed_value typed;
+
+	close_attributes( self );
+	put_byte( self, 'P' );
+	put_name( self, name );
+	if ( type_value( value, &typed ) )
+	{
+		put_byte( self, typed.type );
+		if ( typed.type == 't' )
+			put_byte( self, typed.separator );
+		if ( typed.type != 'i' )
+			put_varint( self, typed.detail );
+		put_varint( self, typed.number );
+	}
+	else
+	{
+		put_byte( self, 's' );
+		put_string( self, value );
+	}
+}
+
+/** End the innermost element. */
+
+void snapshot_end( snapshot_writer self )
+{
+	close_attributes( self );
+	put_byte( self, 'X' );
+}
+
+/** Finish and free a writer.
+ *
+ * \return true if there was an error
+ */
+
+int snapshot_writer_close( snapshot_writer self )
+{
+	int error = 1;
+
+	if ( self )
+	{
+		close_attributes( self );
+		flush( self );
+		error = self->error;
+		free( self->buffer );
+		mlt_properties_close( self->names );
+		free( self );
+	}
+	return error;
+}
+
+typedef struct
+{
+	const unsigned char *data;
+	const unsigned char *end;
+	char **names;
+	int name_count;
+	int name_capacity;
+	char *scratch;
+	size_t scratch_size;
+	int error;
+}
+snapshot_reader;
+
+static int get_byte( snapshot_reader *self )
+{
+	if ( self->data >= self->end )
+	{
+		self->error = 1;
+		return 0;
+	}
+	return *self->data ++;
+}
+
+static uint64_t get_varint( snapshot_reader *self )
+{
+	uint64_t value = 0;
+	int shift = 0;
+	int byte;
+
+	do
+	{
+		byte = get_byte( self );
+		value |= ( uint64_t )( byte & 0x7f ) << shift;
+		shift += 7;
+	}
+	while ( ( byte & 0x80 ) && shift < 64 && !self->error );
+	if ( byte & 0x80 )
+		self->error = 1;
+	return value;
+}
+
+static const char *get_string( snapshot_reader *self, size_t *length )
+{
+	const char *string;
+
+	*length = get_varint( self );
+	if ( self->error || *length > ( size_t )( self->end - self->data ) )
+	{
+		self->error = 1;
+		*length = 0;
+		return "";
+	}
+	string = ( const char* )self->data;
+	self->data += *length;
+	return string;
+}
+
+/** Get a name, or NULL at the end of a list of attributes. */
+
+static const char *get_name( snapshot_reader *self )
+{
+	uint64_t index = get_varint( self );
+
+	if ( self->error || index == 0 )
+		return NULL;
+	if ( index == 1 )
+	{
+		size_t length;
+		const char *name = get_string( self, &length );
+		if ( self->name_count == self->name_capacity )
+		{
+			int capacity = self->name_capacity ? self->name_capacity * 2 : 64;
+			char **names = realloc( self->names, capacity * sizeof( char* ) );
+			if ( !names )
+			{
+				self->error = 1;
+				return NULL;
+			}
+			self->names = names;
+			self->name_capacity = capacity;
+		}
+		self->names[ self->name_count ] = malloc( length + 1 );
+		memcpy( self->names[ self->name_count ], name, length );
+		self->names[ self->name_count ][ length ] = '\0';
+		return self->names[ self->name_count ++ ];
+	}
+	if ( index - 2 >= ( uint64_t )self->name_count )
+	{
+		self->error = 1;
+		return NULL;
+	}
+	return self->names[ index - 2 ];
+}
+
+/** Copy a string to the scratch area, which terminates it. */
+
+static void scratch_add( snapshot_reader *self, size_t offset, const char *string, size_t length )
+{
+	if ( offset + length + 1 > self->scratch_size )
+	{
+		size_t size = ( offset + length + 1 ) * 2;
+		char *scratch = realloc( self->scratch, size );
+		if ( !scratch )
+		{
+			self->error = 1;
+			return;
+		}
+		self->scratch = scratch;
+		self->scratch_size = size;
+	}
+	memcpy( self->scratch + offset, string, length );
+	self->scratch[ offset + length ] = '\0';
+}
+
+static void reader_reset( snapshot_reader *self, const char *data, size_t size )
+{
+	int i;
+	for ( i = 0; i < self->name_count; i ++ )
+		free( self->names[ i ] );
+	self->name_count = 0;
+	self->data = ( const unsigned char* )data + SNAPSHOT_MAGIC_SIZE;
+	self->end = ( const unsigned char* )data + size;
+	self->error = 0;
+}
+
+/** Walk the records of a snapshot.
+ *
+ * When \p late is not NULL, this only collects the late attributes of the
+ * root into it, otherwise it calls back for every element, adding \p late
+ * to the attributes of the root.
+ */
+
+static void walk( snapshot_reader *self, snapshot_start_callback start, snapshot_end_callback end,
+	snapshot_text_callback text, void *user, mlt_properties late, mlt_properties root )
+{
+	const char **stack = NULL;
+	int depth = 0;
+	int capacity = 0;
+	const char **atts = NULL;
+	int atts_capacity = 0;
+
+	while ( !self->error && self->data < self->end )
+	{
+		int type = get_byte( self );
+		const char *name = type == 'X' ? NULL : get_name( self );
+		size_t length = 0;
+
+		if ( type != 'X' && !name )
+		{
+			self->error = 1;
+			break;
+		}
+
+		if ( type == 'E' )
+		{
+			int extra = depth == 0 && root ? mlt_properties_count( root ) : 0;
+			int count = 0;
+			size_t used = 0;
+			const char *attribute;
+
+			// Copy the attributes to the scratch area, each name followed by its value
+			while ( ( attribute = get_name( self ) ) )
+			{
+				const char *value = get_string( self, &length );
+				size_t size = strlen( attribute );
+				scratch_add( self, used, attribute, size );
+				used += size + 1;
+				scratch_add( self, used, value, length );
+				used += length + 1;
+				count ++;
+			}
+			if ( !self->error && !late && ( count + extra ) * 2 + 1 > atts_capacity )
+			{
+				const char **more = realloc( atts, ( ( count + extra ) * 2 + 1 ) * sizeof( char* ) );
+				if ( more )
+				{
+					atts = more;
+					atts_capacity = ( count + extra ) * 2 + 1;
+				}
+				else
+				{
+					self->error = 1;
+				}
+			}
+			if ( !self->error && !late )
+			{
+				char *p = self->scratch;
+				int n = 0;
+				int i;
+				for ( i = 0; i < count * 2; i ++, p += strlen( p ) + 1 )
+					atts[ n ++ ] = p;
+				for ( i = 0; i < extra; i ++ )
+				{
+					mlt_properties pair = mlt_properties_get_data_at( root, i, NULL );
+					atts[ n ++ ] = mlt_properties_get( pair, "name" );
+					atts[ n ++ ] = mlt_properties_get( pair, "value" );
+				}
+				atts[ n ] = NULL;
+				if ( start )
+					start( user, name, atts );
+			}
+
+			if ( depth == capacity )
+			{
+				const char **more = realloc( stack, ( capacity + 16 ) * sizeof( char* ) );
+				if ( !more )
+				{
+					self->error = 1;
+					break;
+				}
+				stack = more;
+				capacity += 16;
+			}
+			stack[ depth ++ ] = name;
+		}
+		else if ( type == 'P' && depth > 0 )
+		{
+			typed_value typed = { get_byte( self ), 0, 0, 0 };
+			const char *value = NULL;
+			char printed[ 64 ];
+
+			if ( typed.type == 's' )
+			{
+				value = get_string( self, &length );
+			}
+			else if ( typed.type && strchr( "idtc", typed.type ) )
+			{
+				if ( typed.type == 't' )
+					typed.separator = get_byte( self );
+				if ( typed.type != 'i' )
+					typed.detail = get_varint( self );
+				typed.number = get_varint( self );
+
+				// Check the details that index tables or pick formats
+				if ( ( typed.type == 'd' && ( typed.detail < 1 || typed.detail > 18 ) ) ||
+				     ( typed.type == 't' && ( typed.detail < 1 || typed.detail > 9 || !strchr( ".:;", typed.separator ) || !typed.separator ) ) ||
+				     ( typed.type == 'c' && ( typed.detail & ~( COLOR_HEX_PREFIX | COLOR_ALPHA | COLOR_UPPER ) ) ) )
+					self->error = 1;
+				if ( !self->error )
+				{
+					length = print_value( &typed, printed, sizeof( printed ) );
+					if ( length >= sizeof( printed ) )
+						self->error = 1;
+					value = printed;
+				}
+			}
+			else
+			{
+				self->error = 1;
+			}
+			if ( !self->error && !late )
+			{
+				const char *property[] = { "name", name, NULL };
+				if ( start )
+					start( user, "property", property );
+				if ( length && text )
+					text( user, value, length );
+				if ( end )
+					end( user, "property" );
+			}
+		}
+		else if ( type == 'A' && depth > 0 )
+		{
+			const char *value = get_string( self, &length );
+			if ( !self->error && late )
+			{
+				// Keep each pair in order, even if a name repeats
+				char key[ 20 ];
+				mlt_properties pair = mlt_properties_new( );
+				mlt_properties_set( pair, "name", name );
+				scratch_add( self, 0, value, length );
+				mlt_properties_set( pair, "value", self->scratch );
+				snprintf( key, sizeof( key ), "%d", mlt_properties_count( late ) );
+				mlt_properties_set_data( late, key, pair, 0, ( mlt_destructor )mlt_properties_close, NULL );
+			}
+		}
+		else if ( type == 'X' && depth > 0 )
+		{
+			depth --;
+			if ( !late && end )
+				end( user, stack[ depth ] );
+		}
+		else
+		{
+			self->error = 1;
+		}
+	}
+	if ( depth )
+		self->error = 1;
+	free( stack );
+	free( atts );
+}
+
+/** Check whether data starts like a snapshot. */
+
+int snapshot_is( const char *data, size_t size )
+{
+	return data && size >= SNAPSHOT_MAGIC_SIZE && !memcmp( data, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE );
+}
+
+/** Call back for each element of a snapshot as an xml parser would.
+ *
+ * A property arrives as a property element with a name attribute and its
+ * value as text. Any of the callbacks may be NULL.
+ * \return true if the snapshot is malformed
+ */
+
+int snapshot_parse( const char *data, size_t size, snapshot_start_callback start,
+	snapshot_end_callback end, snapshot_text_callback text, void *user )
+{
+	snapshot_reader reader;
+	mlt_properties late = mlt_properties_new( );
+	int error;
+
+	if ( !snapshot_is( data, size ) )
+	{
+		mlt_properties_close( late );
+		return 1;
+	}
+	memset( &reader, 0, sizeof( reader ) );
+
+	// The root may have attributes that were only known after its contents
+	reader_reset( &reader, data, size );
+	walk( &reader, start, end, text, user, late, NULL );
+	if ( !reader.error )
+	{
+		reader_reset( &reader, data, size );
+		walk( &reader, start, end, text, user, NULL, late );
+	}
+	error = reader.error;
+
+	reader_reset( &reader, data, size );
+	free( reader.names );
+	free( reader.scratch );
+	mlt_properties_close( late );
+	return error;
+}
@@ -0,0 +1,48 @@
+/*
+ * snapshot.h -- a compact binary encoding of mlt xml documents
+ * Copyright (C) 2015 Meltytech, LLC
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/** the first bytes of a snapshot */
+#define SNAPSHOT_MAGIC "MLTSNAP\001"
+#define SNAPSHOT_MAGIC_SIZE (8)
+
+typedef struct snapshot_writer_s *snapshot_writer;
+
+typedef void ( *snapshot_start_callback )( void *user, const char *name, const char **atts );
+typedef void ( *snapshot_end_callback )( void *user, const char *name );
+typedef void ( *snapshot_text_callback )( void *user, const char *text, int length );
+
+extern snapshot_writer snapshot_writer_init( FILE *file );
+extern void snapshot_start( snapshot_writer self, const char *name );
+extern int snapshot_attribute( snapshot_writer self, const char *name, const char *value );
+extern void snapshot_root_attribute( snapshot_writer self, const char *name, const char *value );
+extern void snapshot_property( snapshot_writer self, const char *name, const char *value );
+extern void snapshot_end( snapshot_writer self );
+extern int snapshot_writer_close( snapshot_writer self );
+
+extern int snapshot_is( const char *data, size_t size );
+extern int snapshot_parse( const char *data, size_t size, snapshot_start_callback start,
+	snapshot_end_callback end, snapshot_text_callback text, void *user );
+
+#endif
@@ -70,6 +70,49 @@ private Q_SLOTS:
         delete frame;
     }
 
+    void PeaksMeasureEveryChannel_data()
+    {
+        QTest::addColumn<int>("channels");
+        QTest::newRow("mono") << 1;
+        QTest::newRow("5.1") << 6;
+    }
+
+    void PeaksMeasureEveryChannel()
+    {
+        QFETCH(int, channels);
+        // A high frame rate keeps the audio short while positions pass 2^31 / 48000
+        Profile profile("dv_pal");
+        profile.set_frame_rate(1000, 1);
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QString fileName = dir.path() + "/tone.mlt";
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(QString("<mlt><producer in=\"0\" out=\"45999\">"
+            "<property name=\"length\">46000</property>"
+            "<property name=\"mlt_service\">tone</property>"
+            "<filter><property name=\"mlt_service\">mono</property>"
+            "<property name=\"channels\">%1</property></filter>"
+            "</producer></mlt>").arg(channels).toUtf8());
+        file.close();
+
+        mlt_peaks peaks = mlt_peaks_open(profile.get_profile(), fileName.toUtf8().constData());
+        QVERIFY(peaks != NULL);
+        QElapsedTimer timer;
+        timer.start();
+        while (!mlt_peaks_is_complete(peaks) && timer.elapsed() < 60000)
+            QTest::qSleep(10);
+        QVERIFY(mlt_peaks_is_complete(peaks));
+        QCOMPARE(mlt_peaks_channels(peaks), channels);
+        QCOMPARE(mlt_peaks_length(peaks), 46000);
+
+        float max[10];
+        QCOMPARE(mlt_peaks_get(peaks, channels - 1, 45000, 45999, 10, NULL, max, NULL), 10);
+        QVERIFY(max[9] > 0.5f);
+        QCOMPARE(mlt_peaks_get(peaks, channels, 45000, 45999, 10, NULL, max, NULL), 0);
+        mlt_peaks_close(peaks);
+    }
+
 };
 
 QTEST_APPLESS_MAIN(TestFilter)
@@ -17,9 +17,27 @@
  */
 
 #include <QtTest>
+#include <climits>
 #include <mlt++/Mlt.h>
 using namespace Mlt;
 
+// Make the image transparent as a keyer does, without asking for a writable image.
+static int key_out_image(mlt_frame frame, uint8_t **image, mlt_image_format *format, int *width, int *height, int)
+{
+    *format = mlt_image_rgb24a;
+    int error = mlt_frame_get_image(frame, image, format, width, height, 0);
+    if (!error) {
+        int size = mlt_image_format_size(*format, *width, *height, NULL);
+        uint8_t *keyed = (uint8_t*) mlt_pool_alloc(size);
+        memcpy(keyed, *image, size);
+        for (int i = 3; i < size; i += 4)
+            keyed[i] = 0;
+        mlt_frame_set_image(frame, keyed, size, mlt_pool_release);
+        *image = keyed;
+    }
+    return error;
+}
+
 class TestFrame: public QObject
 {
     Q_OBJECT
@@ -93,6 +111,72 @@ private Q_SLOTS:
         QCOMPARE(f1.ref_count(), 2);
         mlt_frame_close(frame);
     }
+
+    void AudioRingSurvivesCounterWrap()
+    {
+        mlt_audio_ring ring = mlt_audio_ring_init(mlt_audio_u8, 48000, 1, 100);
+        QVERIFY(ring != NULL);
+        const int chunk = 4000;
+        // Start the counts just below the wrap rather than pass 2^32 samples
+        mlt_audio_ring_set_count(ring, UINT_MAX - 3 * chunk);
+        // A prime period shows any shift of the samples
+        QByteArray pattern(chunk + 251, 0);
+        for (int i = 0; i < pattern.size(); i++)
+            pattern[i] = i % 251;
+        QByteArray out(chunk, 0);
+        qint64 written = 0;
+        qint64 read = 0;
+        while (read < 8 * chunk) {
+            written += mlt_audio_ring_write(ring, pattern.constData() + written % 251, chunk, 0);
+            int count = mlt_audio_ring_read(ring, out.data(), chunk / 2);
+            QCOMPARE(count, chunk / 2);
+            if (memcmp(out.constData(), pattern.constData() + read % 251, count))
+                QFAIL(qPrintable(QString("audio is out of place after %1 samples").arg(read)));
+            read += count;
+        }
+        QCOMPARE(qint64(mlt_audio_ring_fill(ring)), written - read);
+        QCOMPARE(mlt_audio_ring_underruns(ring), 0);
+        mlt_audio_ring_close(ring);
+    }
+
+    void AudioRingCountsUnderrunAtWrap()
+    {
+        mlt_audio_ring ring = mlt_audio_ring_init(mlt_audio_u8, 48000, 1, 100);
+        QVERIFY(ring != NULL);
+        QByteArray out(200, 0);
+        // Reads before the first write are not underruns
+        mlt_audio_ring_set_count(ring, UINT_MAX - 99);
+        QCOMPARE(mlt_audio_ring_read(ring, out.data(), 200), 0);
+        QCOMPARE(mlt_audio_ring_underruns(ring), 0);
+        // The count of samples written is 0 again after this write
+        QCOMPARE(mlt_audio_ring_write(ring, NULL, 100, 0), 100);
+        QCOMPARE(mlt_audio_ring_read(ring, out.data(), 200), 100);
+        QCOMPARE(mlt_audio_ring_underruns(ring), 1);
+        mlt_audio_ring_close(ring);
+    }
+
+    void ReplacedImageIsNotOpaque()
+    {
+        Factory::init();
+        Profile profile;
+        Producer producer(profile, "colour", "red");
+        mlt_image_format format = mlt_image_rgb24a;
+        int width = 0;
+        int height = 0;
+        uint8_t *image = NULL;
+
+        Frame *frame = producer.get_frame();
+        QVERIFY(frame->get_image(format, width, height));
+        QVERIFY(mlt_frame_is_opaque(frame->get_frame()));
+        delete frame;
+
+        frame = producer.get_frame();
+        mlt_frame_push_get_image(frame->get_frame(), key_out_image);
+        QCOMPARE(mlt_frame_get_image(frame->get_frame(), &image, &format, &width, &height, 0), 0);
+        QCOMPARE(int(image[3]), 0);
+        QVERIFY(!mlt_frame_is_opaque(frame->get_frame()));
+        delete frame;
+    }
 };
 
 QTEST_APPLESS_MAIN(TestFrame)
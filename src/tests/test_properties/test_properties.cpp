@@ -671,6 +671,24 @@ private Q_SLOTS:
         QCOMPARE(p.get_double("foo"), 456.0);
     }
 
+    void StringConversionFollowsSet()
+    {
+        mlt_property p = mlt_property_init();
+        mlt_property_set_string(p, "00:00:02.000");
+        QCOMPARE(mlt_property_get_int(p, 25, locale), 50);
+        QCOMPARE(mlt_property_get_int(p, 30, locale), 60);
+        QCOMPARE(mlt_property_get_int(p, 25, locale), 50);
+        QCOMPARE(mlt_property_get_double(p, 25, locale), 50.0);
+        mlt_property_set_string(p, "12.5");
+        QCOMPARE(mlt_property_get_int(p, 25, locale), 12);
+        QCOMPARE(mlt_property_get_double(p, 25, locale), 12.5);
+        QCOMPARE(mlt_property_get_int64(p), (int64_t) 12);
+        mlt_property_set_string(p, "0x10");
+        QCOMPARE(mlt_property_get_int(p, 25, locale), 16);
+        QCOMPARE(mlt_property_get_int64(p), (int64_t) 16);
+        mlt_property_close(p);
+    }
+
     void PropertiesAnimInt()
     {
         Properties p;
@@ -941,6 +959,54 @@ private Q_SLOTS:
         p.set("key", "0=100; -1:=200");
         QCOMPARE(p.anim_get_int("key", 75, 125), 175);
     }
+
+    void ManyPropertiesAreFound()
+    {
+        Properties p;
+        for (int i = 0; i < 1000; i++)
+            p.set(QString("key%1").arg(i).toLatin1().constData(), i);
+        QCOMPARE(p.count(), 1000);
+        // Renaming to a name in use fails
+        QVERIFY(p.rename("key500", "key501"));
+        QVERIFY(!p.rename("key500", "renamed"));
+        QCOMPARE(p.get_int("renamed"), 500);
+        QVERIFY(p.get("key500") == 0);
+        for (int i = 0; i < 1000; i++)
+            if (i != 500)
+                QCOMPARE(p.get_int(QString("key%1").arg(i).toLatin1().constData()), i);
+        QVERIFY(p.get("key1000") == 0);
+    }
+
+    static void onPropertyChanged(mlt_properties, int *count)
+    {
+        ++(*count);
+    }
+
+    void ChangesAreCoalesced()
+    {
+        Properties p;
+        mlt_properties properties = p.get_properties();
+        int count = 0;
+        mlt_events_init(properties);
+        mlt_events_register(properties, "property-changed", NULL);
+        QCOMPARE(mlt_events_listening(properties, "property-changed"), 0);
+        mlt_events_listen(properties, &count, "property-changed", (mlt_listener) onPropertyChanged);
+        QCOMPARE(mlt_events_listening(properties, "property-changed"), 1);
+        p.set("a", 1);
+        QCOMPARE(count, 1);
+        count = 0;
+        mlt_properties_begin_changes(properties);
+        p.set("a", 2);
+        p.set("b", 2);
+        p.set("a", 3);
+        QCOMPARE(count, 0);
+        mlt_properties_end_changes(properties);
+        QCOMPARE(count, 2);
+        mlt_events_disconnect(properties, &count);
+        QCOMPARE(mlt_events_listening(properties, "property-changed"), 0);
+        p.set("a", 4);
+        QCOMPARE(count, 2);
+    }
 };
 
 QTEST_APPLESS_MAIN(TestProperties)
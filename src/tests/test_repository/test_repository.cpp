@@ -29,7 +29,17 @@ class TestRepository : public QObject
 public:
     TestRepository() {}
     
+private:
+    QTemporaryDir cache;
+
 private Q_SLOTS:
+    void initTestCase()
+    {
+        // Keep the service index of these tests out of the user's cache.
+        QVERIFY(cache.isValid());
+        qputenv("MLT_REPOSITORY_INDEX", cache.filePath("services.index").toLocal8Bit());
+    }
+
     void ThereAreProducers()
     {
         Repository* r = Factory::init();
@@ -49,6 +59,27 @@ private Q_SLOTS:
             QVERIFY(consumers->count() > 0);
         delete consumers;
     }
+
+    void ServicesOpenOnDemand()
+    {
+        // The second init registers the services from the index of the first.
+        Factory::close();
+        Factory::init();
+        QVERIFY(QFile::exists(cache.filePath("services.index")));
+        Profile profile;
+        Producer producer(profile, "colour", "red");
+        QVERIFY(producer.is_valid());
+        Filter filter(profile, "brightness");
+        QVERIFY(filter.is_valid());
+    }
+
+    void StartupTime()
+    {
+        QBENCHMARK {
+            Factory::close();
+            Factory::init();
+        }
+    }
 };
 
 QTEST_APPLESS_MAIN(TestRepository)
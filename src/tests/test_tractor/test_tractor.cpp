@@ -34,6 +34,42 @@ public:
         Factory::init();
     }
 
+private:
+    // Two tracks of clips with integer, decimal, time and color properties.
+    void makeProject(Tractor& t)
+    {
+        for (int i = 0; i < 2; i++) {
+            Playlist playlist(profile);
+            for (int j = 0; j < 50; j++) {
+                Producer clip(profile, "colour", j % 2 ? "red" : "blue");
+                clip.set("test.decimal", j % 2 ? "0.5" : "-0.0625");
+                clip.set("test.time", j % 2 ? "00:00:01.040" : "00:01:00:12");
+                clip.set("test.color", j % 2 ? "#ff000080" : "0xFFFFFFFF");
+                clip.set("test.text", j % 2 ? "007" : "1e-05");
+                playlist.append(clip, j, j + 24);
+            }
+            t.set_track(playlist, i);
+        }
+        Transition transition(profile, "mix");
+        t.plant_transition(transition, 0, 1);
+    }
+
+    void save(Service& service, const QString& fileName, const char* format)
+    {
+        Consumer c(profile, "xml", fileName.toUtf8().constData());
+        c.set("format", format);
+        c.connect(service);
+        c.start();
+    }
+
+    QString serialise(Service& service)
+    {
+        Consumer c(profile, "xml", "string");
+        c.connect(service);
+        c.start();
+        return QString::fromUtf8(c.get("string"));
+    }
+
 private Q_SLOTS:
 
     void CreateSingleTrack()
@@ -402,6 +438,96 @@ private Q_SLOTS:
         QCOMPARE(t.count(), 1);
         QCOMPARE(filter.get_track(), 0);
     }
+
+    void SnapshotLoadsLikeXml()
+    {
+        Tractor t(profile);
+        makeProject(t);
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QString xmlName = dir.path() + "/project.mlt";
+        QString snapshotName = dir.path() + "/project.snapshot";
+        save(t, xmlName, "xml");
+        save(t, snapshotName, "snapshot");
+
+        // Load the whole projects instead of references to their files.
+        qputenv("MLT_XML_DEEP", "1");
+        Producer fromXml(profile, "xml", xmlName.toUtf8().constData());
+        Producer fromSnapshot(profile, "xml", snapshotName.toUtf8().constData());
+        qunsetenv("MLT_XML_DEEP");
+        QVERIFY(fromXml.is_valid());
+        QVERIFY(fromSnapshot.is_valid());
+        QString xml = serialise(fromXml);
+        QVERIFY(xml.contains("<property name=\"test.time\">00:01:00:12</property>"));
+        QCOMPARE(serialise(fromSnapshot), xml);
+    }
+
+    void SnapshotIsNotWrittenToAProperty()
+    {
+        Producer producer(profile, "colour", "red");
+        Consumer c(profile, "xml", "string");
+        c.set("format", "snapshot");
+        c.connect(producer);
+        c.start();
+        QVERIFY(!c.get("string"));
+    }
+
+    void StreamedXmlMatchesDocument_data()
+    {
+        QTest::addColumn<bool>("toFile");
+        QTest::newRow("file") << true;
+        QTest::newRow("string") << false;
+    }
+
+    void StreamedXmlMatchesDocument()
+    {
+        QFETCH(bool, toFile);
+        Tractor t(profile);
+        makeProject(t);
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QByteArray output[2];
+
+        // no_stream makes the whole document and dumps it with libxml2.
+        for (int no_stream = 0; no_stream < 2; no_stream++) {
+            QString fileName = dir.path() + QString("/project%1.mlt").arg(no_stream);
+            Consumer c(profile, "xml", toFile ? fileName.toUtf8().constData() : "string");
+            c.set("no_stream", no_stream);
+            c.connect(t);
+            c.start();
+            if (toFile) {
+                QFile file(fileName);
+                QVERIFY(file.open(QIODevice::ReadOnly));
+                output[no_stream] = file.readAll();
+            } else {
+                output[no_stream] = c.get("string");
+            }
+        }
+        QVERIFY(output[0].contains("<playlist"));
+        QCOMPARE(output[0], output[1]);
+    }
+
+    void SnapshotLoadSpeed_data()
+    {
+        QTest::addColumn<QString>("format");
+        QTest::newRow("xml") << "xml";
+        QTest::newRow("snapshot") << "snapshot";
+    }
+
+    void SnapshotLoadSpeed()
+    {
+        QFETCH(QString, format);
+        Tractor t(profile);
+        makeProject(t);
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        file.close();
+
+        QBENCHMARK {
+            save(t, file.fileName(), format.toUtf8().constData());
+            Producer loaded(profile, "xml", file.fileName().toUtf8().constData());
+        }
+    }
 };
 
 QTEST_APPLESS_MAIN(TestTractor)